@@ -201,18 +201,27 @@ defmodule ExMaude.Bench.Backends do
   defp run_batch_benchmarks(backends) do
     IO.puts("")
     IO.puts("--- Batch Reduce Benchmarks ---")
-    IO.puts("100 sequential reduce operations")
+    IO.puts("100 reduce operations, sequential and as one batch")
     IO.puts("")
 
+    commands = for i <- 1..100, do: "reduce in NAT : #{i} + #{i} ."
+
     scenarios =
-      for backend <- backends, into: %{} do
-        {"#{backend}: 100 reduces", fn ->
-          with_backend(backend, fn server ->
-            for i <- 1..100 do
-              Backend.impl().execute(server, "reduce in NAT : #{i} + #{i} .")
-            end
+      for backend <- backends, reduce: %{} do
+        acc ->
+          acc
+          |> Map.put("#{backend}: 100 reduces", fn ->
+            with_backend(backend, fn server ->
+              for command <- commands do
+                Backend.impl().execute(server, command)
+              end
+            end)
+          end)
+          |> Map.put("#{backend}: 100 reduces (batch)", fn ->
+            with_backend(backend, fn server ->
+              ExMaude.Server.execute_batch(server, commands)
+            end)
           end)
-        end}
       end
 
     run_benchee(scenarios)
@@ -0,0 +1,366 @@
+/*
+ * maude_bridge Benchmark Harness
+ *
+ * Drives the bridge's own send_command / instance_read / reply encoding
+ * against fake_maude, which answers every command with scripted output of
+ * a requested size at a configurable rate. Without the BEAM, distribution
+ * and Maude in the loop, the numbers show what the bridge costs per
+ * response: buffer growth, prompt scanning, pipelining across instances
+ * and encoding (plain binaries or execute_parsed tokenizing). Sending the
+ * encoded reply over the distribution socket is not part of it.
+ *
+ * This file includes maude_bridge.c, so it measures exactly the code the
+ * bridge runs, static functions included.
+ *
+ * Usage:
+ *   ./bridge_bench [options]
+ *
+ * Options:
+ *   -maude PATH      Fake Maude to run (default: ./fake_maude)
+ *   -sizes LIST      Comma-separated response sizes, with K/M suffixes
+ *                    (default: 1K,64K,1M,16M,50M)
+ *   -iterations N    Measured requests per size (default: enough for about
+ *                    256 MiB, between 20 and 2000)
+ *   -warmup N        Unmeasured requests per size (default: 3)
+ *   -instances N     Children kept busy at once (default: 1)
+ *   -mode MODE       execute, parsed or search (default: execute)
+ *   -rate BYTES      Output rate of each child per second, with K/M
+ *                    suffixes (default: unlimited)
+ *   -chunk BYTES     Bytes per write of the fake Maude (default: 4096)
+ *   -max-output N    As for maude_bridge (default: 64 MiB)
+ *
+ * For every size one line reports the response throughput, requests per
+ * second and the p50 / p99 / p999 / max latency from writing a command to
+ * having its reply encoded.
+ */
+
+#define MAUDE_BRIDGE_NO_MAIN
+#include "maude_bridge.c"
+
+#include <poll.h>
+#include <math.h>
+
+#define DEFAULT_SIZES "1K,64K,1M,16M,50M"
+#define AUTO_VOLUME (256LL * 1024 * 1024)
+#define AUTO_MIN_ITERATIONS 20
+#define AUTO_MAX_ITERATIONS 2000
+#define MAX_SIZES 32
+
+typedef enum {
+    BENCH_EXECUTE,
+    BENCH_PARSED,
+    BENCH_SEARCH
+} BenchMode;
+
+static const char *mode_names[] = {"execute", "parsed", "search"};
+
+static BenchMode mode = BENCH_EXECUTE;
+static int warmup = 3;
+
+/* Size with an optional K or M suffix, or -1 */
+static long long parse_size(const char *text) {
+    char *end;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || value < 0) return -1;
+
+    if (*end == 'K' || *end == 'k') {
+        value *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        value *= 1024 * 1024;
+        end++;
+    }
+    return (*end == '\0' || *end == ',') ? value : -1;
+}
+
+static int parse_sizes(const char *list, long long *sizes) {
+    int count = 0;
+    const char *pos = list;
+
+    while (*pos && count < MAX_SIZES) {
+        long long size = parse_size(pos);
+        if (size <= 0) return -1;
+        sizes[count++] = size;
+
+        const char *comma = strchr(pos, ',');
+        if (!comma) break;
+        pos = comma + 1;
+    }
+    return count;
+}
+
+static void format_size(long long size, char *out, size_t cap) {
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+        snprintf(out, cap, "%lldM", size / (1024 * 1024));
+    } else if (size >= 1024 && size % 1024 == 0) {
+        snprintf(out, cap, "%lldK", size / 1024);
+    } else {
+        snprintf(out, cap, "%lld", size);
+    }
+}
+
+static int compare_us(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static long long percentile(const long long *sorted, int count, double q) {
+    int rank = (int)ceil(q * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+/* Wait until every child printed its first prompt */
+static int await_ready(void) {
+    for (int i = 0; i < num_instances; i++) {
+        MaudeProcess *inst = &instances[i];
+
+        for (;;) {
+            struct pollfd pfd = {inst->stdout_fd, POLLIN, 0};
+            int r = poll(&pfd, 1, READY_TIMEOUT_MS);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                fprintf(stderr, "Child %d did not print a prompt\n", i);
+                return -1;
+            }
+
+            int status = instance_read(inst);
+            if (status < 0) return -1;
+            if (status == 1) break;
+        }
+
+        inst->starting = 0;
+        reset_buffer(inst);
+    }
+    return 0;
+}
+
+/* Encode a reply the way finish_reply does, without sending it */
+static void encode_reply(const char *output, int out_len) {
+    ei_x_buff *response = begin_response((size_t)out_len);
+    ei_x_encode_tuple_header(response, 2);
+    ei_x_encode_atom(response, "ok");
+
+    if (mode == BENCH_EXECUTE) {
+        ei_x_encode_binary(response, output, out_len);
+    } else {
+        encode_parsed(response, output, out_len);
+    }
+}
+
+/* Run requests through every instance, keeping all of them busy.
+ * Stores each latency in samples when given; returns the response bytes
+ * taken, or -1 on failure. */
+static long long run_requests(const char *cmd, size_t cmd_len, int requests, long long *samples) {
+    long long sent_us[MAX_INSTANCES];
+    int busy[MAX_INSTANCES] = {0};
+    struct pollfd fds[MAX_INSTANCES];
+    int issued = 0, done = 0;
+    long long bytes = 0;
+
+    while (done < requests) {
+        for (int i = 0; i < num_instances && issued < requests; i++) {
+            if (busy[i]) continue;
+
+            sent_us[i] = now_us();
+            if (send_command(&instances[i], cmd, cmd_len) < 0) return -1;
+            busy[i] = 1;
+            issued++;
+        }
+
+        int count = 0;
+        int index[MAX_INSTANCES];
+        for (int i = 0; i < num_instances; i++) {
+            if (!busy[i]) continue;
+            fds[count].fd = instances[i].stdout_fd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            index[count++] = i;
+        }
+
+        int ready = poll(fds, count, REQUEST_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) {
+            fprintf(stderr, "No response within %d ms\n", REQUEST_TIMEOUT_MS);
+            return -1;
+        }
+
+        for (int k = 0; k < count; k++) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            MaudeProcess *inst = &instances[index[k]];
+            int status = instance_read(inst);
+            if (status < 0) {
+                fprintf(stderr, "Child %d failed reading (%d)\n", inst->id, status);
+                return -1;
+            }
+            if (status == 0) continue;
+
+            if (inst->overflowed) {
+                fprintf(stderr, "Response exceeds -max-output %zu\n", max_output);
+                return -1;
+            }
+
+            int out_len;
+            char *output = take_output(inst, &out_len);
+            encode_reply(output, out_len);
+
+            if (samples) samples[done] = now_us() - sent_us[index[k]];
+            bytes += out_len;
+            done++;
+            busy[index[k]] = 0;
+            reset_buffer(inst);
+        }
+    }
+    return bytes;
+}
+
+static int bench_size(long long size, int iterations) {
+    char cmd[128];
+    const char *verb = mode == BENCH_SEARCH ? "search" : "reduce";
+    int cmd_len = snprintf(cmd, sizeof(cmd), "%s in BENCH : %lld .", verb, size);
+
+    if (iterations <= 0) {
+        long long auto_iterations = AUTO_VOLUME / size;
+        if (auto_iterations < AUTO_MIN_ITERATIONS) auto_iterations = AUTO_MIN_ITERATIONS;
+        if (auto_iterations > AUTO_MAX_ITERATIONS) auto_iterations = AUTO_MAX_ITERATIONS;
+        iterations = (int)auto_iterations;
+    }
+
+    long long *samples = malloc(sizeof(long long) * (size_t)iterations);
+    if (!samples) return -1;
+
+    if (warmup > 0 && run_requests(cmd, (size_t)cmd_len, warmup, NULL) < 0) {
+        free(samples);
+        return -1;
+    }
+
+    long long started = now_us();
+    long long bytes = run_requests(cmd, (size_t)cmd_len, iterations, samples);
+    long long elapsed = now_us() - started;
+    if (bytes < 0) {
+        free(samples);
+        return -1;
+    }
+    if (elapsed <= 0) elapsed = 1;
+
+    qsort(samples, (size_t)iterations, sizeof(long long), compare_us);
+
+    char label[32];
+    format_size(size, label, sizeof(label));
+    printf("%-8s %6s %9d %7d %10.1f %10.1f %9lld %9lld %9lld %9lld\n",
+           mode_names[mode], label, num_instances, iterations,
+           (double)bytes / (1024.0 * 1024.0) / ((double)elapsed / 1e6),
+           (double)iterations / ((double)elapsed / 1e6),
+           percentile(samples, iterations, 0.5),
+           percentile(samples, iterations, 0.99),
+           percentile(samples, iterations, 0.999),
+           samples[iterations - 1]);
+    fflush(stdout);
+
+    free(samples);
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-maude PATH] [-sizes LIST] [-iterations N] [-warmup N]\n", name);
+    fprintf(stderr, "          [-instances N] [-mode execute|parsed|search] [-rate BYTES]\n");
+    fprintf(stderr, "          [-chunk BYTES] [-max-output N]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *sizes_arg = DEFAULT_SIZES;
+    int iterations = 0;
+    long long sizes[MAX_SIZES];
+
+    maude_executable = "./fake_maude";
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (strcmp(opt, "-maude") == 0) {
+            maude_executable = value;
+        } else if (strcmp(opt, "-sizes") == 0) {
+            sizes_arg = value;
+        } else if (strcmp(opt, "-iterations") == 0) {
+            iterations = atoi(value);
+        } else if (strcmp(opt, "-warmup") == 0) {
+            warmup = atoi(value);
+        } else if (strcmp(opt, "-instances") == 0) {
+            num_instances = atoi(value);
+            if (num_instances < 1 || num_instances > MAX_INSTANCES) {
+                fprintf(stderr, "-instances must be between 1 and %d\n", MAX_INSTANCES);
+                return 2;
+            }
+        } else if (strcmp(opt, "-mode") == 0) {
+            if (strcmp(value, "execute") == 0) mode = BENCH_EXECUTE;
+            else if (strcmp(value, "parsed") == 0) mode = BENCH_PARSED;
+            else if (strcmp(value, "search") == 0) mode = BENCH_SEARCH;
+            else {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(opt, "-rate") == 0 || strcmp(opt, "-chunk") == 0) {
+            long long bytes = parse_size(value);
+            if (bytes < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            char text[32];
+            snprintf(text, sizeof(text), "%lld", bytes);
+            setenv(strcmp(opt, "-rate") == 0 ? "FAKE_MAUDE_RATE" : "FAKE_MAUDE_CHUNK", text, 1);
+        } else if (strcmp(opt, "-max-output") == 0) {
+            long long limit = parse_size(value);
+            if (limit <= 0 || limit > MAX_OUTPUT_LIMIT) {
+                fprintf(stderr, "-max-output must be between 1 and %d\n", MAX_OUTPUT_LIMIT);
+                return 2;
+            }
+            max_output = (size_t)limit;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int size_count = parse_sizes(sizes_arg, sizes);
+    if (size_count <= 0) {
+        fprintf(stderr, "Invalid -sizes: %s\n", sizes_arg);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    bridge_stats.started_ms = now_ms();
+
+    for (int i = 0; i < num_instances; i++) {
+        instances[i].id = i;
+        if (boot_maude(&instances[i]) < 0) {
+            fprintf(stderr, "Failed to start %s\n", maude_executable);
+            return 1;
+        }
+    }
+
+    int status = await_ready();
+
+    if (status == 0) {
+        printf("%-8s %6s %9s %7s %10s %10s %9s %9s %9s %9s\n",
+               "mode", "size", "instances", "iters", "MiB/s", "req/s",
+               "p50_us", "p99_us", "p999_us", "max_us");
+
+        for (int i = 0; i < size_count && status == 0; i++) {
+            status = bench_size(sizes[i], iterations);
+        }
+    }
+
+    for (int i = 0; i < num_instances; i++) {
+        stop_maude(&instances[i]);
+    }
+    return status == 0 ? 0 : 1;
+}
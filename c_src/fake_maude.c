@@ -0,0 +1,174 @@
+/*
+ * Fake Maude for bridge_bench
+ *
+ * Stands in for Maude behind maude_bridge so the bridge's own costs can be
+ * measured without Maude's. It speaks just enough of the REPL: every input
+ * line is a command, answered with scripted output followed by the
+ * "Maude> " prompt. An empty line only prints the prompt, which is what
+ * the bridge waits for when a child boots.
+ *
+ * The last number in a command is the size of the output in bytes:
+ *   reduce in BENCH : 1048576 .  ->  statistics line, "result String: "
+ *                                    and a term of 80-byte lines
+ *   search in BENCH : 1048576 .  ->  "Solution N" blocks up to the size,
+ *                                    then "No more solutions." and the
+ *                                    final statistics line
+ *   quit                          ->  exit
+ *
+ * Maude's command line options are accepted and ignored; the output rate
+ * is taken from the environment, since maude_bridge starts its children
+ * with fixed arguments:
+ *   FAKE_MAUDE_RATE   bytes per second, 0 or unset for as fast as the pipe
+ *                     takes them
+ *   FAKE_MAUDE_CHUNK  bytes per write (default: 4096)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define LINE_WIDTH 80
+#define DEFAULT_CHUNK 4096
+#define MAX_CHUNK (1024 * 1024)
+#define PROMPT "Maude> "
+
+static char *out = NULL;
+static size_t out_len = 0;
+static size_t out_cap = 0;
+static long long rate = 0;
+static size_t chunk = DEFAULT_CHUNK;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ns(long long ns) {
+    struct timespec ts = {(time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL)};
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+}
+
+static int append(const char *data, size_t len) {
+    if (out_len + len > out_cap) {
+        size_t cap = out_cap ? out_cap : 65536;
+        while (cap < out_len + len) cap *= 2;
+
+        char *grown = realloc(out, cap);
+        if (!grown) return -1;
+        out = grown;
+        out_cap = cap;
+    }
+    memcpy(out + out_len, data, len);
+    out_len += len;
+    return 0;
+}
+
+/* Append exactly len bytes of term text, broken into lines */
+static int append_filler(size_t len) {
+    char line[LINE_WIDTH];
+    memset(line, 'a', sizeof(line) - 1);
+    line[LINE_WIDTH - 1] = '\n';
+
+    while (len > 0) {
+        size_t n = len < LINE_WIDTH ? len : LINE_WIDTH;
+        if (append(line + LINE_WIDTH - n, n) < 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+static int script_reduce(size_t size) {
+    const char *head = "rewrites: 1 in 0ms cpu (0ms real) (~ rewrites/second)\nresult String: ";
+    if (append(head, strlen(head)) < 0) return -1;
+    return append_filler(size > 0 ? size : 1);
+}
+
+static int script_search(size_t size) {
+    char block[256];
+    size_t start = out_len;
+
+    for (int n = 1; out_len - start < size; n++) {
+        int len = snprintf(block, sizeof(block),
+                           "\nSolution %d (state %d)\n"
+                           "states: %d  rewrites: %d in 0ms cpu (0ms real) (~ rewrites/second)\n"
+                           "S:State --> s%d\n",
+                           n, n, n + 1, 2 * n, n);
+        if (append(block, (size_t)len) < 0) return -1;
+    }
+
+    const char *tail = "\nNo more solutions.\nstates: 1  rewrites: 1 in 0ms cpu (0ms real)\n";
+    return append(tail, strlen(tail));
+}
+
+/* Last run of digits in the command */
+static size_t command_size(const char *cmd) {
+    const char *digits = NULL;
+    for (const char *p = cmd; *p; p++) {
+        if (*p >= '0' && *p <= '9' && (p == cmd || p[-1] < '0' || p[-1] > '9')) digits = p;
+    }
+    return digits ? (size_t)strtoull(digits, NULL, 10) : 0;
+}
+
+/* Write the scripted output, paced to the configured rate */
+static int emit(void) {
+    long long started = now_ns();
+    size_t sent = 0;
+
+    while (sent < out_len) {
+        size_t n = out_len - sent < chunk ? out_len - sent : chunk;
+        ssize_t w = write(STDOUT_FILENO, out + sent, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += (size_t)w;
+
+        if (rate > 0) {
+            long long due = started + (long long)((double)sent * 1e9 / (double)rate);
+            long long ahead = due - now_ns();
+            if (ahead > 0) sleep_ns(ahead);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    const char *env = getenv("FAKE_MAUDE_RATE");
+    if (env) rate = atoll(env);
+    env = getenv("FAKE_MAUDE_CHUNK");
+    if (env && atol(env) > 0) chunk = (size_t)atol(env);
+    if (chunk > MAX_CHUNK) chunk = MAX_CHUNK;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &line_cap, stdin)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (strcmp(line, "quit") == 0) break;
+
+        out_len = 0;
+        int r = 0;
+        if (strncmp(line, "search", 6) == 0) {
+            r = script_search(command_size(line));
+        } else if (len > 0) {
+            r = script_reduce(command_size(line));
+        }
+
+        if (r < 0 || append("\n" PROMPT, strlen(PROMPT) + 1) < 0 || emit() < 0) {
+            free(line);
+            return 1;
+        }
+    }
+
+    free(line);
+    free(out);
+    return 0;
+}
@@ -1,60 +1,352 @@
 /*
  * ExMaude C-Node Bridge
  *
- * A C-Node process that manages a Maude subprocess and communicates
- * with the Erlang/Elixir VM using Erlang distribution protocol.
+ * A C-Node process that manages a pool of Maude subprocesses and
+ * communicates with the Erlang/Elixir VM using Erlang distribution protocol.
  *
  * This provides:
  * - Binary Erlang term protocol (no text parsing overhead)
  * - Full process isolation (C-Node crash doesn't affect BEAM)
  * - Lower latency than Port + PTY wrapper
+ * - Several Maude instances behind a single distribution connection
  *
  * Usage:
- *   ./maude_bridge <node_name> <cookie> <maude_path> <erlang_node>
+ *   ./maude_bridge <node_name> <cookie> <maude_path> <erlang_node> [options]
+ *   ./maude_bridge -socket <path> <maude_path> [options]
+ *   ./maude_bridge -fd <fd> <maude_path> [options]
+ *
+ * Options:
+ *   -instances N   Number of Maude children to run (default: 1)
+ *   -queue N       Execute requests to hold while all children are busy
+ *                  (default: 1024)
+ *   -max-output N  Largest response in bytes before a request fails with
+ *                  output_too_large (default: 64 MiB)
+ *   -preload PATH  Maude file to load into every child before READY is
+ *                  printed (repeatable)
+ *   -memory-limit N  Address space of every child in bytes (RLIMIT_AS);
+ *                  allocations past it fail and the child is restarted
+ *   -max-rss N     Resident set in bytes after which a child is recycled
+ *                  between requests
+ *   -cpu-affinity N  Pin child i to CPU N + i, modulo the online CPUs
+ *                  (Linux only)
+ *
+ * Transports:
+ *   By default the bridge is a C-Node: it connects to erlang_node through
+ *   EPMD with the given cookie and exchanges distribution messages. With
+ *   -socket it connects to a Unix domain socket listening at path instead,
+ *   and with -fd it uses an inherited, already connected stream socket
+ *   (e.g. one end of a socketpair). Both carry the same terms, each as a
+ *   4-byte big-endian length followed by the term in external format
+ *   ({packet, 4} framing), so a node that is not distributed can use the
+ *   bridge without EPMD, cookies or a distribution handshake. Replies go
+ *   back over the socket; the socket closing stops the bridge.
  *
  * Protocol:
- *   {execute, Command :: binary()} -> {:ok, Output :: binary()} | {:error, Reason}
+ *   {execute, Command :: binary()} -> {ok, Output :: binary()} | {error, Reason}
+ *   {execute, Ref, Command :: binary()} -> {ok, Ref, Output} | {error, Ref, Reason}
+ *   {load_file, Path :: binary()} -> ok | {error, Output | Reason}
+ *   {load_file, Ref, Path :: binary()} -> {ok, Ref} | {error, Ref, Output | Reason}
+ *   {load_source, Ref, Source :: binary()} -> {ok, Ref} | {error, Ref, Output | Reason}
+ *   {execute_stream, Ref, Command :: binary()} -> {chunk, Ref, Bin}..., {done, Ref}
+ *                                                 | {error, Ref, Reason}
+ *   {execute_batch, Ref, [Command :: binary()]} -> {ok, Ref, [Output | {error, Reason}]}
+ *   {execute_parsed, Ref, Command :: binary()} -> {ok, Ref, Parsed} | {error, Ref, Reason}
+ *   {ack, Ref} -> (no reply) the caller consumed one chunk
+ *   {cancel, Ref} -> (no reply) the caller lost interest in a request
+ *
+ * The commands of a batch are spread over idle instances like separate
+ * execute requests, but answered together, in order, in one message.
+ *
+ * execute_parsed runs like execute, but the bridge tokenizes the output
+ * before replying, so the BEAM does not scan Maude's text:
+ *   {result, Sort, Term, Stats}                  reduce, rewrite, ...
+ *   {search, [{N, State, [{Var, Value}]}], Stats} search ("Solution N" blocks)
+ *   {text, Output}                               anything else, e.g. errors
+ * Stats is a map with the states, rewrites, time_ms (cpu) and real_ms
+ * Maude reported; keys it did not report are left out. State is undefined when
+ * a solution has no state number. All strings are binaries.
+ *
+ * load_source loads module text sent in the message. The bridge writes it
+ * once into a private directory, named by a hash of its content, and loads
+ * that file into every child, so the caller needs no file of its own and a
+ * restarted child can replay the source like any other loaded file.
+ *
+ * Tagged execute, execute_stream, execute_batch, load_file and load_source requests may carry a
+ * trailing timeout in milliseconds, e.g. {execute, Ref, Cmd, TimeoutMs};
+ * without one REQUEST_TIMEOUT_MS applies.
  *   ping -> pong
+ *   {ping, Ref} -> {pong, Ref}
  *   stop -> ok
+ *   {stop, Ref} -> {ok, Ref}
+ *   stats -> {stats, Stats}
+ *   {stats, Ref} -> {stats, Ref, Stats}
+ *
+ * Stats is a map of totals since the bridge connected: bytes_in and
+ * bytes_out on the distribution connection, maude_bytes_written and
+ * maude_bytes_read on the children's pipes, timeouts, overloaded, restarts,
+ * recycled, the current queued count, uptime_ms and rss_bytes (the resident
+ * set of every child, in instance order, 0 where the platform does not
+ * report it), plus one latency histogram per phase of a request:
+ *   decode   receiving and handling a request message, up to writing the
+ *            command to Maude or queueing it
+ *   compute  command written until Maude printed its prompt, minus reads
+ *   read     reading the child's output and scanning it for the prompt
+ *   encode   building the final reply (including execute_parsed tokenizing)
+ * Each is #{count, sum_us, min_us, max_us, buckets => [{UpperUs, Count}]},
+ * with log-linear buckets exact to 1/8 of the value and only the buckets
+ * that were hit listed.
+ *
+ * Execute requests go to whichever instance is idle, so tagged replies may
+ * arrive in a different order than the requests were sent. When every
+ * instance is busy, requests wait in a FIFO queue and start as soon as an
+ * instance frees up, so callers can pipeline commands without waiting for
+ * each reply; a full queue answers {error, Ref, overloaded}. Load requests
+ * are applied to every instance and answered once all of them finished.
+ *
+ * A request that times out or is cancelled while running interrupts its
+ * child with SIGINT instead of killing it. The bridge then aborts Maude's
+ * debugger and waits for the answer to a sentinel command before the
+ * instance takes new work, so loaded modules survive. Only a child that
+ * does not resynchronize within RESYNC_TIMEOUT_MS is restarted.
+ *
+ * Children are kept from starving each other on shared hosts: -memory-limit
+ * caps what one pathological command can allocate, -cpu-affinity keeps
+ * each child on its own core, and with -max-rss a child that has grown too
+ * large is replaced by a fresh one after its current request, before it
+ * takes the next.
+ *
+ * The bridge keeps the module set of its children: every -preload file and
+ * every file loaded successfully through load_file or load_source, in the
+ * order they were last loaded. A child that had to be restarted replays the
+ * whole set before it takes other work, so crash recovery does not lose
+ * modules and workers need not reload them.
+ *
+ * Streamed requests forward output while Maude is still producing it, cut
+ * at "Solution N" boundaries where possible. At most STREAM_WINDOW chunks
+ * may be unacknowledged; after that the bridge stops reading the child, so
+ * a slow consumer throttles Maude through the pipe instead of growing the
+ * bridge or the caller's mailbox.
+ *
+ * A single event loop waits on the distribution socket and the stdout of
+ * every child at once, using epoll on Linux, kqueue on the BSDs and macOS
+ * and select() elsewhere. Children that crash or time out are restarted
+ * without blocking the loop: the others keep running while the new Maude
+ * boots.
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE /* sched_setaffinity */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
 #include <sys/wait.h>
-#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#if defined(__linux__)
+#define POLLER_EPOLL 1
+#include <sys/epoll.h>
+#include <sched.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define POLLER_KQUEUE 1
+#include <sys/event.h>
+#else
+#include <sys/select.h>
+#endif
 
 #include <ei.h>
 
-/* Forward declarations */
-static void handle_message(int fd, erlang_msg *emsg, ei_x_buff *buf);
-static int read_until_prompt(char *output, int max_len, int timeout_ms);
-static int send_command(const char *cmd, size_t len);
-static void encode_ok(ei_x_buff *response, const char *data, int data_len);
-static void encode_error(ei_x_buff *response, const char *reason);
-
-#define BUFSIZE 65536
+#define INITIAL_BUFSIZE 65536
+#define SHRINK_THRESHOLD (1024 * 1024)
+#define READ_CHUNK 65536
+#define DEFAULT_MAX_OUTPUT (64 * 1024 * 1024)
+#define MAX_OUTPUT_LIMIT (1024 * 1024 * 1024)
 #define PROMPT "Maude>"
 #define PROMPT_LEN 6
+#define MAX_INSTANCES 64
+#define MAX_REF_LEN 512
+#define DEFAULT_MAX_QUEUED 1024
+#define REQUEST_TIMEOUT_MS 30000
+#define READY_TIMEOUT_MS 10000
+#define RESYNC_TIMEOUT_MS 5000
+#define MAX_TIMEOUT_MS (24LL * 60 * 60 * 1000)
+#define INLINE_COMMAND 256
+#define FREELIST_MAX 256
+#define INITIAL_RESPONSE 4096
+#define RESPONSE_OVERHEAD 64
+#define STREAM_WINDOW 8
+#define STREAM_CHUNK 65536
+#define SOLUTION_MARK "Solution "
+#define SOLUTION_MARK_LEN 9
+#define MAX_MODULES 256
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define FRAME_HEADER 4
+#define MIN_MEMORY_LIMIT (16LL * 1024 * 1024)
+#define INITIAL_FRAME_BUFSIZE 65536
+
+typedef enum {
+    REQ_EXECUTE,
+    REQ_LOAD,
+    REQ_STREAM,
+    REQ_BATCH,
+    REQ_PARSED
+} RequestKind;
+
+/* Outcome of one command of a batch */
+typedef struct {
+    char *output;
+    int len;
+    const char *reason; /* set when the command failed */
+} BatchResult;
+
+/* Reply target shared by every instance taking part in a request.
+ * Execute requests have exactly one part, load requests one per instance
+ * and batches one per command. */
+typedef struct {
+    erlang_pid from;
+    char ref[MAX_REF_LEN];
+    int ref_len;        /* 0 for untagged (legacy) requests */
+    RequestKind kind;
+    int pending;        /* instances that have not answered yet */
+    char *error_output; /* first load output containing an error */
+    int error_len;
+    const char *error_reason;
+    int unacked;        /* stream chunks sent but not yet acknowledged */
+    int sent_any;       /* whether a stream chunk went out already */
+    int cancelled;      /* abandoned by the caller, never answered */
+    long long timeout_ms;
+    BatchResult *results; /* one per batch command, in request order */
+    int result_count;
+    char *module;       /* load command to remember once every child loaded it */
+    int replay;         /* module set replay into a fresh child, nobody to answer */
+} Reply;
+
+/* A unit of work queued on or running in one Maude instance.
+ * Requests dispatched straight from a message never copy their command;
+ * queued ones keep short commands inline and longer ones on the heap. */
+typedef struct Request {
+    struct Request *next;
+    Reply *reply;
+    char *command;      /* NULL once written to Maude */
+    size_t command_len;
+    int index;          /* position within a batch */
+    long long dispatched_us; /* when the command was written to Maude */
+    long long read_us;  /* time spent reading its output */
+    char inline_command[INLINE_COMMAND];
+} Request;
+
+/* Log-linear latency histogram in microseconds, in the spirit of
+ * HdrHistogram: every power of two is split into HIST_SUB buckets, so a
+ * recorded value is known to within 1 / HIST_SUB of itself. */
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum_us;
+    long long min_us;
+    long long max_us;
+} Histogram;
+
+/* Phase timings and counters answered to a stats request */
+typedef struct {
+    Histogram decode;   /* receiving and handling a request message */
+    Histogram compute;  /* command written until Maude's prompt, minus reads */
+    Histogram read;     /* reading and scanning a response */
+    Histogram encode;   /* building a final reply */
+    unsigned long long bytes_in;   /* distribution messages received */
+    unsigned long long bytes_out;  /* distribution messages sent */
+    unsigned long long maude_bytes_written;
+    unsigned long long maude_bytes_read;
+    unsigned long long timeouts;
+    unsigned long long overloaded;
+    unsigned long long restarts;
+    unsigned long long recycled;   /* children replaced for exceeding -max-rss */
+    long long started_ms;
+} BridgeStats;
 
 /* Maude process state */
 typedef struct {
+    int id;
     pid_t pid;
     int stdin_fd;
     int stdout_fd;
-    char buffer[BUFSIZE];
-    int buffer_len;
+    char *buffer;          /* heap arena reused across requests */
+    size_t buffer_len;
+    size_t buffer_cap;
+    int overflowed;        /* output passed max_output, now only scanning for the prompt */
+    size_t scan_pos;       /* bytes already searched for the prompt */
+    int origin_line_start; /* whether buffer[0] begins a line of output */
+    int starting;          /* restarted child still waiting for its first prompt */
+    int resyncing;         /* interrupted child draining back to the top level */
+    int sync_seen;         /* resync sentinel answered, only the prompt is missing */
+    unsigned sync_seq;
+    char sync_token[32];
+    int watched;           /* stdout registered with the poller */
+    Request *current;      /* NULL while idle */
+    long long deadline_ms;
+    Request *queue_head;   /* work pinned to this instance (loads) */
+    Request *queue_tail;
 } MaudeProcess;
 
-static MaudeProcess maude = {0};
+/* Forward declarations */
+static void handle_message(const erlang_pid *from, ei_x_buff *buf);
+static int send_command(MaudeProcess *inst, const char *cmd, size_t len);
+static int replace_maude(MaudeProcess *inst);
+static void schedule_instance(MaudeProcess *inst);
+
+static MaudeProcess instances[MAX_INSTANCES];
+static int num_instances = 1;
+static int max_queued = DEFAULT_MAX_QUEUED;
+static size_t max_output = DEFAULT_MAX_OUTPUT;
+static long long memory_limit = 0;      /* RLIMIT_AS of every child, 0 for none */
+static unsigned long long max_rss = 0;  /* recycle children above this, 0 for never */
+static int cpu_affinity = -1;           /* first CPU to pin children to, -1 for none */
+
+/* Recycled request and reply structs, so steady traffic does not malloc */
+static Request *request_cache[FREELIST_MAX];
+static int requests_cached = 0;
+static Reply *reply_cache[FREELIST_MAX];
+static int replies_cached = 0;
+
+/* Every message to Erlang is encoded into this one buffer */
+static ei_x_buff out_buf;
+
+/* Execute requests waiting for any idle instance */
+static Request *pending_head = NULL;
+static Request *pending_tail = NULL;
+static int pending_count = 0;
+static const char *maude_executable = NULL;
+
+/* Load commands every child should have run, in load order */
+static char *module_set[MAX_MODULES];
+static int module_count = 0;
+static char module_dir[PATH_MAX]; /* load_source files, created on first use */
+static BridgeStats bridge_stats;
+static int erl_fd = -1;
+static int socket_transport = 0; /* erl_fd is a framed socket, not distribution */
+
+/* Bytes received on a socket transport, parsed as length-prefixed frames */
+static char *frame_buf = NULL;
+static size_t frame_len = 0;
+static size_t frame_cap = 0;
 static volatile sig_atomic_t running = 1;
 
 /* Signal handler for graceful shutdown */
@@ -63,6 +355,52 @@ static void handle_signal(int sig) {
     running = 0;
 }
 
+/* Monotonic clock in milliseconds */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Monotonic clock in microseconds, for phase timings */
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Bucket of a value: exact below HIST_SUB, then HIST_SUB buckets for
+ * every power of two. Values past 2^HIST_MAX_BITS land in the last one. */
+static int hist_bucket(long long value) {
+    unsigned long long v = value > 0 ? (unsigned long long)value : 0;
+    if (v < HIST_SUB) return (int)v;
+
+    int exp = 63 - __builtin_clzll(v);
+    if (exp >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+
+    int shift = exp - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) & (HIST_SUB - 1));
+}
+
+/* Largest value that falls into a bucket */
+static long long hist_upper(int bucket) {
+    if (bucket < HIST_SUB) return bucket;
+
+    int shift = bucket / HIST_SUB - 1;
+    long long lower = (long long)(HIST_SUB + bucket % HIST_SUB) << shift;
+    return lower + (1LL << shift) - 1;
+}
+
+static void hist_record(Histogram *hist, long long value_us) {
+    if (value_us < 0) value_us = 0;
+
+    hist->counts[hist_bucket(value_us)]++;
+    if (hist->count == 0 || value_us < hist->min_us) hist->min_us = value_us;
+    if (value_us > hist->max_us) hist->max_us = value_us;
+    hist->count++;
+    hist->sum_us += (unsigned long long)value_us;
+}
+
 /* Set file descriptor to non-blocking mode */
 static int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -70,8 +408,143 @@ static int set_nonblocking(int fd) {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-/* Start the Maude subprocess */
-static int start_maude(const char *maude_path) {
+/* Keep bridge-side descriptors out of later children */
+static int set_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1) return -1;
+    return fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+}
+
+/* Readiness notification for the distribution socket and child stdouts.
+ * Level-triggered everywhere, so a descriptor that was only partly drained
+ * is reported again on the next wait. */
+#if defined(POLLER_EPOLL) || defined(POLLER_KQUEUE)
+static int poll_fd = -1;
+#else
+static fd_set watch_set;
+static int watch_max = -1;
+#endif
+
+static int poller_init(void) {
+#if defined(POLLER_EPOLL)
+    poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return poll_fd < 0 ? -1 : 0;
+#elif defined(POLLER_KQUEUE)
+    poll_fd = kqueue();
+    if (poll_fd < 0) return -1;
+    return set_cloexec(poll_fd);
+#else
+    FD_ZERO(&watch_set);
+    return 0;
+#endif
+}
+
+/* Start or stop reporting readability of fd */
+static int poller_watch(int fd, int on) {
+#if defined(POLLER_EPOLL)
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(poll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev);
+#elif defined(POLLER_KQUEUE)
+    struct kevent ev;
+    EV_SET(&ev, fd, EVFILT_READ, on ? EV_ADD : EV_DELETE, 0, 0, NULL);
+    return kevent(poll_fd, &ev, 1, NULL, 0, NULL);
+#else
+    if (fd >= FD_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (on) {
+        FD_SET(fd, &watch_set);
+        if (fd > watch_max) watch_max = fd;
+    } else {
+        FD_CLR(fd, &watch_set);
+    }
+    return 0;
+#endif
+}
+
+/* Wait up to timeout_ms for watched descriptors to become readable.
+ * Stores up to max_ready of them in ready and returns how many, or -1. */
+static int poller_wait(long long timeout_ms, int *ready, int max_ready) {
+#if defined(POLLER_EPOLL)
+    struct epoll_event events[MAX_INSTANCES + 1];
+    if (max_ready > MAX_INSTANCES + 1) max_ready = MAX_INSTANCES + 1;
+
+    int n = epoll_wait(poll_fd, events, max_ready, (int)timeout_ms);
+    for (int i = 0; i < n; i++) ready[i] = events[i].data.fd;
+    return n;
+#elif defined(POLLER_KQUEUE)
+    struct kevent events[MAX_INSTANCES + 1];
+    struct timespec ts;
+    if (max_ready > MAX_INSTANCES + 1) max_ready = MAX_INSTANCES + 1;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+    int n = kevent(poll_fd, NULL, 0, events, max_ready, &ts);
+    for (int i = 0; i < n; i++) ready[i] = (int)events[i].ident;
+    return n;
+#else
+    fd_set readfds = watch_set;
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    int n = select(watch_max + 1, &readfds, NULL, NULL, &tv);
+    if (n <= 0) return n;
+
+    int count = 0;
+    for (int fd = 0; fd <= watch_max && count < max_ready; fd++) {
+        if (FD_ISSET(fd, &readfds)) ready[count++] = fd;
+    }
+    return count;
+#endif
+}
+
+/* Apply the resource limits to a freshly forked child. Failures are
+ * reported but not fatal: an unlimited Maude is better than none. */
+static void limit_child(const MaudeProcess *inst) {
+    if (memory_limit > 0) {
+        struct rlimit lim = {(rlim_t)memory_limit, (rlim_t)memory_limit};
+        if (setrlimit(RLIMIT_AS, &lim) < 0) perror("setrlimit");
+    }
+
+#if defined(__linux__)
+    if (cpu_affinity >= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((int)((cpu_affinity + inst->id) % (cpus > 0 ? cpus : 1)), &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) perror("sched_setaffinity");
+    }
+#else
+    (void)inst;
+#endif
+}
+
+/* Resident set of a child in bytes, 0 where the platform does not tell */
+static unsigned long long instance_rss(const MaudeProcess *inst) {
+#if defined(__linux__)
+    if (inst->pid <= 0) return 0;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int)inst->pid);
+    FILE *statm = fopen(path, "r");
+    if (statm == NULL) return 0;
+
+    unsigned long long size, resident;
+    int fields = fscanf(statm, "%llu %llu", &size, &resident);
+    fclose(statm);
+    return fields == 2 ? resident * (unsigned long long)sysconf(_SC_PAGESIZE) : 0;
+#else
+    (void)inst;
+    return 0;
+#endif
+}
+
+/* Start a Maude subprocess for the given instance */
+static int start_maude(MaudeProcess *inst) {
     int stdin_pipe[2], stdout_pipe[2];
 
     if (pipe(stdin_pipe) < 0 || pipe(stdout_pipe) < 0) {
@@ -79,13 +552,13 @@ static int start_maude(const char *maude_path) {
         return -1;
     }
 
-    maude.pid = fork();
-    if (maude.pid < 0) {
+    inst->pid = fork();
+    if (inst->pid < 0) {
         perror("fork");
         return -1;
     }
 
-    if (maude.pid == 0) {
+    if (inst->pid == 0) {
         /* Child process */
         close(stdin_pipe[1]);
         close(stdout_pipe[0]);
@@ -97,10 +570,12 @@ static int start_maude(const char *maude_path) {
         close(stdin_pipe[0]);
         close(stdout_pipe[1]);
 
+        limit_child(inst);
+
         /* Set MAUDE_LIB to the directory containing the Maude binary
          * so that Maude can find prelude.maude and other library files */
         char maude_lib[4096];
-        strncpy(maude_lib, maude_path, sizeof(maude_lib) - 1);
+        strncpy(maude_lib, maude_executable, sizeof(maude_lib) - 1);
         maude_lib[sizeof(maude_lib) - 1] = '\0';
         char *last_slash = strrchr(maude_lib, '/');
         if (last_slash != NULL) {
@@ -109,7 +584,7 @@ static int start_maude(const char *maude_path) {
         }
 
         /* Execute Maude with options to suppress banner and enable interactive mode */
-        execl(maude_path, "maude", "-no-banner", "-no-wrap", "-no-advise", "-interactive", NULL);
+        execl(maude_executable, "maude", "-no-banner", "-no-wrap", "-no-advise", "-interactive", NULL);
 
         /* If execl fails */
         perror("execl");
@@ -120,402 +595,2123 @@ static int start_maude(const char *maude_path) {
     close(stdin_pipe[0]);
     close(stdout_pipe[1]);
 
-    maude.stdin_fd = stdin_pipe[1];
-    maude.stdout_fd = stdout_pipe[0];
-    maude.buffer_len = 0;
+    inst->stdin_fd = stdin_pipe[1];
+    inst->stdout_fd = stdout_pipe[0];
+    inst->buffer_len = 0;
 
-    /* Set stdout to non-blocking for select() */
-    set_nonblocking(maude.stdout_fd);
+    /* Non-blocking so the event loop can drain stdout without stalling */
+    set_nonblocking(inst->stdout_fd);
+    set_cloexec(inst->stdin_fd);
+    set_cloexec(inst->stdout_fd);
 
     return 0;
 }
 
-/* Stop the Maude subprocess */
-static void stop_maude(void) {
-    if (maude.pid > 0) {
+/* Reap a signalled child and release its pipes */
+static void close_maude(MaudeProcess *inst) {
+    waitpid(inst->pid, NULL, 0);
+
+    /* Unregister explicitly: other children may still hold a copy of the
+     * descriptor, which would keep a stale epoll registration alive */
+    if (inst->watched) {
+        poller_watch(inst->stdout_fd, 0);
+        inst->watched = 0;
+    }
+
+    close(inst->stdin_fd);
+    close(inst->stdout_fd);
+    inst->pid = 0;
+}
+
+/* Stop a Maude subprocess */
+static void stop_maude(MaudeProcess *inst) {
+    if (inst->pid > 0) {
         /* Send quit command (ignore errors during shutdown) */
         const char *quit_cmd = "quit\n";
-        (void)write(maude.stdin_fd, quit_cmd, strlen(quit_cmd));
+        (void)write(inst->stdin_fd, quit_cmd, strlen(quit_cmd));
 
         /* Give it a moment to exit gracefully */
         usleep(100000);
 
         /* Force kill if still running */
-        kill(maude.pid, SIGTERM);
-        waitpid(maude.pid, NULL, 0);
-
-        close(maude.stdin_fd);
-        close(maude.stdout_fd);
-        maude.pid = 0;
+        kill(inst->pid, SIGTERM);
+        close_maude(inst);
     }
 }
 
-/* Send command to Maude */
-static int send_command(const char *cmd, size_t len) {
-    ssize_t written = write(maude.stdin_fd, cmd, len);
-    if (written < 0) {
-        perror("write to maude");
-        return -1;
-    }
+/* Send command to Maude, adding the terminating newline in the same
+ * writev so the command is written straight from the caller's buffer */
+static int send_command(MaudeProcess *inst, const char *cmd, size_t len) {
+    struct iovec iov[2];
+    struct iovec *next = iov;
+    int count = 1;
 
-    /* Ensure command ends with newline */
+    iov[0].iov_base = (void *)cmd;
+    iov[0].iov_len = len;
     if (len == 0 || cmd[len - 1] != '\n') {
-        if (write(maude.stdin_fd, "\n", 1) < 0) {
-            perror("write newline to maude");
+        iov[1].iov_base = "\n";
+        iov[1].iov_len = 1;
+        count = 2;
+    }
+
+    while (count > 0) {
+        ssize_t written = writev(inst->stdin_fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            perror("write to maude");
             return -1;
         }
+
+        bridge_stats.maude_bytes_written += (unsigned long long)written;
+
+        /* Skip what went out; a short write resumes mid-iovec */
+        while (count > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + written;
+            next->iov_len -= written;
+        }
     }
 
     return 0;
 }
 
-/* Read from Maude until we see the prompt
- * Returns: >= 0 on success (number of output bytes before prompt)
- *          -1 on timeout (no prompt found)
- *          -2 on read error
- *          -3 on EOF (Maude closed)
- */
-static int read_until_prompt(char *output, int max_len, int timeout_ms) {
-    int total = 0;
-    fd_set readfds;
-    struct timeval tv;
-    int prompt_found = 0;
+/* Empty the output buffer before the next response.
+ * An arena that grew for a large response is given back to the system. */
+static void reset_buffer(MaudeProcess *inst) {
+    if (inst->buffer_cap > SHRINK_THRESHOLD) {
+        free(inst->buffer);
+        inst->buffer = NULL;
+        inst->buffer_cap = 0;
+    }
+    inst->buffer_len = 0;
+    inst->overflowed = 0;
+    inst->scan_pos = 0;
+    inst->origin_line_start = 1;
+    if (inst->buffer) inst->buffer[0] = '\0';
+}
 
-    while (total < max_len - 1) {
-        FD_ZERO(&readfds);
-        FD_SET(maude.stdout_fd, &readfds);
+/* Make room for one more read, growing the buffer geometrically.
+ * The buffer never needs more than max_output plus one read chunk. */
+static int reserve_buffer(MaudeProcess *inst) {
+    size_t needed = inst->buffer_len + READ_CHUNK + 1;
+    if (needed <= inst->buffer_cap) return 0;
 
-        tv.tv_sec = timeout_ms / 1000;
-        tv.tv_usec = (timeout_ms % 1000) * 1000;
+    size_t new_cap = inst->buffer_cap ? inst->buffer_cap : INITIAL_BUFSIZE;
+    while (new_cap < needed) new_cap *= 2;
 
-        int ready = select(maude.stdout_fd + 1, &readfds, NULL, NULL, &tv);
+    char *grown = realloc(inst->buffer, new_cap);
+    if (!grown) {
+        perror("realloc output buffer");
+        return -1;
+    }
+    inst->buffer = grown;
+    inst->buffer_cap = new_cap;
+    return 0;
+}
 
-        if (ready < 0) {
-            if (errno == EINTR) continue;
-            perror("select");
-            output[total] = '\0';
-            return -2;  /* Read error */
-        }
+/* Remove the first n bytes of output, remembering whether what is left
+ * starts a line so the prompt matcher keeps working */
+static void consume_buffer(MaudeProcess *inst, size_t n) {
+    if (n == 0) return;
+
+    size_t keep = inst->buffer_len - n;
+    inst->origin_line_start = inst->buffer[n - 1] == '\n';
+    memmove(inst->buffer, inst->buffer + n, keep);
+    inst->buffer_len = keep;
+    inst->buffer[keep] = '\0';
+    inst->scan_pos = inst->scan_pos > n ? inst->scan_pos - n : 0;
+}
 
-        if (ready == 0) {
-            /* Timeout - no more data available */
-            break;
+/* Drop everything but a tail long enough to hold a split prompt */
+static void discard_output(MaudeProcess *inst) {
+    size_t keep = inst->buffer_len < PROMPT_LEN ? inst->buffer_len : PROMPT_LEN;
+    consume_buffer(inst, inst->buffer_len - keep);
+}
+
+/* Incremental prompt matcher.
+ *
+ * Only the bytes appended since the last call are searched, plus a
+ * PROMPT_LEN - 1 overlap so a prompt split across two reads is still
+ * found. A real prompt is Maude's "Maude> " printed either at the start
+ * of a line or as the last thing written before Maude blocks on stdin;
+ * "Maude>" in the middle of a line of output (e.g. inside a term) is not
+ * a prompt.
+ *
+ * Returns the prompt offset, or -1 when no prompt has been seen yet. */
+static long scan_prompt(MaudeProcess *inst, int drained) {
+    const char *buf = inst->buffer;
+    size_t len = inst->buffer_len;
+    size_t pos = inst->scan_pos > PROMPT_LEN - 1 ? inst->scan_pos - (PROMPT_LEN - 1) : 0;
+
+    while (pos + PROMPT_LEN <= len) {
+        const char *hit = memchr(buf + pos, PROMPT[0], len - pos - PROMPT_LEN + 1);
+        if (hit == NULL) break;
+
+        size_t at = hit - buf;
+        if (memcmp(hit, PROMPT, PROMPT_LEN) == 0) {
+            int line_start = at == 0 ? inst->origin_line_start : buf[at - 1] == '\n';
+            if (line_start) {
+                return (long)at;
+            }
         }
+        pos = at + 1;
+    }
+    inst->scan_pos = len;
+
+    /* Nothing left to read: a prompt ending the output counts even when
+     * the preceding output did not end with a newline */
+    if (drained) {
+        size_t end = len;
+        if (end > 0 && buf[end - 1] == ' ') end--;
+        if (end >= PROMPT_LEN && memcmp(buf + end - PROMPT_LEN, PROMPT, PROMPT_LEN) == 0) {
+            return (long)(end - PROMPT_LEN);
+        }
+    }
+
+    return -1;
+}
 
-        char buf[4096];
-        ssize_t n = read(maude.stdout_fd, buf, sizeof(buf));
+/* Drain whatever Maude has written so far into the instance buffer.
+ * Returns: 1 when the prompt was seen (buffer holds the output before it)
+ *          0 when more output is needed
+ *          -2 on read error
+ *          -3 on EOF (Maude closed)
+ *          -4 when the buffer could not grow
+ */
+static int instance_read(MaudeProcess *inst) {
+    /* Streams hand each read to stream_flush before taking the next one */
+    int streaming = inst->current && inst->current->reply->kind == REQ_STREAM;
 
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
-            perror("read from maude");
-            output[total] = '\0';
-            return -2;  /* Read error */
+    for (;;) {
+        if (reserve_buffer(inst) < 0) {
+            return -4;
         }
 
-        if (n == 0) {
+        char *buf = inst->buffer + inst->buffer_len;
+        ssize_t n = read(inst->stdout_fd, buf, READ_CHUNK);
+        int drained = 0;
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("read from maude");
+                return -2;  /* Read error */
+            }
+            drained = 1;
+            n = 0;
+        } else if (n == 0) {
             /* EOF - Maude closed */
-            output[total] = '\0';
             return -3;
         }
 
-        /* Append to output buffer */
-        int copy_len = (total + n > max_len - 1) ? (max_len - 1 - total) : (int)n;
-        memcpy(output + total, buf, copy_len);
-        total += copy_len;
+        bridge_stats.maude_bytes_read += (unsigned long long)n;
+        inst->buffer_len += n;
+        inst->buffer[inst->buffer_len] = '\0';
 
-        /* Check for prompt - search entire buffer for small buffers,
-         * or just the tail for large buffers (optimization) */
-        output[total] = '\0';
-        
-        if (strstr(output, PROMPT) != NULL) {
+        long prompt_at = scan_prompt(inst, drained);
+        if (prompt_at >= 0) {
             /* Found prompt, remove it from output */
-            char *prompt_pos = strstr(output, PROMPT);
-            if (prompt_pos != NULL) {
-                *prompt_pos = '\0';
-                total = (int)(prompt_pos - output);
-            }
-            prompt_found = 1;
-            break;
+            inst->buffer_len = (size_t)prompt_at;
+            inst->buffer[prompt_at] = '\0';
+            return 1;
+        }
+
+        if (drained || streaming) {
+            return 0;
+        }
+
+        /* Too large to return: keep reading so the instance stays in sync
+         * with Maude, but stop accumulating the output */
+        if (inst->overflowed || inst->buffer_len > max_output) {
+            inst->overflowed = 1;
+            discard_output(inst);
         }
     }
+}
 
-    output[total] = '\0';
+/* Offset of needle in the instance buffer, or -1 */
+static long find_in_buffer(const MaudeProcess *inst, const char *needle, size_t needle_len) {
+    const char *buf = inst->buffer;
+    size_t len = inst->buffer_len;
 
-    /* Trim leading/trailing whitespace */
-    while (total > 0 && (output[total-1] == '\n' || output[total-1] == '\r' || output[total-1] == ' ')) {
-        output[--total] = '\0';
+    for (size_t pos = 0; pos + needle_len <= len; pos++) {
+        const char *hit = memchr(buf + pos, needle[0], len - pos - needle_len + 1);
+        if (hit == NULL) break;
+        pos = hit - buf;
+        if (memcmp(hit, needle, needle_len) == 0) return (long)pos;
     }
+    return -1;
+}
 
-    char *start = output;
-    while (*start == '\n' || *start == '\r' || *start == ' ') {
-        start++;
+/* Drain an interrupted child. Everything before the sentinel's answer is
+ * stale output of the cancelled command (and of the debugger), the first
+ * prompt after it means Maude is back at the top level.
+ * Returns 1 when in sync, 0 when more output is needed, or the negative
+ * codes of instance_read. */
+static int resync_read(MaudeProcess *inst) {
+    size_t token_len = strlen(inst->sync_token);
+
+    for (;;) {
+        if (reserve_buffer(inst) < 0) {
+            return -4;
+        }
+
+        ssize_t n = read(inst->stdout_fd, inst->buffer + inst->buffer_len, READ_CHUNK);
+        int drained = 0;
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("read from maude");
+                return -2;
+            }
+            drained = 1;
+            n = 0;
+        } else if (n == 0) {
+            return -3;
+        }
+
+        inst->buffer_len += n;
+        inst->buffer[inst->buffer_len] = '\0';
+
+        if (!inst->sync_seen) {
+            long at = find_in_buffer(inst, inst->sync_token, token_len);
+            if (at >= 0) {
+                consume_buffer(inst, (size_t)at + token_len);
+                inst->sync_seen = 1;
+            } else if (inst->buffer_len >= token_len) {
+                /* Keep just enough to match a token split across reads */
+                consume_buffer(inst, inst->buffer_len - (token_len - 1));
+            }
+        }
+
+        if (inst->sync_seen && scan_prompt(inst, drained) >= 0) {
+            return 1;
+        }
+
+        if (drained) {
+            return 0;
+        }
     }
+}
 
-    if (start != output) {
-        memmove(output, start, strlen(start) + 1);
-        total = (int)strlen(output);
+/* Trim surrounding whitespace from the collected output.
+ * Returns a pointer into the instance buffer and stores the length. */
+static char *take_output(MaudeProcess *inst, int *out_len) {
+    char *start = inst->buffer;
+    int total = (int)inst->buffer_len;
+
+    while (total > 0 && (start[total-1] == '\n' || start[total-1] == '\r' || start[total-1] == ' ')) {
+        total--;
     }
 
-    if (!prompt_found) {
-        return -1;  /* Timeout without finding prompt */
+    while (total > 0 && (*start == '\n' || *start == '\r' || *start == ' ')) {
+        start++;
+        total--;
     }
 
-    return total;  /* Success - return output length (may be 0) */
+    start[total] = '\0';
+    *out_len = total;
+    return start;
 }
 
-/* Wait for initial Maude prompt after startup */
-static int wait_for_ready(void) {
-    char buf[BUFSIZE];
-    
-    /* With -no-banner, Maude may not output anything until we send a command.
-     * Send a simple newline to trigger the prompt. */
-    (void)write(maude.stdin_fd, "\n", 1);
-    
-    int result = read_until_prompt(buf, BUFSIZE, 10000);
-    if (result >= 0) {
-        fprintf(stderr, "Maude ready (startup output %d bytes): '%s'\n", result, buf);
-    } else if (result == -1) {
-        fprintf(stderr, "Maude startup: timeout waiting for prompt (no 'Maude>' found)\n");
-        fprintf(stderr, "Partial output received: '%s'\n", buf);
-    } else if (result == -2) {
-        fprintf(stderr, "Maude startup: read error\n");
-    } else if (result == -3) {
-        fprintf(stderr, "Maude startup: process closed (EOF)\n");
-    }
-    return result;
+/* Launch a child and nudge it towards its first prompt.
+ * With -no-banner, Maude may not output anything until we send a command,
+ * so a newline triggers the prompt. The event loop takes it from there. */
+static int boot_maude(MaudeProcess *inst) {
+    if (start_maude(inst) < 0) return -1;
+
+    reset_buffer(inst);
+    (void)write(inst->stdin_fd, "\n", 1);
+    inst->starting = 1;
+    inst->resyncing = 0;
+    inst->deadline_ms = now_ms() + READY_TIMEOUT_MS;
+    return 0;
 }
 
-/* Encode an Erlang ok tuple: {:ok, data} */
-static void encode_ok(ei_x_buff *response, const char *data, int data_len) {
-    ei_x_encode_tuple_header(response, 2);
-    ei_x_encode_atom(response, "ok");
-    ei_x_encode_binary(response, data, data_len);
+/* Replace a dead or stuck Maude child with a fresh one.
+ * The new child boots while the event loop keeps serving the other
+ * instances; once its first prompt arrives it replays the module set
+ * and then takes work again. */
+static int restart_maude(MaudeProcess *inst) {
+    fprintf(stderr, "Restarting Maude[%d]\n", inst->id);
+    bridge_stats.restarts++;
+    return replace_maude(inst);
 }
 
-/* Encode an Erlang error tuple: {:error, reason} */
-static void encode_error(ei_x_buff *response, const char *reason) {
-    ei_x_encode_tuple_header(response, 2);
-    ei_x_encode_atom(response, "error");
-    ei_x_encode_atom(response, reason);
+/* Replace an idle child that outgrew -max-rss. Its modules are replayed
+ * into the new one like after a crash. */
+static int recycle_maude(MaudeProcess *inst, unsigned long long rss) {
+    fprintf(stderr, "Recycling Maude[%d] at %llu bytes resident\n", inst->id, rss);
+    bridge_stats.recycled++;
+    return replace_maude(inst);
 }
 
-/* Handle incoming Erlang message */
-static void handle_message(int fd, erlang_msg *emsg, ei_x_buff *buf) {
-    int index = 0;
-    int version;
-    char cmd[256];
-    int arity;
+static int replace_maude(MaudeProcess *inst) {
+    kill(inst->pid, SIGKILL);
+    close_maude(inst);
 
-    ei_x_buff response;
-    ei_x_new_with_version(&response);
+    if (boot_maude(inst) < 0) {
+        fprintf(stderr, "Maude[%d] failed to restart\n", inst->id);
+        return -1;
+    }
+    return 0;
+}
 
-    /* Decode version */
-    if (ei_decode_version(buf->buff, &index, &version) < 0) {
-        encode_error(&response, "decode_version_failed");
-        goto send_response;
+/* Start a message in the shared output buffer. Room for payload bytes of
+ * binary data is made up front, so encoding a reply never reallocates. */
+static ei_x_buff *begin_response(size_t payload) {
+    size_t needed = payload + MAX_REF_LEN + RESPONSE_OVERHEAD;
+
+    if (out_buf.buff == NULL || (size_t)out_buf.buffsz < needed) {
+        size_t cap = needed < INITIAL_RESPONSE ? INITIAL_RESPONSE : needed;
+        char *grown = realloc(out_buf.buff, cap);
+        /* On failure keep the old buffer; the encoders grow it themselves */
+        if (grown) {
+            out_buf.buff = grown;
+            out_buf.buffsz = (int)cap;
+        }
     }
 
-    /* Decode tuple header */
-    if (ei_decode_tuple_header(buf->buff, &index, &arity) < 0) {
-        /* Not a tuple, check if it's just an atom (like :ping) */
-        index = 0;
-        ei_decode_version(buf->buff, &index, &version);
+    out_buf.index = 0;
+    ei_x_encode_version(&out_buf);
+    return &out_buf;
+}
 
-        if (ei_decode_atom(buf->buff, &index, cmd) == 0) {
-            if (strcmp(cmd, "ping") == 0) {
-                ei_x_encode_atom(&response, "pong");
-                goto send_response;
-            } else if (strcmp(cmd, "stop") == 0) {
-                running = 0;
-                ei_x_encode_atom(&response, "ok");
-                goto send_response;
-            }
+/* Encode the head of a reply, inserting the caller's Ref for tagged requests:
+ * {Tag, ...} or {Tag, Ref, ...} */
+static void encode_reply_head(ei_x_buff *response, const Reply *reply, const char *tag, int arity) {
+    if (reply->ref_len > 0) {
+        ei_x_encode_tuple_header(response, arity + 1);
+        ei_x_encode_atom(response, tag);
+        ei_x_append_buf(response, reply->ref, reply->ref_len);
+    } else {
+        ei_x_encode_tuple_header(response, arity);
+        ei_x_encode_atom(response, tag);
+    }
+}
+
+/* Write a length-prefixed frame to a socket transport.
+ * Blocks while the socket is full, like ei_send does. */
+static int send_frame(const char *data, size_t len) {
+    unsigned char header[FRAME_HEADER] = {
+        (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+        (unsigned char)(len >> 8), (unsigned char)len
+    };
+    struct iovec iov[2] = {{header, FRAME_HEADER}, {(void *)data, len}};
+    struct iovec *next = iov;
+    int count = 2;
+
+    while (count > 0) {
+        ssize_t written = writev(erl_fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
         }
 
-        encode_error(&response, "invalid_message_format");
-        goto send_response;
+        while (count > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + written;
+            next->iov_len -= written;
+        }
     }
+    return 0;
+}
 
-    /* Decode command atom */
-    if (ei_decode_atom(buf->buff, &index, cmd) < 0) {
-        encode_error(&response, "decode_command_failed");
-        goto send_response;
+/* Send the message built by begin_response */
+static void send_response(erlang_pid *to) {
+    int failed = socket_transport
+        ? send_frame(out_buf.buff, (size_t)out_buf.index) < 0
+        : ei_send(erl_fd, to, out_buf.buff, out_buf.index) < 0;
+
+    if (failed) {
+        fprintf(stderr, "Failed to send reply (errno: %d)\n",
+                socket_transport ? errno : erl_errno);
+    } else {
+        bridge_stats.bytes_out += (unsigned long long)out_buf.index;
     }
 
-    if (strcmp(cmd, "execute") == 0) {
-        /* Decode command binary */
-        int type, size;
-        if (ei_get_type(buf->buff, &index, &type, &size) < 0) {
-            encode_error(&response, "get_type_failed");
-            goto send_response;
+    /* Hand memory of an unusually large reply back to the system */
+    if (out_buf.buffsz > SHRINK_THRESHOLD) {
+        char *shrunk = realloc(out_buf.buff, INITIAL_RESPONSE);
+        if (shrunk) {
+            out_buf.buff = shrunk;
+            out_buf.buffsz = INITIAL_RESPONSE;
         }
+    }
+}
 
-        char *command = malloc(size + 1);
-        if (!command) {
-            encode_error(&response, "malloc_failed");
-            goto send_response;
-        }
+/* Answer a request that failed before it reached any instance */
+static void reply_error(Reply *reply, const char *reason) {
+    ei_x_buff *response = begin_response(0);
+    encode_reply_head(response, reply, "error", 2);
+    ei_x_encode_atom(response, reason);
+    send_response(&reply->from);
+}
 
-        long bin_size;
-        if (ei_decode_binary(buf->buff, &index, command, &bin_size) < 0) {
-            free(command);
-            encode_error(&response, "decode_binary_failed");
-            goto send_response;
-        }
-        command[bin_size] = '\0';
+/* Bytes of binary data a final reply will carry */
+static size_t reply_payload(const Reply *reply, int out_len) {
+    if (reply->kind != REQ_BATCH) {
+        return reply->error_output ? (size_t)reply->error_len : (size_t)out_len;
+    }
 
-        /* Send command to Maude */
-        if (send_command(command, bin_size) < 0) {
-            free(command);
-            encode_error(&response, "send_failed");
-            goto send_response;
-        }
-        free(command);
+    /* Each element costs its binary plus at most a small error tuple */
+    size_t total = 0;
+    for (int i = 0; i < reply->result_count; i++) {
+        total += reply->results[i].len + RESPONSE_OVERHEAD;
+    }
+    return total;
+}
 
-        /* Read response (30 second timeout) */
-        char output[BUFSIZE];
-        int out_len = read_until_prompt(output, BUFSIZE, 30000);
+/* [Output | {error, Reason}] in command order */
+static void encode_batch_results(ei_x_buff *response, const Reply *reply) {
+    if (reply->result_count > 0) {
+        ei_x_encode_list_header(response, reply->result_count);
+    }
 
-        if (out_len < 0) {
-            encode_error(&response, "read_failed");
+    for (int i = 0; i < reply->result_count; i++) {
+        const BatchResult *result = &reply->results[i];
+        if (result->reason != NULL) {
+            ei_x_encode_tuple_header(response, 2);
+            ei_x_encode_atom(response, "error");
+            ei_x_encode_atom(response, result->reason);
         } else {
-            encode_ok(&response, output, out_len);
+            ei_x_encode_binary(response, result->output ? result->output : "", result->len);
         }
+    }
+    ei_x_encode_empty_list(response);
+}
 
-    } else if (strcmp(cmd, "ping") == 0) {
-        ei_x_encode_atom(&response, "pong");
+/* Statistics from a "states: N  rewrites: N in Nms cpu ..." line, -1 if absent */
+typedef struct {
+    long long states;
+    long long rewrites;
+    long long time_ms;
+    long long real_ms;
+} ParseStats;
+
+/* Return the next line of [*pos, end) without its line terminator */
+static int next_line(const char **pos, const char *end, const char **line, size_t *len) {
+    if (*pos >= end) return 0;
+
+    const char *nl = memchr(*pos, '\n', (size_t)(end - *pos));
+    const char *stop = nl ? nl : end;
+    *line = *pos;
+    *len = (size_t)(stop - *pos);
+    if (*len > 0 && (*line)[*len - 1] == '\r') (*len)--;
+    *pos = nl ? nl + 1 : end;
+    return 1;
+}
 
-    } else if (strcmp(cmd, "stop") == 0) {
-        running = 0;
-        ei_x_encode_atom(&response, "ok");
+static int line_starts_with(const char *line, size_t len, const char *prefix) {
+    size_t plen = strlen(prefix);
+    return len >= plen && memcmp(line, prefix, plen) == 0;
+}
 
-    } else if (strcmp(cmd, "load_file") == 0) {
-        /* Decode file path */
-        int type, size;
-        ei_get_type(buf->buff, &index, &type, &size);
+/* Offset of needle within the line, or -1 */
+static long line_find(const char *line, size_t len, const char *needle) {
+    size_t nlen = strlen(needle);
+    for (size_t i = 0; nlen <= len && i <= len - nlen; i++) {
+        if (memcmp(line + i, needle, nlen) == 0) return (long)i;
+    }
+    return -1;
+}
 
-        char *path = malloc(size + 16);  /* Extra for "load " prefix */
-        if (!path) {
-            encode_error(&response, "malloc_failed");
-            goto send_response;
-        }
+/* Decimal number right after needle in the line, or -1 */
+static long long line_number_after(const char *line, size_t len, const char *needle) {
+    long at = line_find(line, len, needle);
+    if (at < 0) return -1;
 
-        strcpy(path, "load ");
-        long bin_size;
-        if (ei_decode_binary(buf->buff, &index, path + 5, &bin_size) < 0) {
-            free(path);
-            encode_error(&response, "decode_path_failed");
-            goto send_response;
-        }
-        path[5 + bin_size] = '\0';
+    size_t i = (size_t)at + strlen(needle);
+    long long value = -1;
+    while (i < len && line[i] >= '0' && line[i] <= '9') {
+        value = (value < 0 ? 0 : value * 10) + (line[i++] - '0');
+    }
+    return value;
+}
 
-        /* Send load command to Maude */
-        if (send_command(path, strlen(path)) < 0) {
-            free(path);
-            encode_error(&response, "load_send_failed");
-            goto send_response;
-        }
-        free(path);
+static void parse_stats_line(const char *line, size_t len, ParseStats *stats) {
+    long long states = line_number_after(line, len, "states: ");
+    long long rewrites = line_number_after(line, len, "rewrites: ");
+    long long time_ms = line_number_after(line, len, " in ");
+    long long real_ms = line_number_after(line, len, "cpu (");
 
-        /* Read response */
-        char output[BUFSIZE];
-        int out_len = read_until_prompt(output, BUFSIZE, 30000);
+    if (states >= 0) stats->states = states;
+    if (rewrites >= 0) stats->rewrites = rewrites;
+    if (time_ms >= 0) stats->time_ms = time_ms;
+    if (real_ms >= 0) stats->real_ms = real_ms;
+}
 
-        if (out_len < 0) {
-            encode_error(&response, "load_read_failed");
-        } else {
-            /* Check for errors in output */
-            if (strstr(output, "Error") != NULL || strstr(output, "Warning") != NULL) {
-                ei_x_encode_tuple_header(&response, 2);
-                ei_x_encode_atom(&response, "error");
-                ei_x_encode_binary(&response, output, out_len);
+static int is_stats_line(const char *line, size_t len) {
+    return line_starts_with(line, len, "states: ") || line_starts_with(line, len, "rewrites: ");
+}
+
+static void trim_span(const char **data, size_t *len) {
+    while (*len > 0 && ((*data)[0] == ' ' || (*data)[0] == '\t' || (*data)[0] == '\n' ||
+                        (*data)[0] == '\r')) {
+        (*data)++;
+        (*len)--;
+    }
+    while (*len > 0 && ((*data)[*len - 1] == ' ' || (*data)[*len - 1] == '\t' ||
+                        (*data)[*len - 1] == '\n' || (*data)[*len - 1] == '\r')) {
+        (*len)--;
+    }
+}
+
+static void encode_stats(ei_x_buff *response, const ParseStats *stats) {
+    int count = (stats->states >= 0) + (stats->rewrites >= 0) + (stats->time_ms >= 0) +
+                (stats->real_ms >= 0);
+
+    ei_x_encode_map_header(response, count);
+    if (stats->states >= 0) {
+        ei_x_encode_atom(response, "states");
+        ei_x_encode_longlong(response, stats->states);
+    }
+    if (stats->rewrites >= 0) {
+        ei_x_encode_atom(response, "rewrites");
+        ei_x_encode_longlong(response, stats->rewrites);
+    }
+    if (stats->time_ms >= 0) {
+        ei_x_encode_atom(response, "time_ms");
+        ei_x_encode_longlong(response, stats->time_ms);
+    }
+    if (stats->real_ms >= 0) {
+        ei_x_encode_atom(response, "real_ms");
+        ei_x_encode_longlong(response, stats->real_ms);
+    }
+}
+
+/* Var --> Value bindings of the solution block starting at pos; encoded
+ * when response is set, counted otherwise */
+static int encode_bindings(ei_x_buff *response, const char *pos, const char *end) {
+    const char *line;
+    size_t len;
+    int count = 0;
+
+    while (next_line(&pos, end, &line, &len) && !line_starts_with(line, len, "Solution ") &&
+           !line_starts_with(line, len, "No ")) {
+        long arrow = line_find(line, len, " --> ");
+        if (arrow < 0) continue;
+
+        if (response) {
+            const char *var = line, *value = line + arrow + 5;
+            size_t var_len = (size_t)arrow, value_len = len - (size_t)arrow - 5;
+            trim_span(&var, &var_len);
+            trim_span(&value, &value_len);
+
+            ei_x_encode_tuple_header(response, 2);
+            ei_x_encode_binary(response, var, (long)var_len);
+            ei_x_encode_binary(response, value, (long)value_len);
+        }
+        count++;
+    }
+    return count;
+}
+
+/* {search, [{N, State, Bindings}], Stats} for output with solution blocks */
+static void encode_search(ei_x_buff *response, const char *output, const char *end, int solutions) {
+    ParseStats stats = {-1, -1, -1, -1};
+    const char *pos = output, *line;
+    size_t len;
+
+    ei_x_encode_tuple_header(response, 3);
+    ei_x_encode_atom(response, "search");
+    if (solutions > 0) ei_x_encode_list_header(response, solutions);
+
+    while (next_line(&pos, end, &line, &len)) {
+        if (is_stats_line(line, len)) {
+            /* The last statistics line covers the whole search */
+            parse_stats_line(line, len, &stats);
+        } else if (line_starts_with(line, len, "Solution ")) {
+            long long number = line_number_after(line, len, "Solution ");
+            long long state = line_number_after(line, len, "(state ");
+
+            ei_x_encode_tuple_header(response, 3);
+            ei_x_encode_longlong(response, number);
+            if (state >= 0) {
+                ei_x_encode_longlong(response, state);
             } else {
-                ei_x_encode_atom(&response, "ok");
+                ei_x_encode_atom(response, "undefined");
             }
-        }
 
-    } else {
-        encode_error(&response, "unknown_command");
+            int bindings = encode_bindings(NULL, pos, end);
+            if (bindings > 0) ei_x_encode_list_header(response, bindings);
+            encode_bindings(response, pos, end);
+            ei_x_encode_empty_list(response);
+        }
     }
 
-send_response:
-    ei_send(fd, &emsg->from, response.buff, response.index);
-    ei_x_free(&response);
+    ei_x_encode_empty_list(response);
+    encode_stats(response, &stats);
 }
 
-/* Connect to Erlang node with retry logic and exponential backoff */
-static int connect_with_retry(ei_cnode *ec, char *nodename, int max_retries) {
-    int fd;
-    int delay_ms = 100;  /* Start with 100ms */
-    
-    for (int attempt = 1; attempt <= max_retries; attempt++) {
-        fd = ei_connect_tmo(ec, nodename, 5000);  /* 5 second timeout per attempt */
-        if (fd >= 0) {
-            return fd;  /* Success */
+/* Tokenize the output of an execute_parsed request into Erlang terms */
+static void encode_parsed(ei_x_buff *response, const char *output, int out_len) {
+    const char *end = output + out_len, *pos = output, *line;
+    const char *result = NULL;
+    size_t len, result_len = 0;
+    ParseStats stats = {-1, -1, -1, -1};
+    int solutions = 0, searched = 0;
+
+    while (next_line(&pos, end, &line, &len)) {
+        if (line_starts_with(line, len, "Solution ")) {
+            solutions++;
+        } else if (line_starts_with(line, len, "No solution") ||
+                   line_starts_with(line, len, "No more solutions")) {
+            searched = 1;
+        } else if (is_stats_line(line, len)) {
+            parse_stats_line(line, len, &stats);
+        } else if (result == NULL && line_starts_with(line, len, "result ")) {
+            /* The term runs to the end of the output and may span lines */
+            result = line;
+            result_len = (size_t)(end - line);
         }
-        
-        fprintf(stderr, "Connection attempt %d/%d failed (errno: %d), retrying in %dms...\n",
-                attempt, max_retries, erl_errno, delay_ms);
-        
-        usleep(delay_ms * 1000);  /* Convert to microseconds */
-        delay_ms *= 2;  /* Exponential backoff */
-        if (delay_ms > 2000) delay_ms = 2000;  /* Cap at 2 seconds */
     }
-    
-    return -1;  /* All retries exhausted */
-}
 
-/* Main entry point */
-int main(int argc, char **argv) {
-    if (argc < 5) {
-        fprintf(stderr, "Usage: %s <node_name> <cookie> <maude_path> <erlang_node>\n", argv[0]);
-        fprintf(stderr, "\n");
-        fprintf(stderr, "Arguments:\n");
-        fprintf(stderr, "  node_name    - Name for this C-Node (e.g., maude_bridge_1)\n");
-        fprintf(stderr, "  cookie       - Erlang distribution cookie\n");
-        fprintf(stderr, "  maude_path   - Path to Maude executable\n");
-        fprintf(stderr, "  erlang_node  - Full Erlang node name to connect to\n");
-        return 1;
+    if (solutions > 0 || searched) {
+        encode_search(response, output, end, solutions);
+        return;
     }
 
-    char *node_name = argv[1];
-    char *cookie = argv[2];
-    char *maude_path = argv[3];
-    char *erlang_node = argv[4];
+    long colon = result ? line_find(result, result_len, ": ") : -1;
+    if (colon < 0 || strstr(output, "Error:") != NULL || strstr(output, "Warning:") != NULL) {
+        ei_x_encode_tuple_header(response, 2);
+        ei_x_encode_atom(response, "text");
+        ei_x_encode_binary(response, output, out_len);
+        return;
+    }
 
-    /* Setup signal handlers */
-    signal(SIGTERM, handle_signal);
-    signal(SIGINT, handle_signal);
-    signal(SIGPIPE, SIG_IGN);
+    const char *sort = result + 7, *term = result + colon + 2;
+    size_t sort_len = (size_t)colon - 7, term_len = result_len - (size_t)colon - 2;
+    trim_span(&sort, &sort_len);
+    trim_span(&term, &term_len);
 
-    /* Initialize ei library (required since OTP 21) */
-    if (ei_init() != 0) {
-        fprintf(stderr, "Failed to initialize ei library\n");
-        return 1;
+    ei_x_encode_tuple_header(response, 4);
+    ei_x_encode_atom(response, "result");
+    ei_x_encode_binary(response, sort, (long)sort_len);
+    ei_x_encode_binary(response, term, (long)term_len);
+    encode_stats(response, &stats);
+}
+
+/* Send the final answer once every part of a request has finished */
+static void finish_reply(Reply *reply, const char *output, int out_len) {
+    if (reply->replay) {
+        if (reply->error_reason || reply->error_output) {
+            fprintf(stderr, "Module replay failed: %s: %.*s\n", reply->module,
+                    reply->error_output ? reply->error_len : 0,
+                    reply->error_output ? reply->error_output : "");
+        }
+        return;
+    }
+    if (reply->cancelled) {
+        return;
+    }
+
+    long long started = now_us();
+    ei_x_buff *response = begin_response(reply_payload(reply, out_len));
+
+    if (reply->kind == REQ_BATCH) {
+        encode_reply_head(response, reply, "ok", 2);
+        encode_batch_results(response, reply);
+    } else if (reply->error_reason != NULL) {
+        encode_reply_head(response, reply, "error", 2);
+        ei_x_encode_atom(response, reply->error_reason);
+    } else if (reply->kind == REQ_STREAM) {
+        encode_reply_head(response, reply, "done", 1);
+    } else if (reply->kind == REQ_EXECUTE) {
+        encode_reply_head(response, reply, "ok", 2);
+        ei_x_encode_binary(response, output, out_len);
+    } else if (reply->kind == REQ_PARSED) {
+        encode_reply_head(response, reply, "ok", 2);
+        encode_parsed(response, output, out_len);
+    } else if (reply->error_output != NULL) {
+        encode_reply_head(response, reply, "error", 2);
+        ei_x_encode_binary(response, reply->error_output, reply->error_len);
+    } else if (reply->ref_len > 0) {
+        encode_reply_head(response, reply, "ok", 1);
+    } else {
+        ei_x_encode_atom(response, "ok");
+    }
+
+    hist_record(&bridge_stats.encode, now_us() - started);
+    send_response(&reply->from);
+}
+
+static Request *new_request(Reply *reply) {
+    Request *req = requests_cached > 0 ? request_cache[--requests_cached] : malloc(sizeof(Request));
+    if (!req) return NULL;
+
+    req->next = NULL;
+    req->reply = reply;
+    req->command = NULL;
+    req->command_len = 0;
+    req->index = 0;
+    return req;
+}
+
+/* Create a reply target for a decoded request, copying sender and Ref */
+static Reply *new_reply(const Reply *direct, RequestKind kind, int parts) {
+    Reply *reply = replies_cached > 0 ? reply_cache[--replies_cached] : malloc(sizeof(Reply));
+    if (!reply) return NULL;
+
+    /* Clear everything but the Ref bytes, which are overwritten below */
+    memset(reply, 0, offsetof(Reply, ref));
+    memset(&reply->ref_len, 0, sizeof(Reply) - offsetof(Reply, ref_len));
+    reply->from = direct->from;
+    memcpy(reply->ref, direct->ref, direct->ref_len);
+    reply->ref_len = direct->ref_len;
+    reply->kind = kind;
+    reply->pending = parts;
+    reply->timeout_ms = direct->timeout_ms;
+    return reply;
+}
+
+/* Keep a copy of the command for a request that has to wait */
+static int request_copy_command(Request *req, const char *cmd, size_t len) {
+    req->command = len < INLINE_COMMAND ? req->inline_command : malloc(len + 1);
+    if (!req->command) return -1;
+
+    memcpy(req->command, cmd, len);
+    req->command[len] = '\0';
+    req->command_len = len;
+    return 0;
+}
+
+static void release_command(Request *req) {
+    if (req->command != req->inline_command) free(req->command);
+    req->command = NULL;
+}
+
+static void free_request(Request *req) {
+    release_command(req);
+    if (requests_cached < FREELIST_MAX) {
+        request_cache[requests_cached++] = req;
+    } else {
+        free(req);
+    }
+}
+
+static void free_reply(Reply *reply) {
+    free(reply->error_output);
+    free(reply->module);
+    for (int i = 0; i < reply->result_count; i++) {
+        free(reply->results[i].output);
+    }
+    free(reply->results);
+    if (replies_cached < FREELIST_MAX) {
+        reply_cache[replies_cached++] = reply;
+    } else {
+        free(reply);
+    }
+}
+
+static void store_batch_result(BatchResult *result, const char *reason, const char *output, int out_len) {
+    if (reason == NULL) {
+        result->output = malloc(out_len > 0 ? out_len : 1);
+        if (result->output) {
+            memcpy(result->output, output, out_len);
+            result->len = out_len;
+            return;
+        }
+        reason = "malloc_failed";
+    }
+    result->reason = reason;
+}
+
+/* Add a file every child loaded to the module set, taking its command.
+ * A file loaded again moves to the end: replays must end with the module
+ * versions the children had at last. */
+static void remember_module(Reply *reply) {
+    char *module = reply->module;
+    if (module == NULL) return;
+
+    for (int i = 0; i < module_count; i++) {
+        if (strcmp(module_set[i], module) == 0) {
+            free(module_set[i]);
+            memmove(&module_set[i], &module_set[i + 1], (size_t)(module_count - i - 1) * sizeof(char *));
+            module_count--;
+            break;
+        }
+    }
+    if (module_count == MAX_MODULES) {
+        fprintf(stderr, "Module set full, %s will not survive restarts\n", module);
+        return;
+    }
+
+    module_set[module_count++] = module;
+    reply->module = NULL;
+}
+
+/* Record the outcome of one part of a request and reply when it was the last */
+static void complete_part(Request *req, const char *reason, const char *output, int out_len) {
+    Reply *reply = req->reply;
+
+    if (reply->kind == REQ_BATCH && !reply->cancelled) {
+        /* Batch errors are reported per command, not for the whole batch */
+        store_batch_result(&reply->results[req->index], reason, output, out_len);
+    } else if (reason != NULL && reply->error_reason == NULL) {
+        reply->error_reason = reason;
+    }
+
+    /* Check load output for errors, keeping the first one seen */
+    if (reason == NULL && reply->kind == REQ_LOAD && reply->error_output == NULL &&
+        (strstr(output, "Error") != NULL || strstr(output, "Warning") != NULL)) {
+        reply->error_output = malloc(out_len > 0 ? out_len : 1);
+        if (reply->error_output) {
+            memcpy(reply->error_output, output, out_len);
+            reply->error_len = out_len;
+        }
+    }
+
+    if (--reply->pending == 0) {
+        finish_reply(reply, output, out_len);
+        if (reply->kind == REQ_LOAD && !reply->replay && reply->error_reason == NULL &&
+            reply->error_output == NULL) {
+            remember_module(reply);
+        }
+        free_reply(reply);
+    }
+    free_request(req);
+}
+
+/* Whether a stream is waiting for its consumer to acknowledge chunks */
+static int stream_blocked(const MaudeProcess *inst) {
+    const Reply *reply = inst->current ? inst->current->reply : NULL;
+    return reply && reply->kind == REQ_STREAM && !reply->cancelled &&
+           reply->unacked >= STREAM_WINDOW;
+}
+
+/* Find where the last complete solution ends: the start of the final
+ * "Solution N" line in the buffer, or 0 when there is none past offset 0 */
+static size_t last_solution_boundary(const MaudeProcess *inst) {
+    const char *buf = inst->buffer;
+    size_t pos = inst->buffer_len;
+
+    while (pos > 1) {
+        pos--;
+        if (buf[pos - 1] == '\n' && inst->buffer_len - pos >= SOLUTION_MARK_LEN &&
+            memcmp(buf + pos, SOLUTION_MARK, SOLUTION_MARK_LEN) == 0) {
+            return pos;
+        }
+    }
+    return 0;
+}
+
+/* Pick how much of the buffer can go out as a chunk. Output is cut before
+ * the last "Solution N" line so every solution but the one still being
+ * printed is complete. Long output without solutions is cut after its last
+ * full line, keeping a possibly split prompt in the buffer. */
+static size_t stream_cut(const MaudeProcess *inst) {
+    size_t cut = last_solution_boundary(inst);
+    if (cut > 0 || inst->buffer_len < STREAM_CHUNK) return cut;
+
+    for (cut = inst->buffer_len; cut > 0; cut--) {
+        if (inst->buffer[cut - 1] == '\n') return cut;
+    }
+    return inst->buffer_len - PROMPT_LEN;
+}
+
+/* Send buffered output of a streamed request as a {chunk, Ref, Bin}.
+ * The final flush (prompt seen) sends everything that is left. Leading and
+ * trailing whitespace of the whole response is trimmed like take_output,
+ * so the chunks add up to what execute would have returned. */
+static void stream_flush(MaudeProcess *inst, Reply *reply, int final) {
+    size_t cut = final ? inst->buffer_len : stream_cut(inst);
+    if (cut == 0) return;
+
+    const char *start = inst->buffer;
+    size_t len = cut;
+
+    if (!reply->sent_any) {
+        while (len > 0 && (*start == '\n' || *start == '\r' || *start == ' ')) {
+            start++;
+            len--;
+        }
+    }
+    if (final) {
+        while (len > 0 && (start[len-1] == '\n' || start[len-1] == '\r' || start[len-1] == ' ')) {
+            len--;
+        }
+    }
+
+    if (len > 0 && !reply->cancelled) {
+        ei_x_buff *response = begin_response(len);
+        encode_reply_head(response, reply, "chunk", 2);
+        ei_x_encode_binary(response, start, (long)len);
+        send_response(&reply->from);
+
+        reply->sent_any = 1;
+        reply->unacked++;
+        /* Streams time out when Maude goes quiet, not on total duration */
+        inst->deadline_ms = now_ms() + reply->timeout_ms;
+    }
+
+    if (!final) consume_buffer(inst, cut);
+}
+
+/* Instance running the stream with the caller's Ref */
+static MaudeProcess *find_stream(const Reply *direct) {
+    for (int i = 0; i < num_instances; i++) {
+        Request *req = instances[i].current;
+        if (req && req->reply->kind == REQ_STREAM && req->reply->ref_len == direct->ref_len &&
+            memcmp(req->reply->ref, direct->ref, direct->ref_len) == 0) {
+            return &instances[i];
+        }
+    }
+    return NULL;
+}
+
+/* Write a request to an idle instance and start its deadline */
+static void dispatch_command(MaudeProcess *inst, Request *req, const char *cmd, size_t len) {
+    reset_buffer(inst);
+
+    if (send_command(inst, cmd, len) < 0) {
+        complete_part(req, req->reply->kind == REQ_LOAD ? "load_send_failed" : "send_failed", "", 0);
+        return;
+    }
+
+    inst->current = req;
+    inst->deadline_ms = now_ms() + req->reply->timeout_ms;
+    req->dispatched_us = now_us();
+    req->read_us = 0;
+}
+
+/* Start a queued request, whose command was copied when it was queued */
+static void dispatch(MaudeProcess *inst, Request *req) {
+    char *command = req->command;
+    req->command = NULL;
+
+    dispatch_command(inst, req, command, req->command_len);
+    if (command != req->inline_command) free(command);
+}
+
+/* Start the next request if the instance is idle.
+ * Work pinned to the instance goes first, then the shared queue. */
+static void schedule_instance(MaudeProcess *inst) {
+    while (inst->current == NULL && !inst->starting && !inst->resyncing) {
+        Request *req;
+
+        if (inst->queue_head != NULL) {
+            req = inst->queue_head;
+            inst->queue_head = req->next;
+            if (inst->queue_head == NULL) inst->queue_tail = NULL;
+        } else if (pending_head != NULL) {
+            req = pending_head;
+            pending_head = req->next;
+            if (pending_head == NULL) pending_tail = NULL;
+            pending_count--;
+        } else {
+            return;
+        }
+
+        req->next = NULL;
+        dispatch(inst, req);
+    }
+}
+
+static void enqueue(MaudeProcess *inst, Request *req) {
+    req->next = NULL;
+    if (inst->queue_tail) {
+        inst->queue_tail->next = req;
+    } else {
+        inst->queue_head = req;
+    }
+    inst->queue_tail = req;
+    schedule_instance(inst);
+}
+
+static MaudeProcess *find_idle_instance(void) {
+    for (int i = 0; i < num_instances; i++) {
+        if (instances[i].current == NULL && !instances[i].starting &&
+            !instances[i].resyncing && instances[i].queue_head == NULL) {
+            return &instances[i];
+        }
+    }
+    return NULL;
+}
+
+/* Finish the running request of an instance whose output is complete */
+static void instance_done(MaudeProcess *inst) {
+    Request *req = inst->current;
+    int load = req->reply->kind == REQ_LOAD;
+    inst->current = NULL;
+
+    hist_record(&bridge_stats.compute, now_us() - req->dispatched_us - req->read_us);
+    hist_record(&bridge_stats.read, req->read_us);
+
+    if (inst->overflowed) {
+        complete_part(req, "output_too_large", "", 0);
+    } else if (req->reply->kind == REQ_STREAM) {
+        stream_flush(inst, req->reply, 1);
+        complete_part(req, NULL, "", 0);
+    } else {
+        int out_len;
+        char *output = take_output(inst, &out_len);
+        complete_part(req, NULL, output, out_len);
+    }
+
+    /* Loads are left alone: the module set only learns a module once every
+     * child loaded it, so a child recycled before that would miss it */
+    if (max_rss > 0 && !load) {
+        unsigned long long rss = instance_rss(inst);
+        if (rss > max_rss && recycle_maude(inst, rss) < 0) {
+            running = 0;
+            return;
+        }
+    }
+
+    schedule_instance(inst);
+}
+
+/* Fail the running request of an instance and bring up a fresh Maude */
+static void instance_failed(MaudeProcess *inst, const char *reason) {
+    Request *req = inst->current;
+    inst->current = NULL;
+
+    if (req != NULL) {
+        complete_part(req, reason, "", 0);
+    }
+
+    if (restart_maude(inst) < 0) {
+        running = 0;
+        return;
+    }
+
+    schedule_instance(inst);
+}
+
+/* Stop whatever the child is computing without losing its modules.
+ * SIGINT drops Maude into its debugger (or does nothing if the command just
+ * finished); "abort ." returns to the top level either way, and the answer
+ * to a parse of a fresh Qid marks where stale output ends. The running
+ * request, if any, is completed with reason (or silently when NULL). */
+static void interrupt_instance(MaudeProcess *inst, const char *reason) {
+    Request *req = inst->current;
+    inst->current = NULL;
+
+    if (req != NULL) {
+        complete_part(req, reason, "", 0);
+    }
+
+    char sync[96];
+    inst->sync_seq++;
+    snprintf(inst->sync_token, sizeof(inst->sync_token), "'exmaude-sync-%u", inst->sync_seq);
+    int len = snprintf(sync, sizeof(sync), "abort .\nparse in QID : %s .", inst->sync_token);
+
+    if (inst->pid > 0) kill(inst->pid, SIGINT);
+    reset_buffer(inst);
+
+    if (send_command(inst, sync, (size_t)len) < 0) {
+        instance_failed(inst, NULL);
+        return;
+    }
+
+    inst->resyncing = 1;
+    inst->sync_seen = 0;
+    inst->deadline_ms = now_ms() + RESYNC_TIMEOUT_MS;
+}
+
+/* Queue the module set on a child that just came up, ahead of any other
+ * pinned work, so it is loaded before the child serves requests */
+static void replay_modules(MaudeProcess *inst) {
+    Reply none = {0};
+    none.timeout_ms = REQUEST_TIMEOUT_MS;
+
+    /* Drop what is left of a replay the previous child did not finish */
+    Request **link = &inst->queue_head;
+    inst->queue_tail = NULL;
+    while (*link != NULL) {
+        Request *req = *link;
+        if (req->reply->replay) {
+            *link = req->next;
+            free_reply(req->reply);
+            free_request(req);
+        } else {
+            inst->queue_tail = req;
+            link = &req->next;
+        }
+    }
+
+    for (int i = module_count - 1; i >= 0; i--) {
+        size_t len = strlen(module_set[i]);
+        Reply *reply = new_reply(&none, REQ_LOAD, 1);
+        Request *req = reply ? new_request(reply) : NULL;
+        char *module = req ? strdup(module_set[i]) : NULL;
+
+        if (module == NULL || request_copy_command(req, module, len) < 0) {
+            fprintf(stderr, "Maude[%d] cannot replay %s: out of memory\n", inst->id, module_set[i]);
+            free(module);
+            if (req) free_request(req);
+            if (reply) free_reply(reply);
+            continue;
+        }
+        reply->replay = 1;
+        reply->module = module;
+
+        req->next = inst->queue_head;
+        inst->queue_head = req;
+        if (inst->queue_tail == NULL) inst->queue_tail = req;
+    }
+}
+
+/* A child that never came up leaves the bridge without a usable
+ * instance, so shut down and let the worker start everything again */
+static void instance_start_failed(MaudeProcess *inst, const char *what) {
+    fprintf(stderr, "Maude[%d] failed to start: %s\n", inst->id, what);
+    fprintf(stderr, "Partial output received: '%s'\n", inst->buffer ? inst->buffer : "");
+    running = 0;
+}
+
+/* Handle readable output from a busy, starting or resyncing instance */
+static void service_instance(MaudeProcess *inst) {
+    if (inst->resyncing) {
+        int status = resync_read(inst);
+        if (status == 1) {
+            fprintf(stderr, "Maude[%d] resynchronized after interrupt\n", inst->id);
+            inst->resyncing = 0;
+            reset_buffer(inst);
+            schedule_instance(inst);
+        } else if (status < 0) {
+            inst->resyncing = 0;
+            instance_failed(inst, NULL);
+        }
+        return;
+    }
+
+    long long read_started = now_us();
+    int status = instance_read(inst);
+    if (inst->current) inst->current->read_us += now_us() - read_started;
+
+    if (inst->starting) {
+        if (status == 1) {
+            int out_len;
+            char *output = take_output(inst, &out_len);
+            fprintf(stderr, "Maude[%d] ready (startup output %d bytes): '%s'\n",
+                    inst->id, out_len, output);
+            inst->starting = 0;
+            replay_modules(inst);
+            schedule_instance(inst);
+        } else if (status < 0) {
+            instance_start_failed(inst, status == -3 ? "process closed (EOF)" : "read error");
+        }
+        return;
+    }
+
+    if (status == 1) {
+        instance_done(inst);
+    } else if (status == 0 && inst->current->reply->kind == REQ_STREAM) {
+        stream_flush(inst, inst->current->reply, 0);
+    } else if (status < 0) {
+        const char *reason = "read_failed";
+        if (status == -4) {
+            reason = "malloc_failed";
+        } else if (inst->current && inst->current->reply->kind == REQ_LOAD) {
+            reason = "load_read_failed";
+        }
+        instance_failed(inst, reason);
+    }
+}
+
+/* Decode a binary argument, returning a pointer into the message buffer */
+static int decode_binary_arg(ei_x_buff *buf, int *index, const char **data, long *len) {
+    int type, size;
+    if (ei_get_type(buf->buff, index, &type, &size) < 0 || type != ERL_BINARY_EXT) {
+        return -1;
+    }
+
+    /* Binary layout: tag byte, 4 byte length, payload */
+    *data = buf->buff + *index + 5;
+    if (ei_decode_binary(buf->buff, index, NULL, len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Decode the optional trailing timeout of {Cmd, Ref, Arg, TimeoutMs} */
+static int decode_timeout_arg(ei_x_buff *buf, int *index, int arity, Reply *direct) {
+    long timeout;
+    if (arity < 4) return 0;
+
+    if (ei_decode_long(buf->buff, index, &timeout) < 0 || timeout <= 0) {
+        return -1;
+    }
+    direct->timeout_ms = timeout < MAX_TIMEOUT_MS ? timeout : MAX_TIMEOUT_MS;
+    return 0;
+}
+
+static void handle_execute(Reply *direct, RequestKind kind, const char *cmd, long len) {
+    MaudeProcess *inst = find_idle_instance();
+    if (inst == NULL && pending_count >= max_queued) {
+        bridge_stats.overloaded++;
+        reply_error(direct, "overloaded");
+        return;
+    }
+
+    Reply *reply = new_reply(direct, kind, 1);
+    Request *req = reply ? new_request(reply) : NULL;
+    if (!req) {
+        if (reply) free_reply(reply);
+        reply_error(direct, "malloc_failed");
+        return;
+    }
+
+    /* Written straight out of the message buffer, nothing to copy */
+    if (inst != NULL) {
+        dispatch_command(inst, req, cmd, (size_t)len);
+        return;
+    }
+
+    if (request_copy_command(req, cmd, (size_t)len) < 0) {
+        free_request(req);
+        free_reply(reply);
+        reply_error(direct, "malloc_failed");
+        return;
+    }
+
+    /* Every instance is busy: hold the request until one frees up */
+    if (pending_tail) {
+        pending_tail->next = req;
+    } else {
+        pending_head = req;
+    }
+    pending_tail = req;
+    pending_count++;
+}
+
+/* Spread the commands of {execute_batch, Ref, [Cmd], ...} over the
+ * instances as separate parts of one reply. The list was validated by the
+ * caller, so elements are decoded again straight from the message buffer. */
+static void handle_execute_batch(Reply *direct, ei_x_buff *buf, int list_index, int count) {
+    if (count == 0) {
+        Reply empty = *direct;
+        empty.kind = REQ_BATCH;
+        ei_x_buff *response = begin_response(0);
+        encode_reply_head(response, &empty, "ok", 2);
+        ei_x_encode_empty_list(response);
+        send_response(&direct->from);
+        return;
+    }
+
+    /* Admitted as a unit, so a batch may take the queue past max_queued */
+    if (find_idle_instance() == NULL && pending_count >= max_queued) {
+        bridge_stats.overloaded++;
+        reply_error(direct, "overloaded");
+        return;
+    }
+
+    Reply *reply = new_reply(direct, REQ_BATCH, count);
+    BatchResult *results = reply ? calloc(count, sizeof(BatchResult)) : NULL;
+    if (!results) {
+        if (reply) free_reply(reply);
+        reply_error(direct, "malloc_failed");
+        return;
+    }
+    reply->results = results;
+    reply->result_count = count;
+
+    int index = list_index;
+    ei_decode_list_header(buf->buff, &index, &count);
+
+    for (int i = 0; i < count; i++) {
+        const char *cmd;
+        long len;
+        decode_binary_arg(buf, &index, &cmd, &len);
+
+        Request *req = new_request(reply);
+        if (req != NULL) {
+            req->index = i;
+            MaudeProcess *inst = find_idle_instance();
+            if (inst != NULL) {
+                dispatch_command(inst, req, cmd, (size_t)len);
+                continue;
+            }
+            if (request_copy_command(req, cmd, (size_t)len) == 0) {
+                if (pending_tail) {
+                    pending_tail->next = req;
+                } else {
+                    pending_head = req;
+                }
+                pending_tail = req;
+                pending_count++;
+                continue;
+            }
+            free_request(req);
+        }
+
+        /* Out of memory: fail this command and move on to the next */
+        results[i].reason = "malloc_failed";
+        if (--reply->pending == 0) {
+            finish_reply(reply, "", 0);
+            free_reply(reply);
+            return;
+        }
+    }
+}
+
+/* Count one consumed chunk, resuming a stream that hit its window */
+static void handle_ack(const Reply *direct) {
+    MaudeProcess *inst = find_stream(direct);
+    if (inst == NULL || inst->current->reply->unacked == 0) return;
+
+    if (stream_blocked(inst)) {
+        inst->deadline_ms = now_ms() + inst->current->reply->timeout_ms;
+    }
+    inst->current->reply->unacked--;
+}
+
+static int reply_matches(const Reply *reply, const Reply *direct) {
+    return reply->kind != REQ_LOAD && reply->ref_len == direct->ref_len &&
+           memcmp(reply->ref, direct->ref, direct->ref_len) == 0;
+}
+
+/* Forget a request whose caller gave up. Queued parts are dropped and
+ * running ones interrupted; the request is never answered. Loads run on
+ * every instance and are left to finish. */
+static void handle_cancel(const Reply *direct) {
+    Request *prev = NULL;
+    Request *req = pending_head;
+
+    while (req != NULL) {
+        Request *next = req->next;
+
+        if (reply_matches(req->reply, direct)) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                pending_head = next;
+            }
+            if (pending_tail == req) pending_tail = prev;
+            pending_count--;
+
+            req->reply->cancelled = 1;
+            complete_part(req, NULL, "", 0);
+        } else {
+            prev = req;
+        }
+        req = next;
+    }
+
+    /* A batch may be running on several instances at once */
+    for (int i = 0; i < num_instances; i++) {
+        MaudeProcess *inst = &instances[i];
+        if (inst->current && reply_matches(inst->current->reply, direct)) {
+            inst->current->reply->cancelled = 1;
+            interrupt_instance(inst, NULL);
+        }
+    }
+}
+
+static void handle_load_file(Reply *direct, const char *path, long len) {
+    Request *parts[MAX_INSTANCES] = {0};
+
+    /* Build "load <path>" once, then copy it for every instance */
+    char *command = malloc(len + 6);
+    Reply *reply = new_reply(direct, REQ_LOAD, num_instances);
+    int ok = command != NULL && reply != NULL;
+
+    if (ok) {
+        memcpy(command, "load ", 5);
+        memcpy(command + 5, path, len);
+        command[5 + len] = '\0';
+
+        for (int i = 0; i < num_instances && ok; i++) {
+            parts[i] = new_request(reply);
+            ok = parts[i] != NULL && request_copy_command(parts[i], command, 5 + len) == 0;
+        }
+    }
+
+    if (!ok) {
+        free(command);
+        for (int i = 0; i < num_instances; i++) {
+            if (parts[i]) free_request(parts[i]);
+        }
+        if (reply) free_reply(reply);
+        reply_error(direct, "malloc_failed");
+        return;
+    }
+    reply->module = command;
+
+    /* Queue only after every part exists so a reply cannot be sent early */
+    for (int i = 0; i < num_instances; i++) {
+        enqueue(&instances[i], parts[i]);
+    }
+}
+
+/* 64-bit FNV-1a, used to name module source files */
+static unsigned long long source_hash(const char *data, long len) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (long i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Whether the file at path holds exactly len bytes of source */
+static int file_matches(const char *path, const char *source, long len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    char buf[4096];
+    long offset = 0;
+    int match = 1;
+    for (;;) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 || r > len - offset || memcmp(buf, source + offset, (size_t)r) != 0) {
+            match = 0;
+            break;
+        }
+        if (r == 0) break;
+        offset += r;
+    }
+    close(fd);
+    return match && offset == len;
+}
+
+/* Names tried for one source before giving up on hash collisions */
+#define SOURCE_NAME_ATTEMPTS 16
+
+/* Write a module source to the module directory unless a file with the
+ * same contents is there already, leaving its path in path. The hash only
+ * picks the name: a file that differs is a collision, and the next name
+ * is tried. */
+static int store_source(const char *source, long len, char *path, size_t size) {
+    if (module_dir[0] == '\0') {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(module_dir, sizeof(module_dir), "%s/ex_maude_bridge_XXXXXX",
+                 tmp && tmp[0] ? tmp : "/tmp");
+        if (mkdtemp(module_dir) == NULL) {
+            perror("mkdtemp");
+            module_dir[0] = '\0';
+            return -1;
+        }
+    }
+
+    unsigned long long hash = source_hash(source, len);
+    int fd = -1;
+
+    for (int attempt = 0; attempt < SOURCE_NAME_ATTEMPTS && fd < 0; attempt++) {
+        int n = snprintf(path, size, "%s/%016llx-%ld-%d.maude", module_dir, hash, len, attempt);
+        if (n < 0 || (size_t)n >= size) return -1;
+
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EEXIST) return -1;
+        if (fd < 0 && file_matches(path, source, len)) return 0;
+    }
+    if (fd < 0) return -1;
+
+    long written = 0;
+    while (written < len) {
+        ssize_t w = write(fd, source + written, (size_t)(len - written));
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) break;
+        written += w;
+    }
+    if (close(fd) < 0 || written < len) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+static void handle_load_source(Reply *direct, const char *source, long len) {
+    char path[PATH_MAX];
+
+    if (store_source(source, len, path, sizeof(path)) < 0) {
+        reply_error(direct, "source_write_failed");
+        return;
+    }
+    handle_load_file(direct, path, (long)strlen(path));
+}
+
+/* Remove the files written for load_source on the way out */
+static void remove_module_dir(void) {
+    if (module_dir[0] == '\0') return;
+
+    DIR *dir = opendir(module_dir);
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') unlinkat(dirfd(dir), entry->d_name, 0);
+        }
+        closedir(dir);
+    }
+    rmdir(module_dir);
+}
+
+/* #{count, sum_us, min_us, max_us, buckets => [{UpperUs, Count}]}, listing
+ * only the buckets that were hit, in ascending order */
+static void encode_histogram(ei_x_buff *response, const Histogram *hist) {
+    ei_x_encode_map_header(response, 5);
+    ei_x_encode_atom(response, "count");
+    ei_x_encode_ulonglong(response, hist->count);
+    ei_x_encode_atom(response, "sum_us");
+    ei_x_encode_ulonglong(response, hist->sum_us);
+    ei_x_encode_atom(response, "min_us");
+    ei_x_encode_longlong(response, hist->min_us);
+    ei_x_encode_atom(response, "max_us");
+    ei_x_encode_longlong(response, hist->max_us);
+    ei_x_encode_atom(response, "buckets");
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (hist->counts[i] == 0) continue;
+        ei_x_encode_list_header(response, 1);
+        ei_x_encode_tuple_header(response, 2);
+        ei_x_encode_longlong(response, hist_upper(i));
+        ei_x_encode_ulonglong(response, hist->counts[i]);
+    }
+    ei_x_encode_empty_list(response);
+}
+
+/* {stats, Stats} or {stats, Ref, Stats}; counters are totals since start */
+static void handle_stats(Reply *direct) {
+    static const struct {
+        const char *name;
+        const Histogram *hist;
+    } phases[] = {
+        {"decode", &bridge_stats.decode},
+        {"compute", &bridge_stats.compute},
+        {"read", &bridge_stats.read},
+        {"encode", &bridge_stats.encode},
+    };
+    const struct {
+        const char *name;
+        unsigned long long value;
+    } counters[] = {
+        {"bytes_in", bridge_stats.bytes_in},
+        {"bytes_out", bridge_stats.bytes_out},
+        {"maude_bytes_written", bridge_stats.maude_bytes_written},
+        {"maude_bytes_read", bridge_stats.maude_bytes_read},
+        {"timeouts", bridge_stats.timeouts},
+        {"overloaded", bridge_stats.overloaded},
+        {"restarts", bridge_stats.restarts},
+        {"recycled", bridge_stats.recycled},
+        {"queued", (unsigned long long)pending_count},
+        {"uptime_ms", (unsigned long long)(now_ms() - bridge_stats.started_ms)},
+    };
+    int n_phases = (int)(sizeof(phases) / sizeof(phases[0]));
+    int n_counters = (int)(sizeof(counters) / sizeof(counters[0]));
+
+    ei_x_buff *response = begin_response(0);
+    encode_reply_head(response, direct, "stats", 2);
+    ei_x_encode_map_header(response, n_counters + n_phases + 1);
+
+    for (int i = 0; i < n_counters; i++) {
+        ei_x_encode_atom(response, counters[i].name);
+        ei_x_encode_ulonglong(response, counters[i].value);
+    }
+    ei_x_encode_atom(response, "rss_bytes");
+    ei_x_encode_list_header(response, num_instances);
+    for (int i = 0; i < num_instances; i++) {
+        ei_x_encode_ulonglong(response, instance_rss(&instances[i]));
+    }
+    ei_x_encode_empty_list(response);
+    for (int i = 0; i < n_phases; i++) {
+        ei_x_encode_atom(response, phases[i].name);
+        encode_histogram(response, phases[i].hist);
+    }
+
+    send_response(&direct->from);
+}
+
+/* Handle incoming Erlang message; from is unused on socket transports */
+static void handle_message(const erlang_pid *from, ei_x_buff *buf) {
+    int index = 0;
+    int version;
+    char cmd[MAXATOMLEN];
+    int arity;
+
+    /* Reply target for immediate answers */
+    Reply direct = {0};
+    direct.from = *from;
+    direct.timeout_ms = REQUEST_TIMEOUT_MS;
+
+    /* Decode version */
+    if (ei_decode_version(buf->buff, &index, &version) < 0) {
+        reply_error(&direct, "decode_version_failed");
+        return;
+    }
+
+    /* Decode tuple header */
+    if (ei_decode_tuple_header(buf->buff, &index, &arity) < 0) {
+        /* Not a tuple, check if it's just an atom (like :ping) */
+        index = 0;
+        ei_decode_version(buf->buff, &index, &version);
+
+        if (ei_decode_atom(buf->buff, &index, cmd) == 0) {
+            if (strcmp(cmd, "ping") == 0) {
+                ei_x_encode_atom(begin_response(0), "pong");
+            } else if (strcmp(cmd, "stats") == 0) {
+                handle_stats(&direct);
+                return;
+            } else if (strcmp(cmd, "stop") == 0) {
+                running = 0;
+                ei_x_encode_atom(begin_response(0), "ok");
+            } else {
+                reply_error(&direct, "invalid_message_format");
+                return;
+            }
+
+            send_response(&direct.from);
+            return;
+        }
+
+        reply_error(&direct, "invalid_message_format");
+        return;
+    }
+
+    /* Decode command atom */
+    if (ei_decode_atom(buf->buff, &index, cmd) < 0) {
+        reply_error(&direct, "decode_command_failed");
+        return;
+    }
+
+    /* A trailing-argument-plus-one tuple carries a caller Ref that is
+     * echoed in the reply: {ping, Ref}, {execute, Ref, Cmd}, ... */
+    int base_arity = (strcmp(cmd, "ping") == 0 || strcmp(cmd, "stop") == 0 ||
+                      strcmp(cmd, "stats") == 0 || strcmp(cmd, "ack") == 0 ||
+                      strcmp(cmd, "cancel") == 0) ? 1 : 2;
+    if (arity == base_arity + 1 || (base_arity == 2 && arity == base_arity + 2)) {
+        int ref_start = index;
+        if (ei_skip_term(buf->buff, &index) < 0 || index - ref_start > MAX_REF_LEN) {
+            reply_error(&direct, "invalid_ref");
+            return;
+        }
+        memcpy(direct.ref, buf->buff + ref_start, index - ref_start);
+        direct.ref_len = index - ref_start;
+    }
+
+    if (strcmp(cmd, "execute") == 0 || strcmp(cmd, "execute_parsed") == 0) {
+        const char *command;
+        long len;
+        if (decode_binary_arg(buf, &index, &command, &len) < 0) {
+            reply_error(&direct, "decode_binary_failed");
+            return;
+        }
+        if (decode_timeout_arg(buf, &index, arity, &direct) < 0) {
+            reply_error(&direct, "decode_timeout_failed");
+            return;
+        }
+        handle_execute(&direct, cmd[7] == '_' ? REQ_PARSED : REQ_EXECUTE, command, len);
+
+    } else if (strcmp(cmd, "execute_stream") == 0) {
+        const char *command;
+        long len;
+        /* Chunks are matched to their stream by Ref, so one is required */
+        if (direct.ref_len == 0) {
+            reply_error(&direct, "invalid_ref");
+            return;
+        }
+        if (decode_binary_arg(buf, &index, &command, &len) < 0) {
+            reply_error(&direct, "decode_binary_failed");
+            return;
+        }
+        if (decode_timeout_arg(buf, &index, arity, &direct) < 0) {
+            reply_error(&direct, "decode_timeout_failed");
+            return;
+        }
+        handle_execute(&direct, REQ_STREAM, command, len);
+
+    } else if (strcmp(cmd, "execute_batch") == 0) {
+        int list_index, count, tail;
+        /* Cancelling a batch needs its Ref, so one is required */
+        if (direct.ref_len == 0) {
+            reply_error(&direct, "invalid_ref");
+            return;
+        }
+
+        list_index = index;
+        if (ei_decode_list_header(buf->buff, &index, &count) < 0) {
+            reply_error(&direct, "decode_list_failed");
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            const char *command;
+            long len;
+            if (decode_binary_arg(buf, &index, &command, &len) < 0) {
+                reply_error(&direct, "decode_binary_failed");
+                return;
+            }
+        }
+        /* Proper lists end in an empty tail */
+        if (count > 0 && (ei_decode_list_header(buf->buff, &index, &tail) < 0 || tail != 0)) {
+            reply_error(&direct, "decode_list_failed");
+            return;
+        }
+        if (decode_timeout_arg(buf, &index, arity, &direct) < 0) {
+            reply_error(&direct, "decode_timeout_failed");
+            return;
+        }
+        handle_execute_batch(&direct, buf, list_index, count);
+
+    } else if (strcmp(cmd, "ack") == 0 || strcmp(cmd, "cancel") == 0) {
+        /* Flow control only, never answered */
+        if (direct.ref_len == 0) return;
+        if (cmd[0] == 'a') {
+            handle_ack(&direct);
+        } else {
+            handle_cancel(&direct);
+        }
+
+    } else if (strcmp(cmd, "load_file") == 0) {
+        const char *path;
+        long len;
+        if (decode_binary_arg(buf, &index, &path, &len) < 0) {
+            reply_error(&direct, "decode_path_failed");
+            return;
+        }
+        if (decode_timeout_arg(buf, &index, arity, &direct) < 0) {
+            reply_error(&direct, "decode_timeout_failed");
+            return;
+        }
+        handle_load_file(&direct, path, len);
+
+    } else if (strcmp(cmd, "load_source") == 0) {
+        const char *source;
+        long len;
+        if (decode_binary_arg(buf, &index, &source, &len) < 0) {
+            reply_error(&direct, "decode_source_failed");
+            return;
+        }
+        if (decode_timeout_arg(buf, &index, arity, &direct) < 0) {
+            reply_error(&direct, "decode_timeout_failed");
+            return;
+        }
+        handle_load_source(&direct, source, len);
+
+    } else if (strcmp(cmd, "ping") == 0) {
+        encode_reply_head(begin_response(0), &direct, "pong", 1);
+        send_response(&direct.from);
+
+    } else if (strcmp(cmd, "stats") == 0) {
+        handle_stats(&direct);
+
+    } else if (strcmp(cmd, "stop") == 0) {
+        running = 0;
+        encode_reply_head(begin_response(0), &direct, "ok", 1);
+        send_response(&direct.from);
+
+    } else {
+        reply_error(&direct, "unknown_command");
     }
+}
 
-    /* Start Maude subprocess */
-    fprintf(stderr, "Starting Maude: %s\n", maude_path);
-    if (start_maude(maude_path) < 0) {
-        fprintf(stderr, "Failed to start Maude\n");
-        return 1;
+/* Fail every queued or running request (used on shutdown) */
+static void fail_all_requests(const char *reason) {
+    for (int i = 0; i < num_instances; i++) {
+        MaudeProcess *inst = &instances[i];
+
+        if (inst->current) {
+            complete_part(inst->current, reason, "", 0);
+            inst->current = NULL;
+        }
+
+        while (inst->queue_head) {
+            Request *req = inst->queue_head;
+            inst->queue_head = req->next;
+            complete_part(req, reason, "", 0);
+        }
+        inst->queue_tail = NULL;
     }
 
-    /* Wait for Maude to be ready */
-    fprintf(stderr, "Waiting for Maude ready...\n");
-    fflush(stderr);
-    int ready_result = wait_for_ready();
-    fprintf(stderr, "wait_for_ready returned: %d\n", ready_result);
-    fflush(stderr);
-    if (ready_result < 0) {
-        fprintf(stderr, "Maude did not become ready\n");
-        stop_maude();
-        return 1;
+    while (pending_head) {
+        Request *req = pending_head;
+        pending_head = req->next;
+        complete_part(req, reason, "", 0);
     }
-    fprintf(stderr, "Maude ready\n");
-    fflush(stderr);
+    pending_tail = NULL;
+    pending_count = 0;
+}
+
+/* Fail requests that ran past their deadline */
+static void check_deadlines(void) {
+    long long now = now_ms();
+
+    for (int i = 0; i < num_instances; i++) {
+        MaudeProcess *inst = &instances[i];
+        if (inst->starting && now >= inst->deadline_ms) {
+            instance_start_failed(inst, "timeout waiting for prompt");
+        } else if (inst->resyncing && now >= inst->deadline_ms) {
+            fprintf(stderr, "Maude[%d] did not resynchronize\n", inst->id);
+            inst->resyncing = 0;
+            instance_failed(inst, NULL);
+        } else if (inst->current && !stream_blocked(inst) && now >= inst->deadline_ms) {
+            fprintf(stderr, "Maude[%d] request timed out\n", inst->id);
+            bridge_stats.timeouts++;
+            interrupt_instance(inst, "timeout");
+        }
+    }
+}
+
+/* Whether the event loop should read an instance's stdout */
+static int wants_read(const MaudeProcess *inst) {
+    if (inst->starting || inst->resyncing) return 1;
+    /* A stream at its window stays unread until the caller catches up */
+    return inst->current != NULL && !stream_blocked(inst);
+}
+
+/* Bring poller registrations in line with what each instance wants */
+static void sync_watches(void) {
+    for (int i = 0; i < num_instances; i++) {
+        MaudeProcess *inst = &instances[i];
+        int want = wants_read(inst);
+
+        if (want != inst->watched) {
+            if (poller_watch(inst->stdout_fd, want) < 0) {
+                perror("poller_watch");
+                continue;
+            }
+            inst->watched = want;
+        }
+    }
+}
+
+static MaudeProcess *instance_for_fd(int fd) {
+    for (int i = 0; i < num_instances; i++) {
+        if (instances[i].watched && instances[i].stdout_fd == fd) {
+            return &instances[i];
+        }
+    }
+    return NULL;
+}
+
+/* Block until every instance printed its first prompt and loaded the
+ * preloaded modules. Runs before the distribution connection exists. */
+static int wait_for_instances(void) {
+    int ready_fds[MAX_INSTANCES + 1];
+
+    for (;;) {
+        int busy = 0;
+        for (int i = 0; i < num_instances; i++) {
+            const MaudeProcess *inst = &instances[i];
+            busy += inst->starting || inst->resyncing || inst->current || inst->queue_head;
+        }
+        if (busy == 0) return 0;
+        if (!running) return -1;
+
+        sync_watches();
+
+        int ready = poller_wait(100, ready_fds, MAX_INSTANCES + 1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poller_wait");
+            return -1;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            MaudeProcess *inst = instance_for_fd(ready_fds[i]);
+            if (inst) service_instance(inst);
+        }
+        check_deadlines();
+    }
+}
+
+/* Read what arrived on a socket transport and handle every complete frame.
+ * One read per wakeup keeps the loop fair to the children; the poller is
+ * level-triggered and reports the rest again.
+ * Returns -1 once the socket closed or failed, 0 otherwise. */
+static int receive_frames(void) {
+    static const erlang_pid nobody;
+
+    if (frame_len + READ_CHUNK > frame_cap) {
+        size_t new_cap = frame_cap ? frame_cap : INITIAL_FRAME_BUFSIZE;
+        while (new_cap < frame_len + READ_CHUNK) new_cap *= 2;
+
+        char *grown = realloc(frame_buf, new_cap);
+        if (!grown) {
+            perror("realloc frame buffer");
+            return -1;
+        }
+        frame_buf = grown;
+        frame_cap = new_cap;
+    }
+
+    ssize_t n = recv(erl_fd, frame_buf + frame_len, frame_cap - frame_len, MSG_DONTWAIT);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        perror("recv");
+        return -1;
+    }
+    if (n == 0) {
+        fprintf(stderr, "Socket closed\n");
+        return -1;
+    }
+    frame_len += (size_t)n;
+
+    size_t pos = 0;
+    while (frame_len - pos >= FRAME_HEADER) {
+        const unsigned char *h = (const unsigned char *)frame_buf + pos;
+        size_t len = ((size_t)h[0] << 24) | ((size_t)h[1] << 16) | ((size_t)h[2] << 8) | h[3];
+
+        if (len > MAX_OUTPUT_LIMIT) {
+            fprintf(stderr, "Frame of %zu bytes exceeds limit\n", len);
+            return -1;
+        }
+        if (frame_len - pos - FRAME_HEADER < len) break;
+
+        long long received = now_us();
+        ei_x_buff frame = {frame_buf + pos + FRAME_HEADER, (int)len, (int)len};
+
+        bridge_stats.bytes_in += (unsigned long long)(len + FRAME_HEADER);
+        handle_message(&nobody, &frame);
+        hist_record(&bridge_stats.decode, now_us() - received);
+        pos += FRAME_HEADER + len;
+    }
+
+    if (pos > 0) {
+        memmove(frame_buf, frame_buf + pos, frame_len - pos);
+        frame_len -= pos;
+    }
+
+    /* Hand memory of an unusually large message back to the system */
+    if (frame_len == 0 && frame_cap > SHRINK_THRESHOLD) {
+        free(frame_buf);
+        frame_buf = NULL;
+        frame_cap = 0;
+    }
+    return 0;
+}
+
+/* Wait for distribution traffic or Maude output and dispatch it */
+static int event_loop(void) {
+    erlang_msg emsg;
+    ei_x_buff buf;
+    int ready_fds[MAX_INSTANCES + 1];
+
+    if (poller_watch(erl_fd, 1) < 0) {
+        perror("poller_watch");
+        return -1;
+    }
+
+    ei_x_new(&buf);
+
+    while (running) {
+        sync_watches();
+
+        /* Wake up at least once a second to check the running flag */
+        long long wait_ms = 1000;
+        long long now = now_ms();
+
+        for (int i = 0; i < num_instances; i++) {
+            MaudeProcess *inst = &instances[i];
+            if (!wants_read(inst)) continue;
+
+            long long left = inst->deadline_ms - now;
+            if (left < wait_ms) wait_ms = left > 0 ? left : 0;
+        }
+
+        int ready = poller_wait(wait_ms, ready_fds, MAX_INSTANCES + 1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poller_wait");
+            break;
+        }
+
+        /* Drain every ready child before taking the next message */
+        int erl_ready = 0;
+        for (int i = 0; i < ready; i++) {
+            if (ready_fds[i] == erl_fd) {
+                erl_ready = 1;
+                continue;
+            }
+
+            MaudeProcess *inst = instance_for_fd(ready_fds[i]);
+            if (inst && wants_read(inst)) {
+                service_instance(inst);
+            }
+        }
+
+        check_deadlines();
+
+        if (erl_ready && socket_transport) {
+            if (receive_frames() < 0) break;
+        } else if (erl_ready) {
+            long long received = now_us();
+            int got = ei_xreceive_msg_tmo(erl_fd, &emsg, &buf, 1000);
+
+            if (got == ERL_TICK) {
+                /* Heartbeat, ignore */
+                continue;
+            } else if (got == ERL_ERROR) {
+                if (erl_errno == ETIMEDOUT) {
+                    continue;
+                }
+                fprintf(stderr, "Connection error (errno: %d)\n", erl_errno);
+                break;
+            } else if (got == ERL_MSG) {
+                bridge_stats.bytes_in += (unsigned long long)buf.index;
+                handle_message(&emsg.from, &buf);
+                hist_record(&bridge_stats.decode, now_us() - received);
+
+                /* The receive buffer is reused; only a huge message frees it */
+                if (buf.buffsz > SHRINK_THRESHOLD) {
+                    ei_x_free(&buf);
+                    ei_x_new(&buf);
+                }
+            }
+        }
+    }
+
+    ei_x_free(&buf);
+    return 0;
+}
+
+/* Connect to Erlang node with retry logic and exponential backoff */
+static int connect_with_retry(ei_cnode *ec, char *nodename, int max_retries) {
+    int fd;
+    int delay_ms = 100;  /* Start with 100ms */
+
+    for (int attempt = 1; attempt <= max_retries; attempt++) {
+        fd = ei_connect_tmo(ec, nodename, 5000);  /* 5 second timeout per attempt */
+        if (fd >= 0) {
+            return fd;  /* Success */
+        }
+
+        fprintf(stderr, "Connection attempt %d/%d failed (errno: %d), retrying in %dms...\n",
+                attempt, max_retries, erl_errno, delay_ms);
+
+        usleep(delay_ms * 1000);  /* Convert to microseconds */
+        delay_ms *= 2;  /* Exponential backoff */
+        if (delay_ms > 2000) delay_ms = 2000;  /* Cap at 2 seconds */
+    }
+
+    return -1;  /* All retries exhausted */
+}
+
+static void stop_all_instances(void) {
+    for (int i = 0; i < num_instances; i++) {
+        stop_maude(&instances[i]);
+    }
+}
+
+/* Seed the module set with a file every child loads at startup */
+static int preload_module(const char *path) {
+    if (module_count == MAX_MODULES) {
+        fprintf(stderr, "At most %d -preload files are supported\n", MAX_MODULES);
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    char *command = malloc(len + 6);
+    if (!command) return -1;
+
+    memcpy(command, "load ", 5);
+    memcpy(command + 5, path, len + 1);
+    module_set[module_count++] = command;
+    return 0;
+}
 
-    /* Initialize C-Node */
+/* Connect to the Erlang node as a C-Node through EPMD */
+static int connect_distribution(char *node_name, char *cookie, char *erlang_node) {
     ei_cnode ec;
     char full_node_name[256];
     /* Extract hostname from erlang_node (e.g., "test@studio" -> "studio") */
@@ -529,57 +2725,216 @@ int main(int argc, char **argv) {
 
     if (ei_connect_init(&ec, node_name, cookie, 0) < 0) {
         fprintf(stderr, "Failed to init C-Node connection\n");
-        stop_maude();
-        return 1;
+        return -1;
     }
 
     /* Connect to Erlang node with retry logic */
     fprintf(stderr, "Connecting to Erlang node: %s (with retry)\n", erlang_node);
     int fd = connect_with_retry(&ec, erlang_node, 5);  /* 5 retries */
     if (fd < 0) {
-        fprintf(stderr, "Failed to connect to Erlang node after 5 retries: %s (errno: %d)\n", 
+        fprintf(stderr, "Failed to connect to Erlang node after 5 retries: %s (errno: %d)\n",
                 erlang_node, erl_errno);
-        stop_maude();
-        return 1;
     }
-    fprintf(stderr, "Connected to Erlang node\n");
+    return fd;
+}
 
-    /* Signal ready to parent process */
-    printf("READY\n");
-    fflush(stdout);
+/* Open the socket transport: a Unix socket path to connect to, or the
+ * number of an inherited, connected descriptor */
+static int connect_socket(const char *kind, const char *target) {
+    if (strcmp(kind, "-fd") == 0) {
+        char *end;
+        long fd = strtol(target, &end, 10);
+        if (*target == '\0' || *end != '\0' || fd < 0 || fd > INT_MAX ||
+            fcntl((int)fd, F_GETFD) < 0) {
+            fprintf(stderr, "-fd needs an open descriptor: %s\n", target);
+            return -1;
+        }
+        return (int)fd;
+    }
 
-    /* Main message loop */
-    erlang_msg emsg;
-    ei_x_buff buf;
-    ei_x_new(&buf);
+    struct sockaddr_un addr;
+    size_t len = strlen(target);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (len >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", target);
+        return -1;
+    }
+    memcpy(addr.sun_path, target, len + 1);
 
-    while (running) {
-        /* Use timeout variant - handles select internally */
-        int got = ei_xreceive_msg_tmo(fd, &emsg, &buf, 1000);  /* 1 second timeout */
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-        if (got == ERL_TICK) {
-            /* Heartbeat, ignore */
-            continue;
-        } else if (got == ERL_ERROR) {
-            if (erl_errno == ETIMEDOUT) {
-                /* Timeout is normal, check running flag and continue */
-                continue;
+/* Parse optional flags following the positional arguments */
+static int parse_options(int argc, char **argv, int first) {
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "-instances") == 0 && i + 1 < argc) {
+            num_instances = atoi(argv[++i]);
+            if (num_instances < 1 || num_instances > MAX_INSTANCES) {
+                fprintf(stderr, "-instances must be between 1 and %d\n", MAX_INSTANCES);
+                return -1;
             }
-            fprintf(stderr, "Connection error (errno: %d)\n", erl_errno);
-            break;
-        } else if (got == ERL_MSG) {
-            handle_message(fd, &emsg, &buf);
-            ei_x_free(&buf);
-            ei_x_new(&buf);
+        } else if (strcmp(argv[i], "-max-output") == 0 && i + 1 < argc) {
+            long long limit = atoll(argv[++i]);
+            if (limit < PROMPT_LEN || limit > MAX_OUTPUT_LIMIT) {
+                fprintf(stderr, "-max-output must be between %d and %d bytes\n",
+                        PROMPT_LEN, MAX_OUTPUT_LIMIT);
+                return -1;
+            }
+            max_output = (size_t)limit;
+        } else if (strcmp(argv[i], "-preload") == 0 && i + 1 < argc) {
+            if (preload_module(argv[++i]) < 0) return -1;
+        } else if (strcmp(argv[i], "-memory-limit") == 0 && i + 1 < argc) {
+            memory_limit = atoll(argv[++i]);
+            if (memory_limit < MIN_MEMORY_LIMIT) {
+                fprintf(stderr, "-memory-limit must be at least %lld bytes\n", MIN_MEMORY_LIMIT);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-max-rss") == 0 && i + 1 < argc) {
+            long long limit = atoll(argv[++i]);
+            if (limit <= 0) {
+                fprintf(stderr, "-max-rss must be positive\n");
+                return -1;
+            }
+            max_rss = (unsigned long long)limit;
+        } else if (strcmp(argv[i], "-cpu-affinity") == 0 && i + 1 < argc) {
+            cpu_affinity = atoi(argv[++i]);
+            if (cpu_affinity < 0) {
+                fprintf(stderr, "-cpu-affinity must not be negative\n");
+                return -1;
+            }
+#if !defined(__linux__)
+            fprintf(stderr, "-cpu-affinity is only supported on Linux, ignoring it\n");
+#endif
+        } else if (strcmp(argv[i], "-queue") == 0 && i + 1 < argc) {
+            max_queued = atoi(argv[++i]);
+            if (max_queued < 0) {
+                fprintf(stderr, "-queue must not be negative\n");
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Main entry point; bridge_bench.c includes this file with its own */
+#ifndef MAUDE_BRIDGE_NO_MAIN
+int main(int argc, char **argv) {
+    /* -socket PATH / -fd N replace the node name and cookie */
+    int socket_mode = argc >= 4 && (strcmp(argv[1], "-socket") == 0 || strcmp(argv[1], "-fd") == 0);
+
+    if (argc < 5 && !socket_mode) {
+        fprintf(stderr, "Usage: %s <node_name> <cookie> <maude_path> <erlang_node> [options]\n", argv[0]);
+        fprintf(stderr, "       %s -socket <path> <maude_path> [options]\n", argv[0]);
+        fprintf(stderr, "       %s -fd <fd> <maude_path> [options]\n", argv[0]);
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Arguments:\n");
+        fprintf(stderr, "  node_name    - Name for this C-Node (e.g., maude_bridge_1)\n");
+        fprintf(stderr, "  cookie       - Erlang distribution cookie\n");
+        fprintf(stderr, "  maude_path   - Path to Maude executable\n");
+        fprintf(stderr, "  erlang_node  - Full Erlang node name to connect to\n");
+        fprintf(stderr, "  path         - Unix socket to connect to instead of a node\n");
+        fprintf(stderr, "  fd           - Connected socket inherited from the parent\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  -instances N - Number of Maude processes to run (default: 1)\n");
+        fprintf(stderr, "  -queue N     - Requests held while all instances are busy (default: %d)\n",
+                DEFAULT_MAX_QUEUED);
+        fprintf(stderr, "  -max-output N - Largest response in bytes (default: %d)\n",
+                DEFAULT_MAX_OUTPUT);
+        fprintf(stderr, "  -preload PATH - Maude file loaded into every instance (repeatable)\n");
+        fprintf(stderr, "  -memory-limit N - Address space of every instance in bytes\n");
+        fprintf(stderr, "  -max-rss N   - Recycle an instance resident above N bytes\n");
+        fprintf(stderr, "  -cpu-affinity N - Pin instance i to CPU N + i (Linux only)\n");
+        return 1;
+    }
+
+    maude_executable = argv[3];
+
+    if (parse_options(argc, argv, socket_mode ? 4 : 5) < 0) {
+        return 1;
+    }
+
+    /* Setup signal handlers */
+    signal(SIGTERM, handle_signal);
+    signal(SIGINT, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Initialize ei library (required since OTP 21) */
+    if (ei_init() != 0) {
+        fprintf(stderr, "Failed to initialize ei library\n");
+        return 1;
+    }
+
+    if (poller_init() < 0) {
+        perror("poller_init");
+        return 1;
+    }
+
+    /* Start all Maude subprocesses first so they boot in parallel */
+    fprintf(stderr, "Starting %d Maude instance(s): %s\n", num_instances, maude_executable);
+    for (int i = 0; i < num_instances; i++) {
+        instances[i].id = i;
+        if (boot_maude(&instances[i]) < 0) {
+            fprintf(stderr, "Failed to start Maude\n");
+            stop_all_instances();
+            return 1;
         }
     }
 
+    /* Wait for Maude to be ready */
+    fprintf(stderr, "Waiting for Maude ready...\n");
+    fflush(stderr);
+    if (wait_for_instances() < 0) {
+        fprintf(stderr, "Maude did not become ready\n");
+        stop_all_instances();
+        return 1;
+    }
+    fprintf(stderr, "Maude ready\n");
+    fflush(stderr);
+
+    if (socket_mode) {
+        erl_fd = connect_socket(argv[1], argv[2]);
+        socket_transport = 1;
+    } else {
+        erl_fd = connect_distribution(argv[1], argv[2], argv[4]);
+    }
+    if (erl_fd < 0) {
+        stop_all_instances();
+        return 1;
+    }
+    fprintf(stderr, socket_mode ? "Connected to socket\n" : "Connected to Erlang node\n");
+    set_cloexec(erl_fd);
+
+    /* Signal ready to parent process */
+    printf("READY\n");
+    fflush(stdout);
+
+    /* Main message loop */
+    bridge_stats.started_ms = now_ms();
+    event_loop();
+
     /* Cleanup */
     fprintf(stderr, "Shutting down...\n");
-    ei_x_free(&buf);
-    close(fd);
-    stop_maude();
+    fail_all_requests("shutdown");
+    close(erl_fd);
+    stop_all_instances();
+    remove_module_dir();
 
     fprintf(stderr, "Goodbye\n");
     return 0;
 }
+#endif
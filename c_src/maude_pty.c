@@ -0,0 +1,301 @@
+/*
+ * ExMaude PTY Helper
+ *
+ * Runs Maude on a pseudo-terminal for the Port backend. Maude only prints
+ * its "Maude>" prompt when stdin is a terminal, which the Port backend
+ * used to arrange by wrapping Maude in unbuffer (Tcl/expect) or script.
+ * This helper opens the pty itself with forkpty, so there is no extra
+ * interpreter, no line discipline in cooked mode and no wrapper startup.
+ *
+ * Usage:
+ *   ./maude_pty <maude_path> [maude args...]
+ *
+ * Protocol (stdin/stdout, as opened with {packet, 4} by the Port):
+ *   Every message is a 4-byte big-endian length followed by that many
+ *   bytes. Messages on stdin are written to Maude's terminal verbatim;
+ *   Maude's output is sent back in messages of up to READ_CHUNK bytes.
+ *   Message boundaries on stdout carry no meaning.
+ *
+ * The terminal is put in raw mode without echo before Maude starts, so
+ * commands are not echoed back, output newlines are not rewritten to
+ * CRLF and long commands are not cut at the canonical line limit. Writes
+ * to the terminal are non-blocking and queued, so a command larger than
+ * the pty buffer cannot deadlock against Maude's output.
+ *
+ * The helper exits with Maude's exit status (128 + signal number when it
+ * was killed) once its output is drained, and terminates Maude when
+ * stdin closes, i.e. when the Port is closed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+
+#if defined(__linux__)
+#include <pty.h>
+#elif defined(__FreeBSD__) || defined(__DragonFly__)
+#include <libutil.h>
+#else
+#include <util.h>
+#endif
+
+#define READ_CHUNK 65536
+#define HEADER_LEN 4
+#define INITIAL_INPUT 65536
+#define MAX_MESSAGE (256 * 1024 * 1024)
+#define TERMINAL_COLS 4096
+#define TERMINAL_ROWS 1024
+#define STOP_GRACE_MS 1000
+
+/* Bytes read from stdin, parsed as length-prefixed messages */
+static char *input = NULL;
+static size_t input_len = 0;
+static size_t input_cap = 0;
+
+/* Message payloads not yet accepted by the terminal */
+static char *pending = NULL;
+static size_t pending_len = 0;
+static size_t pending_cap = 0;
+
+static pid_t child = -1;
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int reserve(char **buf, size_t *cap, size_t needed) {
+    if (needed <= *cap) return 0;
+
+    size_t new_cap = *cap ? *cap : INITIAL_INPUT;
+    while (new_cap < needed) new_cap *= 2;
+
+    char *grown = realloc(*buf, new_cap);
+    if (!grown) return -1;
+
+    *buf = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Send one chunk of Maude output to the Port as a framed message */
+static int send_output(const char *data, size_t len) {
+    unsigned char header[HEADER_LEN] = {
+        (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+        (unsigned char)(len >> 8), (unsigned char)len
+    };
+
+    if (write_all(STDOUT_FILENO, (const char *)header, HEADER_LEN) < 0) return -1;
+    return write_all(STDOUT_FILENO, data, len);
+}
+
+/* Move every complete message from the input buffer to the write queue */
+static int take_messages(void) {
+    size_t pos = 0;
+
+    while (input_len - pos >= HEADER_LEN) {
+        const unsigned char *h = (const unsigned char *)input + pos;
+        uint32_t len = ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) |
+                       ((uint32_t)h[2] << 8) | (uint32_t)h[3];
+
+        if (len > MAX_MESSAGE) {
+            fprintf(stderr, "maude_pty: message of %u bytes exceeds limit\n", len);
+            return -1;
+        }
+        if (input_len - pos - HEADER_LEN < len) break;
+
+        if (reserve(&pending, &pending_cap, pending_len + len) < 0) return -1;
+        memcpy(pending + pending_len, input + pos + HEADER_LEN, len);
+        pending_len += len;
+        pos += HEADER_LEN + len;
+    }
+
+    if (pos > 0) {
+        memmove(input, input + pos, input_len - pos);
+        input_len -= pos;
+    }
+    return 0;
+}
+
+/* Returns 0 on progress, 1 on end of input, -1 on error */
+static int read_input(void) {
+    if (reserve(&input, &input_cap, input_len + READ_CHUNK) < 0) return -1;
+
+    ssize_t n = read(STDIN_FILENO, input + input_len, input_cap - input_len);
+    if (n < 0) return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    if (n == 0) return 1;
+
+    input_len += (size_t)n;
+    return take_messages();
+}
+
+static int flush_pending(int master) {
+    while (pending_len > 0) {
+        ssize_t n = write(master, pending, pending_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        memmove(pending, pending + n, pending_len - (size_t)n);
+        pending_len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Returns 0 on progress, 1 once Maude closed its terminal, -1 on error */
+static int forward_output(int master, char *chunk) {
+    ssize_t n = read(master, chunk, READ_CHUNK);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        /* Linux reports EIO on the master once the slave side is closed */
+        return errno == EIO ? 1 : -1;
+    }
+    if (n == 0) return 1;
+
+    return send_output(chunk, (size_t)n) < 0 ? -1 : 0;
+}
+
+static int exit_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+/* Ask Maude to terminate, then kill it if it does not within the grace time */
+static int stop_child(void) {
+    int status = 0;
+
+    kill(child, SIGTERM);
+    for (int waited = 0; waited < STOP_GRACE_MS; waited += 10) {
+        pid_t r = waitpid(child, &status, WNOHANG);
+        if (r == child) return exit_code(status);
+        if (r < 0 && errno != EINTR) return 1;
+        usleep(10000);
+    }
+
+    kill(child, SIGKILL);
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+    return exit_code(status);
+}
+
+static int wait_child(void) {
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    return exit_code(status);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <maude_path> [maude args...]\n", argv[0]);
+        return 2;
+    }
+
+    struct termios raw;
+    memset(&raw, 0, sizeof(raw));
+    cfmakeraw(&raw);
+    cfsetispeed(&raw, B38400);
+    cfsetospeed(&raw, B38400);
+
+    struct winsize size;
+    memset(&size, 0, sizeof(size));
+    size.ws_col = TERMINAL_COLS;
+    size.ws_row = TERMINAL_ROWS;
+
+    int master = -1;
+    child = forkpty(&master, NULL, &raw, &size);
+    if (child < 0) {
+        perror("maude_pty: forkpty");
+        return 1;
+    }
+
+    if (child == 0) {
+        execv(argv[1], argv + 1);
+        fprintf(stderr, "maude_pty: cannot run %s: %s\n", argv[1], strerror(errno));
+        _exit(127);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (set_nonblocking(master) < 0 || set_nonblocking(STDIN_FILENO) < 0) {
+        perror("maude_pty: fcntl");
+        return stop_child();
+    }
+
+    char *chunk = malloc(READ_CHUNK);
+    if (!chunk) return stop_child();
+
+    for (;;) {
+        struct pollfd fds[2];
+        fds[0].fd = master;
+        fds[0].events = POLLIN | (pending_len > 0 ? POLLOUT : 0);
+        fds[0].revents = 0;
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("maude_pty: poll");
+            free(chunk);
+            return stop_child();
+        }
+
+        /* Read Maude first, so its output never waits behind our input */
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int r = forward_output(master, chunk);
+            if (r != 0) {
+                free(chunk);
+                return r > 0 ? wait_child() : stop_child();
+            }
+        }
+
+        if ((fds[0].revents & POLLOUT) && flush_pending(master) < 0) {
+            free(chunk);
+            return stop_child();
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int r = read_input();
+            if (r < 0) {
+                free(chunk);
+                return stop_child();
+            }
+            if (r > 0) {
+                /* The Port was closed: nobody is left to talk to Maude */
+                free(chunk);
+                return stop_child();
+            }
+            if (flush_pending(master) < 0) {
+                free(chunk);
+                return stop_child();
+            }
+        }
+    }
+}
@@ -12,11 +12,19 @@ defmodule ExMaude.Application do
   ```
   ExMaude.Supervisor (one_for_one)
       │
-      └── ExMaude.Pool (Poolboy)
+      ├── ExMaude.Pool.Updates (versioned broadcast log)
+      │
+      ├── ExMaude.IoT.Fragments (encoded IoT rules)
+      │
+      ├── ExMaude.Pool (Poolboy)
+      │       │
+      │       ├── ExMaude.Server (worker 1)
+      │       ├── ExMaude.Server (worker 2)
+      │       └── ExMaude.Server (worker N)
+      │
+      └── ExMaude.Pool.Autoscaler (when autoscale is configured)
               │
-              ├── ExMaude.Server (worker 1)
-              ├── ExMaude.Server (worker 2)
-              └── ExMaude.Server (worker N)
+              └── Pool shards (Poolboy, started on demand)
   ```
 
   ## Configuration
@@ -28,6 +36,19 @@ defmodule ExMaude.Application do
         pool_size: 4,        # Number of Maude worker processes
         pool_max_overflow: 2 # Extra workers allowed under load
 
+  Setting `cache: true` also starts `ExMaude.Cache`, which memoizes
+  `ExMaude.Maude.reduce/3` and `ExMaude.Maude.parse/3` results.
+
+  Setting `autoscale: [...]` next to `start_pool: true` starts
+  `ExMaude.Pool.Autoscaler`, which adds warm workers under load and removes
+  them again when they sit idle.
+
+  Setting `start_router: true` starts `ExMaude.Router`, which routes
+  commands to workers by Maude module instead of loading every module into
+  every pool worker. Adding `start_cluster: true` also starts
+  `ExMaude.Cluster`, which schedules those commands over the routers of
+  all connected nodes.
+
   By default, `start_pool` is `false`, meaning no Maude processes are started
   automatically. This is useful for:
 
@@ -52,14 +73,48 @@ defmodule ExMaude.Application do
 
   @impl true
   def start(_type, _args) do
-    children =
+    cache =
+      if Application.get_env(:ex_maude, :cache, false) do
+        [ExMaude.Cache]
+      else
+        []
+      end
+
+    pool =
       if Application.get_env(:ex_maude, :start_pool, false) do
-        [ExMaude.Pool.child_spec()]
+        [ExMaude.Pool.child_spec()] ++ autoscaler()
       else
         []
       end
 
+    router =
+      if Application.get_env(:ex_maude, :start_router, false) do
+        [ExMaude.Router] ++ cluster()
+      else
+        []
+      end
+
+    # Own the versioned update log used by ExMaude.Pool.publish/2 and the
+    # encoded rules reused by ExMaude.IoT.detect_conflicts/2
+    children = [ExMaude.Pool.Updates, ExMaude.IoT.Fragments] ++ cache ++ pool ++ router
+
     opts = [strategy: :one_for_one, name: ExMaude.Supervisor]
     Supervisor.start_link(children, opts)
   end
+
+  defp cluster do
+    if Application.get_env(:ex_maude, :start_cluster, false) do
+      [ExMaude.Cluster]
+    else
+      []
+    end
+  end
+
+  defp autoscaler do
+    if Application.get_env(:ex_maude, :autoscale, false) do
+      [ExMaude.Pool.Autoscaler]
+    else
+      []
+    end
+  end
 end
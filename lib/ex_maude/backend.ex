@@ -28,7 +28,11 @@ defmodule ExMaude.Backend do
 
   """
 
-  @type command :: String.t()
+  @typedoc """
+  A Maude command. Backends that write to a pipe (Port) send iodata as
+  it is; the others flatten it first.
+  """
+  @type command :: iodata()
   @type result :: {:ok, String.t()} | {:error, term()}
 
   @doc """
@@ -53,6 +57,48 @@ defmodule ExMaude.Backend do
   """
   @callback execute(server :: GenServer.server(), command(), keyword()) :: result()
 
+  @doc """
+  Executes a Maude command and streams its output as it is produced.
+
+  Optional; `ExMaude.Server.stream/3` falls back to `execute/3` and emits
+  the whole output as a single chunk for backends without it.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait for the next chunk in ms
+
+  """
+  @callback stream(server :: GenServer.server(), command(), keyword()) :: Enumerable.t()
+
+  @doc """
+  Executes several Maude commands and returns one result per command.
+
+  Optional; `ExMaude.Server.execute_batch/3` falls back to calling
+  `execute/3` for each command for backends without it.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait for each command in ms
+
+  """
+  @callback execute_batch(server :: GenServer.server(), [command()], keyword()) ::
+              {:ok, [result()]} | {:error, term()}
+
+  @doc """
+  Executes a Maude command and returns its output as result structs.
+
+  Optional; `ExMaude.Server.execute_parsed/3` falls back to `execute/3`
+  and `ExMaude.Parser.tokenize/1` for backends without it.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait in ms
+
+  """
+  @callback execute_parsed(server :: GenServer.server(), command(), keyword()) ::
+              {:ok, ExMaude.Result.Reduction.t() | ExMaude.Result.Search.t() | String.t()}
+              | {:error, term()}
+
   @doc """
   Checks if the backend worker is alive and ready.
   """
@@ -63,11 +109,22 @@ defmodule ExMaude.Backend do
   """
   @callback load_file(server :: GenServer.server(), path :: Path.t()) :: :ok | {:error, term()}
 
+  @doc """
+  Loads Maude module source into the session.
+
+  Optional; `ExMaude.Server.load_source/2` falls back to writing a
+  temporary file for `load_file/2` for backends without it.
+  """
+  @callback load_source(server :: GenServer.server(), source :: String.t()) ::
+              :ok | {:error, term()}
+
   @doc """
   Stops the backend worker.
   """
   @callback stop(server :: GenServer.server()) :: :ok
 
+  @optional_callbacks stream: 3, execute_batch: 3, execute_parsed: 3, load_source: 2
+
   @typedoc "Backend module types"
   @type backend_module :: ExMaude.Backend.Port | ExMaude.Backend.CNode | ExMaude.Backend.NIF
 
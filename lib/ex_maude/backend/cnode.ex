@@ -15,7 +15,8 @@ defmodule ExMaude.Backend.CNode do
 
     * Requires compiled C code (maude_bridge binary)
     * More complex deployment (native dependency)
-    * Requires Erlang distribution (epmd must be running)
+    * The default transport requires Erlang distribution (epmd must be
+      running); see [Transports](#module-transports)
 
   ## Requirements
 
@@ -29,7 +30,133 @@ defmodule ExMaude.Backend.CNode do
 
       config :ex_maude,
         backend: :cnode,
-        cnode_timeout: 30_000
+        cnode_timeout: 30_000,
+        cnode_instances: 1,
+        cnode_queue: 1024,
+        cnode_max_output: 67_108_864,
+        cnode_transport: :distribution,
+        cnode_memory_limit: nil,
+        cnode_max_rss: nil,
+        cnode_cpu_affinity: nil
+
+  ## Transports
+
+  With `transport: :distribution` (the default) the bridge is a real
+  C-Node: it registers with EPMD, authenticates with the node's cookie and
+  talks Erlang distribution, so the worker's node must be alive.
+
+  With `transport: :socket` (or `:cnode_transport`) the worker listens on a
+  Unix domain socket in the system temp directory and starts the bridge
+  with `-socket PATH`. The same request and reply terms then travel as
+  `:erlang.term_to_binary/1` frames with a 4-byte length prefix, which
+  skips EPMD, cookies and the distribution handshake and works on nodes
+  that are not distributed. Stream chunks reach the consuming process
+  through the worker, which relays them.
+
+  ## Multiple Maude Instances
+
+  A single bridge can run several Maude children behind one distribution
+  connection. Pass `:instances` to `start_link/1` (or set `:cnode_instances`)
+  and the bridge forks that many Maude processes, sending each request to
+  whichever child is idle. Modules loaded with `load_file/2` are loaded into
+  every child.
+
+  ## Preloaded Modules
+
+  Files given in `:preload_modules` (or the `:preload_modules` application
+  setting shared with the Port backend) are loaded by the bridge into every
+  Maude child before it reports ready. The bridge also remembers every file
+  loaded successfully with `load_file/2`, and a child restarted after a
+  crash or a stuck interrupt reloads that whole set before taking requests
+  again, so recovery does not depend on the worker reloading its modules.
+
+  ## Pipelining
+
+  Every request carries a unique reference that the bridge echoes in its
+  reply, so the worker never blocks while Maude is computing. Requests from
+  several callers are forwarded immediately and queued inside the bridge
+  (`:queue` / `:cnode_queue`, default 1024) until a Maude child is free.
+  A single worker can therefore be shared by many processes calling
+  `execute/3` directly, keeping several commands in flight on one
+  distribution connection.
+
+  ## Large Outputs
+
+  The bridge collects each response in a buffer that grows as needed, up
+  to `:max_output` bytes (`:cnode_max_output`, default 64 MiB). Larger
+  responses are drained and discarded by the bridge, and the request fails
+  with an `:output_too_large` error instead of timing out.
+
+  ## Streaming
+
+  `stream/3` returns a lazy `Stream` of output chunks that are forwarded
+  while Maude is still running, so the first solutions of a long `search`
+  can be consumed before the last one is found. Chunks are cut before
+  `Solution N` lines where possible and go straight from the bridge to the
+  consuming process. The bridge sends at most a small window of chunks
+  ahead of the consumer and stops reading Maude until they have been
+  consumed, which keeps memory bounded on both sides. Halting the stream
+  early cancels the command in the bridge.
+
+  ## Batches
+
+  `execute_batch/3` sends a list of commands in one message. The bridge
+  spreads them over its idle Maude children like separate requests and
+  answers with all results, in order, in one reply, so bulk workloads pay
+  for a single round trip instead of one per command.
+
+  ## Module Loading
+
+  `load_source/2` sends module text in the request; the bridge stores it
+  under a hash of its content and loads it into every child, with no file
+  on the caller's side. Both `load_file/2` and `load_source/2` answer `:ok`
+  right away when every module in the source is already loaded in this
+  version (see `ExMaude.Backend.Modules`), so redeploying an unchanged
+  module set does not make Maude parse it again.
+
+  ## Parsed Results
+
+  `execute_parsed/3` asks the bridge to tokenize the output before it is
+  sent: `result Sort: Term` lines, `Solution N` blocks with their
+  substitutions, and the rewrite, state and timing statistics arrive as
+  Erlang terms, which are only wrapped in `ExMaude.Result` structs here.
+  No regex runs on the BEAM side.
+
+  ## Timeouts and Cancellation
+
+  The `:timeout` given to `execute/3` travels with the request and is
+  enforced by the bridge. A command that runs too long, or whose caller
+  gave up, is interrupted with SIGINT and the Maude child is brought back
+  to its prompt instead of being restarted, so loaded modules survive a
+  runaway rewrite.
+
+  ## Resource Limits
+
+  On hosts shared by many workers, one pathological command should not
+  take memory or CPU from its neighbours:
+
+    * `:memory_limit` (`:cnode_memory_limit`) caps the address space of
+      every Maude child in bytes (`RLIMIT_AS`). A command that needs more
+      fails and the child is restarted with its modules.
+    * `:max_rss` (`:cnode_max_rss`) recycles a child whose resident set
+      grew past the given bytes, after the request it was running and
+      before it takes the next one. Its modules are replayed into the
+      fresh child.
+    * `:cpu_affinity` (`:cnode_cpu_affinity`) pins child `i` to CPU
+      `cpu_affinity + i`, modulo the online CPUs (Linux only). Give each
+      worker of a pool its own range to keep them apart.
+
+  The resident set of every child is part of `stats/1` as `:rss_bytes`,
+  and recycled children are counted in `:recycled`.
+
+  ## Bridge Statistics
+
+  The bridge keeps latency histograms for the phases of a request (message
+  decode, Maude compute, output read and reply encode) together with byte,
+  timeout and overload counters. `stats/1` returns them, and every health
+  check reports what changed since the previous one as
+  `[:ex_maude, :bridge, :stats]` and `[:ex_maude, :bridge, :phase]`
+  telemetry. See `ExMaude.Backend.CNode.Stats`.
 
   """
 
@@ -38,10 +165,18 @@ defmodule ExMaude.Backend.CNode do
   use GenServer
   require Logger
 
-  alias ExMaude.{Binary, Error}
+  alias ExMaude.{Binary, Error, Parser}
+  alias ExMaude.Backend.CNode.Stats
+  alias ExMaude.Backend.Modules
 
   @default_timeout 30_000
+  @default_instances 1
+  @default_queue 1024
+  @default_max_output 64 * 1024 * 1024
   @connect_timeout 10_000
+  # The bridge enforces request timeouts; the worker only steps in when no
+  # answer arrives shortly after
+  @cancel_grace 500
   @health_check_interval 5_000
 
   @typedoc """
@@ -53,6 +188,22 @@ defmodule ExMaude.Backend.CNode do
           os_pid: non_neg_integer() | nil,
           maude_path: String.t() | nil,
           cookie: String.t(),
+          instances: pos_integer(),
+          queue: non_neg_integer(),
+          max_output: pos_integer(),
+          preload_modules: [Path.t()],
+          memory_limit: pos_integer() | nil,
+          max_rss: pos_integer() | nil,
+          cpu_affinity: non_neg_integer() | nil,
+          modules: Modules.t(),
+          pending: %{reference() => map()},
+          health_ref: reference() | nil,
+          stats: Stats.t() | nil,
+          transport: :distribution | :socket,
+          socket: port() | nil,
+          listen_socket: port() | nil,
+          socket_path: Path.t() | nil,
+          streams: %{reference() => {pid(), reference()}},
           connected: boolean()
         }
 
@@ -61,7 +212,23 @@ defmodule ExMaude.Backend.CNode do
     :port,
     :os_pid,
     :maude_path,
+    :health_ref,
+    :stats,
+    :socket,
+    :listen_socket,
+    :socket_path,
+    :memory_limit,
+    :max_rss,
+    :cpu_affinity,
     cookie: "",
+    instances: 1,
+    queue: 1024,
+    max_output: 67_108_864,
+    preload_modules: [],
+    pending: %{},
+    modules: %{},
+    transport: :distribution,
+    streams: %{},
     connected: false
   ]
 
@@ -76,22 +243,153 @@ defmodule ExMaude.Backend.CNode do
   def execute(server, command, opts \\ []) do
     timeout = Keyword.get(opts, :timeout, @default_timeout)
 
+    # Flattened by the caller; the bridge takes commands as one binary
     try do
-      GenServer.call(server, {:execute, command}, timeout + 1_000)
+      GenServer.call(server, {:execute, IO.iodata_to_binary(command), timeout}, timeout + 1_000)
     catch
       :exit, {:timeout, _} -> {:error, Error.timeout(timeout)}
     end
   end
 
+  @doc """
+  Executes several Maude commands with a single bridge round trip.
+
+  Returns `{:ok, results}` with one `{:ok, output}` or `{:error, error}` per
+  command, in the order given. A failing command does not affect the
+  others.
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms for each command
+
+  ## Examples
+
+      {:ok, [{:ok, _}, {:ok, _}]} =
+        ExMaude.Backend.CNode.execute_batch(server, [
+          "reduce in NAT : 1 + 2 .",
+          "reduce in NAT : 3 * 4 ."
+        ])
+
+  """
+  @impl ExMaude.Backend
+  @spec execute_batch(GenServer.server(), [iodata()], keyword()) ::
+          {:ok, [{:ok, String.t()} | {:error, Error.t()}]} | {:error, Error.t()}
+  def execute_batch(server, commands, opts \\ []) do
+    timeout = Keyword.get(opts, :timeout, @default_timeout)
+    # Commands may wait for each other on a busy bridge
+    total = timeout * max(length(commands), 1)
+
+    try do
+      batch = Enum.map(commands, &IO.iodata_to_binary/1)
+      GenServer.call(server, {:execute_batch, batch, timeout}, total + 1_000)
+    catch
+      :exit, {:timeout, _} -> {:error, Error.timeout(total)}
+    end
+  end
+
+  @doc """
+  Executes a Maude command and returns its output tokenized by the bridge.
+
+  Returns an `ExMaude.Result.Reduction` for `result Sort: Term` output, an
+  `ExMaude.Result.Search` for search output and the raw text otherwise.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait in ms
+
+  ## Examples
+
+      {:ok, %ExMaude.Result.Reduction{term: %{sort: "NzNat", value: "3"}}} =
+        ExMaude.Backend.CNode.execute_parsed(server, "reduce in NAT : 1 + 2 .")
+
+  """
+  @impl ExMaude.Backend
+  @spec execute_parsed(GenServer.server(), String.t(), keyword()) ::
+          {:ok, ExMaude.Result.Reduction.t() | ExMaude.Result.Search.t() | String.t()}
+          | {:error, Error.t()}
+  def execute_parsed(server, command, opts \\ []) do
+    timeout = Keyword.get(opts, :timeout, @default_timeout)
+
+    try do
+      GenServer.call(
+        server,
+        {:execute_parsed, IO.iodata_to_binary(command), timeout},
+        timeout + 1_000
+      )
+    catch
+      :exit, {:timeout, _} -> {:error, Error.timeout(timeout)}
+    end
+  end
+
+  @doc """
+  Executes a Maude command and streams its output as it is produced.
+
+  Returns a lazy enumerable of binaries that concatenate to the output
+  `execute/3` would return. The command is only sent once the stream is
+  enumerated, and errors are raised as `ExMaude.Error`.
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms to wait for the next chunk
+
+  ## Examples
+
+      server
+      |> ExMaude.Backend.CNode.stream("search in MY-MOD : init =>* S:State .")
+      |> Enum.take(2)
+
+  """
+  @impl ExMaude.Backend
+  @spec stream(GenServer.server(), iodata(), keyword()) :: Enumerable.t()
+  def stream(server, command, opts \\ []) do
+    timeout = Keyword.get(opts, :timeout, @default_timeout)
+    command = IO.iodata_to_binary(command)
+
+    Stream.resource(
+      fn -> open_stream(server, command, timeout) end,
+      &next_chunk(&1, timeout),
+      &close_stream/1
+    )
+  end
+
+  @doc """
+  Returns the bridge's counters and latency histograms.
+
+  The values are totals since the bridge started; see
+  `ExMaude.Backend.CNode.Stats` for the fields and for percentiles.
+
+  ## Examples
+
+      {:ok, stats} = ExMaude.Backend.CNode.stats(server)
+      ExMaude.Backend.CNode.Stats.percentile(stats.compute, 0.99)
+
+  """
+  @spec stats(GenServer.server()) :: {:ok, Stats.t()} | {:error, Error.t()}
+  def stats(server) do
+    GenServer.call(server, :stats, @default_timeout + 1_000)
+  catch
+    :exit, {:timeout, _} -> {:error, Error.timeout(@default_timeout)}
+  end
+
   @impl ExMaude.Backend
   def load_file(server, path) do
-    case GenServer.call(server, {:load_file, path}, @default_timeout) do
+    case GenServer.call(server, {:load_file, path}, @default_timeout + 1_000) do
       :ok -> :ok
       {:ok, _} -> :ok
       error -> error
     end
   end
 
+  @doc """
+  Loads Maude module source into every Maude child of the bridge.
+
+  The source travels in the request, so no file is written on this side.
+  """
+  @impl ExMaude.Backend
+  def load_source(server, source) when is_binary(source) do
+    GenServer.call(server, {:load_source, source}, @default_timeout + 1_000)
+  end
+
   @impl ExMaude.Backend
   def alive?(server) do
     GenServer.call(server, :alive?)
@@ -112,10 +410,26 @@ defmodule ExMaude.Backend.CNode do
   def init(opts) do
     maude_path = opts[:maude_path] || Binary.find() || "maude"
     cookie = opts[:cookie] || get_cookie()
+    instances = opts[:instances] || config_instances()
+    queue = opts[:queue] || config_queue()
+    max_output = opts[:max_output] || config_max_output()
+    preload_modules = opts[:preload_modules] || config_preload_modules()
+    transport = opts[:transport] || config_transport()
+    memory_limit = opts[:memory_limit] || config_limit(:cnode_memory_limit)
+    max_rss = opts[:max_rss] || config_limit(:cnode_max_rss)
+    cpu_affinity = opts[:cpu_affinity] || config_limit(:cnode_cpu_affinity)
 
     state = %__MODULE__{
       maude_path: maude_path,
-      cookie: cookie
+      cookie: cookie,
+      instances: instances,
+      queue: queue,
+      max_output: max_output,
+      preload_modules: Enum.map(preload_modules, &Path.expand/1),
+      transport: transport,
+      memory_limit: memory_limit,
+      max_rss: max_rss,
+      cpu_affinity: cpu_affinity
     }
 
     case start_cnode(state) do
@@ -130,22 +444,65 @@ defmodule ExMaude.Backend.CNode do
   end
 
   @impl GenServer
-  def handle_call({:execute, command}, _from, %{connected: true} = state) do
-    result = send_cnode_command(state.cnode_name, {:execute, command})
-    emit_telemetry(:command_complete, %{success: match?({:ok, _}, result)})
-    {:reply, result, state}
+  def handle_call({:execute, command, timeout}, from, %{connected: true} = state) do
+    {:noreply, send_request(state, :execute, command, from, timeout)}
+  end
+
+  def handle_call({:execute, _command, _timeout}, _from, %{connected: false} = state) do
+    {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
+  end
+
+  def handle_call({:execute_parsed, command, timeout}, from, %{connected: true} = state) do
+    {:noreply, send_request(state, :execute_parsed, command, from, timeout)}
+  end
+
+  def handle_call({:execute_parsed, _command, _timeout}, _from, %{connected: false} = state) do
+    {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
+  end
+
+  def handle_call({:execute_batch, commands, timeout}, from, %{connected: true} = state) do
+    {:noreply, send_request(state, :execute_batch, commands, from, timeout)}
+  end
+
+  def handle_call({:execute_batch, _commands, _timeout}, _from, %{connected: false} = state) do
+    {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
   end
 
-  def handle_call({:execute, _command}, _from, %{connected: false} = state) do
+  def handle_call({:load_file, path}, from, %{connected: true} = state) do
+    # A file that cannot be read is left to Maude to report
+    source =
+      case File.read(path) do
+        {:ok, source} -> source
+        {:error, _reason} -> nil
+      end
+
+    load(state, :load_file, path, source, from)
+  end
+
+  def handle_call({:load_source, source}, from, %{connected: true} = state) do
+    load(state, :load_source, source, source, from)
+  end
+
+  def handle_call({kind, _payload}, _from, %{connected: false} = state)
+      when kind in [:load_file, :load_source] do
+    {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
+  end
+
+  def handle_call({:stream_target, ref}, {pid, _tag}, %{connected: true} = state) do
+    # Over a socket the chunks arrive here and are relayed to the consumer
+    state = if state.socket, do: watch_stream(state, ref, pid), else: state
+    {:reply, {:ok, bridge_target(state), state.max_output}, state}
+  end
+
+  def handle_call({:stream_target, _ref}, _from, %{connected: false} = state) do
     {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
   end
 
-  def handle_call({:load_file, path}, _from, %{connected: true} = state) do
-    result = send_cnode_command(state.cnode_name, {:load_file, path})
-    {:reply, result, state}
+  def handle_call(:stats, from, %{connected: true} = state) do
+    {:noreply, send_request(state, :stats, nil, from, @default_timeout)}
   end
 
-  def handle_call({:load_file, _path}, _from, %{connected: false} = state) do
+  def handle_call(:stats, _from, %{connected: false} = state) do
     {:reply, {:error, Error.exception(:not_connected, "C-Node not connected")}, state}
   end
 
@@ -154,24 +511,97 @@ defmodule ExMaude.Backend.CNode do
   end
 
   @impl GenServer
-  def handle_info(:health_check, state) do
-    case send_cnode_command(state.cnode_name, :ping) do
-      :pong ->
-        schedule_health_check()
-        {:noreply, %{state | connected: true}}
+  def handle_cast({:close_stream, ref}, state) do
+    {:noreply, unwatch_stream(state, ref)}
+  end
 
-      _ ->
-        Logger.warning("C-Node health check failed")
-        {:noreply, %{state | connected: false}}
+  @impl GenServer
+  # sobelow_skip ["Misc.BinToTerm"]
+  def handle_info({:tcp, socket, data}, %{socket: socket, streams: streams} = state) do
+    # Frames come from our own bridge process, so atoms in them are trusted
+    case :erlang.binary_to_term(data) do
+      {tag, ref, _payload} = message when tag in [:chunk, :error] and is_map_key(streams, ref) ->
+        {:noreply, relay_stream(state, ref, message)}
+
+      {:done, ref} = message when is_map_key(streams, ref) ->
+        {:noreply, relay_stream(state, ref, message)}
+
+      message ->
+        handle_info(message, state)
     end
   end
 
+  def handle_info({:tcp_closed, socket}, %{socket: socket} = state) do
+    Logger.error("C-Node socket closed")
+    emit_telemetry(:crash, %{node: state.cnode_name})
+    {:stop, :socket_closed, %{state | socket: nil, connected: false}}
+  end
+
+  def handle_info({tag, ref, payload}, %{pending: pending} = state)
+      when tag in [:ok, :error, :stats] and is_map_key(pending, ref) do
+    {:noreply, complete_request(state, ref, {tag, payload})}
+  end
+
+  def handle_info({:ok, ref}, %{pending: pending} = state) when is_map_key(pending, ref) do
+    {:noreply, complete_request(state, ref, :ok)}
+  end
+
+  def handle_info({:request_timeout, ref}, %{pending: pending} = state)
+      when is_map_key(pending, ref) do
+    # The bridge did not answer in time: stop the command so the Maude
+    # child frees up, any late reply is dropped once the ref is gone
+    %{timeout: timeout} = Map.fetch!(pending, ref)
+    send_to_cnode(bridge_target(state), {:cancel, ref})
+    {:noreply, complete_request(state, ref, {:error, Error.timeout(timeout)})}
+  end
+
+  def handle_info(:health_check, %{connected: false, health_ref: nil} = state) do
+    # Not connected yet, try again later
+    schedule_health_check()
+    {:noreply, state}
+  end
+
+  def handle_info(:health_check, %{health_ref: nil} = state) do
+    # A stats query doubles as the ping and feeds the bridge telemetry
+    ref = make_ref()
+    send_to_cnode(bridge_target(state), {:stats, ref})
+    schedule_health_check()
+    {:noreply, %{state | health_ref: ref}}
+  end
+
+  def handle_info(:health_check, state) do
+    # Previous ping was never answered
+    Logger.warning("C-Node health check failed")
+    {:noreply, %{state | connected: false, health_ref: nil}}
+  end
+
+  def handle_info({:pong, ref}, %{health_ref: ref} = state) do
+    {:noreply, %{state | connected: true, health_ref: nil}}
+  end
+
+  def handle_info({:stats, ref, stats}, %{health_ref: ref} = state) do
+    Stats.emit(stats, state.stats, %{pid: self(), node: state.cnode_name})
+    {:noreply, %{state | connected: true, health_ref: nil, stats: stats}}
+  end
+
   def handle_info({:nodedown, node}, %{cnode_name: node} = state) do
     Logger.error("C-Node #{node} went down")
     emit_telemetry(:crash, %{node: node})
     {:stop, :nodedown, state}
   end
 
+  def handle_info({:DOWN, monitor, :process, _pid, _reason}, state) do
+    # A consumer died without closing its stream: cancel it in the bridge
+    case Enum.find(state.streams, fn {_ref, {_pid, mon}} -> mon == monitor end) do
+      {ref, _consumer} ->
+        send_to_cnode(bridge_target(state), {:cancel, ref})
+        {:noreply, %{state | streams: Map.delete(state.streams, ref)}}
+
+      nil ->
+        {:noreply, state}
+    end
+  end
+
   def handle_info({port, {:data, data}}, %{port: port} = state) do
     output = to_string(data)
     Logger.debug("C-Node output: #{String.trim(output)}")
@@ -180,7 +610,7 @@ defmodule ExMaude.Backend.CNode do
     if String.contains?(output, "READY") and not state.connected do
       Logger.info("C-Node ready, connecting...")
 
-      case connect_to_cnode(state) do
+      case connect_bridge(state) do
         {:ok, state} ->
           {:noreply, state}
 
@@ -207,9 +637,26 @@ defmodule ExMaude.Backend.CNode do
   def terminate(reason, state) do
     Logger.debug("ExMaude.Backend.CNode terminating: #{inspect(reason)}")
 
-    # Send stop command to C-Node
-    if state.connected do
-      send_cnode_command(state.cnode_name, :stop)
+    # Fail requests that are still waiting for the bridge
+    Enum.each(state.pending, fn {_ref, %{from: from}} ->
+      GenServer.reply(from, {:error, Error.exception(:not_connected, "C-Node terminated")})
+    end)
+
+    cond do
+      # The bridge stops once its socket closes
+      state.socket ->
+        :gen_tcp.close(state.socket)
+
+      state.listen_socket ->
+        :gen_tcp.close(state.listen_socket)
+        File.rm(state.socket_path)
+
+      # Send stop command to C-Node
+      state.connected ->
+        call_cnode(state.cnode_name, :stop, @connect_timeout)
+
+      true ->
+        :ok
     end
 
     # Close the port
@@ -233,50 +680,99 @@ defmodule ExMaude.Backend.CNode do
   defp start_cnode(state) do
     bridge_path = bridge_executable()
 
-    unless File.exists?(bridge_path) do
-      {:error, {:missing_binary, bridge_path}}
-    else
-      # Generate both string (for args) and atom (for cnode_name) forms
-      {node_name_str, cnode_name_atom} = generate_node_name()
-      erlang_node = Atom.to_string(Node.self())
+    cond do
+      not File.exists?(bridge_path) ->
+        {:error, {:missing_binary, bridge_path}}
+
+      state.transport == :socket ->
+        start_socket_bridge(state, bridge_path)
 
       # Ensure we're running as a distributed node
-      unless Node.alive?() do
+      not Node.alive?() ->
         {:error, :node_not_distributed}
-      else
-        args = [
-          node_name_str,
-          state.cookie,
-          state.maude_path,
-          erlang_node
-        ]
 
-        port =
-          Port.open(
-            {:spawn_executable, bridge_path},
-            [
-              :binary,
-              :exit_status,
-              :use_stdio,
-              :stderr_to_stdout,
-              {:args, args},
-              :stream
-            ]
-          )
+      true ->
+        # Generate both string (for args) and atom (for cnode_name) forms
+        {node_name_str, cnode_name_atom} = generate_node_name()
+        erlang_node = Atom.to_string(Node.self())
+
+        args = [node_name_str, state.cookie, state.maude_path, erlang_node | bridge_options(state)]
+        {port, os_pid} = open_bridge(bridge_path, args)
+
+        {:ok, %{state | port: port, os_pid: os_pid, cnode_name: cnode_name_atom}}
+    end
+  end
 
-        {:os_pid, os_pid} = Port.info(port, :os_pid)
+  # Listen before the bridge starts; it connects once its Maude children
+  # are ready and the connection is accepted when it prints READY
+  defp start_socket_bridge(state, bridge_path) do
+    path = socket_path()
+    File.rm(path)
+
+    case :gen_tcp.listen(0, [:binary, {:ifaddr, {:local, path}}, {:packet, 4}, active: false]) do
+      {:ok, listen_socket} ->
+        args = ["-socket", path, state.maude_path | bridge_options(state)]
+        {port, os_pid} = open_bridge(bridge_path, args)
 
         {:ok,
-         %{
-           state
-           | port: port,
-             os_pid: os_pid,
-             cnode_name: cnode_name_atom
-         }}
-      end
+         %{state | port: port, os_pid: os_pid, listen_socket: listen_socket, socket_path: path}}
+
+      {:error, reason} ->
+        {:error, {:listen_failed, reason}}
+    end
+  end
+
+  defp bridge_options(state) do
+    [
+      "-instances",
+      Integer.to_string(state.instances),
+      "-queue",
+      Integer.to_string(state.queue),
+      "-max-output",
+      Integer.to_string(state.max_output)
+    ] ++
+      limit_option("-memory-limit", state.memory_limit) ++
+      limit_option("-max-rss", state.max_rss) ++
+      limit_option("-cpu-affinity", state.cpu_affinity) ++
+      Enum.flat_map(state.preload_modules, &["-preload", &1])
+  end
+
+  defp limit_option(_flag, nil), do: []
+  defp limit_option(flag, value), do: [flag, Integer.to_string(value)]
+
+  defp open_bridge(bridge_path, args) do
+    port =
+      Port.open(
+        {:spawn_executable, bridge_path},
+        [
+          :binary,
+          :exit_status,
+          :use_stdio,
+          :stderr_to_stdout,
+          {:args, args},
+          :stream
+        ]
+      )
+
+    {:os_pid, os_pid} = Port.info(port, :os_pid)
+    {port, os_pid}
+  end
+
+  defp connect_bridge(%{transport: :socket} = state) do
+    result = :gen_tcp.accept(state.listen_socket, @connect_timeout)
+    :gen_tcp.close(state.listen_socket)
+    File.rm(state.socket_path)
+    state = %{state | listen_socket: nil}
+
+    with {:ok, socket} <- result,
+         :ok <- :inet.setopts(socket, active: true) do
+      Logger.info("Connected to C-Node over #{state.socket_path}")
+      {:ok, %{state | socket: socket, connected: true}}
     end
   end
 
+  defp connect_bridge(state), do: connect_to_cnode(state)
+
   defp connect_to_cnode(state, retries \\ 10) do
     if retries <= 0 do
       Logger.error("Failed to connect to C-Node after all retries: #{state.cnode_name}")
@@ -300,25 +796,225 @@ defmodule ExMaude.Backend.CNode do
     end
   end
 
-  defp send_cnode_command(cnode_name, command) do
-    try do
-      # Send command to C-Node using the :any registered name pattern
-      # The C-Node expects: {:execute, binary} or atoms like :ping, :stop
-      send({:any, cnode_name}, command)
+  # Forward a request tagged with a fresh ref; the reply arrives in handle_info/2
+  defp load(state, kind, payload, source, from) do
+    if source && Modules.unchanged?(state.modules, source) do
+      {:reply, :ok, state}
+    else
+      {:noreply, send_request(state, kind, payload, from, @default_timeout, %{source: source})}
+    end
+  end
+
+  defp send_request(state, kind, payload, from, timeout, extra \\ %{}) do
+    ref = make_ref()
+
+    case send_to_cnode(bridge_target(state), request_message(kind, ref, payload, timeout)) do
+      :ok ->
+        timer =
+          Process.send_after(
+            self(),
+            {:request_timeout, ref},
+            request_timeout(kind, payload, timeout) + @cancel_grace
+          )
+
+        request = Map.merge(extra, %{from: from, kind: kind, timer: timer, timeout: timeout})
+        %{state | pending: Map.put(state.pending, ref, request)}
+
+      {:error, _} = error ->
+        GenServer.reply(from, error)
+        state
+    end
+  end
+
+  # Queries without arguments carry only their ref
+  defp request_message(:stats, ref, _payload, _timeout), do: {:stats, ref}
+  defp request_message(kind, ref, payload, timeout), do: {kind, ref, payload, timeout}
+
+  # A batch gets the per-command timeout for each of its commands
+  defp request_timeout(:execute_batch, commands, timeout),
+    do: timeout * max(length(commands), 1)
+
+  defp request_timeout(_kind, _payload, timeout), do: timeout
+
+  defp complete_request(state, ref, response) do
+    {request, pending} = Map.pop!(state.pending, ref)
+    Process.cancel_timer(request.timer)
+
+    result = to_result(response, request, state)
+    GenServer.reply(request.from, result)
+
+    if request.kind in [:execute, :execute_parsed] do
+      emit_telemetry(:command_complete, %{success: match?({:ok, _}, result)})
+    end
+
+    record_load(%{state | pending: pending}, request, result)
+  end
+
+  defp record_load(state, %{source: source}, :ok) when is_binary(source),
+    do: %{state | modules: Modules.put(state.modules, source)}
+
+  defp record_load(state, _request, _result), do: state
+
+  defp to_result({:ok, output}, %{kind: :execute}, _state) when is_binary(output),
+    do: {:ok, output}
+
+  defp to_result({:ok, parsed}, %{kind: :execute_parsed}, _state),
+    do: {:ok, Parser.to_result(parsed)}
+
+  defp to_result({:ok, results}, %{kind: :execute_batch} = request, state)
+       when is_list(results) do
+    {:ok, Enum.map(results, &batch_result(&1, request, state))}
+  end
+
+  defp to_result(:ok, %{kind: kind}, _state) when kind in [:load_file, :load_source], do: :ok
+  defp to_result({:stats, stats}, %{kind: :stats}, _state), do: {:ok, stats}
+  defp to_result({:error, %Error{}} = error, _request, _state), do: error
+
+  defp to_result({:error, :output_too_large}, _request, state),
+    do: {:error, Error.output_too_large(state.max_output)}
+
+  defp to_result({:error, :timeout}, request, _state), do: {:error, Error.timeout(request.timeout)}
+
+  defp to_result({:error, reason}, _request, _state), do: {:error, bridge_error(reason)}
+
+  defp batch_result(output, _request, _state) when is_binary(output), do: {:ok, output}
+  defp batch_result({:error, reason}, request, state), do: to_result({:error, reason}, request, state)
+
+  # Bridge errors are either Maude output or atoms describing the failure
+  defp bridge_error(output) when is_binary(output), do: Error.from_output(output)
+  defp bridge_error(:timeout), do: Error.timeout(@default_timeout)
+  defp bridge_error(reason), do: Error.exception(:cnode_error, "C-Node error: #{reason}")
 
+  # Over distribution streams bypass the GenServer: the consuming process
+  # talks to the bridge directly, so chunks never queue up in the worker's
+  # mailbox. Over a socket only the worker can read, so it relays them
+  defp open_stream(server, command, timeout) do
+    ref = make_ref()
+
+    case GenServer.call(server, {:stream_target, ref}) do
+      {:ok, target, max_output} ->
+        case send_to_cnode(target, {:execute_stream, ref, command, timeout}) do
+          :ok ->
+            %{server: server, target: target, ref: ref, max_output: max_output, done: false}
+
+          {:error, error} ->
+            GenServer.cast(server, {:close_stream, ref})
+            raise error
+        end
+
+      {:error, error} ->
+        raise error
+    end
+  end
+
+  defp next_chunk(%{done: true} = stream, _timeout), do: {:halt, stream}
+
+  defp next_chunk(%{ref: ref} = stream, timeout) do
+    receive do
+      {:chunk, ^ref, chunk} ->
+        send_to_cnode(stream.target, {:ack, ref})
+        {[chunk], stream}
+
+      {:done, ^ref} ->
+        {:halt, %{stream | done: true}}
+
+      {:error, ^ref, :output_too_large} ->
+        raise Error.output_too_large(stream.max_output)
+
+      {:error, ^ref, :timeout} ->
+        raise Error.timeout(timeout)
+
+      {:error, ^ref, reason} ->
+        raise bridge_error(reason)
+    after
+      (timeout + @cancel_grace) -> raise Error.timeout(timeout)
+    end
+  end
+
+  defp close_stream(%{done: true}), do: :ok
+
+  defp close_stream(%{server: server, target: target, ref: ref}) do
+    send_to_cnode(target, {:cancel, ref})
+    GenServer.cast(server, {:close_stream, ref})
+    flush_stream(ref)
+  end
+
+  # Drop chunks that were already in flight when the stream was halted
+  defp flush_stream(ref) do
+    receive do
+      {:chunk, ^ref, _chunk} -> flush_stream(ref)
+      {:done, ^ref} -> :ok
+      {:error, ^ref, _reason} -> :ok
+    after
+      0 -> :ok
+    end
+  end
+
+  # Synchronous request used outside the request flow, e.g. on terminate
+  defp call_cnode(cnode_name, command, timeout) do
+    ref = make_ref()
+
+    with :ok <- send_to_cnode(cnode_name, {command, ref}) do
       receive do
-        response -> response
+        {:ok, ^ref} -> :ok
+        {:pong, ^ref} -> :pong
+        {:error, ^ref, reason} -> {:error, bridge_error(reason)}
       after
-        @connect_timeout ->
-          {:error, Error.timeout(@connect_timeout)}
+        timeout -> {:error, Error.timeout(timeout)}
       end
-    catch
-      kind, reason ->
-        Logger.error("C-Node command failed: #{kind} - #{inspect(reason)}")
+    end
+  end
+
+  # Where requests go: the bridge's node, or the socket of the socket transport
+  defp bridge_target(%{socket: nil, cnode_name: cnode_name}), do: cnode_name
+  defp bridge_target(%{socket: socket}), do: socket
+
+  # Consumers of socket streams are monitored, so an abandoned stream is
+  # cancelled in the bridge
+  defp watch_stream(state, ref, pid) do
+    %{state | streams: Map.put(state.streams, ref, {pid, Process.monitor(pid)})}
+  end
+
+  defp unwatch_stream(state, ref) do
+    case Map.pop(state.streams, ref) do
+      {{_pid, monitor}, streams} ->
+        Process.demonitor(monitor, [:flush])
+        %{state | streams: streams}
+
+      {nil, _streams} ->
+        state
+    end
+  end
+
+  # Forward a bridge message to the stream's consumer; the final one ends it
+  defp relay_stream(state, ref, message) do
+    {pid, _monitor} = Map.fetch!(state.streams, ref)
+    send(pid, message)
+
+    if elem(message, 0) == :chunk, do: state, else: unwatch_stream(state, ref)
+  end
+
+  defp send_to_cnode(socket, message) when is_port(socket) do
+    case :gen_tcp.send(socket, :erlang.term_to_binary(message)) do
+      :ok ->
+        :ok
+
+      {:error, reason} ->
+        Logger.error("C-Node command failed: #{inspect(reason)}")
         {:error, Error.exception(:cnode_error, inspect(reason))}
     end
   end
 
+  defp send_to_cnode(cnode_name, message) do
+    # Send command to C-Node using the :any registered name pattern
+    send({:any, cnode_name}, message)
+    :ok
+  catch
+    kind, reason ->
+      Logger.error("C-Node command failed: #{kind} - #{inspect(reason)}")
+      {:error, Error.exception(:cnode_error, inspect(reason))}
+  end
+
   defp schedule_health_check do
     Process.send_after(self(), :health_check, @health_check_interval)
   end
@@ -328,6 +1024,35 @@ defmodule ExMaude.Backend.CNode do
     Path.join(priv_dir, "maude_bridge")
   end
 
+  defp config_instances do
+    Application.get_env(:ex_maude, :cnode_instances, @default_instances)
+  end
+
+  defp config_queue do
+    Application.get_env(:ex_maude, :cnode_queue, @default_queue)
+  end
+
+  defp config_max_output do
+    Application.get_env(:ex_maude, :cnode_max_output, @default_max_output)
+  end
+
+  defp config_preload_modules do
+    Application.get_env(:ex_maude, :preload_modules, [])
+  end
+
+  defp config_limit(key) do
+    Application.get_env(:ex_maude, key)
+  end
+
+  defp config_transport do
+    Application.get_env(:ex_maude, :cnode_transport, :distribution)
+  end
+
+  defp socket_path do
+    id = :erlang.unique_integer([:positive])
+    Path.join(System.tmp_dir!(), "ex_maude_bridge_#{System.pid()}_#{id}.sock")
+  end
+
   defp get_cookie do
     case Node.get_cookie() do
       :nocookie -> "exmaude"
@@ -0,0 +1,222 @@
+defmodule ExMaude.Backend.CNode.Stats do
+  @moduledoc """
+  Bridge-side counters and latency histograms of the C-Node backend.
+
+  The `maude_bridge` process times every request in four phases and
+  answers `{stats, Ref}` with the totals since it started:
+
+  | Phase | Covers |
+  |-------|--------|
+  | `:decode` | receiving and handling a request message, up to writing the command to Maude |
+  | `:compute` | command written until Maude printed its prompt, minus reads |
+  | `:read` | reading the child's output and scanning it for the prompt |
+  | `:encode` | building the final reply, including `execute_parsed` tokenizing |
+
+  Each phase is a histogram with `:count`, `:sum_us`, `:min_us`, `:max_us`
+  and `:buckets`, a list of `{upper_us, count}` for the log-linear buckets
+  that were hit. Bucket bounds are exact to 1/8 of the value, like an
+  HdrHistogram with one significant digit. Next to the phases the snapshot
+  holds `:bytes_in` / `:bytes_out` on the distribution connection,
+  `:maude_bytes_written` / `:maude_bytes_read` on the children's pipes,
+  `:timeouts`, `:overloaded`, `:restarts`, `:recycled` (children replaced
+  for outgrowing `:max_rss`), the current `:queued` count, `:uptime_ms` and
+  `:rss_bytes`, the resident set of every Maude child in bytes (0 where the
+  platform does not report it).
+
+  `ExMaude.Backend.CNode.stats/1` returns the snapshot. The worker also asks
+  for one on every health check and reports the difference to the previous
+  one as telemetry, so compute time in Maude can be told apart from time in
+  the bridge and on the wire:
+
+  `[:ex_maude, :bridge, :stats]`
+  - Measurements: counter increments since the last report, plus `:queued`,
+    and the current `:rss_bytes` (summed over the children) and
+    `:max_rss_bytes` (of the largest one)
+  - Metadata: `%{pid: pid, node: atom}`
+
+  `[:ex_maude, :bridge, :phase]`, once per phase with requests in the interval
+  - Measurements: `%{count: integer, total: integer, p50: integer, p90: integer,
+    p99: integer, max: integer}` (durations in native time units)
+  - Metadata: `%{pid: pid, node: atom, phase: :decode | :compute | :read | :encode}`
+  """
+
+  @phases [:decode, :compute, :read, :encode]
+  @counters [
+    :bytes_in,
+    :bytes_out,
+    :maude_bytes_written,
+    :maude_bytes_read,
+    :timeouts,
+    :overloaded,
+    :restarts,
+    :recycled
+  ]
+
+  @typedoc """
+  Latency histogram of one phase, in microseconds.
+  """
+  @type histogram :: %{
+          count: non_neg_integer(),
+          sum_us: non_neg_integer(),
+          min_us: non_neg_integer(),
+          max_us: non_neg_integer(),
+          buckets: [{non_neg_integer(), pos_integer()}]
+        }
+
+  @typedoc """
+  Snapshot answered by the bridge.
+  """
+  @type t :: %{optional(atom()) => non_neg_integer() | [non_neg_integer()] | histogram()}
+
+  @doc """
+  Returns the phases the bridge times.
+  """
+  @spec phases() :: [atom()]
+  def phases, do: @phases
+
+  @doc """
+  Returns the value in microseconds below which a fraction `q` of the
+  recorded values fall, as the upper bound of its bucket. Empty histograms
+  return 0.
+
+  ## Examples
+
+      iex> buckets = [{5, 1}, {23, 2}, {103, 1}]
+      iex> histogram = %{count: 4, sum_us: 130, min_us: 5, max_us: 100, buckets: buckets}
+      iex> ExMaude.Backend.CNode.Stats.percentile(histogram, 0.5)
+      23
+      iex> ExMaude.Backend.CNode.Stats.percentile(histogram, 0.99)
+      100
+  """
+  @spec percentile(histogram(), float()) :: non_neg_integer()
+  def percentile(%{count: 0}, _q), do: 0
+
+  def percentile(%{count: count, buckets: buckets, max_us: max_us}, q) when q >= 0 and q <= 1 do
+    rank = max(ceil(count * q), 1)
+
+    buckets
+    |> Enum.reduce_while(0, fn {upper, n}, seen ->
+      if seen + n >= rank, do: {:halt, {:found, upper}}, else: {:cont, seen + n}
+    end)
+    |> case do
+      {:found, upper} -> min(upper, max_us)
+      _seen -> max_us
+    end
+  end
+
+  @doc """
+  Returns what changed from `previous` to `current`: counter increments and
+  the histograms of the values recorded in between.
+
+  With no previous snapshot, `current` itself is the difference. The
+  `:min_us` and `:max_us` of an interval are bucket bounds, clamped to the
+  totals.
+
+  ## Examples
+
+      iex> before = %{count: 1, sum_us: 5, min_us: 5, max_us: 5, buckets: [{5, 1}]}
+      iex> now = %{count: 3, sum_us: 37, min_us: 5, max_us: 17, buckets: [{5, 1}, {17, 2}]}
+      iex> ExMaude.Backend.CNode.Stats.diff(%{timeouts: 3, decode: now}, %{timeouts: 1, decode: before})
+      %{timeouts: 2, decode: %{count: 2, sum_us: 32, min_us: 16, max_us: 17, buckets: [{17, 2}]}}
+  """
+  @spec diff(t(), t() | nil) :: t()
+  def diff(current, nil), do: current
+
+  def diff(current, previous) do
+    Map.new(current, fn
+      {phase, histogram} when is_map(histogram) ->
+        {phase, diff_histogram(histogram, Map.get(previous, phase))}
+
+      {key, value} when key in @counters ->
+        {key, max(value - Map.get(previous, key, 0), 0)}
+
+      other ->
+        other
+    end)
+  end
+
+  @doc """
+  Emits the telemetry events for the interval from `previous` to `current`.
+  """
+  @spec emit(t(), t() | nil, map()) :: :ok
+  def emit(current, previous, metadata) do
+    interval = diff(current, previous)
+
+    :telemetry.execute(
+      [:ex_maude, :bridge, :stats],
+      interval |> Map.take([:queued | @counters]) |> Map.merge(rss_measurements(current)),
+      metadata
+    )
+
+    for phase <- @phases,
+        %{count: count} = histogram <- [Map.get(interval, phase)],
+        count > 0 do
+      :telemetry.execute(
+        [:ex_maude, :bridge, :phase],
+        phase_measurements(histogram),
+        Map.put(metadata, :phase, phase)
+      )
+    end
+
+    :ok
+  end
+
+  # Private Functions
+
+  defp rss_measurements(%{rss_bytes: [_ | _] = rss}),
+    do: %{rss_bytes: Enum.sum(rss), max_rss_bytes: Enum.max(rss)}
+
+  defp rss_measurements(_snapshot), do: %{}
+
+  defp diff_histogram(histogram, nil), do: histogram
+
+  defp diff_histogram(histogram, previous) do
+    seen = Map.new(previous.buckets)
+
+    buckets =
+      Enum.flat_map(histogram.buckets, fn {upper, n} ->
+        delta = n - Map.get(seen, upper, 0)
+        if delta > 0, do: [{upper, delta}], else: []
+      end)
+
+    {min_us, max_us} =
+      case buckets do
+        [] ->
+          {0, 0}
+
+        [{first, _} | _] ->
+          {last, _} = List.last(buckets)
+          {max(lower_bound(first), histogram.min_us), min(last, histogram.max_us)}
+      end
+
+    %{
+      count: max(histogram.count - previous.count, 0),
+      sum_us: max(histogram.sum_us - previous.sum_us, 0),
+      min_us: min_us,
+      max_us: max_us,
+      buckets: buckets
+    }
+  end
+
+  # Bucket bounds follow the bridge: exact below 8, then 8 buckets for
+  # every power of two
+  defp lower_bound(upper) when upper < 8, do: upper
+
+  defp lower_bound(upper) do
+    shift = length(Integer.digits(upper, 2)) - 4
+    upper - Bitwise.bsl(1, shift) + 1
+  end
+
+  defp phase_measurements(histogram) do
+    %{
+      count: histogram.count,
+      total: to_native(histogram.sum_us),
+      p50: to_native(percentile(histogram, 0.5)),
+      p90: to_native(percentile(histogram, 0.9)),
+      p99: to_native(percentile(histogram, 0.99)),
+      max: to_native(histogram.max_us)
+    }
+  end
+
+  defp to_native(us), do: System.convert_time_unit(us, :microsecond, :native)
+end
@@ -0,0 +1,123 @@
+defmodule ExMaude.Backend.Modules do
+  @moduledoc """
+  Content-addressed table of the modules loaded into a worker.
+
+  Backends keep one table per worker, mapping every module name declared
+  by a loaded source to the SHA-256 of that source. Loading a source again
+  is a no-op when each module it declares was last defined by the very
+  same content, so redeploying an unchanged module set costs one hash per
+  source instead of a Maude parse.
+
+  The check is deliberately conservative. A source is always loaded when:
+
+    * it declares no module, view or theory (e.g. it only runs commands)
+    * it loads other files (`load`, `sload`, `in`), whose content the
+      table cannot see
+    * any module it declares was redefined since, even by an older
+      version of the same source, so rolling back reloads
+
+  ## Examples
+
+      iex> alias ExMaude.Backend.Modules
+      iex> source = "fmod GREETING is sort Greeting . endfm"
+      iex> table = Modules.put(Modules.new(), source)
+      iex> Modules.unchanged?(table, source)
+      true
+      iex> Modules.unchanged?(table, "fmod GREETING is sort Hello . endfm")
+      false
+  """
+
+  @typedoc """
+  Module name to the digest of the source that last defined it.
+  """
+  @type t :: %{String.t() => binary()}
+
+  @declaration ~r/^\s*(?:fmod|mod|fth|th|smod|sth|omod|oth|view)\s+([^\s{(]+)/m
+  @include ~r/^\s*(?:s?load|in)\s/m
+
+  @doc """
+  Returns an empty table.
+  """
+  @spec new() :: t()
+  def new, do: %{}
+
+  @doc ~S"""
+  Returns the names of the modules, theories and views `source` declares.
+
+  ## Examples
+
+      iex> ExMaude.Backend.Modules.names("fmod LIST{X :: TRIV} is endfm\nview Nat from TRIV to NAT is endv")
+      ["LIST", "Nat"]
+  """
+  @spec names(String.t()) :: [String.t()]
+  def names(source) do
+    @declaration
+    |> Regex.scan(source, capture: :all_but_first)
+    |> List.flatten()
+    |> Enum.uniq()
+  end
+
+  @doc """
+  Returns whether loading `source` would leave the worker as it is.
+  """
+  @spec unchanged?(t(), String.t()) :: boolean()
+  def unchanged?(table, source) do
+    case names(source) do
+      [] ->
+        false
+
+      names ->
+        digest = digest(source)
+
+        not Regex.match?(@include, source) and
+          Enum.all?(names, &(Map.get(table, &1) == digest))
+    end
+  end
+
+  @doc """
+  Records that `source` was loaded, making it the definition of every
+  module it declares.
+  """
+  @spec put(t(), String.t()) :: t()
+  def put(table, source) do
+    digest = digest(source)
+    Enum.reduce(names(source), table, &Map.put(&2, &1, digest))
+  end
+
+  @doc """
+  Writes `source` to a temporary file, calls `fun` with its path and
+  removes the file again.
+
+  For backends that can only load files.
+  """
+  # sobelow_skip ["Traversal.FileModule"]
+  @spec with_temp_file(String.t(), (Path.t() -> result)) :: result | {:error, ExMaude.Error.t()}
+        when result: term()
+  def with_temp_file(source, fun) do
+    # The path is constructed from System.tmp_dir! and a unique integer,
+    # with no user input in the path - safe from directory traversal.
+    tmp_dir = System.tmp_dir!()
+    filename = "ex_maude_#{:erlang.unique_integer([:positive])}.maude"
+    tmp_path = Path.join(tmp_dir, filename)
+
+    # Verify path stays within tmp_dir (defense in depth)
+    expanded_path = Path.expand(tmp_path)
+    expanded_tmp = Path.expand(tmp_dir)
+
+    if String.starts_with?(expanded_path, expanded_tmp) do
+      try do
+        File.write!(expanded_path, source)
+        fun.(expanded_path)
+      after
+        File.rm(expanded_path)
+      end
+    else
+      # coveralls-ignore-start
+      # This branch can only be reached if Path.expand behaves unexpectedly
+      {:error, ExMaude.Error.invalid_path("Generated path escapes temp directory")}
+      # coveralls-ignore-stop
+    end
+  end
+
+  defp digest(source), do: :crypto.hash(:sha256, source)
+end
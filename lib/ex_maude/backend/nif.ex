@@ -15,9 +15,30 @@ defmodule ExMaude.Backend.NIF do
   ## Features
 
     * Lower latency than Port backend
-    * Uses Rust dirty CPU schedulers for I/O operations
+    * Commands run on a background I/O thread per Maude process, so no
+      scheduler is blocked while Maude computes
     * Managed subprocess with synchronized I/O
 
+  ## Async Execution
+
+  The worker queues each command with `execute_async` and returns to its
+  mailbox right away. The NIF's I/O thread answers with a
+  `{:maude_result, ref, result}` message, which the worker matches to the
+  waiting caller. Commands from many callers can be in flight at once
+  without tying up dirty schedulers, of which there are only as many as
+  cores; Maude still runs them one at a time.
+
+  The I/O thread also enforces each command's `:timeout`: a command that
+  runs past it is answered with a timeout error and Maude is killed. The
+  commands queued behind it fail right away, and the worker stops once
+  they are answered, so its supervisor starts a fresh Maude.
+
+  ## Module Loading
+
+  As with the Port backend, `load_file/2` answers `:ok` without asking
+  Maude when every module in the file is already loaded in this version.
+  See `ExMaude.Backend.Modules`.
+
   ## Trade-offs
 
     * **No process isolation** - NIF crash takes down the BEAM
@@ -59,6 +80,7 @@ defmodule ExMaude.Backend.NIF do
   require Logger
 
   alias ExMaude.{Binary, Error}
+  alias ExMaude.Backend.Modules
 
   @default_timeout 30_000
 
@@ -68,13 +90,22 @@ defmodule ExMaude.Backend.NIF do
   @type t :: %__MODULE__{
           handle: reference() | nil,
           maude_path: String.t() | nil,
-          initialized: boolean()
+          initialized: boolean(),
+          modules: Modules.t(),
+          timed_out: boolean(),
+          pending: %{
+            reference() =>
+              {:execute | {:load_file, binary() | nil}, GenServer.from(), pos_integer()}
+          }
         }
 
   defstruct [
     :handle,
     :maude_path,
-    initialized: false
+    initialized: false,
+    modules: %{},
+    timed_out: false,
+    pending: %{}
   ]
 
   # Native module - loads the Rustler NIF
@@ -125,8 +156,9 @@ defmodule ExMaude.Backend.NIF do
     end
 
     @doc false
-    @spec execute(reference(), String.t()) :: binary() | {:ok, String.t()} | {:error, term()}
-    def execute(_handle, _command) do
+    @spec execute_async(reference(), String.t(), pos_integer()) ::
+            reference() | {:error, term()}
+    def execute_async(_handle, _command, _timeout_ms) do
       :erlang.nif_error(:nif_not_loaded)
     end
 
@@ -168,13 +200,13 @@ defmodule ExMaude.Backend.NIF do
     * `:timeout` - Maximum time to wait in milliseconds (default: 30000)
 
   """
-  @spec execute(GenServer.server(), String.t(), keyword()) ::
+  @spec execute(GenServer.server(), iodata(), keyword()) ::
           {:ok, String.t()} | {:error, term()}
   def execute(server, command, opts \\ []) do
     timeout = Keyword.get(opts, :timeout, @default_timeout)
 
     try do
-      GenServer.call(server, {:execute, command}, timeout + 1_000)
+      GenServer.call(server, {:execute, IO.iodata_to_binary(command), timeout}, timeout + 1_000)
     catch
       :exit, {:timeout, _} -> {:error, Error.timeout(timeout)}
     end
@@ -245,24 +277,11 @@ defmodule ExMaude.Backend.NIF do
   end
 
   @impl GenServer
-  def handle_call({:execute, command}, _from, %{initialized: true, handle: handle} = state) do
-    result =
-      try do
-        case Native.execute(handle, command) do
-          result when is_binary(result) -> {:ok, result}
-          {:ok, result} -> {:ok, result}
-          {:error, _} = err -> err
-        end
-      rescue
-        e ->
-          {:error, Error.exception(:nif_error, Exception.message(e))}
-      end
-
-    emit_telemetry(:command_complete, %{success: match?({:ok, _}, result)})
-    {:reply, result, state}
+  def handle_call({:execute, command, timeout}, from, %{initialized: true} = state) do
+    submit(state, :execute, command, timeout, from)
   end
 
-  def handle_call({:execute, _command}, _from, state) do
+  def handle_call({:execute, _command, _timeout}, _from, state) do
     {:reply,
      {:error,
       Error.exception(
@@ -271,31 +290,19 @@ defmodule ExMaude.Backend.NIF do
       )}, state}
   end
 
-  def handle_call({:load_file, path}, _from, %{initialized: true, handle: handle} = state) do
-    command = "load #{path}"
-
-    result =
-      try do
-        case Native.execute(handle, command) do
-          result when is_binary(result) ->
-            if String.contains?(result, "Error") do
-              {:error, Error.exception(:load_error, result)}
-            else
-              :ok
-            end
-
-          {:ok, _} ->
-            :ok
-
-          {:error, _} = err ->
-            err
-        end
-      rescue
-        e ->
-          {:error, Error.exception(:nif_error, Exception.message(e))}
+  def handle_call({:load_file, path}, from, %{initialized: true} = state) do
+    # A file that cannot be read is left to Maude to report
+    source =
+      case File.read(path) do
+        {:ok, source} -> source
+        {:error, _reason} -> nil
       end
 
-    {:reply, result, state}
+    if source && Modules.unchanged?(state.modules, source) do
+      {:reply, :ok, state}
+    else
+      submit(state, {:load_file, source}, "load #{path}", @default_timeout, from)
+    end
   end
 
   def handle_call({:load_file, _path}, _from, state) do
@@ -323,6 +330,33 @@ defmodule ExMaude.Backend.NIF do
   end
 
   @impl GenServer
+  def handle_info({:maude_result, ref, result}, %{pending: pending} = state)
+      when is_map_key(pending, ref) do
+    {{kind, from, timeout}, pending} = Map.pop!(pending, ref)
+    reply = to_reply(kind, result, timeout)
+
+    if kind == :execute do
+      emit_telemetry(:command_complete, %{success: match?({:ok, _}, reply)})
+    end
+
+    GenServer.reply(from, reply)
+
+    state = %{
+      state
+      | pending: pending,
+        modules: record_load(state.modules, kind, reply),
+        timed_out: state.timed_out or result == {:error, "timeout"}
+    }
+
+    # The I/O thread killed Maude; stop once every queued command has its
+    # error so the supervisor starts a new worker
+    if state.timed_out and pending == %{} do
+      {:stop, {:shutdown, :maude_timeout}, state}
+    else
+      {:noreply, state}
+    end
+  end
+
   def handle_info(_msg, state) do
     {:noreply, state}
   end
@@ -345,6 +379,41 @@ defmodule ExMaude.Backend.NIF do
     :ok
   end
 
+  # Queue the command on the NIF's I/O thread and answer the caller when
+  # its {:maude_result, ref, result} message arrives
+  defp submit(%{handle: handle} = state, kind, command, timeout, from) do
+    case Native.execute_async(handle, command, timeout) do
+      ref when is_reference(ref) ->
+        {:noreply, %{state | pending: Map.put(state.pending, ref, {kind, from, timeout})}}
+
+      {:error, reason} ->
+        {:reply, {:error, Error.exception(:nif_error, inspect(reason))}, state}
+    end
+  rescue
+    e ->
+      {:reply, {:error, Error.exception(:nif_error, Exception.message(e))}, state}
+  end
+
+  defp to_reply(:execute, {:ok, output}, _timeout), do: {:ok, output}
+
+  defp to_reply({:load_file, _source}, {:ok, output}, _timeout) do
+    if String.contains?(output, "Error") do
+      {:error, Error.exception(:load_error, output)}
+    else
+      :ok
+    end
+  end
+
+  defp to_reply(_kind, {:error, "timeout"}, timeout), do: {:error, Error.timeout(timeout)}
+
+  defp to_reply(_kind, {:error, reason}, _timeout),
+    do: {:error, Error.exception(:nif_error, to_string(reason))}
+
+  defp record_load(modules, {:load_file, source}, :ok) when is_binary(source),
+    do: Modules.put(modules, source)
+
+  defp record_load(modules, _kind, _reply), do: modules
+
   # coveralls-ignore-stop
 
   # Private Functions
@@ -5,6 +5,22 @@ defmodule ExMaude.Backend.Port do
   This backend communicates with Maude via an Erlang Port, using a PTY wrapper
   to ensure Maude outputs prompts for response detection.
 
+  ## PTY Helper
+
+  When `priv/maude_pty` was built (by `c_src/Makefile`, next to
+  `maude_bridge`), Maude runs on a pty opened by that helper with
+  `forkpty`, in raw mode without echo. The Port talks to it in
+  length-prefixed `{:packet, 4}` messages, so there is no Tcl/expect
+  process in between and no terminal line discipline to pass through.
+  Without the helper, or with `pty_helper: false`, Maude is wrapped in
+  `unbuffer` or `script` instead.
+
+  ## Module Loading
+
+  `load_file/2` hashes the file first and answers `:ok` without asking
+  Maude when every module in it is already loaded in this version. See
+  `ExMaude.Backend.Modules`.
+
   ## Features
 
     * Full process isolation - Maude crashes don't affect the BEAM
@@ -21,7 +37,8 @@ defmodule ExMaude.Backend.Port do
 
       config :ex_maude,
         backend: :port,
-        use_pty: true  # Set to false if PTY allocation fails
+        use_pty: true,    # Set to false if PTY allocation fails
+        pty_helper: true  # Set to false to use unbuffer/script instead
 
   """
 
@@ -30,23 +47,41 @@ defmodule ExMaude.Backend.Port do
   use GenServer
   require Logger
 
-  alias ExMaude.{Binary, Error}
+  alias ExMaude.{Binary, Error, Parser}
+  alias ExMaude.Backend.Modules
 
   @default_timeout_ms 5_000
   @prompt_marker "Maude>"
+  @prompt_tail byte_size(@prompt_marker) - 1
 
   @typedoc """
   Internal state for the Port backend GenServer.
   """
   @type t :: %__MODULE__{
           port: port() | nil,
-          buffer: String.t() | nil,
+          buffer: iodata(),
+          buffer_size: non_neg_integer(),
+          tail: binary(),
           from: GenServer.from() | nil,
           timeout_ref: reference() | nil,
-          maude_path: String.t() | nil
+          maude_path: String.t() | nil,
+          parsed: boolean(),
+          modules: Modules.t(),
+          loading: String.t() | nil
         }
 
-  defstruct [:port, :buffer, :from, :timeout_ref, :maude_path]
+  defstruct [
+    :port,
+    :from,
+    :timeout_ref,
+    :maude_path,
+    :loading,
+    buffer: [],
+    buffer_size: 0,
+    tail: "",
+    parsed: false,
+    modules: %{}
+  ]
 
   # Client API
 
@@ -66,12 +101,34 @@ defmodule ExMaude.Backend.Port do
     end
   end
 
+  @doc """
+  Executes a Maude command and returns its output as result structs.
+
+  Unlike `execute/3`, which keeps only the value of a `result` line, the
+  whole output is tokenized with `ExMaude.Parser.tokenize/1`, so the
+  statistics Maude printed stay on the result.
+  """
+  @impl ExMaude.Backend
+  def execute_parsed(server, command, opts \\ []) do
+    timeout = Keyword.get(opts, :timeout, @default_timeout_ms)
+
+    try do
+      GenServer.call(server, {:execute_parsed, command, timeout}, timeout + 1_000)
+    catch
+      :exit, {:timeout, _} -> {:error, Error.timeout(timeout)}
+    end
+  end
+
   @impl ExMaude.Backend
   def load_file(server, path) do
-    case execute(server, "load #{path}") do
+    timeout = @default_timeout_ms
+
+    case GenServer.call(server, {:load_file, path, timeout}, timeout + 1_000) do
       {:ok, _output} -> :ok
       error -> error
     end
+  catch
+    :exit, {:timeout, _} -> {:error, Error.timeout(@default_timeout_ms)}
   end
 
   @impl ExMaude.Backend
@@ -99,7 +156,6 @@ defmodule ExMaude.Backend.Port do
       {:ok, port} ->
         state = %__MODULE__{
           port: port,
-          buffer: "",
           from: nil,
           timeout_ref: nil,
           maude_path: maude_path
@@ -120,6 +176,10 @@ defmodule ExMaude.Backend.Port do
   end
 
   @impl GenServer
+  def handle_call({:execute_parsed, command, timeout}, from, state) do
+    handle_call({:execute, command, timeout}, from, %{state | parsed: true})
+  end
+
   def handle_call({:execute, command, timeout}, from, state) do
     # Ensure command ends with period and newline
     command = ensure_command_format(command)
@@ -132,7 +192,22 @@ defmodule ExMaude.Backend.Port do
 
     emit_telemetry(:command_start, %{command: truncate(command, 100)})
 
-    {:noreply, %{state | from: from, buffer: "", timeout_ref: timeout_ref}}
+    {:noreply, %{reset_buffer(state) | from: from, timeout_ref: timeout_ref}}
+  end
+
+  def handle_call({:load_file, path, timeout}, from, state) do
+    # A file that cannot be read is left to Maude to report
+    source =
+      case File.read(path) do
+        {:ok, source} -> source
+        {:error, _reason} -> nil
+      end
+
+    if source && Modules.unchanged?(state.modules, source) do
+      {:reply, {:ok, ""}, state}
+    else
+      handle_call({:execute, "load #{path}", timeout}, from, %{state | loading: source})
+    end
   end
 
   def handle_call(:alive?, _from, state) do
@@ -142,27 +217,28 @@ defmodule ExMaude.Backend.Port do
 
   @impl GenServer
   def handle_info({port, {:data, data}}, %{port: port} = state) do
-    buffer = state.buffer <> to_string(data)
+    case append_output(state, data) do
+      {:complete, output, size, state} ->
+        # Cancel timeout
+        if state.timeout_ref, do: Process.cancel_timer(state.timeout_ref)
 
-    if response_complete?(buffer) do
-      # Cancel timeout
-      if state.timeout_ref, do: Process.cancel_timer(state.timeout_ref)
+        # Parse and send response
+        response = parse_response(output, state.parsed)
 
-      # Parse and send response
-      response = parse_response(buffer)
+        if state.from do
+          GenServer.reply(state.from, response)
+        end
 
-      if state.from do
-        GenServer.reply(state.from, response)
-      end
+        emit_telemetry(:command_complete, %{
+          success: match?({:ok, _}, response),
+          response_size: size
+        })
 
-      emit_telemetry(:command_complete, %{
-        success: match?({:ok, _}, response),
-        response_size: byte_size(buffer)
-      })
+        state = record_load(state, response)
+        {:noreply, %{state | from: nil, timeout_ref: nil, parsed: false, loading: nil}}
 
-      {:noreply, %{state | from: nil, buffer: "", timeout_ref: nil}}
-    else
-      {:noreply, %{state | buffer: buffer}}
+      {:more, state} ->
+        {:noreply, state}
     end
   end
 
@@ -182,9 +258,10 @@ defmodule ExMaude.Backend.Port do
       GenServer.reply(state.from, {:error, Error.timeout(@default_timeout_ms)})
     end
 
-    emit_telemetry(:timeout, %{buffer_size: byte_size(state.buffer)})
+    emit_telemetry(:timeout, %{buffer_size: state.buffer_size})
 
-    {:noreply, %{state | from: nil, buffer: "", timeout_ref: nil}}
+    {:noreply,
+     %{reset_buffer(state) | from: nil, timeout_ref: nil, parsed: false, loading: nil}}
   end
 
   def handle_info(_msg, state) do
@@ -234,27 +311,29 @@ defmodule ExMaude.Backend.Port do
         ["-interactive" | maude_args]
       end
 
-    # Use script/unbuffer to create a PTY so Maude outputs prompts
-    # Can be disabled via config if PTY allocation fails (e.g., in Docker/CI)
-    {wrapper_executable, wrapper_args} =
-      if use_pty do
-        pty_wrapper(maude_executable, maude_args)
-      else
-        {maude_executable, maude_args}
+    # Use the PTY helper or script/unbuffer to create a PTY so Maude outputs
+    # prompts. Can be disabled via config if PTY allocation fails (e.g., in Docker/CI)
+    helper = if use_pty, do: pty_helper()
+
+    {wrapper_executable, wrapper_args, framing} =
+      cond do
+        helper ->
+          # stderr stays out of the framed stream; Maude's own goes to the pty
+          {helper, [maude_executable | maude_args], [{:packet, 4}]}
+
+        use_pty ->
+          {wrapper, args} = pty_wrapper(maude_executable, maude_args)
+          {wrapper, args, [:stderr_to_stdout, :stream]}
+
+        true ->
+          {maude_executable, maude_args, [:stderr_to_stdout, :stream]}
       end
 
     try do
       port =
         Port.open(
           {:spawn_executable, wrapper_executable},
-          [
-            :binary,
-            :exit_status,
-            :use_stdio,
-            :stderr_to_stdout,
-            {:args, wrapper_args},
-            :stream
-          ]
+          [:binary, :exit_status, :use_stdio, {:args, wrapper_args} | framing]
         )
 
       {:ok, port}
@@ -263,6 +342,14 @@ defmodule ExMaude.Backend.Port do
     end
   end
 
+  defp pty_helper do
+    path = Path.join(Binary.priv_dir(), "maude_pty")
+
+    if Application.get_env(:ex_maude, :pty_helper, true) and File.regular?(path) do
+      path
+    end
+  end
+
   # Use a PTY wrapper to make Maude think it's running interactively
   # This is needed because Maude only outputs prompts in TTY mode
   defp pty_wrapper(executable, args) do
@@ -314,12 +401,9 @@ defmodule ExMaude.Backend.Port do
     # Collect initial output until we see the prompt
     receive do
       {port, {:data, data}} when port == state.port ->
-        buffer = state.buffer <> to_string(data)
-
-        if String.contains?(buffer, @prompt_marker) do
-          %{state | buffer: ""}
-        else
-          wait_for_ready(%{state | buffer: buffer})
+        case append_output(state, data) do
+          {:complete, _output, _size, state} -> state
+          {:more, state} -> wait_for_ready(state)
         end
     after
       10_000 ->
@@ -328,6 +412,11 @@ defmodule ExMaude.Backend.Port do
     end
   end
 
+  defp record_load(%{loading: source} = state, {:ok, _output}) when is_binary(source),
+    do: %{state | modules: Modules.put(state.modules, source)}
+
+  defp record_load(state, _response), do: state
+
   defp preload_modules(state, []), do: state
 
   defp preload_modules(state, [path | rest]) do
@@ -341,6 +430,10 @@ defmodule ExMaude.Backend.Port do
     end
   end
 
+  # Iodata (e.g. from ExMaude.IoT) goes to the port as it is, in one
+  # write, and has to be a complete command already
+  defp ensure_command_format(command) when is_list(command), do: [command, ?\n]
+
   defp ensure_command_format(command) do
     command = String.trim(command)
 
@@ -354,18 +447,47 @@ defmodule ExMaude.Backend.Port do
     command <> "\n"
   end
 
-  defp response_complete?(buffer) do
-    # Response is complete when we see the prompt
-    String.contains?(buffer, @prompt_marker)
+  # The response is complete at the first prompt. Chunks are kept as iodata
+  # and only the new chunk, plus the bytes before it that could hold the
+  # start of a prompt, is scanned, so a long response costs linear time.
+  # Returns the output before the prompt and the response size.
+  defp append_output(state, data) do
+    window = state.tail <> data
+
+    case :binary.match(window, @prompt_marker) do
+      {pos, _len} ->
+        size = state.buffer_size + byte_size(data)
+        output_len = state.buffer_size - byte_size(state.tail) + pos
+        output = binary_part(IO.iodata_to_binary([state.buffer, data]), 0, output_len)
+        {:complete, output, size, reset_buffer(state)}
+
+      :nomatch ->
+        keep = min(byte_size(window), @prompt_tail)
+
+        {:more,
+         %{
+           state
+           | buffer: [state.buffer, data],
+             buffer_size: state.buffer_size + byte_size(data),
+             tail: binary_part(window, byte_size(window) - keep, keep)
+         }}
+    end
   end
 
-  defp parse_response(buffer) do
-    # Remove the prompt from the end
-    output =
-      buffer
-      |> String.split(@prompt_marker)
-      |> List.first()
-      |> String.trim()
+  defp reset_buffer(state), do: %{state | buffer: [], buffer_size: 0, tail: ""}
+
+  defp parse_response(output, true) do
+    output = String.trim(output)
+
+    if has_maude_error?(output) do
+      {:error, Error.from_output(output)}
+    else
+      {:ok, output |> Parser.tokenize() |> Parser.to_result()}
+    end
+  end
+
+  defp parse_response(output, false) do
+    output = String.trim(output)
 
     # Check for errors - but be more careful about false positives
     cond do
@@ -382,22 +504,14 @@ defmodule ExMaude.Backend.Port do
     end
   end
 
-  # Check if output contains actual Maude errors (not just the word "error" in content)
+  # Check if output contains actual Maude errors (not just the word "error" in content).
+  # One alternation scans the output once; only the module and syntax
+  # patterns ignore case.
   defp has_maude_error?(output) do
-    # Look for Maude error patterns
-    error_patterns = [
-      ~r/Error:/,
-      ~r/Warning:/,
-      ~r/No parse for term/,
-      ~r/no module\s+\S+/i,
-      ~r/module\s+\S+\s+not found/i,
-      ~r/syntax error/i,
-      ~r/Advisory:/
-    ]
-
-    Enum.any?(error_patterns, fn pattern ->
-      Regex.match?(pattern, output)
-    end)
+    Regex.match?(
+      ~r/Error:|Warning:|Advisory:|No parse for term|(?i:no module\s+\S+|module\s+\S+\s+not found|syntax error)/,
+      output
+    )
   end
 
   defp extract_result(output) do
@@ -419,12 +533,33 @@ defmodule ExMaude.Backend.Port do
     Application.get_env(:ex_maude, :preload_modules, [])
   end
 
+  defp truncate(iodata, max_length) when is_list(iodata) do
+    {_left, head} = take_bytes(iodata, max_length + 1, [])
+    head |> IO.iodata_to_binary() |> truncate(max_length)
+  end
+
   defp truncate(string, max_length) when byte_size(string) > max_length do
     String.slice(string, 0, max_length) <> "..."
   end
 
   defp truncate(string, _max_length), do: string
 
+  # The first `n` bytes of iodata, without flattening the rest
+  defp take_bytes(_iodata, 0, acc), do: {0, acc}
+  defp take_bytes(byte, n, acc) when is_integer(byte), do: {n - 1, [acc, byte]}
+
+  defp take_bytes(binary, n, acc) when is_binary(binary) do
+    take = min(byte_size(binary), n)
+    {n - take, [acc, binary_part(binary, 0, take)]}
+  end
+
+  defp take_bytes([], n, acc), do: {n, acc}
+
+  defp take_bytes([head | tail], n, acc) do
+    {n, acc} = take_bytes(head, n, acc)
+    take_bytes(tail, n, acc)
+  end
+
   defp emit_telemetry(event, measurements) do
     :telemetry.execute(
       [:ex_maude, :server, event],
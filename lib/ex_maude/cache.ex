@@ -0,0 +1,215 @@
+defmodule ExMaude.Cache do
+  @moduledoc """
+  Opt-in ETS cache for deterministic Maude results.
+
+  `ExMaude.Maude.reduce/3` and `ExMaude.Maude.parse/3` only depend on the
+  term and the modules loaded into the pool, so their successful results can
+  be reused instead of paying for a pool checkout and a Maude round trip.
+
+  Entries are keyed on the operation, module name, term and a version stamp
+  of the loaded module set. `ExMaude.Maude.load_file/1`,
+  `ExMaude.Maude.load_module/1`, `ExMaude.Pool.publish/2` (and each worker
+  applying it) and lazy loads of `ExMaude.Router` bump the version, so
+  results computed against older modules are never returned and are
+  dropped right away. Reloading a source that is unchanged keeps them.
+
+  ## Configuration
+
+      config :ex_maude,
+        cache: true,              # Start the cache with the application
+        cache_max_entries: 10_000 # Entries kept before the cache is flushed
+
+  The cache can also be started in your own supervision tree:
+
+      children = [
+        {ExMaude.Cache, max_entries: 50_000}
+      ]
+
+  When the cache is not running every call goes to Maude as usual. A single
+  call can skip the cache with `cache: false`.
+
+  ## Bounding
+
+  Once `:max_entries` results are stored the whole table is flushed. A hot
+  working set refills within a few calls, while the cost of a hit stays a
+  single ETS lookup with no bookkeeping writes.
+
+  ## Telemetry
+
+  - `[:ex_maude, :cache, :hit]` - A result was served from the cache
+  - `[:ex_maude, :cache, :miss]` - A result had to be computed by Maude
+
+  Measurements are `%{count: 1}`, metadata is `%{operation: atom, module: String.t}`.
+  """
+
+  use GenServer
+
+  alias ExMaude.Backend.Modules
+
+  @table :ex_maude_cache
+  @default_max_entries 10_000
+  # :version, :max_entries and :modules rows stored next to the results
+  @meta_rows 3
+
+  @doc """
+  Starts the process owning the cache table.
+
+  ## Options
+
+    * `:max_entries` - Entries kept before the cache is flushed (default: 10000)
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    GenServer.start_link(__MODULE__, opts, name: __MODULE__)
+  end
+
+  @doc """
+  Returns whether the cache is running.
+  """
+  @spec enabled?() :: boolean()
+  def enabled? do
+    :ets.whereis(@table) != :undefined
+  end
+
+  @doc """
+  Returns the cached result for `{operation, module, term}` or computes it.
+
+  `fun` runs on a miss (or when the cache is not running) and its result is
+  stored only if it is `{:ok, _}`, so errors and timeouts are retried.
+  """
+  @spec fetch({atom(), String.t(), String.t()}, (-> result)) :: result when result: term()
+  def fetch({operation, module, _term} = key, fun) when is_function(fun, 0) do
+    if enabled?() do
+      version = version()
+      metadata = %{operation: operation, module: module}
+
+      case lookup({version, key}) do
+        {:ok, result} ->
+          :telemetry.execute([:ex_maude, :cache, :hit], %{count: 1}, metadata)
+          result
+
+        :error ->
+          :telemetry.execute([:ex_maude, :cache, :miss], %{count: 1}, metadata)
+          result = fun.()
+          store({version, key}, result)
+          result
+      end
+    else
+      fun.()
+    end
+  end
+
+  @doc """
+  Invalidates all cached results after the loaded module set changed.
+  """
+  @spec invalidate() :: :ok
+  def invalidate do
+    if enabled?() do
+      # A command still running against the old modules stores its result
+      # under the old version, where it can never be found
+      :ets.update_counter(@table, :version, 1, {:version, 0})
+      # Whatever changed the modules is not in the table below
+      :ets.insert(@table, {:modules, Modules.new()})
+      clear()
+    end
+
+    :ok
+  end
+
+  @doc """
+  Invalidates all cached results unless loading `source` left every module
+  it declares as it was.
+
+  The cache keeps the digests of the sources loaded through it since the
+  last `invalidate/0` (see `ExMaude.Backend.Modules`), the same check that
+  lets workers skip such a load. Callers that reload one file on every call,
+  such as `ExMaude.IoT.detect_conflicts/2`, keep their cached results.
+  """
+  @spec invalidate(String.t()) :: :ok
+  def invalidate(source) when is_binary(source) do
+    if enabled?() do
+      modules = :ets.lookup_element(@table, :modules, 2)
+
+      unless Modules.unchanged?(modules, source) do
+        invalidate()
+        :ets.insert(@table, {:modules, Modules.put(modules, source)})
+      end
+    end
+
+    :ok
+  rescue
+    ArgumentError -> :ok
+  end
+
+  @doc """
+  Removes every cached result.
+  """
+  @spec clear() :: :ok
+  def clear do
+    if enabled?() do
+      :ets.select_delete(@table, [{{{:_, :_}, :_}, [], [true]}])
+    end
+
+    :ok
+  end
+
+  @doc """
+  Returns the number of cached results.
+  """
+  @spec size() :: non_neg_integer()
+  def size do
+    if enabled?(), do: :ets.info(@table, :size) - @meta_rows, else: 0
+  end
+
+  # Server Callbacks
+
+  @impl GenServer
+  def init(opts) do
+    max_entries = opts[:max_entries] || config_max_entries()
+
+    :ets.new(@table, [:named_table, :public, :set, read_concurrency: true])
+    :ets.insert(@table, [
+      {:version, 0},
+      {:max_entries, max_entries},
+      {:modules, Modules.new()}
+    ])
+
+    {:ok, %{}}
+  end
+
+  # Private Functions
+
+  defp version do
+    :ets.lookup_element(@table, :version, 2)
+  rescue
+    ArgumentError -> 0
+  end
+
+  defp lookup(key) do
+    case :ets.lookup(@table, key) do
+      [{^key, result}] -> {:ok, result}
+      [] -> :error
+    end
+  rescue
+    # The cache stopped between the check and the lookup
+    ArgumentError -> :error
+  end
+
+  defp store(key, {:ok, _} = result) do
+    max_entries = :ets.lookup_element(@table, :max_entries, 2)
+
+    if :ets.info(@table, :size) - @meta_rows >= max_entries do
+      clear()
+    end
+
+    :ets.insert(@table, {key, result})
+  rescue
+    ArgumentError -> false
+  end
+
+  defp store(_key, _result), do: false
+
+  defp config_max_entries do
+    Application.get_env(:ex_maude, :cache_max_entries, @default_max_entries)
+  end
+end
@@ -0,0 +1,412 @@
+defmodule ExMaude.Cluster do
+  @moduledoc """
+  Schedules commands over the `ExMaude.Router` of every connected node.
+
+  Each node runs one cluster member next to its router. Members find each
+  other through a `:pg` scope and every interval send the others a summary
+  of their router: how many workers it has, how many leases they hold and
+  which modules are loaded or registered. A command for a module goes to
+  the node that:
+
+    1. has the module loaded on some worker, else
+    2. has a file registered for it, else
+    3. has any worker,
+
+  picking the lowest leases per worker within the first tier that has a
+  node, and the local node on a tie. Between reports the member counts its
+  own picks against the chosen node, so a burst does not pile onto one.
+
+  ## Partitions
+
+  A node that leaves the `:pg` group or misses three reports is no longer
+  picked. A command sent to a node that cannot be reached before it runs
+  is run on the local router instead, within what is left of the caller's
+  `:timeout`, and a stream whose relay dies before the first chunk is
+  restarted locally. Once a command ran remotely, its failure is returned
+  as it is, an exit such as a nodedown as `{:error, _}`; it is never run
+  twice.
+
+  ## Configuration
+
+      config :ex_maude,
+        start_router: true,
+        start_cluster: true,
+        cluster_interval: 1_000
+
+  When the cluster is running, `ExMaude.Maude.reduce/3`, `rewrite/3`,
+  `search/4`, `parse/3` and `search_stream/4` are scheduled through it.
+
+  Transaction functions run in the caller against the picked worker, so
+  every node has to use the same `ExMaude.Backend`. Streams are relayed
+  from a process on the worker's node, as a C-Node worker can only talk to
+  the bridge of its own node.
+  """
+
+  use GenServer
+  require Logger
+
+  alias ExMaude.{Error, Router, Server}
+
+  @default_interval_ms 1_000
+  @default_scope :ex_maude_cluster
+  @group :routers
+  @stale_reports 3
+  @route_timeout_ms 30_000
+
+  @typedoc """
+  What a member last reported about its router.
+  """
+  @type peer :: %{
+          node: node(),
+          router: GenServer.server(),
+          workers: non_neg_integer(),
+          busy: non_neg_integer(),
+          loaded: [String.t()],
+          registered: [String.t()],
+          seen: integer()
+        }
+
+  @typedoc """
+  Router a command was scheduled to, and the local one to fall back to.
+  """
+  @type pick :: %{node: node(), router: GenServer.server(), local: GenServer.server()}
+
+  @typedoc """
+  Internal state of a cluster member.
+  """
+  @type t :: %__MODULE__{
+          router: GenServer.server(),
+          scope: atom(),
+          interval: pos_integer(),
+          peers: %{pid() => peer()}
+        }
+
+  defstruct router: Router, scope: @default_scope, interval: @default_interval_ms, peers: %{}
+
+  # Client API
+
+  @doc """
+  Starts the cluster member of this node.
+
+  ## Options
+
+    * `:router` - Local router to schedule onto (default: `ExMaude.Router`)
+    * `:interval` - Time in ms between reports (default: `:cluster_interval`
+      or 1000)
+    * `:scope` - `:pg` scope the members meet in (default: `:ex_maude_cluster`)
+    * `:name` - Registered name (default: `ExMaude.Cluster`)
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    {name, opts} = Keyword.pop(opts, :name, __MODULE__)
+    GenServer.start_link(__MODULE__, opts, name: name)
+  end
+
+  @doc """
+  Returns whether the cluster member is running.
+  """
+  @spec running?(GenServer.server()) :: boolean()
+  def running?(cluster \\ __MODULE__) do
+    GenServer.whereis(cluster) != nil
+  end
+
+  @doc """
+  Returns the router a command for `module` would be scheduled to.
+
+  Without a running member this is the local `ExMaude.Router`.
+  """
+  @spec pick(String.t(), GenServer.server()) :: pick()
+  def pick(module, cluster \\ __MODULE__) do
+    GenServer.call(cluster, {:pick, module})
+  catch
+    :exit, _ -> %{node: node(), router: Router, local: Router}
+  end
+
+  @doc """
+  Runs `fun` with a worker that has `module` loaded, on whichever node
+  the cluster picks.
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms to wait for a worker, including a
+      lazy load of the module (default: 30000)
+    * `:cluster` - Cluster member to schedule with (default: `ExMaude.Cluster`)
+  """
+  @spec transaction(String.t(), (pid() -> result), keyword()) :: result | {:error, Error.t()}
+        when result: any()
+  def transaction(module, fun, opts \\ []) when is_function(fun, 1) do
+    {cluster, opts} = Keyword.pop(opts, :cluster, __MODULE__)
+    timeout = Keyword.get(opts, :timeout, @route_timeout_ms)
+    deadline = now() + timeout
+
+    case pick(module, cluster) do
+      %{node: node, router: router} when node == node() ->
+        Router.transaction(module, fun, [router: router] ++ opts)
+
+      %{node: node, router: router, local: local} ->
+        ran = make_ref()
+
+        case Router.transaction(module, &{ran, run(fun, &1)}, [router: router] ++ opts) do
+          {^ran, result} ->
+            result
+
+          {:error, %Error{} = error} ->
+            Logger.warning(
+              "ExMaude.Cluster: #{node} unreachable (#{Exception.message(error)}), running #{module} locally"
+            )
+
+            # The caller's timeout covers both attempts
+            remaining = max(deadline - now(), 0)
+            Router.transaction(module, fun, [router: local, timeout: remaining] ++ opts)
+        end
+    end
+  end
+
+  # An exit once the command runs remotely, e.g. on nodedown, is its
+  # result; only a failure to reach the router is retried locally
+  defp run(fun, worker) do
+    fun.(worker)
+  catch
+    :exit, reason -> {:error, Error.pool_error(reason)}
+  end
+
+  @doc """
+  Streams the output of `command` from a worker that has `module` loaded,
+  on whichever node the cluster picks.
+
+  Chunks are relayed one at a time: the relay reads the next one only
+  after the previous one was taken, and halting the stream cancels the
+  command. Errors are raised as `ExMaude.Error`.
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms to wait for each chunk (default: 30000)
+    * `:cluster` - Cluster member to schedule with (default: `ExMaude.Cluster`)
+  """
+  @spec stream(String.t(), String.t(), keyword()) :: Enumerable.t()
+  def stream(module, command, opts \\ []) do
+    cluster = Keyword.get(opts, :cluster, __MODULE__)
+    timeout = Keyword.get(opts, :timeout, @route_timeout_ms)
+
+    Stream.resource(
+      fn -> module |> pick(cluster) |> start_relay(module, command, timeout) end,
+      &next_chunk/1,
+      &stop_relay/1
+    )
+  end
+
+  defp start_relay(pick, module, command, timeout) do
+    ref = make_ref()
+    args = [self(), ref, module, command, timeout, pick.router]
+    {pid, monitor} = Node.spawn_monitor(pick.node, __MODULE__, :relay, args)
+
+    %{
+      pid: pid,
+      monitor: monitor,
+      ref: ref,
+      pick: pick,
+      module: module,
+      command: command,
+      timeout: timeout,
+      started: false,
+      done: false
+    }
+  end
+
+  defp next_chunk(%{done: true} = relay), do: {:halt, relay}
+
+  defp next_chunk(%{ref: ref, monitor: monitor} = relay) do
+    receive do
+      {^ref, {:chunk, chunk}} ->
+        send(relay.pid, {ref, :ack})
+        {[chunk], %{relay | started: true}}
+
+      {^ref, :done} ->
+        {:halt, %{relay | done: true}}
+
+      {^ref, {:error, error}} ->
+        raise error
+
+      {:DOWN, ^monitor, :process, _pid, reason} ->
+        restart_relay(relay, reason)
+    after
+      relay.timeout -> raise Error.timeout(relay.timeout)
+    end
+  end
+
+  # Nothing was emitted yet, so the command can still run locally
+  defp restart_relay(%{started: false, pick: %{node: node} = pick} = relay, reason)
+       when node != node() do
+    Logger.warning(
+      "ExMaude.Cluster: relay on #{node} down (#{inspect(reason)}), streaming #{relay.module} locally"
+    )
+
+    local = %{pick | node: node(), router: pick.local}
+    local |> start_relay(relay.module, relay.command, relay.timeout) |> next_chunk()
+  end
+
+  defp restart_relay(_relay, reason), do: raise(Error.pool_error({:relay_down, reason}))
+
+  defp stop_relay(%{ref: ref} = relay) do
+    send(relay.pid, {ref, :cancel})
+    Process.demonitor(relay.monitor, [:flush])
+    flush_relay(ref)
+  end
+
+  defp flush_relay(ref) do
+    receive do
+      {^ref, _} -> flush_relay(ref)
+    after
+      0 -> :ok
+    end
+  end
+
+  @doc false
+  # Runs on the worker's node for stream/3, until the caller cancels or
+  # goes away
+  @spec relay(pid(), reference(), String.t(), String.t(), timeout(), GenServer.server()) :: term()
+  def relay(caller, ref, module, command, timeout, router) do
+    monitor = Process.monitor(caller)
+
+    run = fn worker ->
+      worker
+      |> Server.stream(command, timeout: timeout)
+      |> Enum.reduce_while(:done, fn chunk, :done ->
+        send(caller, {ref, {:chunk, chunk}})
+
+        case await_ack(ref, monitor) do
+          :ack -> {:cont, :done}
+          :cancel -> {:halt, :cancel}
+        end
+      end)
+    end
+
+    case Router.transaction(module, run, router: router, timeout: timeout) do
+      :done -> send(caller, {ref, :done})
+      :cancel -> :ok
+      {:error, error} -> send(caller, {ref, {:error, error}})
+    end
+  rescue
+    error in Error -> send(caller, {ref, {:error, error}})
+  end
+
+  defp await_ack(ref, monitor) do
+    receive do
+      {^ref, :ack} -> :ack
+      {^ref, :cancel} -> :cancel
+      {:DOWN, ^monitor, :process, _pid, _reason} -> :cancel
+    end
+  end
+
+  # Server Callbacks
+
+  @impl GenServer
+  def init(opts) do
+    state = %__MODULE__{
+      router: Keyword.get(opts, :router, Router),
+      scope: Keyword.get(opts, :scope, @default_scope),
+      interval: Keyword.get(opts, :interval, config_interval())
+    }
+
+    case :pg.start(state.scope) do
+      {:ok, _pid} -> :ok
+      {:error, {:already_started, _pid}} -> :ok
+    end
+
+    :ok = :pg.join(state.scope, @group, self())
+    {:ok, state, {:continue, :report}}
+  end
+
+  @impl GenServer
+  def handle_continue(:report, state) do
+    {:noreply, report(state)}
+  end
+
+  @impl GenServer
+  def handle_call({:pick, module}, _from, state) do
+    case Enum.filter(state.peers, fn {_member, peer} -> peer.workers > 0 end) do
+      [] ->
+        local = target(state.router)
+        {:reply, %{node: node(), router: local, local: local}, state}
+
+      candidates ->
+        {member, peer} = Enum.min_by(candidates, &rank(&1, module))
+        peers = Map.put(state.peers, member, %{peer | busy: peer.busy + 1})
+        pick = %{node: peer.node, router: peer.router, local: target(state.router)}
+        {:reply, pick, %{state | peers: peers}}
+    end
+  end
+
+  @impl GenServer
+  def handle_info(:report, state) do
+    {:noreply, report(state)}
+  end
+
+  def handle_info({:report, member, peer}, state) do
+    {:noreply, %{state | peers: Map.put(state.peers, member, %{peer | seen: now()})}}
+  end
+
+  # coveralls-ignore-start
+  def handle_info(_msg, state) do
+    {:noreply, state}
+  end
+
+  # coveralls-ignore-stop
+
+  # Refreshes our own entry, drops peers that left or went quiet, and
+  # tells the others about us
+  defp report(state) do
+    own = summary(state.router)
+    members = :pg.get_members(state.scope, @group)
+    oldest = now() - state.interval * @stale_reports
+
+    peers =
+      state.peers
+      |> Map.filter(fn {member, peer} -> member in members and peer.seen >= oldest end)
+      |> Map.put(self(), own)
+
+    for member <- members, member != self(), do: send(member, {:report, self(), own})
+
+    Process.send_after(self(), :report, state.interval)
+    %{state | peers: peers}
+  end
+
+  defp summary(router) do
+    router
+    |> Router.summary()
+    |> Map.merge(%{node: node(), router: target(router), seen: now()})
+  catch
+    # A router that is down or restarting gets no commands until it is back
+    :exit, _ ->
+      %{
+        node: node(),
+        router: target(router),
+        workers: 0,
+        busy: 0,
+        loaded: [],
+        registered: [],
+        seen: now()
+      }
+  end
+
+  defp rank({_member, peer}, module) do
+    affinity =
+      cond do
+        module in peer.loaded -> 0
+        module in peer.registered -> 1
+        true -> 2
+      end
+
+    {affinity, peer.busy / peer.workers, if(peer.node == node(), do: 0, else: 1)}
+  end
+
+  # Registered names are only meaningful on their own node
+  defp target(router) when is_atom(router), do: {router, node()}
+  defp target(router), do: router
+
+  defp now, do: System.monotonic_time(:millisecond)
+
+  defp config_interval do
+    Application.get_env(:ex_maude, :cluster_interval, @default_interval_ms)
+  end
+end
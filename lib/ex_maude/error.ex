@@ -11,6 +11,7 @@ defmodule ExMaude.Error do
     * `:module_not_found` - Referenced module doesn't exist
     * `:syntax_error` - Invalid Maude syntax
     * `:timeout` - Operation timed out
+    * `:output_too_large` - Maude output exceeded the configured limit
     * `:maude_crash` - Maude process crashed
     * `:file_not_found` - File doesn't exist
     * `:load_error` - Failed to load a module
@@ -48,6 +49,7 @@ defmodule ExMaude.Error do
           | :module_not_found
           | :syntax_error
           | :timeout
+          | :output_too_large
           | :maude_crash
           | :file_not_found
           | :load_error
@@ -194,6 +196,24 @@ defmodule ExMaude.Error do
     }
   end
 
+  @doc """
+  Creates an error for a response that exceeded the output limit.
+
+  ## Examples
+
+      error = ExMaude.Error.output_too_large(1024)
+      error.type    #=> :output_too_large
+      error.message #=> "Maude output exceeded 1024 bytes"
+  """
+  @spec output_too_large(pos_integer()) :: t()
+  def output_too_large(limit_bytes) do
+    %__MODULE__{
+      type: :output_too_large,
+      message: "Maude output exceeded #{limit_bytes} bytes",
+      details: %{limit_bytes: limit_bytes}
+    }
+  end
+
   @doc """
   Creates a Maude crash error.
 
@@ -261,6 +281,7 @@ defmodule ExMaude.Error do
       case reason do
         :timeout -> "Pool checkout timed out"
         :full -> "Pool is full, no workers available"
+        :no_workers -> "No pool or router workers are running"
         {:exit, exit_reason} -> "Pool worker exited: #{inspect(exit_reason)}"
         other -> "Pool error: #{inspect(other)}"
       end
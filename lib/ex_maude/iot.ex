@@ -48,6 +48,9 @@ defmodule ExMaude.IoT do
       {:ok, conflicts} = ExMaude.IoT.detect_conflicts(rules)
       # => [%{type: :state_conflict, rule1: "motion-light", rule2: "night-light", ...}]
 
+  For rule sets that change a few rules at a time, `ExMaude.IoT.Incremental`
+  keeps the known conflicts and only checks the changed rules.
+
   ## Prerequisites
 
   Before using conflict detection, load the IoT rules module:
@@ -68,7 +71,16 @@ defmodule ExMaude.IoT do
   """
 
   alias ExMaude.Maude
-  alias ExMaude.IoT.{Encoder, ConflictParser, Validator}
+  alias ExMaude.IoT.{Encoder, ConflictParser, Partition, Validator}
+
+  @conflict_types [:state_conflict, :env_conflict, :state_cascade, :state_env_cascade]
+
+  # Conflict kind, the conflict types it finds and its Maude operator
+  @detections [
+    {:state, [:state_conflict], "detectConflicts"},
+    {:env, [:env_conflict], "detectEnvConflicts"},
+    {:cascade, [:state_cascade, :state_env_cascade], "detectCascades"}
+  ]
 
   @type thing_id :: String.t()
 
@@ -115,6 +127,11 @@ defmodule ExMaude.IoT do
   verification. Returns a list of detected conflicts, or an empty list if
   no conflicts are found.
 
+  The rules are first split into groups that can only conflict among
+  themselves (see `ExMaude.IoT.Partition`). Each group is reduced as its
+  own Maude command, and the groups run concurrently across the pool
+  workers. Cascades are checked in both directions.
+
   ## Examples
 
       rules = [
@@ -129,12 +146,12 @@ defmodule ExMaude.IoT do
 
   ## Options
 
-    * `:timeout` - Maximum time in milliseconds (default: 10000)
+    * `:timeout` - Maximum time in milliseconds for each group (default: 10000)
     * `:conflict_types` - List of conflict types to check (default: all)
+    * `:max_concurrency` - Groups checked at once (default: `System.schedulers_online/0`)
   """
   @spec detect_conflicts([rule()], keyword()) :: {:ok, [conflict()]} | {:error, term()}
   def detect_conflicts(rules, opts \\ []) when is_list(rules) do
-    timeout = Keyword.get(opts, :timeout, 10_000)
     rule_count = length(rules)
     start_time = System.monotonic_time()
 
@@ -144,12 +161,7 @@ defmodule ExMaude.IoT do
       %{}
     )
 
-    result =
-      with :ok <- ensure_iot_module_loaded(),
-           {:ok, maude_rules} <- Encoder.encode_rules(rules),
-           {:ok, output} <- run_detection(maude_rules, timeout) do
-        {:ok, ConflictParser.parse_conflicts(output)}
-      end
+    result = run_detection(rules, opts)
 
     duration = System.monotonic_time() - start_time
 
@@ -180,14 +192,7 @@ defmodule ExMaude.IoT do
   """
   @spec detect_state_conflicts([rule()], keyword()) :: {:ok, [conflict()]} | {:error, term()}
   def detect_state_conflicts(rules, opts \\ []) do
-    timeout = Keyword.get(opts, :timeout, 10_000)
-
-    with :ok <- ensure_iot_module_loaded(),
-         {:ok, maude_rules} <- Encoder.encode_rules(rules),
-         command = "reduce in CONFLICT-DETECTOR : detectConflicts(#{maude_rules}) .",
-         {:ok, output} <- Maude.execute(command, timeout: timeout) do
-      {:ok, ConflictParser.parse_conflicts(output)}
-    end
+    run_detection(rules, Keyword.put(opts, :conflict_types, [:state_conflict]))
   end
 
   @doc """
@@ -198,14 +203,7 @@ defmodule ExMaude.IoT do
   """
   @spec detect_env_conflicts([rule()], keyword()) :: {:ok, [conflict()]} | {:error, term()}
   def detect_env_conflicts(rules, opts \\ []) do
-    timeout = Keyword.get(opts, :timeout, 10_000)
-
-    with :ok <- ensure_iot_module_loaded(),
-         {:ok, maude_rules} <- Encoder.encode_rules(rules),
-         command = "reduce in CONFLICT-DETECTOR : detectEnvConflicts(#{maude_rules}) .",
-         {:ok, output} <- Maude.execute(command, timeout: timeout) do
-      {:ok, ConflictParser.parse_conflicts(output)}
-    end
+    run_detection(rules, Keyword.put(opts, :conflict_types, [:env_conflict]))
   end
 
   @doc """
@@ -215,14 +213,7 @@ defmodule ExMaude.IoT do
   """
   @spec detect_cascade_conflicts([rule()], keyword()) :: {:ok, [conflict()]} | {:error, term()}
   def detect_cascade_conflicts(rules, opts \\ []) do
-    timeout = Keyword.get(opts, :timeout, 10_000)
-
-    with :ok <- ensure_iot_module_loaded(),
-         {:ok, maude_rules} <- Encoder.encode_rules(rules),
-         command = "reduce in CONFLICT-DETECTOR : detectCascades(#{maude_rules}) .",
-         {:ok, output} <- Maude.execute(command, timeout: timeout) do
-      {:ok, ConflictParser.parse_conflicts(output)}
-    end
+    run_detection(rules, Keyword.put(opts, :conflict_types, [:state_cascade, :state_env_cascade]))
   end
 
   @doc """
@@ -254,9 +245,9 @@ defmodule ExMaude.IoT do
   @spec validate_rules([rule()]) :: :ok | {:error, %{String.t() => [String.t()]}}
   defdelegate validate_rules(rules), to: Validator
 
-  # Private functions
-
-  defp ensure_iot_module_loaded do
+  @doc false
+  # Shared with ExMaude.IoT.Incremental
+  def ensure_iot_module_loaded do
     path = ExMaude.iot_rules_path()
 
     if File.exists?(path) do
@@ -266,8 +257,43 @@ defmodule ExMaude.IoT do
     end
   end
 
-  defp run_detection(maude_rules, timeout) do
-    command = "reduce in CONFLICT-DETECTOR : detectAllConflicts(#{maude_rules}) ."
-    Maude.execute(command, timeout: timeout)
+  # Private functions
+
+  # Each conflict kind is reduced per independent group of rules, with the
+  # groups spread over the pool workers
+  defp run_detection(rules, opts) do
+    types = Keyword.get(opts, :conflict_types, @conflict_types)
+
+    with :ok <- ensure_iot_module_loaded() do
+      jobs =
+        for {kind, kind_types, operator} <- @detections,
+            Enum.any?(kind_types, &(&1 in types)),
+            group <- Partition.groups(rules, kind),
+            do: {operator, group}
+
+      jobs
+      |> Task.async_stream(&detect_group(&1, opts),
+        max_concurrency: Keyword.get(opts, :max_concurrency, System.schedulers_online()),
+        timeout: :infinity
+      )
+      |> Enum.reduce_while({:ok, []}, fn
+        {:ok, {:ok, conflicts}}, {:ok, acc} -> {:cont, {:ok, acc ++ conflicts}}
+        {:ok, error}, _acc -> {:halt, error}
+      end)
+      |> case do
+        {:ok, conflicts} -> {:ok, conflicts |> Enum.filter(&(&1.type in types)) |> Enum.uniq()}
+        error -> error
+      end
+    end
+  end
+
+  # The command stays iodata around the cached rule fragments
+  defp detect_group({operator, group}, opts) do
+    {:ok, maude_rules} = Encoder.encode_rules_iodata(group)
+    command = ["reduce in CONFLICT-DETECTOR : ", operator, ?(, maude_rules, ") ."]
+
+    with {:ok, output} <- Maude.execute(command, timeout: Keyword.get(opts, :timeout, 10_000)) do
+      {:ok, ConflictParser.parse_conflicts(output)}
+    end
   end
 end
@@ -60,13 +60,32 @@ defmodule ExMaude.IoT.Encoder do
       {:ok, maude_syntax} = ExMaude.IoT.Encoder.encode_rules(rules)
       # => {:ok, "rule(\\"r1\\", thing(\\"light\\"), always, nil, 1)"}
 
+  Terms are built as iodata and only flattened by the public `encode_*`
+  functions. `encode_rules_iodata/1` keeps the rule set as iodata around
+  fragments cached in `ExMaude.IoT.Fragments`, for commands that go to the
+  backend without being copied into one string.
+
   ## See Also
 
   - `ExMaude.IoT` - High-level conflict detection API
   - `ExMaude.IoT.Validator` - Rule validation before encoding
   - `ExMaude.IoT.ConflictParser` - Parsing Maude output
+  - `ExMaude.IoT.Fragments` - Cache of encoded rules
   """
 
+  alias ExMaude.IoT.Fragments
+
+  @comparisons %{
+    prop_eq: "propEq",
+    prop_gt: "propGt",
+    prop_lt: "propLt",
+    prop_gte: "propGte",
+    prop_lte: "propLte",
+    env_eq: "envEq",
+    env_gt: "envGt",
+    env_lt: "envLt"
+  }
+
   @doc """
   Encodes a list of rules into Maude syntax.
 
@@ -78,36 +97,36 @@ defmodule ExMaude.IoT.Encoder do
       {:ok, "rule(\\"r1\\", thing(\\"t1\\"), always, nil, 1)"} = encode_rules(rules)
   """
   @spec encode_rules([map()]) :: {:ok, String.t()}
-  def encode_rules([]), do: {:ok, "empty"}
-
   def encode_rules(rules) do
-    encoded =
-      rules
-      |> Enum.map(&encode_rule/1)
-      |> Enum.join(", ")
+    {:ok, encoded} = encode_rules_iodata(rules)
+    {:ok, IO.iodata_to_binary(encoded)}
+  end
+
+  @doc """
+  Encodes a list of rules into Maude syntax as iodata.
 
-    {:ok, encoded}
+  Each rule is taken from `ExMaude.IoT.Fragments` when the same rule was
+  encoded before, so re-encoding a mostly unchanged rule set costs one
+  lookup per rule and the result references the cached binaries.
+  """
+  @spec encode_rules_iodata([map()]) :: {:ok, iodata()}
+  def encode_rules_iodata([]), do: {:ok, "empty"}
+
+  def encode_rules_iodata(rules) do
+    {:ok, Enum.map_intersperse(rules, ", ", &rule_fragment/1)}
   end
 
   @doc """
   Encodes a single rule into Maude syntax.
   """
   @spec encode_rule(map()) :: String.t()
-  def encode_rule(rule) do
-    id = encode_string(rule.id)
-    thing_id = encode_thing_id(rule.thing_id)
-    trigger = encode_trigger(rule.trigger)
-    actions = encode_actions(rule.actions)
-    priority = rule[:priority] || 1
-
-    "rule(#{id}, #{thing_id}, #{trigger}, #{actions}, #{priority})"
-  end
+  def encode_rule(rule), do: rule |> rule_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a thing ID into Maude syntax.
   """
   @spec encode_thing_id(String.t()) :: String.t()
-  def encode_thing_id(id), do: "thing(#{encode_string(id)})"
+  def encode_thing_id(id), do: id |> thing_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a trigger into Maude syntax.
@@ -116,74 +135,25 @@ defmodule ExMaude.IoT.Encoder do
   and the `always` trigger.
   """
   @spec encode_trigger(ExMaude.IoT.trigger()) :: String.t()
-  def encode_trigger({:prop_eq, prop, value}),
-    do: "propEq(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:prop_gt, prop, value}),
-    do: "propGt(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:prop_lt, prop, value}),
-    do: "propLt(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:prop_gte, prop, value}),
-    do: "propGte(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:prop_lte, prop, value}),
-    do: "propLte(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:env_eq, prop, value}),
-    do: "envEq(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:env_gt, prop, value}),
-    do: "envGt(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:env_lt, prop, value}),
-    do: "envLt(#{encode_string(prop)}, #{encode_value(value)})"
-
-  def encode_trigger({:always}), do: "always"
-
-  def encode_trigger({:and, t1, t2}),
-    do: "and(#{encode_trigger(t1)}, #{encode_trigger(t2)})"
-
-  def encode_trigger({:or, t1, t2}),
-    do: "or(#{encode_trigger(t1)}, #{encode_trigger(t2)})"
-
-  def encode_trigger({:not, t}), do: "not(#{encode_trigger(t)})"
+  def encode_trigger(trigger), do: trigger |> trigger_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a list of actions into Maude syntax.
   """
   @spec encode_actions([ExMaude.IoT.action()]) :: String.t()
-  def encode_actions([]), do: "nil"
-
-  def encode_actions(actions) do
-    actions
-    |> Enum.map(&encode_action/1)
-    |> Enum.join(" ; ")
-  end
+  def encode_actions(actions), do: actions |> actions_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a single action into Maude syntax.
   """
   @spec encode_action(ExMaude.IoT.action()) :: String.t()
-  def encode_action({:set_prop, thing_id, prop, value}) do
-    "setProp(#{encode_thing_id(thing_id)}, #{encode_string(prop)}, #{encode_value(value)})"
-  end
-
-  def encode_action({:set_env, prop, value}) do
-    "setEnv(#{encode_string(prop)}, #{encode_value(value)})"
-  end
-
-  def encode_action({:invoke, thing_id, action_name}) do
-    "invoke(#{encode_thing_id(thing_id)}, #{encode_string(action_name)})"
-  end
+  def encode_action(action), do: action |> action_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a string value for Maude (quoted).
   """
   @spec encode_string(String.t() | atom()) :: String.t()
-  def encode_string(s) when is_binary(s), do: "\"#{s}\""
-  def encode_string(s) when is_atom(s), do: "\"#{Atom.to_string(s)}\""
+  def encode_string(s), do: s |> string_iodata() |> IO.iodata_to_binary()
 
   @doc """
   Encodes a value into Maude's wrapped value syntax.
@@ -192,9 +162,72 @@ defmodule ExMaude.IoT.Encoder do
   the Maude type system.
   """
   @spec encode_value(boolean() | number() | String.t() | atom()) :: String.t()
-  def encode_value(v) when is_boolean(v), do: "boolVal(#{if v, do: "true", else: "false"})"
-  def encode_value(v) when is_integer(v), do: "intVal(#{encode_string(Integer.to_string(v))})"
-  def encode_value(v) when is_float(v), do: "intVal(#{encode_string(Float.to_string(v))})"
-  def encode_value(v) when is_binary(v), do: "strVal(#{encode_string(v)})"
-  def encode_value(v) when is_atom(v), do: "strVal(#{encode_string(Atom.to_string(v))})"
+  def encode_value(v), do: v |> value_iodata() |> IO.iodata_to_binary()
+
+  # Private Functions
+
+  # Cached as one binary per rule, keyed on everything encode_rule/1 reads
+  defp rule_fragment(rule) do
+    key = {rule.id, rule.thing_id, rule.trigger, rule.actions, rule[:priority]}
+    Fragments.fetch(key, fn -> encode_rule(rule) end)
+  end
+
+  defp rule_iodata(rule) do
+    [
+      "rule(",
+      string_iodata(rule.id),
+      ", ",
+      thing_iodata(rule.thing_id),
+      ", ",
+      trigger_iodata(rule.trigger),
+      ", ",
+      actions_iodata(rule.actions),
+      ", ",
+      to_string(rule[:priority] || 1),
+      ?)
+    ]
+  end
+
+  defp thing_iodata(id), do: ["thing(", string_iodata(id), ?)]
+
+  defp trigger_iodata({:always}), do: "always"
+
+  defp trigger_iodata({:and, t1, t2}),
+    do: ["and(", trigger_iodata(t1), ", ", trigger_iodata(t2), ?)]
+
+  defp trigger_iodata({:or, t1, t2}),
+    do: ["or(", trigger_iodata(t1), ", ", trigger_iodata(t2), ?)]
+
+  defp trigger_iodata({:not, t}), do: ["not(", trigger_iodata(t), ?)]
+
+  defp trigger_iodata({comparison, prop, value}) when is_map_key(@comparisons, comparison) do
+    [Map.fetch!(@comparisons, comparison), ?(, string_iodata(prop), ", ", value_iodata(value), ?)]
+  end
+
+  defp actions_iodata([]), do: "nil"
+  defp actions_iodata(actions), do: Enum.map_intersperse(actions, " ; ", &action_iodata/1)
+
+  defp action_iodata({:set_prop, thing_id, prop, value}) do
+    ["setProp(", thing_iodata(thing_id), ", ", string_iodata(prop), ", ", value_iodata(value), ?)]
+  end
+
+  defp action_iodata({:set_env, prop, value}),
+    do: ["setEnv(", string_iodata(prop), ", ", value_iodata(value), ?)]
+
+  defp action_iodata({:invoke, thing_id, action_name}),
+    do: ["invoke(", thing_iodata(thing_id), ", ", string_iodata(action_name), ?)]
+
+  defp string_iodata(s) when is_binary(s), do: [?", s, ?"]
+  defp string_iodata(s) when is_atom(s), do: [?", Atom.to_string(s), ?"]
+
+  defp value_iodata(true), do: "boolVal(true)"
+  defp value_iodata(false), do: "boolVal(false)"
+  defp value_iodata(v) when is_integer(v),
+    do: ["intVal(", string_iodata(Integer.to_string(v)), ?)]
+
+  defp value_iodata(v) when is_float(v), do: ["intVal(", string_iodata(Float.to_string(v)), ?)]
+  defp value_iodata(v) when is_binary(v), do: ["strVal(", string_iodata(v), ?)]
+
+  defp value_iodata(v) when is_atom(v),
+    do: ["strVal(", string_iodata(Atom.to_string(v)), ?)]
 end
@@ -0,0 +1,131 @@
+defmodule ExMaude.IoT.Fragments do
+  @moduledoc """
+  ETS cache of encoded IoT rules.
+
+  `ExMaude.IoT.detect_conflicts/2` sends the whole rule set to Maude on
+  every call, while large rule sets usually change a few rules at a time.
+  `ExMaude.IoT.Encoder.encode_rules_iodata/1` takes each rule's Maude term
+  from this table, keyed on the rule fields the encoding depends on, and
+  only encodes the rules it has not seen. The command is assembled as
+  iodata around the cached binaries, so they are shared on their way to
+  the backend instead of being copied into one string per call.
+
+  The table is owned by this process, which is started with the
+  application. When it is not running rules are encoded every time.
+
+  ## Configuration
+
+      config :ex_maude,
+        iot_fragments_max_entries: 50_000 # Fragments kept before the table is flushed
+
+  ## Bounding
+
+  As with `ExMaude.Cache`, the whole table is flushed once `:max_entries`
+  fragments are stored; the rules in use are encoded again on their next
+  call.
+  """
+
+  use GenServer
+
+  @table :ex_maude_iot_fragments
+  @default_max_entries 50_000
+  # :max_entries row stored next to the fragments
+  @meta_rows 1
+
+  @doc """
+  Starts the process owning the fragment table.
+
+  ## Options
+
+    * `:max_entries` - Fragments kept before the table is flushed
+      (default: `:iot_fragments_max_entries` or 50000)
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    GenServer.start_link(__MODULE__, opts, name: __MODULE__)
+  end
+
+  @doc """
+  Returns whether the fragment table is running.
+  """
+  @spec enabled?() :: boolean()
+  def enabled? do
+    :ets.whereis(@table) != :undefined
+  end
+
+  @doc """
+  Returns the fragment stored for `key`, or encodes and stores it with `fun`.
+  """
+  @spec fetch(term(), (-> binary())) :: binary()
+  def fetch(key, fun) when is_function(fun, 0) do
+    case lookup({:rule, key}) do
+      {:ok, fragment} ->
+        fragment
+
+      :error ->
+        fragment = fun.()
+        store({:rule, key}, fragment)
+        fragment
+    end
+  end
+
+  @doc """
+  Removes every fragment.
+  """
+  @spec clear() :: :ok
+  def clear do
+    if enabled?() do
+      :ets.select_delete(@table, [{{{:rule, :_}, :_}, [], [true]}])
+    end
+
+    :ok
+  end
+
+  @doc """
+  Returns the number of stored fragments.
+  """
+  @spec size() :: non_neg_integer()
+  def size do
+    if enabled?(), do: :ets.info(@table, :size) - @meta_rows, else: 0
+  end
+
+  # Server Callbacks
+
+  @impl GenServer
+  def init(opts) do
+    max_entries = opts[:max_entries] || config_max_entries()
+
+    :ets.new(@table, [:named_table, :public, :set, read_concurrency: true])
+    :ets.insert(@table, {:max_entries, max_entries})
+
+    {:ok, %{}}
+  end
+
+  # Private Functions
+
+  defp lookup(key) do
+    case :ets.lookup(@table, key) do
+      [{^key, fragment}] -> {:ok, fragment}
+      [] -> :error
+    end
+  rescue
+    # The table is not running, or stopped between calls
+    ArgumentError -> :error
+  end
+
+  defp store(key, fragment) do
+    max_entries = :ets.lookup_element(@table, :max_entries, 2)
+
+    if :ets.info(@table, :size) - @meta_rows >= max_entries do
+      clear()
+    end
+
+    :ets.insert(@table, {key, fragment})
+  rescue
+    ArgumentError -> false
+  end
+
+  defp config_max_entries do
+    Application.get_env(:ex_maude, :iot_fragments_max_entries, @default_max_entries)
+  end
+end
@@ -0,0 +1,268 @@
+defmodule ExMaude.IoT.Incremental do
+  @moduledoc """
+  Incremental IoT conflict detection for rule sets that change one rule at
+  a time.
+
+  `ExMaude.IoT.detect_conflicts/2` encodes every rule and checks all pairs
+  on each call. This module instead keeps the current rule set together
+  with its known conflicts. When rules are added or changed, only those
+  rules are checked, and only against the rules they could conflict with.
+  The cost of an update therefore follows the size of the change, not the
+  square of the rule set.
+
+  ## Candidate Index
+
+  Every conflict type needs rules that touch the same property:
+
+  | Conflict | Rule A | Rule B |
+  |----------|--------|--------|
+  | State conflict | `thing_id` T, `{:set_prop, t, p, _}` | same T, same `t` and `p` |
+  | Environment conflict | `{:set_env, p, _}` | `{:set_env, p, _}` |
+  | Cascades | `{:set_prop, _, p, _}` / `{:set_env, p, _}` | trigger `{:prop_eq, p, _}` / `{:env_eq, p, _}` |
+
+  Rules are indexed by those keys, and a changed rule is sent to Maude
+  (`detectAgainst` in `CONFLICT-DETECTOR`) with just the rules that share
+  a key with it. Rules with no such neighbours cost no Maude call at all.
+  Cascades are checked in both directions.
+
+  ## Usage
+
+      {:ok, detector} = ExMaude.IoT.Incremental.put_rules(ExMaude.IoT.Incremental.new(), rules)
+
+      {:ok, detector} = ExMaude.IoT.Incremental.put_rule(detector, changed_rule)
+      detector = ExMaude.IoT.Incremental.delete_rule(detector, "night-light")
+
+      ExMaude.IoT.Incremental.conflicts(detector)
+      #=> [%{type: :state_conflict, rule1: "motion-light", rule2: "dim-light", ...}]
+
+  The detector is a plain struct; keep it in the process that owns the
+  rule set. A failed update returns `{:error, error}` and leaves the
+  detector as it was.
+  """
+
+  alias ExMaude.{IoT, Maude}
+  alias ExMaude.IoT.{ConflictParser, Encoder}
+
+  defstruct rules: %{}, index: %{}, conflicts: %{}, by_rule: %{}
+
+  @typedoc """
+  Index key shared by rules that could conflict.
+  """
+  @type key ::
+          {:state, IoT.thing_id(), IoT.thing_id(), String.t()}
+          | {:env, String.t()}
+          | {:writes_prop | :reads_prop | :writes_env | :reads_env, String.t()}
+
+  @typep conflict_key :: {IoT.conflict_type(), String.t(), String.t()}
+
+  @type t :: %__MODULE__{
+          rules: %{String.t() => {IoT.rule(), String.t()}},
+          index: %{key() => MapSet.t(String.t())},
+          conflicts: %{conflict_key() => IoT.conflict()},
+          by_rule: %{String.t() => MapSet.t(conflict_key())}
+        }
+
+  @doc """
+  Creates an empty detector.
+  """
+  @spec new() :: t()
+  def new, do: %__MODULE__{}
+
+  @doc """
+  Adds or replaces one rule and checks it for conflicts.
+
+  See `put_rules/3`.
+  """
+  @spec put_rule(t(), IoT.rule(), keyword()) :: {:ok, t()} | {:error, term()}
+  def put_rule(detector, rule, opts \\ []), do: put_rules(detector, [rule], opts)
+
+  @doc """
+  Adds or replaces rules and checks them for conflicts.
+
+  A rule whose `:id` is already known replaces the old version, whose
+  conflicts are dropped first. Each rule is checked against its candidate
+  rules, including the ones added earlier in the same call, all in one
+  Maude command. Loading a whole rule set this way checks each rule only
+  against its neighbours.
+
+  ## Options
+
+    * `:timeout` - Maximum time in milliseconds (default: 10000)
+  """
+  @spec put_rules(t(), [IoT.rule()], keyword()) :: {:ok, t()} | {:error, term()}
+  def put_rules(%__MODULE__{} = detector, rules, opts \\ []) when is_list(rules) do
+    # Only the last version of a rule given twice counts
+    rules = rules |> Enum.reverse() |> Enum.uniq_by(& &1.id) |> Enum.reverse()
+
+    {updated, checks} =
+      Enum.reduce(rules, {detector, []}, fn rule, {acc, checks} ->
+        acc = delete_rule(acc, rule.id)
+        candidates = candidates(acc, rule)
+        encoded = Encoder.encode_rule(rule)
+        acc = insert(acc, rule, encoded)
+
+        if MapSet.size(candidates) == 0 do
+          {acc, checks}
+        else
+          {acc, [{encoded, candidates} | checks]}
+        end
+      end)
+
+    with {:ok, conflicts} <- check(updated, Enum.reverse(checks), opts) do
+      {:ok, Enum.reduce(conflicts, updated, &add_conflict(&2, &1))}
+    end
+  end
+
+  @doc """
+  Removes a rule and its conflicts. Unknown ids are ignored.
+  """
+  @spec delete_rule(t(), String.t()) :: t()
+  def delete_rule(%__MODULE__{} = detector, id) do
+    case Map.pop(detector.rules, id) do
+      {nil, _rules} ->
+        detector
+
+      {{rule, _encoded}, rules} ->
+        index = Enum.reduce(keys(rule), detector.index, &delete_member(&2, &1, id))
+
+        detector = %{detector | rules: rules, index: index}
+        conflict_keys = Map.get(detector.by_rule, id, MapSet.new())
+        Enum.reduce(conflict_keys, detector, &drop_conflict(&2, &1))
+    end
+  end
+
+  @doc """
+  Returns all known conflicts.
+  """
+  @spec conflicts(t()) :: [IoT.conflict()]
+  def conflicts(%__MODULE__{conflicts: conflicts}), do: Map.values(conflicts)
+
+  @doc """
+  Returns the known conflicts involving rule `id`.
+  """
+  @spec conflicts_for(t(), String.t()) :: [IoT.conflict()]
+  def conflicts_for(%__MODULE__{} = detector, id) do
+    detector.by_rule
+    |> Map.get(id, MapSet.new())
+    |> Enum.map(&Map.fetch!(detector.conflicts, &1))
+  end
+
+  @doc """
+  Returns the current rules.
+  """
+  @spec rules(t()) :: [IoT.rule()]
+  def rules(%__MODULE__{rules: rules}), do: Enum.map(rules, fn {_id, {rule, _}} -> rule end)
+
+  @doc """
+  Returns the index keys of a rule.
+
+  Two rules can only conflict when a key of one is the partner of a key of
+  the other (`{:writes_prop, p}` pairs with `{:reads_prop, p}`, and so on;
+  all other keys pair with themselves).
+
+  ## Examples
+
+      iex> ExMaude.IoT.Incremental.keys(%{
+      ...>   id: "r1",
+      ...>   thing_id: "light-1",
+      ...>   trigger: {:prop_eq, "motion", true},
+      ...>   actions: [{:set_prop, "light-1", "state", "on"}]
+      ...> })
+      [{:state, "light-1", "light-1", "state"}, {:writes_prop, "state"}, {:reads_prop, "motion"}]
+  """
+  @spec keys(IoT.rule()) :: [key()]
+  def keys(rule) do
+    writes =
+      Enum.flat_map(rule.actions, fn
+        {:set_prop, thing_id, prop, _value} ->
+          [{:state, rule.thing_id, thing_id, prop}, {:writes_prop, prop}]
+
+        {:set_env, prop, _value} ->
+          [{:env, prop}, {:writes_env, prop}]
+
+        _action ->
+          []
+      end)
+
+    # Maude only matches cascades against a top-level equality trigger
+    reads =
+      case rule.trigger do
+        {:prop_eq, prop, _value} -> [{:reads_prop, prop}]
+        {:env_eq, prop, _value} -> [{:reads_env, prop}]
+        _trigger -> []
+      end
+
+    Enum.uniq(writes ++ reads)
+  end
+
+  # Private Functions
+
+  defp partner({:writes_prop, prop}), do: {:reads_prop, prop}
+  defp partner({:reads_prop, prop}), do: {:writes_prop, prop}
+  defp partner({:writes_env, prop}), do: {:reads_env, prop}
+  defp partner({:reads_env, prop}), do: {:writes_env, prop}
+  defp partner(key), do: key
+
+  defp candidates(detector, rule) do
+    rule
+    |> keys()
+    |> Enum.reduce(MapSet.new(), fn key, acc ->
+      MapSet.union(acc, Map.get(detector.index, partner(key), MapSet.new()))
+    end)
+    |> MapSet.delete(rule.id)
+  end
+
+  defp insert(detector, rule, encoded) do
+    index = Enum.reduce(keys(rule), detector.index, &put_member(&2, &1, rule.id))
+
+    %{detector | rules: Map.put(detector.rules, rule.id, {rule, encoded}), index: index}
+  end
+
+  defp check(_detector, [], _opts), do: {:ok, []}
+
+  defp check(detector, checks, opts) do
+    timeout = Keyword.get(opts, :timeout, 10_000)
+
+    terms =
+      Enum.map_join(checks, " | ", fn {encoded, candidates} ->
+        others = Enum.map_join(candidates, ", ", &elem(Map.fetch!(detector.rules, &1), 1))
+        "detectAgainst(#{encoded}, (#{others}))"
+      end)
+
+    with :ok <- IoT.ensure_iot_module_loaded(),
+         {:ok, output} <-
+           Maude.execute("reduce in CONFLICT-DETECTOR : #{terms} .", timeout: timeout) do
+      {:ok, ConflictParser.parse_conflicts(output)}
+    end
+  end
+
+  defp add_conflict(detector, conflict) do
+    key = {conflict.type, conflict.rule1, conflict.rule2}
+
+    by_rule =
+      Enum.reduce([conflict.rule1, conflict.rule2], detector.by_rule, &put_member(&2, &1, key))
+
+    %{detector | conflicts: Map.put(detector.conflicts, key, conflict), by_rule: by_rule}
+  end
+
+  defp drop_conflict(detector, {_type, rule1, rule2} = key) do
+    by_rule = Enum.reduce([rule1, rule2], detector.by_rule, &delete_member(&2, &1, key))
+    %{detector | conflicts: Map.delete(detector.conflicts, key), by_rule: by_rule}
+  end
+
+  # Maps of sets, where empty sets are removed
+  defp put_member(map, key, member) do
+    Map.update(map, key, MapSet.new([member]), &MapSet.put(&1, member))
+  end
+
+  defp delete_member(map, key, member) do
+    case Map.fetch(map, key) do
+      {:ok, set} ->
+        set = MapSet.delete(set, member)
+        if MapSet.size(set) == 0, do: Map.delete(map, key), else: Map.put(map, key, set)
+
+      :error ->
+        map
+    end
+  end
+end
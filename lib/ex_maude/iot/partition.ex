@@ -0,0 +1,104 @@
+defmodule ExMaude.IoT.Partition do
+  @moduledoc """
+  Splits a rule set into groups that can be checked for conflicts
+  independently.
+
+  Two rules can only conflict when they share one of the keys of
+  `ExMaude.IoT.Incremental.keys/1`: the same written property on the same
+  thing, the same environment property, or a written property that the
+  other rule triggers on. Maude's state conflicts also cover two rules of
+  the same thing that set the same environment property, so those share a
+  key for `:state` as well. Rules connected through such keys form a group.
+  No conflict crosses groups, so `ExMaude.IoT.detect_conflicts/2` reduces
+  each group on its own pool worker and merges the results.
+
+  Groups are formed per conflict kind, so a rule can be in one state group
+  and another cascade group. Rules without partners are left out.
+
+  ## Examples
+
+      iex> rules = [
+      ...>   %{id: "a", thing_id: "l1", trigger: {:always}, actions: [{:set_prop, "l1", "s", 1}]},
+      ...>   %{id: "b", thing_id: "l1", trigger: {:always}, actions: [{:set_prop, "l1", "s", 2}]},
+      ...>   %{id: "c", thing_id: "l2", trigger: {:always}, actions: [{:set_prop, "l2", "s", 1}]}
+      ...> ]
+      iex> groups = ExMaude.IoT.Partition.groups(rules, :state)
+      iex> Enum.map(groups, fn group -> Enum.map(group, & &1.id) end)
+      [["a", "b"]]
+  """
+
+  alias ExMaude.IoT
+  alias ExMaude.IoT.Incremental
+
+  @typedoc """
+  Conflict kind a partition is built for.
+  """
+  @type kind :: :state | :env | :cascade
+
+  @doc """
+  Returns the groups of at least two rules that may conflict with each
+  other for `kind`, keeping the rules' order within each group.
+  """
+  @spec groups([IoT.rule()], kind()) :: [[IoT.rule()]]
+  def groups(rules, kind) do
+    indexed = Enum.with_index(rules)
+
+    {parents, _owners} =
+      Enum.reduce(indexed, {%{}, %{}}, fn {rule, i}, {parents, owners} ->
+        rule
+        |> group_keys(kind)
+        |> Enum.reduce({Map.put(parents, i, i), owners}, fn key, {parents, owners} ->
+          case Map.fetch(owners, key) do
+            {:ok, j} -> {union(parents, i, j), owners}
+            :error -> {parents, Map.put(owners, key, i)}
+          end
+        end)
+      end)
+
+    # A group's root is its first rule, so sorting by root keeps rule order
+    indexed
+    |> Enum.group_by(fn {_rule, i} -> root(parents, i) end, fn {rule, _i} -> rule end)
+    |> Enum.sort_by(fn {root, _group} -> root end)
+    |> Enum.map(fn {_root, group} -> group end)
+    |> Enum.filter(&match?([_, _ | _], &1))
+  end
+
+  # actionsConflict in CONFLICT-DETECTOR compares setEnv pairs too, so
+  # :state groups also join a thing's rules writing one environment property
+  defp group_keys(rule, :state) do
+    env_writes =
+      for {:set_env, prop, _value} <- rule.actions, do: {:state_env, rule.thing_id, prop}
+
+    Enum.flat_map(Incremental.keys(rule), &group_key(&1, :state)) ++ env_writes
+  end
+
+  defp group_keys(rule, kind) do
+    rule |> Incremental.keys() |> Enum.flat_map(&group_key(&1, kind))
+  end
+
+  # Writers and readers of a property share one key for cascades
+  defp group_key({:state, _, _, _} = key, :state), do: [key]
+  defp group_key({:env, _} = key, :env), do: [key]
+
+  defp group_key({flow, prop}, :cascade) when flow in [:writes_prop, :reads_prop],
+    do: [{:prop, prop}]
+
+  defp group_key({flow, prop}, :cascade) when flow in [:writes_env, :reads_env],
+    do: [{:env, prop}]
+
+  defp group_key(_key, _kind), do: []
+
+  defp union(parents, i, j) do
+    case {root(parents, i), root(parents, j)} do
+      {same, same} -> parents
+      {a, b} -> Map.put(parents, max(a, b), min(a, b))
+    end
+  end
+
+  defp root(parents, i) do
+    case Map.fetch!(parents, i) do
+      ^i -> i
+      parent -> root(parents, parent)
+    end
+  end
+end
@@ -28,15 +28,24 @@ defmodule ExMaude.Maude do
   - `[:ex_maude, :command, :exception]` - Emitted when a command raises
 
   Metadata includes `:operation` (`:reduce`, `:rewrite`, `:search`, `:execute`,
-  `:parse`, `:load_file`, `:load_module`) and `:module` (the Maude module name).
+  `:execute_batch`, `:parse`, `:load_file`, `:load_module`) and `:module` (the Maude module name).
+
+  For `reduce`, `rewrite`, `search` and `execute_parsed` the `:stop`
+  measurements also carry the statistics Maude printed: `:rewrites`,
+  `:cpu_ms`, `:real_ms` and, for searches, `:states`.
 
   See `ExMaude.Telemetry` for full event documentation and integration examples.
   """
 
-  alias ExMaude.{Error, Pool, Server, Parser, Telemetry}
+  alias ExMaude.{Cache, Cluster, Error, Pool, Server, Parser, Router, Telemetry}
+  alias ExMaude.Backend.Modules
+  alias ExMaude.Parser.SearchStream
+  alias ExMaude.Result.Reduction
 
   @default_timeout_ms 5_000
   @search_timeout_ms 30_000
+  # Headroom for the router to load a module on first use
+  @route_load_timeout_ms 30_000
 
   @doc """
   Reduces a term in the given module to its normal form.
@@ -55,12 +64,15 @@ defmodule ExMaude.Maude do
   ## Options
 
     * `:timeout` - Maximum time in ms (default: 5000)
+    * `:cache` - Use `ExMaude.Cache` when it is running (default: true)
   """
   @spec reduce(String.t(), String.t(), keyword()) :: {:ok, String.t()} | {:error, term()}
   def reduce(module, term, opts \\ []) do
     Telemetry.span([:ex_maude, :command], %{operation: :reduce, module: module}, fn ->
-      command = "reduce in #{module} : #{term}"
-      do_execute(command, opts)
+      cached({:reduce, module, term}, opts, fn ->
+        command = "reduce in #{module} : #{term}"
+        execute_with_stats(command, opts, module)
+      end)
     end)
   end
 
@@ -92,7 +104,7 @@ defmodule ExMaude.Maude do
           "rewrite in #{module} : #{term}"
         end
 
-      do_execute(command, opts)
+      execute_with_stats(command, opts, module)
     end)
   end
 
@@ -125,18 +137,68 @@ defmodule ExMaude.Maude do
       timeout = Keyword.get(opts, :timeout, @search_timeout_ms)
       command = build_search_command(module, initial, pattern, opts)
 
-      case do_execute(command, timeout: timeout) do
-        {:ok, output} -> {:ok, Parser.parse_search_results(output)}
-        error -> error
+      case do_execute(command, [timeout: timeout], module) do
+        {:ok, output} ->
+          put_stats(Parser.parse_stats(output))
+          {:ok, Parser.parse_search_results(output)}
+
+        error ->
+          error
       end
     end)
   end
 
+  @doc """
+  Searches like `search/4`, but returns a lazy stream of solutions.
+
+  Output is parsed with `ExMaude.Parser.SearchStream` while it arrives, so
+  memory stays bounded however many solutions Maude finds. With the C-Node
+  backend solutions are emitted while Maude is still searching, and once
+  `:limit` solutions were taken (or the stream is halted otherwise) the
+  search is cancelled and the pool worker returned. When `ExMaude.Cluster`
+  is running the search runs on the node it picks for `module`.
+
+  ## Examples
+
+      ExMaude.Maude.search_stream("MY-MOD", "init", "S:State", limit: 100)
+      |> Stream.filter(&unsafe?/1)
+      |> Enum.take(1)
+      #=> [%ExMaude.Result.Solution{number: 7, state_num: 42, ...}]
+
+  ## Options
+
+    * `:limit` - Emit at most this many solutions (default: unbounded)
+    * `:max_solutions` - Solution bound passed to Maude (default: `:limit`)
+    * `:max_depth`, `:arrow`, `:condition`, `:timeout` - As for `search/4`
+  """
+  @spec search_stream(String.t(), String.t(), String.t(), keyword()) :: Enumerable.t()
+  def search_stream(module, initial, pattern, opts \\ []) do
+    limit = Keyword.get(opts, :limit, :infinity)
+    opts = Keyword.put_new(opts, :max_solutions, limit)
+    command = build_search_command(module, initial, pattern, opts)
+    timeout = Keyword.get(opts, :timeout, @search_timeout_ms)
+
+    if Cluster.running?() do
+      module
+      |> Cluster.stream(command, timeout: timeout + @route_load_timeout_ms)
+      |> SearchStream.stream(limit: limit)
+    else
+      command
+      |> stream(timeout: timeout)
+      |> SearchStream.stream(limit: limit)
+    end
+  end
+
   @doc """
   Loads a Maude file into all pool workers.
 
-  The file is loaded into every worker in the pool to ensure consistent
-  module availability across all operations.
+  The file is loaded into every worker in the pool, and into every
+  `ExMaude.Router` worker when the router runs, to ensure consistent
+  module availability across all operations. Workers skip files whose
+  modules they already have in exactly this version (see
+  `ExMaude.Backend.Modules`). Results held by `ExMaude.Cache` are
+  invalidated unless the file left its modules as they were (see
+  `ExMaude.Cache.invalidate/1`).
 
   ## Examples
 
@@ -148,27 +210,26 @@ defmodule ExMaude.Maude do
     unless File.exists?(path) do
       {:error, Error.file_not_found(path)}
     else
-      results =
-        Pool.broadcast(fn worker ->
-          Server.load_file(worker, path)
-        end)
+      # Lets the router record which modules its workers now have, and the
+      # cache keep its results when the file did not change
+      source =
+        case File.read(path) do
+          {:ok, source} -> source
+          {:error, _} -> nil
+        end
 
-      if Enum.all?(results, &(&1 == :ok)) do
-        :ok
-      else
-        # coveralls-ignore-start
-        # This branch requires a partial failure across pool workers
-        failures = Enum.reject(results, &(&1 == :ok))
-        {:error, Error.partial_load(failures)}
-        # coveralls-ignore-stop
-      end
+      modules = if source, do: Modules.names(source), else: []
+      broadcast_load(&Server.load_file(&1, path), {:load_file, path}, source, modules)
     end
   end
 
   @doc """
   Loads a Maude module from a string.
 
-  The module definition is loaded into all pool workers.
+  The module definition is loaded into all pool and router workers. The
+  C-Node backend sends the source to its bridge directly, the others
+  write it to a temporary file first. Workers that already have this
+  exact source loaded skip it.
 
   ## Examples
 
@@ -176,35 +237,45 @@ defmodule ExMaude.Maude do
       ExMaude.Maude.load_module(source)
       #=> :ok
   """
-  # sobelow_skip ["Traversal.FileModule"]
   @spec load_module(String.t()) :: :ok | {:error, term()}
   def load_module(source) do
-    # Create a temporary file for the module in a controlled location.
-    # The path is constructed from System.tmp_dir! and a unique integer,
-    # with no user input in the path - safe from directory traversal.
-    tmp_dir = System.tmp_dir!()
-    filename = "ex_maude_#{:erlang.unique_integer([:positive])}.maude"
-    tmp_path = Path.join(tmp_dir, filename)
-
-    # Verify path stays within tmp_dir (defense in depth)
-    expanded_path = Path.expand(tmp_path)
-    expanded_tmp = Path.expand(tmp_dir)
-
-    if String.starts_with?(expanded_path, expanded_tmp) do
-      try do
-        File.write!(expanded_path, source)
-        load_file(expanded_path)
-      after
-        File.rm(expanded_path)
-      end
+    modules = Modules.names(source)
+    key = {:load_module, if(modules == [], do: source, else: modules)}
+    broadcast_load(&Server.load_source(&1, source), key, source, modules)
+  end
+
+  # The key lets autoscaler shards started later replay the load
+  defp broadcast_load(load, key, source, modules) do
+    results = Pool.broadcast(load, key: key) ++ router_broadcast(load, modules)
+
+    # Even a partial load changes what cached results were computed against.
+    # A source every worker skipped as unchanged does not.
+    if source && Enum.all?(results, &(&1 == :ok)) do
+      Cache.invalidate(source)
     else
-      # coveralls-ignore-start
-      # This branch can only be reached if Path.expand behaves unexpectedly
-      {:error, Error.invalid_path("Generated path escapes temp directory")}
-      # coveralls-ignore-stop
+      Cache.invalidate()
+    end
+
+    cond do
+      results == [] ->
+        {:error, Error.pool_error(:no_workers)}
+
+      Enum.all?(results, &(&1 == :ok)) ->
+        :ok
+
+      true ->
+        # coveralls-ignore-start
+        # This branch requires a partial failure across pool workers
+        failures = Enum.reject(results, &(&1 == :ok))
+        {:error, Error.partial_load(failures)}
+        # coveralls-ignore-stop
     end
   end
 
+  defp router_broadcast(load, modules) do
+    if Router.running?(), do: Router.broadcast(load, modules), else: []
+  end
+
   @doc """
   Executes a raw Maude command.
 
@@ -218,25 +289,173 @@ defmodule ExMaude.Maude do
       ExMaude.Maude.execute("parse in NAT : 1 + 2 .")
       #=> {:ok, "1 + 2"}
   """
-  @spec execute(String.t(), keyword()) :: {:ok, String.t()} | {:error, term()}
+  @spec execute(iodata(), keyword()) :: {:ok, String.t()} | {:error, term()}
   def execute(command, opts \\ []) do
     Telemetry.span([:ex_maude, :command], %{operation: :execute, module: "raw"}, fn ->
       do_execute(command, opts)
     end)
   end
 
-  # Internal execute without telemetry (used by instrumented functions)
-  defp do_execute(command, opts) do
-    timeout = Keyword.get(opts, :timeout, @default_timeout_ms)
+  @doc """
+  Executes a raw Maude command and returns its output as result structs.
+
+  See `ExMaude.Server.execute_parsed/3`. With the C-Node backend the
+  output is tokenized by the bridge instead of by regexes on the BEAM.
+
+  ## Examples
+
+      ExMaude.Maude.execute_parsed("reduce in NAT : 1 + 2 .")
+      #=> {:ok, #ExMaude.Result.Reduction<term: 3 : NzNat, rewrites: 1, time: 0ms>}
+
+  ## Options
 
-    Pool.transaction(
-      fn worker ->
-        Server.execute(worker, command, timeout: timeout)
-      end,
-      timeout: timeout + 1_000
+    * `:timeout` - Maximum time in ms (default: 5000)
+  """
+  @spec execute_parsed(String.t(), keyword()) ::
+          {:ok, ExMaude.Result.Reduction.t() | ExMaude.Result.Search.t() | String.t()}
+          | {:error, term()}
+  def execute_parsed(command, opts \\ []) do
+    Telemetry.span([:ex_maude, :command], %{operation: :execute_parsed, module: "raw"}, fn ->
+      timeout = Keyword.get(opts, :timeout, @default_timeout_ms)
+
+      result =
+        Pool.transaction(
+          fn worker -> Server.execute_parsed(worker, command, timeout: timeout) end,
+          timeout: timeout + 1_000
+        )
+
+      with {:ok, %{__struct__: _} = parsed} <- result do
+        put_stats(Map.from_struct(parsed))
+      end
+
+      result
+    end)
+  end
+
+  @doc """
+  Executes several raw Maude commands on one pool worker.
+
+  With the C-Node backend the whole batch costs a single round trip to the
+  bridge, which spreads the commands over its Maude instances. Results are
+  returned in the order of `commands`, each as `{:ok, output}` or
+  `{:error, error}`.
+
+  ## Examples
+
+      ExMaude.Maude.execute_batch([
+        "reduce in NAT : 1 + 2 .",
+        "reduce in NAT : 3 * 4 ."
+      ])
+      #=> {:ok, [{:ok, "result NzNat: 3"}, {:ok, "result NzNat: 12"}]}
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms for each command (default: 5000)
+  """
+  @spec execute_batch([String.t()], keyword()) ::
+          {:ok, [{:ok, String.t()} | {:error, term()}]} | {:error, term()}
+  def execute_batch(commands, opts \\ []) do
+    Telemetry.span([:ex_maude, :command], %{operation: :execute_batch, module: "raw"}, fn ->
+      timeout = Keyword.get(opts, :timeout, @default_timeout_ms)
+
+      Pool.transaction(
+        fn worker ->
+          Server.execute_batch(worker, commands, timeout: timeout)
+        end,
+        timeout: timeout * max(length(commands), 1) + 1_000
+      )
+    end)
+  end
+
+  @doc """
+  Executes a raw Maude command and streams its output.
+
+  Returns a lazy stream of binaries. With the C-Node backend chunks arrive
+  while Maude is still working, so the first solutions of a long `search`
+  can be handled early and halting the stream (e.g. with `Enum.take/2`)
+  abandons the rest of the output. Other backends emit the whole output as
+  a single chunk.
+
+  A pool worker is checked out when enumeration starts and returned when
+  the stream finishes or is halted. Errors are raised as `ExMaude.Error`.
+
+  ## Examples
+
+      "search [10] in MY-MOD : init =>* S:State ."
+      |> ExMaude.Maude.stream(timeout: 60_000)
+      |> Enum.take(1)
+      #=> ["Solution 1 (state 4)\n..."]
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms to wait for each chunk (default: 30000)
+  """
+  @spec stream(String.t(), keyword()) :: Enumerable.t()
+  def stream(command, opts \\ []) do
+    timeout = Keyword.get(opts, :timeout, @search_timeout_ms)
+
+    Stream.transform(
+      [command],
+      fn -> checkout!(timeout) end,
+      fn command, worker -> {Server.stream(worker, command, timeout: timeout), worker} end,
+      &Pool.checkin/1
     )
   end
 
+  defp checkout!(timeout) do
+    case Pool.checkout(timeout: timeout) do
+      {:error, error} -> raise error
+      :full -> raise Error.pool_error(:full)
+      worker -> worker
+    end
+  end
+
+  defp cached(key, opts, fun) do
+    if Keyword.get(opts, :cache, true), do: Cache.fetch(key, fun), else: fun.()
+  end
+
+  # Internal execute without telemetry (used by instrumented functions).
+  # Commands for a known module go through ExMaude.Cluster or
+  # ExMaude.Router when they run.
+  defp do_execute(command, opts, module \\ nil, execute \\ &Server.execute/3) do
+    timeout = Keyword.get(opts, :timeout, @default_timeout_ms)
+    run = fn worker -> execute.(worker, command, timeout: timeout) end
+
+    cond do
+      module != nil and Cluster.running?() ->
+        Cluster.transaction(module, run, timeout: timeout + @route_load_timeout_ms)
+
+      module != nil and Router.running?() ->
+        Router.transaction(module, run, timeout: timeout + @route_load_timeout_ms)
+
+      true ->
+        Pool.transaction(run, timeout: timeout + 1_000)
+    end
+  end
+
+  # Runs a reduce or rewrite parsed, so Maude's statistics are kept for
+  # telemetry, and returns the value of the result term
+  defp execute_with_stats(command, opts, module) do
+    case do_execute(command, opts, module, &Server.execute_parsed/3) do
+      {:ok, %Reduction{} = reduction} ->
+        put_stats(Map.from_struct(reduction))
+        {:ok, reduction.term.value}
+
+      other ->
+        other
+    end
+  end
+
+  # Parser statistics and result structs name the same values differently
+  defp put_stats(stats) do
+    Telemetry.put_measurements(%{
+      rewrites: stats[:rewrites],
+      cpu_ms: stats[:time_ms],
+      real_ms: stats[:real_ms],
+      states: stats[:states] || stats[:states_explored]
+    })
+  end
+
   @doc """
   Returns Maude version information.
 
@@ -267,12 +486,19 @@ defmodule ExMaude.Maude do
 
       ExMaude.Maude.parse("NAT", "1 + 2 + 3")
       #=> {:ok, "1 + (2 + 3)"}
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms (default: 5000)
+    * `:cache` - Use `ExMaude.Cache` when it is running (default: true)
   """
   @spec parse(String.t(), String.t(), keyword()) :: {:ok, String.t()} | {:error, term()}
   def parse(module, term, opts \\ []) do
     Telemetry.span([:ex_maude, :command], %{operation: :parse, module: module}, fn ->
-      command = "parse in #{module} : #{term}"
-      do_execute(command, opts)
+      cached({:parse, module, term}, opts, fn ->
+        command = "parse in #{module} : #{term}"
+        do_execute(command, opts, module)
+      end)
     end)
   end
 
@@ -303,7 +529,8 @@ defmodule ExMaude.Maude do
     arrow = Keyword.get(opts, :arrow, "=>*")
     condition = Keyword.get(opts, :condition)
 
-    base = "search [#{max_solutions}, #{max_depth}] in #{module} : #{initial} #{arrow} #{pattern}"
+    bound = if max_solutions == :infinity, do: "", else: max_solutions
+    base = "search [#{bound}, #{max_depth}] in #{module} : #{initial} #{arrow} #{pattern}"
 
     if condition do
       "#{base} such that #{condition}"
@@ -32,6 +32,16 @@ defmodule ExMaude.Parser do
       :ok = ExMaude.Parser.parse_errors(clean_output)
       {:error, issues} = ExMaude.Parser.parse_errors("Error: bad input")
 
+  For search output that arrives in chunks, `ExMaude.Parser.SearchStream`
+  emits solutions incrementally instead of splitting the whole output.
+
+  ## Tokens
+
+  The C-Node bridge can tokenize output itself (`ExMaude.Server.execute_parsed/3`),
+  so the BEAM does no text scanning. `tokenize/1` produces the same tokens
+  in Elixir for the other backends, and `to_result/1` turns either into
+  `ExMaude.Result` structs.
+
   ## Limitations
 
   The term parser (`parse_term/1`) provides basic parsing but does not handle
@@ -40,6 +50,94 @@ defmodule ExMaude.Parser do
   parsers or Maude's own `parse` command.
   """
 
+  alias ExMaude.Result.{Reduction, Search, Solution}
+  alias ExMaude.Term
+
+  @typedoc """
+  Statistics Maude reported for a command; unreported keys are left out.
+  """
+  @type stats :: %{optional(:states | :rewrites | :time_ms | :real_ms) => non_neg_integer()}
+
+  @typedoc """
+  Maude output split into its parts.
+  """
+  @type tokens ::
+          {:result, sort :: String.t(), term :: String.t(), stats()}
+          | {:search,
+             [{pos_integer(), non_neg_integer() | :undefined, [{String.t(), String.t()}]}],
+             stats()}
+          | {:text, String.t()}
+
+  @doc """
+  Splits Maude output into tokens, like the C-Node bridge's parse mode.
+
+  ## Examples
+
+      iex> ExMaude.Parser.tokenize("rewrites: 3 in 0ms cpu (0ms real)\\nresult Nat: 6")
+      {:result, "Nat", "6", %{rewrites: 3, time_ms: 0, real_ms: 0}}
+
+      iex> ExMaude.Parser.tokenize("fmod NAT")
+      {:text, "fmod NAT"}
+  """
+  @spec tokenize(String.t()) :: tokens()
+  def tokenize(output) do
+    cond do
+      Regex.match?(~r/^(Solution \d+|No solution|No more solutions)/m, output) ->
+        solutions =
+          output
+          |> parse_search_results()
+          |> Enum.map(fn solution ->
+            {solution.solution, solution.state_num || :undefined,
+             Enum.to_list(solution.substitution)}
+          end)
+
+        {:search, solutions, parse_stats(output)}
+
+      parse_errors(output) != :ok ->
+        {:text, output}
+
+      match?({:ok, _, _}, parse_result(output)) ->
+        {:ok, value, sort} = parse_result(output)
+        {:result, sort, value, parse_stats(output)}
+
+      true ->
+        {:text, output}
+    end
+  end
+
+  @doc """
+  Builds result structs from tokens.
+
+  Results become `ExMaude.Result.Reduction`, searches
+  `ExMaude.Result.Search`, and other output is returned as is.
+
+  ## Examples
+
+      iex> ExMaude.Parser.to_result({:text, "fmod NAT"})
+      "fmod NAT"
+  """
+  @spec to_result(tokens()) :: Reduction.t() | Search.t() | String.t()
+  def to_result({:result, sort, term, stats}) do
+    Reduction.new(Term.new(term, sort),
+      rewrites: stats[:rewrites],
+      time_ms: stats[:time_ms],
+      real_ms: stats[:real_ms]
+    )
+  end
+
+  def to_result({:search, solutions, stats}) do
+    solutions
+    |> Enum.map(fn {number, state, bindings} ->
+      Solution.new(number,
+        state_num: if(state == :undefined, do: nil, else: state),
+        substitution: Map.new(bindings)
+      )
+    end)
+    |> Search.new(states_explored: stats[:states], time_ms: stats[:time_ms])
+  end
+
+  def to_result({:text, output}), do: output
+
   @doc """
   Parses search command output into a list of solutions.
 
@@ -167,6 +265,48 @@ defmodule ExMaude.Parser do
     |> do_parse_term()
   end
 
+  @doc """
+  Parses the statistics Maude printed for a command.
+
+  Maude reports `rewrites: N in Xms cpu (Yms real) (Z rewrites/second)`
+  after a reduce or rewrite, with a leading `states: N` for searches. The
+  last such line covers the whole command; `:time_ms` is its cpu time and
+  `:real_ms` its wall-clock time.
+
+  ## Examples
+
+      iex> output = "rewrites: 3 in 1ms cpu (2ms real) (~ rewrites/second)\\nresult Nat: 6"
+      iex> ExMaude.Parser.parse_stats(output)
+      %{rewrites: 3, time_ms: 1, real_ms: 2}
+
+      iex> ExMaude.Parser.parse_stats("result Nat: 6")
+      %{}
+  """
+  @spec parse_stats(String.t()) :: stats()
+  def parse_stats(output) do
+    case Regex.scan(~r/^(?:states|rewrites): .*$/m, output) do
+      [] ->
+        %{}
+
+      lines ->
+        [line] = List.last(lines)
+
+        [
+          states: ~r/states: (\d+)/,
+          rewrites: ~r/rewrites: (\d+)/,
+          time_ms: ~r/ in (\d+)ms/,
+          real_ms: ~r/cpu \((\d+)ms real\)/
+        ]
+        |> Enum.flat_map(fn {key, regex} ->
+          case Regex.run(regex, line) do
+            [_, n] -> [{key, String.to_integer(n)}]
+            nil -> []
+          end
+        end)
+        |> Map.new()
+    end
+  end
+
   defp parse_solution(text, index) do
     # Extract state number if present
     state_num =
@@ -0,0 +1,231 @@
+defmodule ExMaude.Parser.SearchStream do
+  @moduledoc """
+  Resumable parser for `search` output that arrives in chunks.
+
+  `ExMaude.Parser.parse_search_results/1` needs the whole output at once.
+  This parser is instead fed chunks as they arrive, for example from
+  `ExMaude.Maude.stream/2`, and hands out each `ExMaude.Result.Solution` as
+  soon as its block is complete. Only the unfinished last line and the
+  solution being read are kept between chunks, so memory stays bounded no
+  matter how long the search runs.
+
+  A solution is complete at the blank line after its bindings, at the next
+  `Solution N` header, at `No more solutions.` or when `finish/1` is called.
+
+  ## Usage
+
+      state = ExMaude.Parser.SearchStream.new(limit: 10)
+
+      {:cont, solutions, state} = ExMaude.Parser.SearchStream.feed(state, chunk)
+      {solutions, state} = ExMaude.Parser.SearchStream.finish(state)
+
+  Or lazily over a stream of chunks:
+
+      "search [, 100] in MY-MOD : init =>* S:State ."
+      |> ExMaude.Maude.stream(timeout: 60_000)
+      |> ExMaude.Parser.SearchStream.stream(limit: 10)
+      |> Enum.each(&IO.inspect/1)
+
+  ## Early Stop
+
+  With `:limit` the parser returns `{:halt, solutions, state}` once that
+  many solutions were emitted, and `stream/2` halts the chunk stream
+  there. For `ExMaude.Maude.stream/2` that cancels the command on the
+  C-Node bridge and returns the worker while Maude may still be searching.
+  """
+
+  alias ExMaude.Parser
+  alias ExMaude.Result.Solution
+
+  defstruct rest: "",
+            current: nil,
+            emitted: 0,
+            limit: :infinity,
+            stats: %{}
+
+  @typedoc """
+  Parser state between chunks.
+  """
+  @type t :: %__MODULE__{
+          rest: binary(),
+          current: Solution.t() | nil,
+          emitted: non_neg_integer(),
+          limit: pos_integer() | :infinity,
+          stats: ExMaude.Parser.stats()
+        }
+
+  @doc """
+  Creates a parser state.
+
+  ## Options
+
+    * `:limit` - Stop after this many solutions (default: `:infinity`)
+  """
+  @spec new(keyword()) :: t()
+  def new(opts \\ []) do
+    %__MODULE__{limit: Keyword.get(opts, :limit, :infinity)}
+  end
+
+  @doc """
+  Feeds a chunk of output to the parser.
+
+  Returns the solutions completed by this chunk, in order. Once `:limit`
+  solutions have been emitted the result is `{:halt, solutions, state}`
+  and later chunks are ignored.
+
+  ## Examples
+
+      iex> alias ExMaude.Parser.SearchStream
+      iex> state = SearchStream.new()
+      iex> {:cont, [], state} = SearchStream.feed(state, "Solution 1 (state 5)\\nS:State --")
+      iex> {:cont, [solution], _state} = SearchStream.feed(state, "> active\\n\\n")
+      iex> {solution.number, solution.state_num, solution.substitution}
+      {1, 5, %{"S:State" => "active"}}
+  """
+  @spec feed(t(), iodata()) :: {:cont | :halt, [Solution.t()], t()}
+  def feed(%__MODULE__{} = state, chunk) do
+    if done?(state) do
+      {:halt, [], state}
+    else
+      {lines, rest} = split_lines(state.rest <> IO.iodata_to_binary(chunk))
+      {solutions, state} = parse_lines(lines, %{state | rest: rest}, [])
+      {continue(state), solutions, state}
+    end
+  end
+
+  @doc """
+  Parses what is left once the output has ended.
+
+  Returns the solution still being read, if any, and respects `:limit`.
+
+  ## Examples
+
+      iex> alias ExMaude.Parser.SearchStream
+      iex> {:cont, [], state} = SearchStream.feed(SearchStream.new(), "Solution 1\\nX:Nat --> 1")
+      iex> {[solution], _state} = SearchStream.finish(state)
+      iex> solution.substitution
+      %{"X:Nat" => "1"}
+  """
+  @spec finish(t()) :: {[Solution.t()], t()}
+  def finish(%__MODULE__{} = state) do
+    if done?(state) do
+      {[], state}
+    else
+      {solutions, state} = parse_lines([state.rest], %{state | rest: ""}, [])
+      {current, state} = complete(state)
+      {solutions ++ current, state}
+    end
+  end
+
+  @doc """
+  Parses a stream of output chunks into a lazy stream of solutions.
+
+  The chunk stream is halted once `:limit` solutions were emitted, so only
+  as much output is read as the caller consumes.
+
+  ## Options
+
+    * `:limit` - Emit at most this many solutions (default: `:infinity`)
+
+  ## Examples
+
+      iex> ["Solution 1 (state 2)\\nX:Nat --> 1\\n", "\\nSolution 2 (state 3)\\nX:Nat --> 2\\n"]
+      ...> |> ExMaude.Parser.SearchStream.stream()
+      ...> |> Enum.map(& &1.substitution)
+      [%{"X:Nat" => "1"}, %{"X:Nat" => "2"}]
+  """
+  @spec stream(Enumerable.t(), keyword()) :: Enumerable.t()
+  def stream(chunks, opts \\ []) do
+    solutions =
+      chunks
+      |> Stream.concat([:eof])
+      |> Stream.transform(new(opts), fn
+        :eof, state -> finish(state)
+        chunk, state ->
+          {_, solutions, state} = feed(state, chunk)
+          {solutions, state}
+      end)
+
+    # Stream.take/2 halts the chunk stream right after the last solution,
+    # without waiting for another chunk
+    case Keyword.get(opts, :limit, :infinity) do
+      :infinity -> solutions
+      limit -> Stream.take(solutions, limit)
+    end
+  end
+
+  @doc """
+  Returns the statistics of the last `states:` line seen so far.
+  """
+  @spec stats(t()) :: ExMaude.Parser.stats()
+  def stats(%__MODULE__{stats: stats}), do: stats
+
+  # Private Functions
+
+  defp done?(%__MODULE__{limit: :infinity}), do: false
+  defp done?(%__MODULE__{emitted: emitted, limit: limit}), do: emitted >= limit
+
+  defp continue(state), do: if(done?(state), do: :halt, else: :cont)
+
+  # The last element is an unfinished line, kept for the next chunk
+  defp split_lines(buffer) do
+    lines = :binary.split(buffer, "\n", [:global])
+    {rest, lines} = List.pop_at(lines, -1)
+    {lines, rest}
+  end
+
+  defp parse_lines([], state, acc), do: {Enum.reverse(acc), state}
+
+  defp parse_lines([line | lines], state, acc) do
+    {done, state} = parse_line(String.trim(line), state)
+    acc = Enum.reverse(done, acc)
+
+    if done?(state), do: {Enum.reverse(acc), state}, else: parse_lines(lines, state, acc)
+  end
+
+  defp parse_line("Solution " <> header, state) do
+    {done, state} = complete(state)
+    {done, %{state | current: new_solution(header, state.emitted + 1)}}
+  end
+
+  defp parse_line("No more solutions." <> _, state), do: complete(state)
+  defp parse_line("No solution." <> _, state), do: complete(state)
+  defp parse_line("", state), do: complete(state)
+
+  defp parse_line("states: " <> _ = line, state),
+    do: {[], %{state | stats: Parser.parse_stats(line)}}
+
+  defp parse_line("rewrites: " <> _ = line, state),
+    do: {[], %{state | stats: Parser.parse_stats(line)}}
+
+  defp parse_line(_line, %{current: nil} = state), do: {[], state}
+
+  defp parse_line(line, %{current: current} = state) do
+    case :binary.split(line, "-->") do
+      [var, value] ->
+        substitution = Map.put(current.substitution, String.trim(var), String.trim(value))
+        {[], %{state | current: %{current | substitution: substitution}}}
+
+      [_] ->
+        {[], state}
+    end
+  end
+
+  defp complete(%{current: nil} = state), do: {[], state}
+
+  defp complete(%{current: solution} = state) do
+    {[solution], %{state | current: nil, emitted: state.emitted + 1}}
+  end
+
+  # Numbered in arrival order like parse_search_results/1, which the
+  # header's own number matches for output from a single search
+  defp new_solution(header, number) do
+    state_num =
+      case Regex.run(~r/\(state (\d+)\)/, header) do
+        [_, num] -> String.to_integer(num)
+        nil -> nil
+      end
+
+    Solution.new(number, state_num: state_num)
+  end
+end
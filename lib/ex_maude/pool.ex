@@ -1,5 +1,6 @@
 defmodule ExMaude.Pool do
-  alias ExMaude.{Backend, Error}
+  alias ExMaude.{Backend, Cache, Error}
+  alias ExMaude.Pool.{Autoscaler, Updates}
 
   @moduledoc """
   Poolboy-based pool of Maude server processes.
@@ -36,6 +37,30 @@ defmodule ExMaude.Pool do
       └── Worker 4 (Backend.impl()) ─── Maude Process 4
   ```
 
+  ## Hot Reloads
+
+  `broadcast/1` checks out every idle worker at once and skips busy ones.
+  To change the module set under load, `publish/2` records the update
+  under a version instead: busy workers apply it when they are checked in,
+  and idle ones are updated while one of them stays free for traffic.
+  `await_version/2` waits until an update is visible on enough workers.
+
+      {:ok, version} =
+        ExMaude.Pool.publish(fn worker ->
+          ExMaude.Server.load_file(worker, "/path/to/spec.maude")
+        end)
+
+      :ok = ExMaude.Pool.await_version(version, workers: 2)
+
+  ## Autoscaling
+
+  With `config :ex_maude, autoscale: [...]`, `ExMaude.Pool.Autoscaler`
+  adds and removes shards of warm workers next to the base pool, driven by
+  checkout wait times. Checkouts take an idle worker from any shard before
+  waiting on the base pool, and `status/0` and `broadcast/1` cover every
+  shard. Shard workers replay published updates at their first checkin,
+  like any worker that joins the pool late.
+
   ## Telemetry
 
   This module emits the following telemetry events:
@@ -110,63 +135,82 @@ defmodule ExMaude.Pool do
       %{backend: backend}
     )
 
-    try do
-      result =
-        :poolboy.transaction(
-          @pool_name,
-          fn worker -> fun.(worker) end,
-          timeout
-        )
-
-      duration = System.monotonic_time() - start_time
-
-      :telemetry.execute(
-        [:ex_maude, :pool, :checkout, :stop],
-        %{duration: duration},
-        %{result: :ok, backend: backend}
-      )
-
-      result
-    catch
-      :exit, reason ->
-        duration = System.monotonic_time() - start_time
-
-        :telemetry.execute(
-          [:ex_maude, :pool, :checkout, :stop],
-          %{duration: duration},
-          %{result: :error, backend: backend}
-        )
+    # The stop event's :wait covers only the checkout, :duration the whole
+    # transaction including `fun`
+    case timed_checkout(timeout, start_time) do
+      {:ok, worker, wait} ->
+        try do
+          result =
+            try do
+              worker |> catch_up_stale() |> fun.()
+            after
+              checkin(worker)
+            end
+
+          checkout_stop(start_time, wait, :ok, backend)
+          result
+        catch
+          :exit, reason ->
+            checkout_stop(start_time, wait, :error, backend)
+            {:error, Error.pool_error(reason)}
+        end
 
+      {:error, reason} ->
+        checkout_stop(start_time, System.monotonic_time() - start_time, :error, backend)
         {:error, Error.pool_error(reason)}
     end
   end
 
+  defp timed_checkout(timeout, start_time) do
+    worker = checkout_worker(true, timeout)
+    {:ok, worker, System.monotonic_time() - start_time}
+  catch
+    :exit, reason -> {:error, reason}
+  end
+
+  defp checkout_stop(start_time, wait, result, backend) do
+    :telemetry.execute(
+      [:ex_maude, :pool, :checkout, :stop],
+      %{duration: System.monotonic_time() - start_time, wait: wait},
+      %{result: result, backend: backend}
+    )
+  end
+
   @doc """
   Broadcasts a function to all workers in the pool.
 
   Useful for operations that need to affect all Maude sessions,
   such as loading a module.
 
+  ## Options
+
+    * `:key` - Also records `fun` under this key for the shards that
+      `ExMaude.Pool.Autoscaler` starts later, replacing an earlier `fun`
+      with the same key (default: none)
+
   ## Examples
 
       ExMaude.Pool.broadcast(fn worker ->
         ExMaude.Server.load_file(worker, "/path/to/module.maude")
       end)
   """
-  @spec broadcast(fun()) :: [:ok | {:error, Error.t() | term()}]
-  def broadcast(fun) when is_function(fun, 1) do
-    pool_size = config_pool_size() + config_max_overflow()
+  @spec broadcast(fun(), keyword()) :: [:ok | {:error, Error.t() | term()}]
+  def broadcast(fun, opts \\ []) when is_function(fun, 1) do
+    # Recorded first, so a shard starting meanwhile gets it too
+    if key = opts[:key], do: Updates.record(key, fun)
+
+    pools = [{@pool_name, config_pool_size() + config_max_overflow()}] ++ shard_sizes()
 
-    # Checkout all workers (up to pool size + overflow)
+    # Checkout all workers (up to pool size + overflow, and every shard)
     workers =
-      for _ <- 1..pool_size do
+      for {pool, size} <- pools, _ <- 1..size//1 do
         try do
-          :poolboy.checkout(@pool_name, false)
+          pool |> :poolboy.checkout(false) |> track(pool)
         catch
           :exit, _ -> nil
         end
       end
-      |> Enum.reject(&is_nil/1)
+      |> Enum.filter(&is_pid/1)
 
     # Execute function on each worker
     results =
@@ -176,7 +220,7 @@ defmodule ExMaude.Pool do
           try do
             fun.(worker)
           after
-            :poolboy.checkin(@pool_name, worker)
+            return_worker(worker)
           end
         end,
         timeout: 30_000
@@ -189,9 +233,116 @@ defmodule ExMaude.Pool do
     results
   end
 
+  @doc """
+  Publishes an update that every worker applies once, without draining
+  the pool.
+
+  Returns the version of the update. Workers apply pending updates in
+  version order when they are checked in; idle workers are updated right
+  away, leaving one of them free to serve requests until the others are
+  done. Workers started later replay every published update. Results held
+  by `ExMaude.Cache` are invalidated now and whenever a worker applies the
+  update.
+
+  ## Options
+
+    * `:key` - Replaces the previous update published under the same key,
+      so workers that have not applied it yet skip it (default: none)
+
+  ## Examples
+
+      {:ok, version} =
+        ExMaude.Pool.publish(
+          fn worker -> ExMaude.Server.load_file(worker, "/path/to/spec.maude") end,
+          key: {:load_file, "/path/to/spec.maude"}
+        )
+  """
+  @spec publish((pid() -> term()), keyword()) :: {:ok, pos_integer()}
+  def publish(fun, opts \\ []) when is_function(fun, 1) do
+    {:ok, version} = Updates.publish(fun, Keyword.get(opts, :key))
+    Cache.invalidate()
+    {:ok, _} = Task.start(fn -> update_idle_workers() end)
+    {:ok, version}
+  end
+
+  @doc """
+  Waits until `version` has been applied by enough workers.
+
+  ## Options
+
+    * `:workers` - Number of workers that must have applied the update
+      (default: the pool size)
+    * `:timeout` - Maximum time to wait in ms (default: 30000)
+  """
+  @spec await_version(pos_integer(), keyword()) :: :ok | {:error, Error.t()}
+  def await_version(version, opts \\ []) do
+    count = Keyword.get(opts, :workers, config_pool_size())
+    timeout = Keyword.get(opts, :timeout, 30_000)
+
+    case Updates.await(version, count, timeout) do
+      :ok -> :ok
+      {:error, :timeout} -> {:error, Error.timeout(timeout)}
+    end
+  end
+
+  @doc """
+  Returns the latest version published with `publish/2`.
+  """
+  @spec version() :: non_neg_integer()
+  def version, do: Updates.version()
+
+  # Update idle workers in parallel, keeping one of them available so that
+  # live traffic is never left waiting for a reload. The one kept free is
+  # updated once the others are back, as an idle pool has no checkins that
+  # would do it.
+  defp update_idle_workers do
+    %{available: available} = status()
+
+    workers =
+      List.duplicate(:free, max(available - 1, 0))
+      |> Enum.map(fn :free -> idle_checkout() end)
+      |> Enum.filter(&is_pid/1)
+
+    workers
+    |> Task.async_stream(&Updates.catch_up/1, timeout: :infinity)
+    |> Stream.run()
+
+    Enum.each(workers, &return_worker/1)
+    update_held_worker(available, [])
+  end
+
+  # Takes idle workers until a stale one turns up, then returns the others
+  # before updating it
+  defp update_held_worker(0, fresh), do: Enum.each(fresh, &return_worker/1)
+
+  defp update_held_worker(tries, fresh) do
+    case idle_checkout() do
+      worker when is_pid(worker) ->
+        if Updates.stale?(worker) do
+          Enum.each(fresh, &return_worker/1)
+          Updates.catch_up(worker)
+          return_worker(worker)
+        else
+          update_held_worker(tries - 1, [worker | fresh])
+        end
+
+      _full ->
+        Enum.each(fresh, &return_worker/1)
+    end
+  end
+
+  # Leaves the catch-up to the caller, which updates these workers in parallel
+  defp idle_checkout do
+    checkout_worker(false, @checkout_timeout_ms)
+  catch
+    :exit, _ -> :full
+  end
+
   @doc """
   Returns the current pool status.
 
+  Counts include the shards started by `ExMaude.Pool.Autoscaler`.
+
   ## Examples
 
       ExMaude.Pool.status()
@@ -210,14 +361,14 @@ defmodule ExMaude.Pool do
 
       # workers is the count of available workers in the pool
       # monitors is the count of checked-out workers being monitored
-      # Size is the configured pool size
-      pool_size = config_pool_size()
+      # Size is the configured pool size plus the workers of every shard
+      shards = Enum.map(Autoscaler.shards(), &shard_status/1)
 
       %{
-        size: pool_size,
+        size: config_pool_size() + Enum.sum(Enum.map(shards, &(&1.available + &1.in_use))),
         overflow: overflow,
-        available: workers,
-        in_use: monitors,
+        available: workers + Enum.sum(Enum.map(shards, & &1.available)),
+        in_use: monitors + Enum.sum(Enum.map(shards, & &1.in_use)),
         state: state_name
       }
     catch
@@ -229,6 +380,9 @@ defmodule ExMaude.Pool do
   @doc """
   Checks out a worker from the pool.
 
+  A worker that has not applied every update from `publish/2`, e.g. one
+  started after it, applies them before it is returned.
+
   Remember to check the worker back in with `checkin/1`.
   Prefer `transaction/2` for automatic resource management.
   """
@@ -238,7 +392,7 @@ defmodule ExMaude.Pool do
     block = Keyword.get(opts, :block, true)
 
     try do
-      :poolboy.checkout(@pool_name, block, timeout)
+      block |> checkout_worker(timeout) |> catch_up_stale()
     catch
       :exit, {:timeout, _} -> {:error, Error.pool_error(:timeout)}
       :exit, {:full, _} -> {:error, Error.pool_error(:full)}
@@ -247,10 +401,73 @@ defmodule ExMaude.Pool do
 
   @doc """
   Returns a worker to the pool.
+
+  A worker that missed updates from `publish/2` applies them first, in
+  the caller. Poolboy hands the worker to the next client as soon as the
+  caller exits, so the update has to finish while the caller still holds
+  the checkout.
   """
   @spec checkin(pid()) :: :ok
   def checkin(worker) do
-    :poolboy.checkin(@pool_name, worker)
+    if Updates.stale?(worker), do: Updates.catch_up(worker)
+    return_worker(worker)
+  end
+
+  # Workers that joined after an update (restarts, overflow, shards) have
+  # not replayed the log yet
+  defp catch_up_stale(worker) when is_pid(worker) do
+    if Updates.stale?(worker), do: Updates.catch_up(worker)
+    worker
+  end
+
+  defp catch_up_stale(other), do: other
+
+  # Without shards this is a plain poolboy checkout. With shards an idle
+  # worker anywhere is taken before blocking on the base pool.
+  defp checkout_worker(block, timeout) do
+    case Autoscaler.shards() do
+      [] ->
+        :poolboy.checkout(@pool_name, block, timeout)
+
+      shards ->
+        Enum.find_value([@pool_name | shards], &checkout_idle/1) ||
+          :poolboy.checkout(@pool_name, block, timeout)
+    end
+  end
+
+  defp checkout_idle(pool) do
+    case pool |> :poolboy.checkout(false) |> track(pool) do
+      worker when is_pid(worker) -> worker
+      :full -> nil
+    end
+  catch
+    # A shard being shut down by the autoscaler
+    :exit, _ -> nil
+  end
+
+  defp track(worker, pool) when is_pid(worker) and pool != @pool_name do
+    Autoscaler.track(worker, pool)
+    worker
+  end
+
+  defp track(worker, _pool), do: worker
+
+  defp return_worker(worker) do
+    worker |> Autoscaler.untrack(@pool_name) |> :poolboy.checkin(worker)
+  end
+
+  defp shard_sizes do
+    Enum.map(Autoscaler.shards(), fn shard ->
+      %{available: available, in_use: in_use} = shard_status(shard)
+      {shard, available + in_use}
+    end)
+  end
+
+  defp shard_status(shard) do
+    {_state, available, _overflow, in_use} = :poolboy.status(shard)
+    %{available: available, in_use: in_use}
+  catch
+    :exit, _ -> %{available: 0, in_use: 0}
   end
 
   defp config_pool_size do
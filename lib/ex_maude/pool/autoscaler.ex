@@ -0,0 +1,383 @@
+defmodule ExMaude.Pool.Autoscaler do
+  @moduledoc """
+  Grows and shrinks `ExMaude.Pool` with its load.
+
+  Poolboy pools have a fixed size, and their overflow workers are cold Maude
+  processes that are stopped again as soon as they are checked in. The
+  autoscaler adds capacity as extra pools ("shards") of persistent warm
+  workers next to the base pool instead. `ExMaude.Pool` checks out from
+  any pool with an idle worker, so a shard is used as soon as it starts.
+
+  Every `:interval` it looks at the checkout wait times (the `:wait`
+  measurement, not the whole transaction's `:duration`) reported by
+  `[:ex_maude, :pool, :checkout, :stop]` events since the last tick and at
+  `ExMaude.Pool.status/0`:
+
+    * When more than `:slow_ratio` of the checkouts waited longer than
+      `:wait_ms`, a shard of `:step` workers is started, up to
+      `:max_workers` workers in total
+    * When no checkout was slow and few enough workers were in use that a
+      shard could go for `:idle_ticks` ticks in a row, the newest shard
+      stops taking checkouts and is stopped once its workers are back
+
+  After any change the autoscaler waits `:cooldown` ms before the next one.
+  The base pool (`:pool_size`) is never shrunk.
+
+  ## Configuration
+
+      config :ex_maude,
+        start_pool: true,
+        pool_size: 4,
+        pool_max_overflow: 0,
+        autoscale: [
+          max_workers: 32,
+          step: 4,
+          interval: 5_000,
+          wait_ms: 50,
+          slow_ratio: 0.1,
+          idle_ticks: 3,
+          cooldown: 30_000
+        ]
+
+  New shard workers start with `:preload_modules`, then run the loads of
+  `ExMaude.Maude.load_file/1` and `load_module/1` (see
+  `ExMaude.Pool.Updates.replay/1`) and the published updates before the
+  shard takes checkouts.
+
+  A `pool_max_overflow` of 0 is recommended with autoscaling, so that load
+  is absorbed by warm shards rather than short-lived overflow workers.
+  """
+
+  use GenServer
+  require Logger
+
+  alias ExMaude.{Backend, Pool}
+  alias ExMaude.Pool.Updates
+
+  @shards_key {__MODULE__, :shards}
+  @table :ex_maude_pool_shards
+  @handler_id "ex-maude-pool-autoscaler"
+  @drain_timeout_ms 60_000
+  @drain_poll_ms 100
+
+  @defaults [
+    max_workers: 16,
+    step: 2,
+    interval: 5_000,
+    wait_ms: 50,
+    slow_ratio: 0.1,
+    idle_ticks: 3,
+    cooldown: 30_000
+  ]
+
+  @typedoc """
+  Load observed during one tick, as passed to `decide/2`.
+  """
+  @type sample :: %{
+          checkouts: non_neg_integer(),
+          slow: non_neg_integer(),
+          in_use: non_neg_integer(),
+          size: non_neg_integer(),
+          base_size: non_neg_integer()
+        }
+
+  # Client API
+
+  @doc """
+  Starts the autoscaler.
+
+  Options override the `:autoscale` application setting; `:worker_opts`
+  is passed to every shard worker's `start_link/1`.
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    GenServer.start_link(__MODULE__, opts, name: __MODULE__)
+  end
+
+  @doc """
+  Returns the names of the shard pools currently taking checkouts.
+  """
+  @spec shards() :: [atom()]
+  def shards do
+    :persistent_term.get(@shards_key, [])
+  end
+
+  @doc false
+  # Remember which shard a checked-out worker belongs to, so it can be
+  # checked in again with only its pid
+  @spec track(pid(), atom()) :: :ok
+  def track(worker, pool) do
+    :ets.insert(@table, {worker, pool})
+    :ok
+  rescue
+    ArgumentError -> :ok
+  end
+
+  @doc false
+  # Returns the shard of a worker being checked in and forgets it; the
+  # mapping lives while the worker is checked out, even after its shard
+  # stopped taking checkouts, so draining shards get their workers back
+  @spec untrack(pid(), atom()) :: atom()
+  def untrack(worker, default) do
+    case :ets.take(@table, worker) do
+      [{_, pool}] -> pool
+      [] -> default
+    end
+  rescue
+    ArgumentError -> default
+  end
+
+  @doc """
+  Decides how to resize the pool for one tick's `sample`.
+
+  Returns `:up` when too many checkouts waited, `:down` when a shard's
+  worth of workers sat unused, and `:hold` otherwise. `:down` only shrinks
+  the pool after `:idle_ticks` such ticks in a row.
+
+  ## Examples
+
+      iex> config = [max_workers: 8, step: 2, slow_ratio: 0.1]
+      iex> sample = %{checkouts: 100, slow: 20, in_use: 4, size: 4, base_size: 4}
+      iex> ExMaude.Pool.Autoscaler.decide(sample, config)
+      :up
+  """
+  @spec decide(sample(), keyword()) :: :up | :down | :hold
+  def decide(sample, config) do
+    config = Keyword.merge(@defaults, config)
+    step = config[:step]
+
+    cond do
+      sample.checkouts > 0 and sample.slow > sample.checkouts * config[:slow_ratio] and
+          sample.size + step <= config[:max_workers] ->
+        :up
+
+      sample.slow == 0 and sample.size - step >= sample.base_size and
+          sample.in_use <= sample.size - step ->
+        :down
+
+      true ->
+        :hold
+    end
+  end
+
+  @doc false
+  # Telemetry handler, runs in the process that checked out a worker
+  def handle_checkout(_event, %{wait: wait}, _metadata, wait_native) do
+    slow = if wait > wait_native, do: 1, else: 0
+    :ets.update_counter(@table, :stats, [{2, 1}, {3, slow}], {:stats, 0, 0})
+  rescue
+    ArgumentError -> :ok
+  end
+
+  # Server Callbacks
+  # coveralls-ignore-start
+  # Scaling needs a running pool of Maude workers - tested via integration tests
+
+  @impl GenServer
+  def init(opts) do
+    Process.flag(:trap_exit, true)
+
+    {worker_opts, opts} = Keyword.pop(opts, :worker_opts, [])
+    config = @defaults |> Keyword.merge(config_autoscale()) |> Keyword.merge(opts)
+
+    :ets.new(@table, [:named_table, :public, :set, write_concurrency: true])
+    :persistent_term.put(@shards_key, [])
+
+    wait_native = System.convert_time_unit(config[:wait_ms], :millisecond, :native)
+
+    :telemetry.attach(
+      @handler_id,
+      [:ex_maude, :pool, :checkout, :stop],
+      &__MODULE__.handle_checkout/4,
+      wait_native
+    )
+
+    schedule_tick(config)
+
+    {:ok,
+     %{
+       config: config,
+       worker_opts: worker_opts,
+       shards: [],
+       idle_ticks: 0,
+       changed_at: System.monotonic_time(:millisecond) - config[:cooldown]
+     }}
+  end
+
+  @impl GenServer
+  def handle_info(:tick, state) do
+    schedule_tick(state.config)
+    {:noreply, tick(state)}
+  end
+
+  def handle_info({:EXIT, pid, reason}, state) do
+    case Enum.find(state.shards, fn {_name, shard} -> shard == pid end) do
+      {name, _} ->
+        Logger.warning("Pool shard #{name} exited: #{inspect(reason)}")
+        {:noreply, drop_shard(state, name)}
+
+      nil ->
+        {:noreply, state}
+    end
+  end
+
+  def handle_info(_msg, state) do
+    {:noreply, state}
+  end
+
+  @impl GenServer
+  def terminate(_reason, state) do
+    :telemetry.detach(@handler_id)
+    :persistent_term.put(@shards_key, [])
+
+    Enum.each(state.shards, fn {name, _pid} ->
+      try do
+        :poolboy.stop(name)
+      catch
+        :exit, _ -> :ok
+      end
+    end)
+  end
+
+  # Private Functions
+
+  defp tick(state) do
+    {checkouts, slow} = take_stats()
+    %{in_use: in_use, size: size} = Pool.status()
+    base_size = size - length(state.shards) * state.config[:step]
+
+    sample = %{checkouts: checkouts, slow: slow, in_use: in_use, size: size, base_size: base_size}
+    cooling? = System.monotonic_time(:millisecond) - state.changed_at < state.config[:cooldown]
+
+    case {decide(sample, state.config), cooling?} do
+      {_, true} ->
+        %{state | idle_ticks: 0}
+
+      {:up, false} ->
+        state |> add_shard() |> changed()
+
+      {:down, false} when state.idle_ticks + 1 >= state.config[:idle_ticks] ->
+        state |> remove_shard() |> changed()
+
+      {:down, false} ->
+        %{state | idle_ticks: state.idle_ticks + 1}
+
+      {:hold, false} ->
+        %{state | idle_ticks: 0}
+    end
+  end
+
+  defp take_stats do
+    case :ets.take(@table, :stats) do
+      [{:stats, checkouts, slow}] -> {checkouts, slow}
+      [] -> {0, 0}
+    end
+  end
+
+  defp changed(state), do: %{state | idle_ticks: 0, changed_at: System.monotonic_time(:millisecond)}
+
+  defp add_shard(state) do
+    name = free_shard_name(state)
+
+    pool_config = [
+      name: {:local, name},
+      worker_module: Backend.impl(),
+      size: state.config[:step],
+      max_overflow: 0
+    ]
+
+    case :poolboy.start_link(pool_config, state.worker_opts) do
+      {:ok, pid} ->
+        warm(name, state.config[:step])
+        Logger.info("Pool grew by #{state.config[:step]} workers (#{name})")
+        shards = state.shards ++ [{name, pid}]
+        publish(shards)
+        %{state | shards: shards}
+
+      {:error, reason} ->
+        Logger.error("Failed to start pool shard #{name}: #{inspect(reason)}")
+        state
+    end
+  end
+
+  # Loads the modules the pool has into the workers of a new shard, before
+  # publishing it lets checkouts reach them
+  defp warm(name, size) do
+    workers =
+      1..size//1
+      |> Enum.map(fn _ -> :poolboy.checkout(name, false) end)
+      |> Enum.filter(&is_pid/1)
+
+    workers
+    |> Task.async_stream(
+      fn worker ->
+        Updates.replay(worker)
+        Updates.catch_up(worker)
+      end,
+      timeout: :infinity
+    )
+    |> Stream.run()
+
+    Enum.each(workers, &:poolboy.checkin(name, &1))
+  end
+
+  # Stop handing out the newest shard, then let its workers finish first
+  defp remove_shard(%{shards: []} = state), do: state
+
+  defp remove_shard(state) do
+    {name, pid} = List.last(state.shards)
+    Logger.info("Pool shrinks by #{state.config[:step]} workers (#{name})")
+
+    state = drop_shard(state, name)
+    Process.unlink(pid)
+    {:ok, _} = Task.start(fn -> drain(name, @drain_timeout_ms) end)
+    state
+  end
+
+  defp drop_shard(state, name) do
+    shards = Enum.reject(state.shards, fn {shard, _pid} -> shard == name end)
+    publish(shards)
+    %{state | shards: shards}
+  end
+
+  defp drain(name, remaining) do
+    {_state, _available, _overflow, in_use} = :poolboy.status(name)
+
+    if in_use > 0 and remaining > 0 do
+      Process.sleep(@drain_poll_ms)
+      drain(name, remaining - @drain_poll_ms)
+    else
+      :poolboy.stop(name)
+    end
+  catch
+    :exit, _ -> :ok
+  end
+
+  # Shard names are reused so scaling up and down does not mint new atoms
+  defp free_shard_name(state) do
+    taken = MapSet.new(state.shards, fn {name, _pid} -> name end)
+
+    Stream.iterate(1, &(&1 + 1))
+    |> Stream.map(&:"ex_maude_pool_shard_#{&1}")
+    |> Enum.find(&(not MapSet.member?(taken, &1) and Process.whereis(&1) == nil))
+  end
+
+  # Scaling is rare (at most once per cooldown), so the global GC caused by
+  # a persistent_term update is cheaper than a lookup on every checkout
+  defp publish(shards) do
+    :persistent_term.put(@shards_key, Enum.map(shards, &elem(&1, 0)))
+  end
+
+  defp schedule_tick(config) do
+    Process.send_after(self(), :tick, config[:interval])
+  end
+
+  defp config_autoscale do
+    case Application.get_env(:ex_maude, :autoscale, false) do
+      opts when is_list(opts) -> opts
+      _ -> []
+    end
+  end
+
+  # coveralls-ignore-stop
+end
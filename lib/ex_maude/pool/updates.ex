@@ -0,0 +1,263 @@
+defmodule ExMaude.Pool.Updates do
+  @moduledoc """
+  Versioned updates for the workers of `ExMaude.Pool`.
+
+  `ExMaude.Pool.publish/2` records an update function under a new version
+  instead of checking out every worker at once. Each worker applies the
+  updates it has not seen yet when it is checked in, still inside the
+  caller's checkout, so busy workers pick them up after their current
+  command and live traffic keeps its capacity. Idle workers are updated
+  right away, except for one that is left free to serve requests in the
+  meantime and updated last.
+
+  The update log lives in an ETS table owned by this process, which is
+  started with the application. Workers that join the pool later, e.g. after
+  a crash, replay the log at their first checkout, before serving a request.
+
+  An update published under a key replaces the earlier ones under the same
+  key, so reloading one spec many times leaves a single entry for new
+  workers to replay.
+
+  The table also keeps the keyed `ExMaude.Pool.broadcast/2` functions, such
+  as the loads of `ExMaude.Maude.load_file/1`, which `replay/1` runs on
+  the workers of new autoscaler shards before they take checkouts.
+  """
+
+  use GenServer
+  require Logger
+
+  alias ExMaude.Cache
+
+  @table :ex_maude_pool_updates
+
+  @doc """
+  Starts the process owning the update log.
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    GenServer.start_link(__MODULE__, opts, name: __MODULE__)
+  end
+
+  @doc """
+  Appends `fun` to the log and returns its version.
+
+  With a `key` other than `nil`, the previous update under `key` is removed
+  from the log: workers that have not applied it yet only apply `fun`.
+  """
+  @spec publish((pid() -> term()), term()) :: {:ok, pos_integer()}
+  def publish(fun, key \\ nil) when is_function(fun, 1) do
+    GenServer.call(__MODULE__, {:publish, fun, key})
+  end
+
+  @doc """
+  Records a broadcast `fun` under `key` for `replay/1`.
+
+  A `fun` recorded again under the same key keeps its place in the replay
+  order, so modules still load after the ones they import.
+  """
+  @spec record(term(), (pid() -> term())) :: :ok
+  def record(key, fun) when is_function(fun, 1) do
+    GenServer.call(__MODULE__, {:record, key, fun})
+  catch
+    # Without the log there is nothing to replay into
+    :exit, _ -> :ok
+  end
+
+  @doc """
+  Runs every recorded broadcast on `worker`, in the order they were first
+  recorded.
+
+  Must only be called while the caller has `worker` checked out.
+  """
+  @spec replay(pid()) :: :ok
+  def replay(worker) do
+    pattern = {{:broadcast, :"$1"}, :"$2", :"$3"}
+    broadcasts = :ets.select(@table, [{pattern, [], [{{:"$2", :"$1", :"$3"}}]}])
+
+    for {_seq, key, fun} <- Enum.sort_by(broadcasts, &elem(&1, 0)) do
+      apply_update(worker, inspect(key), fun)
+    end
+
+    :ok
+  rescue
+    ArgumentError -> :ok
+  end
+
+  @doc """
+  Returns the latest published version, 0 when nothing was published.
+  """
+  @spec version() :: non_neg_integer()
+  def version do
+    :ets.lookup_element(@table, :version, 2)
+  rescue
+    ArgumentError -> 0
+  end
+
+  @doc """
+  Returns the version `worker` has applied.
+  """
+  @spec worker_version(pid()) :: non_neg_integer()
+  def worker_version(worker) do
+    case :ets.lookup(@table, {:worker, worker}) do
+      [{_, version}] -> version
+      [] -> 0
+    end
+  rescue
+    ArgumentError -> 0
+  end
+
+  @doc """
+  Returns whether `worker` has updates left to apply.
+  """
+  @spec stale?(pid()) :: boolean()
+  def stale?(worker) do
+    worker_version(worker) < version()
+  end
+
+  @doc """
+  Applies every update `worker` has not seen yet, in version order.
+
+  Must only be called while the caller has `worker` checked out. The
+  applied version is recorded before this returns, so the worker is not
+  seen as stale again once it is checked in.
+  """
+  @spec catch_up(pid()) :: :ok
+  def catch_up(worker) do
+    from = worker_version(worker)
+    to = version()
+
+    if from < to do
+      # Versions replaced by a later update under their key are gone
+      range = [{:>, :"$1", from}, {:"=<", :"$1", to}]
+      updates = :ets.select(@table, [{{{:update, :"$1"}, :"$2"}, range, [{{:"$1", :"$2"}}]}])
+
+      for {version, fun} <- Enum.sort(updates) do
+        apply_update(worker, version, fun)
+      end
+
+      # Results this worker computed before the update may be cached
+      Cache.invalidate()
+
+      :ok = GenServer.call(__MODULE__, {:applied, worker, to})
+    end
+
+    :ok
+  end
+
+  @doc """
+  Waits until at least `count` live workers applied `version`.
+  """
+  @spec await(pos_integer(), pos_integer(), timeout()) :: :ok | {:error, :timeout}
+  def await(version, count, timeout) do
+    GenServer.call(__MODULE__, {:await, version, count, timeout}, timeout)
+  catch
+    :exit, {:timeout, _} -> {:error, :timeout}
+  end
+
+  # Server Callbacks
+
+  @impl GenServer
+  def init(_opts) do
+    :ets.new(@table, [:named_table, :protected, :set, read_concurrency: true])
+    :ets.insert(@table, {:version, 0})
+    {:ok, %{waiters: [], monitors: %{}}}
+  end
+
+  @impl GenServer
+  def handle_call({:publish, fun, key}, _from, state) do
+    version = version() + 1
+    replace(key, version)
+    :ets.insert(@table, [{{:update, version}, fun}, {:version, version}])
+    {:reply, {:ok, version}, state}
+  end
+
+  def handle_call({:record, key, fun}, _from, state) do
+    seq =
+      case :ets.lookup(@table, {:broadcast, key}) do
+        [{_, seq, _fun}] -> seq
+        [] -> :ets.update_counter(@table, :broadcasts, 1, {:broadcasts, 0})
+      end
+
+    :ets.insert(@table, {{:broadcast, key}, seq, fun})
+    {:reply, :ok, state}
+  end
+
+  def handle_call({:await, version, count, timeout}, from, state) do
+    if applied_count(version) >= count do
+      {:reply, :ok, state}
+    else
+      # The caller stops waiting at its timeout; forget it then
+      ref = make_ref()
+      if timeout != :infinity, do: Process.send_after(self(), {:expire, ref}, timeout)
+      {:noreply, %{state | waiters: [{version, count, from, ref} | state.waiters]}}
+    end
+  end
+
+  def handle_call({:applied, worker, version}, _from, state) do
+    :ets.insert(@table, {{:worker, worker}, version})
+    state = monitor_worker(state, worker)
+    {:reply, :ok, notify_waiters(state)}
+  end
+
+  @impl GenServer
+  def handle_info({:DOWN, ref, :process, worker, _reason}, state) do
+    :ets.delete(@table, {:worker, worker})
+    {:noreply, notify_waiters(%{state | monitors: Map.delete(state.monitors, ref)})}
+  end
+
+  def handle_info({:expire, ref}, state) do
+    waiters = Enum.reject(state.waiters, &match?({_version, _count, _from, ^ref}, &1))
+    {:noreply, %{state | waiters: waiters}}
+  end
+
+  def handle_info(_msg, state) do
+    {:noreply, state}
+  end
+
+  # Private Functions
+
+  defp apply_update(worker, version, fun) do
+    case fun.(worker) do
+      :ok -> :ok
+      {:ok, _} -> :ok
+      other -> Logger.warning("Pool update #{version} failed: #{inspect(other)}")
+    end
+  rescue
+    e -> Logger.warning("Pool update #{version} raised: #{Exception.message(e)}")
+  catch
+    :exit, reason -> Logger.warning("Pool update #{version} exited: #{inspect(reason)}")
+  end
+
+  defp replace(nil, _version), do: true
+
+  defp replace(key, version) do
+    case :ets.lookup(@table, {:key, key}) do
+      [{_, previous}] -> :ets.delete(@table, {:update, previous})
+      [] -> true
+    end
+
+    :ets.insert(@table, {{:key, key}, version})
+  end
+
+  defp monitor_worker(state, worker) do
+    if worker in Map.values(state.monitors) do
+      state
+    else
+      %{state | monitors: Map.put(state.monitors, Process.monitor(worker), worker)}
+    end
+  end
+
+  defp notify_waiters(state) do
+    {ready, waiting} =
+      Enum.split_with(state.waiters, fn {version, count, _from, _ref} ->
+        applied_count(version) >= count
+      end)
+
+    Enum.each(ready, fn {_version, _count, from, _ref} -> GenServer.reply(from, :ok) end)
+    %{state | waiters: waiting}
+  end
+
+  defp applied_count(version) do
+    :ets.select_count(@table, [{{{:worker, :_}, :"$1"}, [{:>=, :"$1", version}], [true]}])
+  end
+end
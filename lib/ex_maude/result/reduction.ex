@@ -9,7 +9,8 @@ defmodule ExMaude.Result.Reduction do
 
     * `:term` - The resulting `ExMaude.Term` after reduction
     * `:rewrites` - Number of rewrite steps applied
-    * `:time_ms` - Time taken in milliseconds
+    * `:time_ms` - CPU time taken in milliseconds
+    * `:real_ms` - Wall-clock time taken in milliseconds
 
   ## Maude Output Format
 
@@ -25,6 +26,7 @@ defmodule ExMaude.Result.Reduction do
   |---------|-------------|
   | `rewrites: N` | Number of rewrite steps applied |
   | `in Nms` | Execution time in milliseconds |
+  | `(Nms real)` | Wall-clock time in milliseconds |
   | `result Sort: Term` | The resulting term with its sort |
 
   ## Examples
@@ -47,12 +49,13 @@ defmodule ExMaude.Result.Reduction do
   alias ExMaude.Term
 
   @enforce_keys [:term]
-  defstruct [:term, :rewrites, :time_ms]
+  defstruct [:term, :rewrites, :time_ms, :real_ms]
 
   @type t :: %__MODULE__{
           term: Term.t(),
           rewrites: non_neg_integer() | nil,
-          time_ms: non_neg_integer() | nil
+          time_ms: non_neg_integer() | nil,
+          real_ms: non_neg_integer() | nil
         }
 
   @doc """
@@ -68,7 +71,8 @@ defmodule ExMaude.Result.Reduction do
     %__MODULE__{
       term: term,
       rewrites: Keyword.get(opts, :rewrites),
-      time_ms: Keyword.get(opts, :time_ms)
+      time_ms: Keyword.get(opts, :time_ms),
+      real_ms: Keyword.get(opts, :real_ms)
     }
   end
 
@@ -85,7 +89,8 @@ defmodule ExMaude.Result.Reduction do
        %__MODULE__{
          term: term,
          rewrites: parse_rewrites(output),
-         time_ms: parse_time(output)
+         time_ms: parse_time(output),
+         real_ms: parse_real_time(output)
        }}
     end
   end
@@ -104,6 +109,13 @@ defmodule ExMaude.Result.Reduction do
     end
   end
 
+  defp parse_real_time(output) do
+    case Regex.run(~r/\((\d+)ms real\)/, output) do
+      [_, ms] -> String.to_integer(ms)
+      nil -> nil
+    end
+  end
+
   defimpl Inspect do
     @spec inspect(ExMaude.Result.Reduction.t(), Inspect.Opts.t()) :: String.t()
     def inspect(
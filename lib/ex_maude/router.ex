@@ -0,0 +1,468 @@
+defmodule ExMaude.Router do
+  @moduledoc """
+  Worker pool that routes commands by Maude module.
+
+  `ExMaude.Pool` treats every worker alike, so a module has to be loaded
+  into all of them with `ExMaude.Pool.broadcast/1`. With dozens of large
+  specs that multiplies memory by the pool size. The router instead knows
+  which file defines each module and which worker has loaded it:
+
+    * A command for a module goes to a worker that already has it, the
+      least busy one when several do
+    * On first use the module is loaded into the worker holding the fewest
+      modules, and callers asking for it meanwhile wait for that one load
+    * Commands for modules without a registered file (e.g. `NAT`) go to
+      the least busy worker
+    * Modules loaded with `ExMaude.Maude.load_file/1` or `load_module/1`
+      are loaded into every worker (`broadcast/3`), and commands for them
+      go to the workers where that load succeeded
+    * Every completed load invalidates the results held by `ExMaude.Cache`
+
+  Workers are not checked out exclusively; callers share a worker the way
+  they would share a single `ExMaude.Server`.
+
+  ## Configuration
+
+      config :ex_maude,
+        start_router: true,
+        router_size: 4,
+        router_modules: %{
+          "SMART-HOME" => "/path/to/smart-home.maude",
+          "FACTORY" => "/path/to/factory.maude"
+        }
+
+  When the router is running, `ExMaude.Maude.reduce/3`, `rewrite/3`,
+  `search/4` and `parse/3` are routed through it instead of the pool.
+
+  ## Usage
+
+      ExMaude.Router.register("MY-MOD", "/path/to/my-mod.maude")
+
+      ExMaude.Router.transaction("MY-MOD", fn worker ->
+        ExMaude.Server.execute(worker, "reduce in MY-MOD : init .")
+      end)
+  """
+
+  use GenServer
+  require Logger
+
+  alias ExMaude.{Backend, Cache, Error}
+
+  @default_size 4
+  @route_timeout_ms 30_000
+
+  @typedoc """
+  Internal state of the router.
+  """
+  @type t :: %__MODULE__{
+          worker_opts: keyword(),
+          workers: %{pid() => %{modules: MapSet.t(String.t()), busy: non_neg_integer()}},
+          sources: %{String.t() => Path.t()},
+          loading: %{reference() => {String.t(), pid(), [{GenServer.from(), integer()}]}}
+        }
+
+  defstruct worker_opts: [], workers: %{}, sources: %{}, loading: %{}
+
+  # Client API
+
+  @doc """
+  Starts the router and its workers.
+
+  ## Options
+
+    * `:size` - Number of workers (default: `:router_size` or 4)
+    * `:modules` - Map of Maude module name to the file defining it
+      (default: `:router_modules`)
+    * `:name` - Registered name (default: `ExMaude.Router`)
+
+  Other options are passed to every worker's `start_link/1`.
+  """
+  @spec start_link(keyword()) :: GenServer.on_start()
+  def start_link(opts \\ []) do
+    {name, opts} = Keyword.pop(opts, :name, __MODULE__)
+    GenServer.start_link(__MODULE__, opts, name: name)
+  end
+
+  @doc """
+  Returns whether the router is running.
+  """
+  @spec running?(GenServer.server()) :: boolean()
+  def running?(router \\ __MODULE__) do
+    GenServer.whereis(router) != nil
+  end
+
+  @doc """
+  Registers the file that defines `module`.
+
+  Nothing is loaded until a command for `module` arrives. Registering a
+  new file for a known module makes workers load it again on next use.
+
+  ## Options
+
+    * `:router` - Router to register with (default: `ExMaude.Router`)
+  """
+  @spec register(String.t(), Path.t(), keyword()) :: :ok
+  def register(module, path, opts \\ []) do
+    router = Keyword.get(opts, :router, __MODULE__)
+    GenServer.call(router, {:register, module, Path.expand(path)})
+  end
+
+  @doc """
+  Runs `fun` with a worker that has `module` loaded.
+
+  ## Options
+
+    * `:timeout` - Maximum time in ms to wait for a worker, including a
+      lazy load of the module (default: 30000)
+    * `:router` - Router to use (default: `ExMaude.Router`)
+
+  As with `ExMaude.Pool.transaction/2`, an exit while `fun` runs is
+  returned as a pool error.
+  """
+  @spec transaction(String.t(), (pid() -> result), keyword()) :: result | {:error, Error.t()}
+        when result: any()
+  def transaction(module, fun, opts \\ []) when is_function(fun, 1) do
+    router = Keyword.get(opts, :router, __MODULE__)
+    timeout = Keyword.get(opts, :timeout, @route_timeout_ms)
+
+    case route(router, module, timeout) do
+      {:ok, worker} ->
+        try do
+          fun.(worker)
+        catch
+          # A worker that crashed mid-command, or whose node went away
+          :exit, reason -> {:error, Error.pool_error(reason)}
+        after
+          GenServer.cast(router, {:release, worker})
+        end
+
+      {:error, %Error{}} = error ->
+        error
+    end
+  end
+
+  @doc """
+  Returns which modules every worker has loaded and how busy it is.
+
+  ## Examples
+
+      ExMaude.Router.status()
+      #=> %{#PID<0.250.0> => %{modules: ["SMART-HOME"], busy: 1}, ...}
+  """
+  @spec status(GenServer.server()) ::
+          %{pid() => %{modules: [String.t()], busy: non_neg_integer()}}
+  def status(router \\ __MODULE__) do
+    GenServer.call(router, :status)
+  end
+
+  @doc """
+  Returns the totals `ExMaude.Cluster` schedules by: the number of
+  workers, the leases they hold, and the modules loaded anywhere or
+  registered.
+  """
+  @spec summary(GenServer.server()) :: %{
+          workers: non_neg_integer(),
+          busy: non_neg_integer(),
+          loaded: [String.t()],
+          registered: [String.t()]
+        }
+  def summary(router \\ __MODULE__) do
+    GenServer.call(router, :summary)
+  end
+
+  @doc """
+  Runs `load` on every worker and records the `modules` it defines on the
+  workers where it returned `:ok`.
+
+  Returns one result per worker. Workers that start later (e.g. after a
+  crash) don't have the modules, and commands for them avoid those
+  workers.
+
+  ## Options
+
+    * `:router` - Router to use (default: `ExMaude.Router`)
+  """
+  @spec broadcast((pid() -> result), [String.t()], keyword()) :: [result | {:error, Error.t()}]
+        when result: term()
+  def broadcast(load, modules, opts \\ []) when is_function(load, 1) do
+    router = Keyword.get(opts, :router, __MODULE__)
+
+    workers = GenServer.call(router, :workers)
+
+    results =
+      workers
+      |> Task.async_stream(load, timeout: 30_000)
+      |> Enum.map(fn
+        {:ok, result} -> result
+        {:exit, reason} -> {:error, Error.pool_error({:exit, reason})}
+      end)
+
+    loaded = Enum.zip_with(workers, results, &{&1, &2 == :ok})
+    GenServer.call(router, {:loaded, loaded, modules})
+
+    results
+  end
+
+  # The router gets the caller's timeout rather than a deadline, since
+  # it may run on another node with its own monotonic clock
+  defp route(router, module, timeout) do
+    GenServer.call(router, {:route, module, timeout}, timeout)
+  catch
+    :exit, {:timeout, _} -> {:error, Error.pool_error(:timeout)}
+    :exit, reason -> {:error, Error.pool_error(reason)}
+  end
+
+  # Server Callbacks
+
+  @impl GenServer
+  def init(opts) do
+    Process.flag(:trap_exit, true)
+
+    {size, opts} = Keyword.pop(opts, :size, config_size())
+    {modules, worker_opts} = Keyword.pop(opts, :modules, config_modules())
+
+    state = %__MODULE__{
+      worker_opts: worker_opts,
+      sources: Map.new(modules, fn {module, path} -> {module, Path.expand(path)} end)
+    }
+
+    Enum.reduce_while(1..size, {:ok, state}, fn _, {:ok, state} ->
+      case start_worker(state) do
+        {:ok, state} -> {:cont, {:ok, state}}
+        {:error, reason} -> {:halt, {:stop, {:worker_start_failed, reason}}}
+      end
+    end)
+  end
+
+  @impl GenServer
+  def handle_call({:route, module, timeout}, from, state) do
+    case find_loaded(state, module) do
+      {:ok, worker} ->
+        reply_with(state, worker)
+
+      :error ->
+        case Map.fetch(state.sources, module) do
+          {:ok, path} -> {:noreply, await_load(state, module, path, {from, now() + timeout})}
+          # Built-in modules are available on every worker
+          :error -> reply_with(state, least_busy(state))
+        end
+    end
+  end
+
+  def handle_call(:workers, _from, state) do
+    {:reply, Map.keys(state.workers), state}
+  end
+
+  # A failed load may have left a worker with part of the modules, so it
+  # no longer counts as having any of them
+  def handle_call({:loaded, loaded, modules}, _from, state) do
+    state =
+      Enum.reduce(loaded, state, fn {worker, ok?}, state ->
+        update_worker(state, worker, fn info ->
+          modules =
+            if ok?,
+              do: MapSet.union(info.modules, MapSet.new(modules)),
+              else: MapSet.difference(info.modules, MapSet.new(modules))
+
+          %{info | modules: modules}
+        end)
+      end)
+
+    {:reply, :ok, state}
+  end
+
+  def handle_call({:register, module, path}, _from, state) do
+    workers =
+      if Map.get(state.sources, module) == path do
+        state.workers
+      else
+        Map.new(state.workers, fn {pid, info} ->
+          {pid, %{info | modules: MapSet.delete(info.modules, module)}}
+        end)
+      end
+
+    {:reply, :ok, %{state | sources: Map.put(state.sources, module, path), workers: workers}}
+  end
+
+  def handle_call(:summary, _from, state) do
+    workers = Map.values(state.workers)
+
+    summary = %{
+      workers: length(workers),
+      busy: workers |> Enum.map(& &1.busy) |> Enum.sum(),
+      loaded:
+        workers
+        |> Enum.map(& &1.modules)
+        |> Enum.reduce(MapSet.new(), &MapSet.union/2)
+        |> MapSet.to_list(),
+      registered: Map.keys(state.sources)
+    }
+
+    {:reply, summary, state}
+  end
+
+  def handle_call(:status, _from, state) do
+    status =
+      Map.new(state.workers, fn {pid, info} ->
+        {pid, %{modules: info.modules |> MapSet.to_list() |> Enum.sort(), busy: info.busy}}
+      end)
+
+    {:reply, status, state}
+  end
+
+  @impl GenServer
+  def handle_cast({:release, worker}, state) do
+    {:noreply, update_worker(state, worker, &%{&1 | busy: max(&1.busy - 1, 0)})}
+  end
+
+  # coveralls-ignore-start
+  # Load completion and worker crashes need real Maude workers - tested via integration tests
+
+  @impl GenServer
+  def handle_info({ref, result}, %{loading: loading} = state) when is_map_key(loading, ref) do
+    Process.demonitor(ref, [:flush])
+    {{module, worker, waiters}, loading} = Map.pop!(loading, ref)
+    state = %{state | loading: loading}
+
+    case result do
+      :ok ->
+        state = update_worker(state, worker, &%{&1 | modules: MapSet.put(&1.modules, module)})
+        Cache.invalidate()
+
+        # A caller that gave up no longer releases its lease
+        state =
+          Enum.reduce(waiters, state, fn waiter, state ->
+            if waiting?(waiter) do
+              GenServer.reply(elem(waiter, 0), {:ok, worker})
+              lease(state, worker)
+            else
+              state
+            end
+          end)
+
+        {:noreply, state}
+
+      error ->
+        Logger.warning("Router failed to load #{module}: #{inspect(error)}")
+        reply = {:error, load_error(module, error)}
+        Enum.each(waiters, &GenServer.reply(elem(&1, 0), reply))
+        {:noreply, state}
+    end
+  end
+
+  def handle_info({:DOWN, ref, :process, _pid, reason}, %{loading: loading} = state)
+      when is_map_key(loading, ref) do
+    {{module, _worker, waiters}, loading} = Map.pop!(loading, ref)
+    reply = {:error, load_error(module, reason)}
+    Enum.each(waiters, &GenServer.reply(elem(&1, 0), reply))
+    {:noreply, %{state | loading: loading}}
+  end
+
+  def handle_info({:EXIT, pid, reason}, %{workers: workers} = state)
+      when is_map_key(workers, pid) do
+    # The replacement starts empty and loads modules again on demand
+    Logger.warning("Router worker #{inspect(pid)} exited: #{inspect(reason)}")
+    state = %{state | workers: Map.delete(workers, pid)}
+
+    case start_worker(state) do
+      {:ok, state} -> {:noreply, state}
+      {:error, reason} -> {:stop, {:worker_start_failed, reason}, state}
+    end
+  end
+
+  def handle_info(_msg, state) do
+    {:noreply, state}
+  end
+
+  @impl GenServer
+  def terminate(_reason, state) do
+    Enum.each(Map.keys(state.workers), fn worker ->
+      try do
+        Backend.impl().stop(worker)
+      catch
+        :exit, _ -> :ok
+      end
+    end)
+  end
+
+  # coveralls-ignore-stop
+
+  # Private Functions
+
+  defp start_worker(state) do
+    case Backend.impl().start_link(state.worker_opts) do
+      {:ok, pid} ->
+        info = %{modules: MapSet.new(), busy: 0}
+        {:ok, %{state | workers: Map.put(state.workers, pid, info)}}
+
+      {:error, reason} ->
+        {:error, reason}
+    end
+  end
+
+  defp find_loaded(state, module) do
+    state.workers
+    |> Enum.filter(fn {_pid, info} -> MapSet.member?(info.modules, module) end)
+    |> case do
+      [] -> :error
+      loaded -> {:ok, loaded |> Enum.min_by(fn {_pid, info} -> info.busy end) |> elem(0)}
+    end
+  end
+
+  defp least_busy(state) do
+    state.workers |> Enum.min_by(fn {_pid, info} -> info.busy end) |> elem(0)
+  end
+
+  # Spread modules evenly: the worker holding the fewest modules loads the next one
+  defp least_loaded(state) do
+    state.workers
+    |> Enum.min_by(fn {_pid, info} -> {MapSet.size(info.modules), info.busy} end)
+    |> elem(0)
+  end
+
+  # Join a load already in flight for the module or start one
+  defp await_load(state, module, path, waiter) do
+    case Enum.find(state.loading, fn {_ref, {loading, _, _}} -> loading == module end) do
+      {ref, {^module, worker, waiters}} ->
+        %{state | loading: Map.put(state.loading, ref, {module, worker, [waiter | waiters]})}
+
+      nil ->
+        worker = least_loaded(state)
+        task = Task.async(fn -> Backend.impl().load_file(worker, path) end)
+        %{state | loading: Map.put(state.loading, task.ref, {module, worker, [waiter]})}
+    end
+  end
+
+  # Whether the caller is still blocked in route/3: its call has not
+  # timed out and (when local) it is alive
+  defp waiting?({{pid, _tag}, deadline}) do
+    now() < deadline and (node(pid) != node() or Process.alive?(pid))
+  end
+
+  defp now, do: System.monotonic_time(:millisecond)
+
+  defp reply_with(state, worker), do: {:reply, {:ok, worker}, lease(state, worker)}
+
+  defp lease(state, worker), do: update_worker(state, worker, &%{&1 | busy: &1.busy + 1})
+
+  defp update_worker(state, worker, fun) do
+    case Map.fetch(state.workers, worker) do
+      {:ok, info} -> %{state | workers: Map.put(state.workers, worker, fun.(info))}
+      :error -> state
+    end
+  end
+
+  defp load_error(module, {:error, %Error{} = error}),
+    do: Error.new(:load_error, "Failed to load #{module}: #{error.message}", details: error)
+
+  defp load_error(module, reason),
+    do: Error.new(:load_error, "Failed to load #{module}", details: reason)
+
+  defp config_size do
+    Application.get_env(:ex_maude, :router_size, @default_size)
+  end
+
+  defp config_modules do
+    Application.get_env(:ex_maude, :router_modules, %{})
+  end
+end
@@ -34,7 +34,8 @@ defmodule ExMaude.Server do
 
   """
 
-  alias ExMaude.Backend
+  alias ExMaude.{Backend, Error, Parser}
+  alias ExMaude.Backend.Modules
 
   @default_timeout_ms 5_000
 
@@ -53,12 +54,98 @@ defmodule ExMaude.Server do
 
     * `:timeout` - Maximum time to wait in ms (default: 5000)
   """
-  @spec execute(GenServer.server(), String.t(), keyword()) ::
+  @spec execute(GenServer.server(), iodata(), keyword()) ::
           {:ok, String.t()} | {:error, term()}
   def execute(server, command, opts \\ []) do
     Backend.impl().execute(server, command, opts)
   end
 
+  @doc """
+  Executes several Maude commands and returns one result per command.
+
+  Backends that support batches (C-Node) send all commands in a single
+  round trip; the others run them one after another. Results keep the
+  order of `commands`.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait for each command in ms (default: 5000)
+  """
+  @spec execute_batch(GenServer.server(), [String.t()], keyword()) ::
+          {:ok, [{:ok, String.t()} | {:error, term()}]} | {:error, term()}
+  def execute_batch(server, commands, opts \\ []) do
+    backend = Backend.impl()
+    Code.ensure_loaded(backend)
+
+    if function_exported?(backend, :execute_batch, 3) do
+      backend.execute_batch(server, commands, opts)
+    else
+      {:ok, Enum.map(commands, &backend.execute(server, &1, opts))}
+    end
+  end
+
+  @doc """
+  Executes a Maude command and returns its output as result structs.
+
+  A `result Sort: Term` answer becomes an `ExMaude.Result.Reduction`, a
+  search an `ExMaude.Result.Search`, and any other output is returned as
+  text. The C-Node backend tokenizes the output in the bridge; the others
+  use `ExMaude.Parser.tokenize/1`.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait in ms (default: 5000)
+
+  ## Examples
+
+      {:ok, %ExMaude.Result.Reduction{}} =
+        ExMaude.Server.execute_parsed(pid, "reduce in NAT : 1 + 2 .")
+  """
+  @spec execute_parsed(GenServer.server(), String.t(), keyword()) ::
+          {:ok, ExMaude.Result.Reduction.t() | ExMaude.Result.Search.t() | String.t()}
+          | {:error, term()}
+  def execute_parsed(server, command, opts \\ []) do
+    backend = Backend.impl()
+    Code.ensure_loaded(backend)
+
+    if function_exported?(backend, :execute_parsed, 3) do
+      backend.execute_parsed(server, command, opts)
+    else
+      with {:ok, output} <- backend.execute(server, command, opts) do
+        {:ok, output |> Parser.tokenize() |> Parser.to_result()}
+      end
+    end
+  end
+
+  @doc """
+  Executes a Maude command and returns a lazy stream of output chunks.
+
+  Backends that support streaming (C-Node) emit chunks while Maude is still
+  running; the others emit the complete output as one chunk. Errors are
+  raised as `ExMaude.Error` while the stream is enumerated.
+
+  ## Options
+
+    * `:timeout` - Maximum time to wait in ms (default: 5000)
+  """
+  @spec stream(GenServer.server(), String.t(), keyword()) :: Enumerable.t()
+  def stream(server, command, opts \\ []) do
+    backend = Backend.impl()
+    Code.ensure_loaded(backend)
+
+    if function_exported?(backend, :stream, 3) do
+      backend.stream(server, command, opts)
+    else
+      Stream.flat_map([command], fn command ->
+        case backend.execute(server, command, opts) do
+          {:ok, output} -> [output]
+          {:error, %Error{} = error} -> raise error
+          {:error, reason} -> raise Error.new(:unknown, inspect(reason))
+        end
+      end)
+    end
+  end
+
   @doc """
   Loads a Maude file into this server's session.
   """
@@ -67,6 +154,24 @@ defmodule ExMaude.Server do
     Backend.impl().load_file(server, path)
   end
 
+  @doc """
+  Loads Maude module source into this server's session.
+
+  Backends that accept source directly (C-Node) get it in the request;
+  for the others it goes through a temporary file.
+  """
+  @spec load_source(GenServer.server(), String.t()) :: :ok | {:error, term()}
+  def load_source(server, source) do
+    backend = Backend.impl()
+    Code.ensure_loaded(backend)
+
+    if function_exported?(backend, :load_source, 2) do
+      backend.load_source(server, source)
+    else
+      Modules.with_temp_file(source, &backend.load_file(server, &1))
+    end
+  end
+
   @doc """
   Checks if the Maude process is alive.
   """
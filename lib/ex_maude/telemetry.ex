@@ -26,7 +26,10 @@ defmodule ExMaude.Telemetry do
   - Metadata: `%{operation: atom, module: String.t}`
 
   `[:ex_maude, :command, :stop]`
-  - Measurements: `%{duration: integer}` (native time units)
+  - Measurements: `%{duration: integer}` (native time units), plus the
+    statistics Maude printed for `reduce`, `rewrite`, `search` and
+    `execute_parsed`: `:rewrites`, `:cpu_ms`, `:real_ms` and, for searches,
+    `:states`. Each one is only present when Maude reported it.
   - Metadata: `%{operation: atom, module: String.t, result: :ok | :error}`
 
   `[:ex_maude, :command, :exception]`
@@ -42,9 +45,40 @@ defmodule ExMaude.Telemetry do
   - Metadata: `%{}`
 
   `[:ex_maude, :pool, :checkout, :stop]`
-  - Measurements: `%{duration: integer}`
+  - Measurements: `%{duration: integer, wait: integer}` - `duration` spans
+    the whole transaction, `wait` only the time until a worker was checked out
   - Metadata: `%{result: :ok | :error}`
 
+  ### Cache Events
+
+  Emitted by `ExMaude.Cache` for memoized `reduce`/`parse` calls.
+
+  `[:ex_maude, :cache, :hit]`
+  - Measurements: `%{count: 1}`
+  - Metadata: `%{operation: atom, module: String.t}`
+
+  `[:ex_maude, :cache, :miss]`
+  - Measurements: `%{count: 1}`
+  - Metadata: `%{operation: atom, module: String.t}`
+
+  ### Bridge Events
+
+  Emitted by `ExMaude.Backend.CNode` on every health check, from the
+  histograms and counters the `maude_bridge` process keeps (see
+  `ExMaude.Backend.CNode.Stats`). They split the time of a command into
+  bridge-side phases, next to the end-to-end `[:ex_maude, :command, :stop]`.
+
+  `[:ex_maude, :bridge, :stats]`
+  - Measurements: `%{bytes_in: integer, bytes_out: integer, maude_bytes_written: integer,
+    maude_bytes_read: integer, timeouts: integer, overloaded: integer, restarts: integer,
+    queued: integer}` (increments since the last report, `:queued` as is)
+  - Metadata: `%{pid: pid, node: atom}`
+
+  `[:ex_maude, :bridge, :phase]`
+  - Measurements: `%{count: integer, total: integer, p50: integer, p90: integer,
+    p99: integer, max: integer}` (durations in native time units)
+  - Metadata: `%{pid: pid, node: atom, phase: :decode | :compute | :read | :encode}`
+
   ### IoT Events
 
   Emitted for IoT conflict detection operations.
@@ -98,6 +132,14 @@ defmodule ExMaude.Telemetry do
             tags: [:operation, :result],
             description: "Maude command execution time"
           ),
+          sum("ex_maude.command.stop.rewrites",
+            tags: [:operation],
+            description: "Rewrites performed by Maude"
+          ),
+          distribution("ex_maude.command.stop.cpu_ms",
+            tags: [:operation],
+            description: "CPU time Maude reported per command"
+          ),
           counter("ex_maude.pool.checkout.stop.count",
             tags: [:result],
             description: "Pool checkout operations"
@@ -105,12 +147,30 @@ defmodule ExMaude.Telemetry do
           distribution("ex_maude.pool.checkout.stop.duration",
             unit: {:native, :millisecond},
             tags: [:result],
-            description: "Pool checkout time"
+            description: "Pool transaction time"
+          ),
+          distribution("ex_maude.pool.checkout.stop.wait",
+            unit: {:native, :millisecond},
+            tags: [:result],
+            description: "Pool checkout wait time"
+          ),
+          counter("ex_maude.cache.hit.count",
+            tags: [:operation],
+            description: "Results served from the cache"
+          ),
+          counter("ex_maude.cache.miss.count",
+            tags: [:operation],
+            description: "Results computed by Maude"
           ),
           counter("ex_maude.iot.detect_conflicts.stop.count",
             tags: [:result],
             description: "IoT conflict detections"
           ),
+          last_value("ex_maude.bridge.phase.p99",
+            unit: {:native, :microsecond},
+            tags: [:phase],
+            description: "Bridge-side 99th percentile per request phase"
+          ),
           last_value("ex_maude.iot.detect_conflicts.stop.conflict_count",
             description: "Number of conflicts detected"
           )
@@ -131,6 +191,8 @@ defmodule ExMaude.Telemetry do
       duration_us = System.convert_time_unit(duration, :native, :microsecond)
   """
 
+  @measurements_key {__MODULE__, :measurements}
+
   @doc """
   Returns a list of all telemetry events emitted by ExMaude.
 
@@ -158,6 +220,10 @@ defmodule ExMaude.Telemetry do
       [:ex_maude, :command, :exception],
       [:ex_maude, :pool, :checkout, :start],
       [:ex_maude, :pool, :checkout, :stop],
+      [:ex_maude, :cache, :hit],
+      [:ex_maude, :cache, :miss],
+      [:ex_maude, :bridge, :stats],
+      [:ex_maude, :bridge, :phase],
       [:ex_maude, :iot, :detect_conflicts, :start],
       [:ex_maude, :iot, :detect_conflicts, :stop]
     ]
@@ -178,12 +244,14 @@ defmodule ExMaude.Telemetry do
   ## Events Emitted
 
   - `event ++ [:start]` - Before function execution
-  - `event ++ [:stop]` - After successful completion
+  - `event ++ [:stop]` - After successful completion, with the measurements
+    `fun` recorded through `put_measurements/1` next to `:duration`
   - `event ++ [:exception]` - If function raises or throws
   """
   @spec span([atom(), ...], map(), (-> {:ok, term()} | {:error, term()})) ::
           {:ok, term()} | {:error, term()}
   def span(event, start_metadata, fun) when is_list(event) and is_map(start_metadata) do
+    outer = Process.put(@measurements_key, %{})
     start_time = System.monotonic_time()
 
     :telemetry.execute(
@@ -196,10 +264,11 @@ defmodule ExMaude.Telemetry do
       result = fun.()
       duration = System.monotonic_time() - start_time
       result_atom = if is_tuple(result), do: elem(result, 0), else: :ok
+      measurements = Process.get(@measurements_key, %{})
 
       :telemetry.execute(
         event ++ [:stop],
-        %{duration: duration},
+        Map.put(measurements, :duration, duration),
         Map.put(start_metadata, :result, result_atom)
       )
 
@@ -226,6 +295,41 @@ defmodule ExMaude.Telemetry do
         )
 
         :erlang.raise(kind, reason, __STACKTRACE__)
+    after
+      restore_measurements(outer)
     end
   end
+
+  @doc """
+  Records numeric measurements for the `:stop` event of the enclosing
+  `span/3`.
+
+  Values are merged into what the span already recorded, and `nil` values
+  are left out. Outside of a span, or in a process other than the one
+  running it, the measurements are ignored.
+
+  ## Examples
+
+      iex> ExMaude.Telemetry.put_measurements(%{rewrites: 3, cpu_ms: nil})
+      :ok
+  """
+  @spec put_measurements(map()) :: :ok
+  def put_measurements(measurements) when is_map(measurements) do
+    case Process.get(@measurements_key) do
+      nil ->
+        :ok
+
+      current ->
+        recorded =
+          for {key, value} <- measurements, is_number(value), into: current, do: {key, value}
+
+        Process.put(@measurements_key, recorded)
+        :ok
+    end
+  end
+
+  # Private Functions
+
+  defp restore_measurements(nil), do: Process.delete(@measurements_key)
+  defp restore_measurements(outer), do: Process.put(@measurements_key, outer)
 end
@@ -10,22 +10,181 @@
 //!
 //! Use the `:port` backend (default) for production unless profiling shows
 //! the latency improvement from NIF is necessary.
+//!
+//! ## Async Execution
+//!
+//! Every Maude process gets a background I/O thread. `execute_async`
+//! queues the command for that thread and returns a reference right away;
+//! the thread sends `{maude_result, Ref, {ok, Output} | {error, Reason}}`
+//! to the caller with `enif_send` once Maude prints its prompt. No
+//! scheduler, dirty or not, is held while Maude computes.
+//!
+//! ## Timeouts
+//!
+//! Each job carries the caller's timeout. A watchdog thread kills Maude
+//! when a job runs past it; the job is answered with `{error, timeout}`
+//! and the ones queued behind it with the EOF error, and `alive` reports
+//! `false` from then on so the worker is replaced.
+//!
+//! ## Read Path
+//!
+//! Output is read as raw bytes into a buffer reused across commands, and
+//! only the newly read bytes are searched for the prompt. The output is
+//! copied once, into the `OwnedBinary` handed to the BEAM, without UTF-8
+//! validation or per-line allocations.
+
+use memchr::memmem;
+use rustler::types::atom;
+use rustler::{
+    Binary, Encoder, Env, LocalPid, NifResult, OwnedBinary, OwnedEnv, Reference, ResourceArc,
+    SavedTerm,
+};
+use std::io::{Read, Write};
+use std::process::{Child, ChildStdin, ChildStdout, Command, Stdio};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
 
-use rustler::{NifResult, ResourceArc};
-use std::io::{BufRead, BufReader, Write};
-use std::process::{Child, Command, Stdio};
-use std::sync::Mutex;
+const PROMPT: &[u8] = b"Maude>";
+
+/// Bytes requested from the pipe per read.
+const READ_CHUNK: usize = 64 * 1024;
+
+/// Capacity kept in the read buffer after a large output.
+const RETAINED_CAPACITY: usize = 1024 * 1024;
+
+mod atoms {
+    rustler::atoms! {
+        maude_result,
+    }
+}
+
+/// Maude's stdout and the buffer reused for every response. Its length is
+/// the part already initialized, not the size of the last response.
+struct MaudeStdout {
+    pipe: ChildStdout,
+    buf: Vec<u8>,
+}
 
-/// Wrapper around the Maude subprocess with synchronized I/O handles.
+/// Pipes to the Maude subprocess, shared with its I/O thread.
+struct MaudeIo {
+    stdin: Mutex<ChildStdin>,
+    stdout: Mutex<MaudeStdout>,
+}
+
+/// A command waiting for the I/O thread, with the reference to reply under.
+struct Job {
+    pid: LocalPid,
+    env: OwnedEnv,
+    reference: SavedTerm,
+    command: Vec<u8>,
+    timeout: Duration,
+}
+
+/// Deadline of the running job, shared by the I/O and watchdog threads.
+#[derive(Default)]
+struct WatchState {
+    deadline: Option<Instant>,
+    timed_out: bool,
+    done: bool,
+}
+
+/// Kills Maude when a job runs past its deadline.
+struct Watchdog {
+    state: Mutex<WatchState>,
+    wake: Condvar,
+}
+
+impl Watchdog {
+    fn arm(&self, timeout: Duration) {
+        if let Ok(mut state) = self.state.lock() {
+            state.deadline = Some(Instant::now() + timeout);
+            state.timed_out = false;
+            self.wake.notify_one();
+        }
+    }
+
+    /// Clears the deadline and returns whether it had passed.
+    fn disarm(&self) -> bool {
+        match self.state.lock() {
+            Ok(mut state) => {
+                state.deadline = None;
+                state.timed_out
+            }
+            Err(_) => false,
+        }
+    }
+
+    fn finish(&self) {
+        if let Ok(mut state) = self.state.lock() {
+            state.done = true;
+            self.wake.notify_one();
+        }
+    }
+
+    /// Body of the watchdog thread, until `finish` is called.
+    fn run(&self, child: &Mutex<Child>) {
+        let Ok(mut state) = self.state.lock() else {
+            return;
+        };
+
+        while !state.done {
+            state = match state.deadline {
+                None => match self.wake.wait(state) {
+                    Ok(state) => state,
+                    Err(_) => return,
+                },
+                Some(deadline) if Instant::now() >= deadline => {
+                    state.deadline = None;
+                    state.timed_out = true;
+                    drop(state);
+
+                    // The blocked read then ends with EOF
+                    if let Ok(mut child) = child.lock() {
+                        let _ = child.kill();
+                    }
+
+                    match self.state.lock() {
+                        Ok(state) => state,
+                        Err(_) => return,
+                    }
+                }
+                Some(deadline) => match self.wake.wait_timeout(state, deadline - Instant::now()) {
+                    Ok((state, _)) => state,
+                    Err(_) => return,
+                },
+            };
+        }
+    }
+}
+
+/// Wrapper around the Maude subprocess and its background I/O thread.
 pub struct MaudeProcess {
-    child: Mutex<Child>,
-    stdin: Mutex<std::process::ChildStdin>,
-    stdout: Mutex<BufReader<std::process::ChildStdout>>,
+    child: Arc<Mutex<Child>>,
+    io: Arc<MaudeIo>,
+    jobs: Mutex<Option<Sender<Job>>>,
+    thread: Mutex<Option<JoinHandle<()>>>,
 }
 
 #[rustler::resource_impl]
 impl rustler::Resource for MaudeProcess {}
 
+impl Drop for MaudeProcess {
+    // A handle garbage collected without `stop` still ends its thread and
+    // does not leave Maude running
+    fn drop(&mut self) {
+        if let Ok(mut jobs) = self.jobs.lock() {
+            jobs.take();
+        }
+
+        if let Ok(mut child) = self.child.lock() {
+            let _ = child.kill();
+            let _ = child.wait();
+        }
+    }
+}
+
 /// Start a new Maude subprocess.
 ///
 /// # Arguments
@@ -54,49 +213,104 @@ fn start(maude_path: String) -> NifResult<ResourceArc<MaudeProcess>> {
         .take()
         .ok_or_else(|| rustler::Error::Term(Box::new("failed to get stdout".to_string())))?;
 
-    let process = MaudeProcess {
-        child: Mutex::new(child),
+    let io = Arc::new(MaudeIo {
         stdin: Mutex::new(stdin),
-        stdout: Mutex::new(BufReader::new(stdout)),
-    };
+        stdout: Mutex::new(MaudeStdout {
+            pipe: stdout,
+            buf: Vec::with_capacity(READ_CHUNK),
+        }),
+    });
+
+    // Read until first prompt to ensure Maude is ready. This is the only
+    // blocking read outside the I/O thread.
+    if let Err(e) = read_until_prompt(&io, |_| ()) {
+        let _ = child.kill();
+        let _ = child.wait();
+        return Err(rustler::Error::Term(Box::new(e)));
+    }
+
+    let child = Arc::new(Mutex::new(child));
+    let watchdog = Arc::new(Watchdog {
+        state: Mutex::new(WatchState::default()),
+        wake: Condvar::new(),
+    });
+
+    let watched = Arc::clone(&child);
+    let thread_watchdog = Arc::clone(&watchdog);
 
-    // Read until first prompt to ensure Maude is ready
-    read_until_prompt(&process)?;
+    if let Err(e) = thread::Builder::new()
+        .name("ex_maude_nif_watchdog".to_string())
+        .spawn(move || thread_watchdog.run(&watched))
+    {
+        if let Ok(mut child) = child.lock() {
+            let _ = child.kill();
+            let _ = child.wait();
+        }
+        return Err(rustler::Error::Term(Box::new(format!(
+            "thread spawn failed: {}",
+            e
+        ))));
+    }
+
+    let (jobs, queue) = mpsc::channel();
+    let thread_io = Arc::clone(&io);
 
-    Ok(ResourceArc::new(process))
+    let thread = thread::Builder::new()
+        .name("ex_maude_nif_io".to_string())
+        .spawn(move || run_jobs(&thread_io, &watchdog, queue))
+        .map_err(|e| rustler::Error::Term(Box::new(format!("thread spawn failed: {}", e))))?;
+
+    Ok(ResourceArc::new(MaudeProcess {
+        child,
+        io,
+        jobs: Mutex::new(Some(jobs)),
+        thread: Mutex::new(Some(thread)),
+    }))
 }
 
-/// Execute a Maude command and return the output.
+/// Queue a Maude command and return a reference for its result.
 ///
-/// This function uses a dirty CPU scheduler to avoid blocking the
-/// main BEAM schedulers during I/O operations.
+/// The calling process receives `{maude_result, Ref, {ok, Output}}` or
+/// `{maude_result, Ref, {error, Reason}}` when Maude answers. Commands run
+/// in the order they were queued. A command still running `timeout_ms`
+/// after it started is answered with `{error, timeout}` and Maude is
+/// killed.
 ///
 /// # Arguments
 /// * `process` - Handle to the Maude process
 /// * `command` - Maude command to execute
+/// * `timeout_ms` - Time the command may run, in milliseconds
 ///
 /// # Returns
-/// * `Ok(String)` - Command output (without the prompt)
-/// * `Err` - If I/O fails
-#[rustler::nif(schedule = "DirtyCpu")]
-fn execute(process: ResourceArc<MaudeProcess>, command: String) -> NifResult<String> {
-    // Write command to Maude stdin
-    {
-        let mut stdin = process
-            .stdin
-            .lock()
-            .map_err(|e| rustler::Error::Term(Box::new(format!("stdin lock failed: {}", e))))?;
+/// * `Ok(Reference)` - Reference tagging the result message
+/// * `Err` - If the process was stopped
+#[rustler::nif]
+fn execute_async<'a>(
+    env: Env<'a>,
+    process: ResourceArc<MaudeProcess>,
+    command: Binary,
+    timeout_ms: u64,
+) -> NifResult<Reference<'a>> {
+    let reference = env.make_ref();
+    let owned = OwnedEnv::new();
 
-        writeln!(stdin, "{}", command)
-            .map_err(|e| rustler::Error::Term(Box::new(format!("write failed: {}", e))))?;
+    let job = Job {
+        pid: env.pid(),
+        reference: owned.save(&reference),
+        env: owned,
+        command: command.as_slice().to_vec(),
+        timeout: Duration::from_millis(timeout_ms),
+    };
 
-        stdin
-            .flush()
-            .map_err(|e| rustler::Error::Term(Box::new(format!("flush failed: {}", e))))?;
-    }
+    let jobs = process
+        .jobs
+        .lock()
+        .map_err(|e| rustler::Error::Term(Box::new(format!("jobs lock failed: {}", e))))?;
 
-    // Read response until we see the prompt
-    read_until_prompt(&process)
+    match jobs.as_ref().map(|jobs| jobs.send(job)) {
+        Some(Ok(())) => Ok(reference),
+        _ => Err(rustler::Error::Term(Box::new("process stopped".to_string()))),
+    }
 }
 
 /// Stop the Maude subprocess.
@@ -105,13 +319,19 @@ fn execute(process: ResourceArc<MaudeProcess>, command: String) -> NifResult<Str
 /// * `process` - Handle to the Maude process
 #[rustler::nif]
 fn stop(process: ResourceArc<MaudeProcess>) -> NifResult<()> {
+    // No new jobs; the thread exits once the queued ones are answered
+    if let Ok(mut jobs) = process.jobs.lock() {
+        jobs.take();
+    }
+
     let mut child = process
         .child
         .lock()
         .map_err(|e| rustler::Error::Term(Box::new(format!("child lock failed: {}", e))))?;
 
-    // Send quit command first for graceful shutdown
-    if let Ok(mut stdin) = process.stdin.lock() {
+    // Send quit command first for graceful shutdown. Skipped while the
+    // thread is writing a command, the kill below ends Maude either way.
+    if let Ok(mut stdin) = process.io.stdin.try_lock() {
         let _ = writeln!(stdin, "quit");
         let _ = stdin.flush();
     }
@@ -119,10 +339,16 @@ fn stop(process: ResourceArc<MaudeProcess>) -> NifResult<()> {
     // Give it a moment to exit gracefully
     std::thread::sleep(std::time::Duration::from_millis(100));
 
-    // Force kill if still running
+    // Force kill if still running; pending jobs get an EOF error
     let _ = child.kill();
     let _ = child.wait();
 
+    if let Ok(mut thread) = process.thread.lock() {
+        if let Some(thread) = thread.take() {
+            let _ = thread.join();
+        }
+    }
+
     Ok(())
 }
 
@@ -146,46 +372,123 @@ fn alive(process: ResourceArc<MaudeProcess>) -> bool {
     }
 }
 
-/// Read from Maude stdout until we see the "Maude>" prompt.
-fn read_until_prompt(process: &MaudeProcess) -> NifResult<String> {
-    let mut stdout = process
+/// Body of the I/O thread: answer queued jobs until the queue is closed.
+fn run_jobs(io: &MaudeIo, watchdog: &Watchdog, queue: Receiver<Job>) {
+    for mut job in queue {
+        watchdog.arm(job.timeout);
+        let result = run_command(io, &job.command);
+
+        let result = if watchdog.disarm() {
+            Err("timeout".to_string())
+        } else {
+            result
+        };
+
+        let reference = job.reference;
+
+        // The caller may have exited meanwhile; nobody is left to tell
+        let _ = job.env.send_and_clear(&job.pid, |env| {
+            let result = match result {
+                Ok(output) => (atom::ok(), output.release(env)).encode(env),
+                Err(reason) => (atom::error(), reason).encode(env),
+            };
+
+            (atoms::maude_result(), reference.load(env), result).encode(env)
+        });
+    }
+
+    watchdog.finish();
+}
+
+/// Write one command to Maude and read its output into a binary.
+fn run_command(io: &MaudeIo, command: &[u8]) -> Result<OwnedBinary, String> {
+    {
+        let mut stdin = io
+            .stdin
+            .lock()
+            .map_err(|e| format!("stdin lock failed: {}", e))?;
+
+        stdin
+            .write_all(command)
+            .and_then(|_| stdin.write_all(b"\n"))
+            .map_err(|e| format!("write failed: {}", e))?;
+        stdin.flush().map_err(|e| format!("flush failed: {}", e))?;
+    }
+
+    read_until_prompt(io, |output| {
+        let mut binary = OwnedBinary::new(output.len())
+            .ok_or_else(|| "binary allocation failed".to_string())?;
+        binary.as_mut_slice().copy_from_slice(output);
+        Ok(binary)
+    })?
+}
+
+/// Read from Maude stdout until we see the "Maude>" prompt and pass the
+/// trimmed output before it to `take`.
+fn read_until_prompt<T>(io: &MaudeIo, take: impl FnOnce(&[u8]) -> T) -> Result<T, String> {
+    let mut stdout = io
         .stdout
         .lock()
-        .map_err(|e| rustler::Error::Term(Box::new(format!("stdout lock failed: {}", e))))?;
+        .map_err(|e| format!("stdout lock failed: {}", e))?;
 
-    let mut output = String::new();
-    let mut line = String::new();
+    let MaudeStdout { pipe, buf } = &mut *stdout;
 
-    loop {
-        line.clear();
-        match stdout.read_line(&mut line) {
-            Ok(0) => {
-                // EOF - process likely exited
-                break;
-            }
-            Ok(_) => {
-                // Check if this line contains the prompt
-                if line.contains("Maude>") {
-                    // Don't include the prompt in output
-                    if let Some(before_prompt) = line.split("Maude>").next() {
-                        if !before_prompt.is_empty() {
-                            output.push_str(before_prompt);
-                        }
-                    }
-                    break;
+    // The buffer keeps its bytes between reads and responses, so growing
+    // it zeroes only memory it never held; `filled` bytes are this response
+    let mut filled = 0;
+    // Bytes before `scanned` are known not to start a prompt
+    let mut scanned = 0;
+
+    let prompt_at = loop {
+        if buf.len() < filled + READ_CHUNK {
+            buf.resize(filled + READ_CHUNK, 0);
+        }
+
+        match pipe.read(&mut buf[filled..]) {
+            // EOF - process likely exited
+            Ok(0) => break None,
+            Ok(n) => {
+                filled += n;
+
+                if let Some(at) = memmem::find(&buf[scanned..filled], PROMPT) {
+                    break Some(scanned + at);
                 }
-                output.push_str(&line);
-            }
-            Err(e) => {
-                return Err(rustler::Error::Term(Box::new(format!(
-                    "read failed: {}",
-                    e
-                ))))
+
+                scanned = filled.saturating_sub(PROMPT.len() - 1);
             }
+            Err(e) if e.kind() == std::io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(format!("read failed: {}", e)),
         }
+    };
+
+    // Anything after the prompt is the rest of the prompt line
+    let end = prompt_at.unwrap_or(filled);
+    let output = trim_ascii(&buf[..end]);
+
+    if prompt_at.is_none() && output.is_empty() {
+        return Err("maude exited".to_string());
     }
 
-    Ok(output.trim().to_string())
+    let result = take(output);
+
+    if buf.capacity() > RETAINED_CAPACITY {
+        *buf = Vec::with_capacity(READ_CHUNK);
+    }
+
+    Ok(result)
+}
+
+fn trim_ascii(bytes: &[u8]) -> &[u8] {
+    let start = bytes
+        .iter()
+        .position(|b| !b.is_ascii_whitespace())
+        .unwrap_or(bytes.len());
+    let end = bytes
+        .iter()
+        .rposition(|b| !b.is_ascii_whitespace())
+        .map_or(start, |i| i + 1);
+
+    &bytes[start..end]
 }
 
 rustler::init!("Elixir.ExMaude.Backend.NIF.Native");
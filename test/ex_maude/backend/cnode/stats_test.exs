@@ -0,0 +1,151 @@
+defmodule ExMaude.Backend.CNode.StatsTest do
+  @moduledoc """
+  Tests for `ExMaude.Backend.CNode.Stats` - bridge counters and histograms.
+  """
+
+  use ExUnit.Case, async: true
+
+  alias ExMaude.Backend.CNode.Stats
+
+  doctest ExMaude.Backend.CNode.Stats
+
+  defp histogram(buckets) do
+    count = buckets |> Enum.map(&elem(&1, 1)) |> Enum.sum()
+    sum = buckets |> Enum.map(fn {upper, n} -> upper * n end) |> Enum.sum()
+    {min, _} = List.first(buckets, {0, 0})
+    {max, _} = List.last(buckets, {0, 0})
+    %{count: count, sum_us: sum, min_us: min, max_us: max, buckets: buckets}
+  end
+
+  defp snapshot(overrides) do
+    empty = histogram([])
+
+    Map.merge(
+      %{
+        bytes_in: 0,
+        bytes_out: 0,
+        maude_bytes_written: 0,
+        maude_bytes_read: 0,
+        timeouts: 0,
+        overloaded: 0,
+        restarts: 0,
+        recycled: 0,
+        queued: 0,
+        uptime_ms: 0,
+        rss_bytes: [],
+        decode: empty,
+        compute: empty,
+        read: empty,
+        encode: empty
+      },
+      Map.new(overrides)
+    )
+  end
+
+  describe "percentile/2" do
+    test "returns 0 for an empty histogram" do
+      assert Stats.percentile(histogram([]), 0.99) == 0
+    end
+
+    test "returns the upper bound of the bucket holding the rank" do
+      h = histogram([{1, 50}, {103, 40}, {1023, 10}])
+
+      assert Stats.percentile(h, 0.5) == 1
+      assert Stats.percentile(h, 0.51) == 103
+      assert Stats.percentile(h, 0.9) == 103
+      assert Stats.percentile(h, 0.99) == 1023
+    end
+
+    test "never exceeds the recorded maximum" do
+      h = %{histogram([{103, 2}]) | max_us: 97}
+      assert Stats.percentile(h, 1.0) == 97
+    end
+  end
+
+  describe "diff/2" do
+    test "returns the snapshot itself without a previous one" do
+      current = snapshot(timeouts: 2)
+      assert Stats.diff(current, nil) == current
+    end
+
+    test "subtracts counters and keeps gauges" do
+      previous = snapshot(bytes_in: 100, timeouts: 1, queued: 5, uptime_ms: 1000)
+      current = snapshot(bytes_in: 250, timeouts: 1, queued: 2, uptime_ms: 6000)
+
+      interval = Stats.diff(current, previous)
+
+      assert interval.bytes_in == 150
+      assert interval.timeouts == 0
+      assert interval.queued == 2
+      assert interval.uptime_ms == 6000
+    end
+
+    test "keeps only the values recorded in between" do
+      previous = snapshot(compute: histogram([{3, 1}, {103, 1}]))
+      current = snapshot(compute: histogram([{3, 1}, {103, 3}, {2047, 1}]))
+
+      interval = Stats.diff(current, previous).compute
+
+      assert interval.count == 3
+      assert interval.buckets == [{103, 2}, {2047, 1}]
+      assert interval.sum_us == 103 * 2 + 2047
+      assert interval.min_us == 96
+      assert interval.max_us == 2047
+    end
+
+    test "empties histograms without new values" do
+      h = histogram([{17, 4}])
+      interval = Stats.diff(snapshot(read: h), snapshot(read: h)).read
+
+      assert interval == %{count: 0, sum_us: 0, min_us: 0, max_us: 0, buckets: []}
+    end
+  end
+
+  describe "emit/3" do
+    setup do
+      test_pid = self()
+      handler_id = "cnode-stats-test-#{inspect(make_ref())}"
+
+      :telemetry.attach_many(
+        handler_id,
+        [[:ex_maude, :bridge, :stats], [:ex_maude, :bridge, :phase]],
+        fn event, measurements, metadata, _ -> send(test_pid, {event, measurements, metadata}) end,
+        nil
+      )
+
+      on_exit(fn -> :telemetry.detach(handler_id) end)
+    end
+
+    test "reports counter increments and phases with new values" do
+      previous = snapshot(bytes_out: 10, compute: histogram([{103, 1}]))
+      current = snapshot(bytes_out: 30, timeouts: 1, compute: histogram([{103, 2}, {1023, 2}]))
+
+      assert :ok = Stats.emit(current, previous, %{pid: self(), node: :bridge@host})
+
+      assert_receive {[:ex_maude, :bridge, :stats], measurements, %{node: :bridge@host}}
+      assert measurements.bytes_out == 20
+      assert measurements.timeouts == 1
+      refute Map.has_key?(measurements, :uptime_ms)
+
+      assert_receive {[:ex_maude, :bridge, :phase], phase, %{phase: :compute}}
+      assert phase.count == 3
+      assert phase.p50 == System.convert_time_unit(1023, :microsecond, :native)
+      assert phase.max == System.convert_time_unit(1023, :microsecond, :native)
+      assert phase.total == System.convert_time_unit(103 + 2 * 1023, :microsecond, :native)
+
+      refute_receive {[:ex_maude, :bridge, :phase], _, %{phase: :decode}}
+    end
+
+    test "reports recycled children and their resident sets" do
+      previous = snapshot(recycled: 1, rss_bytes: [4096, 8192])
+      current = snapshot(recycled: 3, rss_bytes: [1024, 65_536])
+
+      Stats.emit(current, previous, %{pid: self(), node: :bridge@host})
+
+      assert_receive {[:ex_maude, :bridge, :stats], measurements, _}
+      assert measurements.recycled == 2
+      assert measurements.rss_bytes == 66_560
+      assert measurements.max_rss_bytes == 65_536
+    end
+  end
+end
@@ -121,11 +121,183 @@ defmodule ExMaude.Backend.CNodeIntegrationTest do
         end
       end
 
+      test "handles concurrent commands on one worker", %{pid: pid} do
+        results =
+          1..10
+          |> Task.async_stream(fn i -> {i, CNode.execute(pid, "reduce in NAT : #{i} * 3 .")} end)
+          |> Enum.map(fn {:ok, result} -> result end)
+
+        for {i, {:ok, result}} <- results do
+          assert result =~ "#{i * 3}"
+        end
+
+        assert length(results) == 10
+      end
+
       test "handles timeout option", %{pid: pid} do
         assert {:ok, _} = CNode.execute(pid, "reduce in NAT : 1 + 1 .", timeout: 5000)
       end
     end
 
+    describe "execute_batch/3" do
+      setup do
+        {:ok, pid} = CNode.start_link(instances: 2)
+
+        Enum.reduce_while(1..40, false, fn _i, _acc ->
+          if CNode.alive?(pid) do
+            {:halt, true}
+          else
+            Process.sleep(100)
+            {:cont, false}
+          end
+        end)
+
+        on_exit(fn -> catch_exit(CNode.stop(pid)) end)
+        {:ok, pid: pid}
+      end
+
+      test "returns one result per command in order", %{pid: pid} do
+        commands = for i <- 1..20, do: "reduce in NAT : #{i} + #{i} ."
+        assert {:ok, results} = CNode.execute_batch(pid, commands)
+        assert length(results) == 20
+
+        for {{:ok, output}, i} <- Enum.with_index(results, 1) do
+          assert output =~ "#{i * 2}"
+        end
+      end
+
+      test "returns an empty list for an empty batch", %{pid: pid} do
+        assert {:ok, []} = CNode.execute_batch(pid, [])
+      end
+    end
+
+    describe "execute_parsed/3" do
+      setup do
+        {:ok, pid} = CNode.start_link([])
+
+        Enum.reduce_while(1..40, false, fn _i, _acc ->
+          if CNode.alive?(pid) do
+            {:halt, true}
+          else
+            Process.sleep(100)
+            {:cont, false}
+          end
+        end)
+
+        on_exit(fn -> catch_exit(CNode.stop(pid)) end)
+        {:ok, pid: pid}
+      end
+
+      test "returns a reduction tokenized by the bridge", %{pid: pid} do
+        assert {:ok, %ExMaude.Result.Reduction{} = result} =
+                 CNode.execute_parsed(pid, "reduce in NAT : 1 + 2 .")
+
+        assert result.term.value == "3"
+        assert result.term.sort == "NzNat"
+        assert is_integer(result.rewrites)
+      end
+
+      test "returns other output as text", %{pid: pid} do
+        assert {:ok, output} = CNode.execute_parsed(pid, "show module BOOL .")
+        assert output =~ "BOOL"
+      end
+    end
+
+    describe "stats/1" do
+      setup do
+        {:ok, pid} = CNode.start_link([])
+
+        Enum.reduce_while(1..40, false, fn _i, _acc ->
+          if CNode.alive?(pid) do
+            {:halt, true}
+          else
+            Process.sleep(100)
+            {:cont, false}
+          end
+        end)
+
+        on_exit(fn -> catch_exit(CNode.stop(pid)) end)
+        {:ok, pid: pid}
+      end
+
+      test "times every phase of completed requests", %{pid: pid} do
+        for i <- 1..5, do: assert({:ok, _} = CNode.execute(pid, "reduce in NAT : #{i} + 1 ."))
+
+        assert {:ok, stats} = CNode.stats(pid)
+
+        for phase <- ExMaude.Backend.CNode.Stats.phases() do
+          assert stats[phase].count >= 5
+          assert stats[phase].buckets |> Enum.map(&elem(&1, 1)) |> Enum.sum() == stats[phase].count
+        end
+
+        assert stats.bytes_in > 0
+        assert stats.bytes_out > 0
+        assert stats.maude_bytes_read > 0
+        assert stats.timeouts == 0
+      end
+
+      test "counts timed out requests", %{pid: pid} do
+        path = Path.join(System.tmp_dir!(), "test_cnode_stats_#{:rand.uniform(10000)}.maude")
+
+        File.write!(path, """
+        mod TEST-STATS-LOOP is
+          sort S .
+          op a : -> S .
+          rl [spin] : a => a .
+        endm
+        """)
+
+        on_exit(fn -> File.rm(path) end)
+        assert :ok = CNode.load_file(pid, path)
+
+        assert {:error, %ExMaude.Error{type: :timeout}} =
+                 CNode.execute(pid, "rewrite in TEST-STATS-LOOP : a .", timeout: 500)
+
+        assert {:ok, %{timeouts: 1}} = CNode.stats(pid)
+      end
+    end
+
+    describe "stream/3" do
+      setup do
+        {:ok, pid} = CNode.start_link([])
+
+        Enum.reduce_while(1..40, false, fn _i, _acc ->
+          if CNode.alive?(pid) do
+            {:halt, true}
+          else
+            Process.sleep(100)
+            {:cont, false}
+          end
+        end)
+
+        on_exit(fn -> catch_exit(CNode.stop(pid)) end)
+        {:ok, pid: pid}
+      end
+
+      test "streams output matching execute/3", %{pid: pid} do
+        command = "reduce in NAT : 2 + 5 ."
+        {:ok, output} = CNode.execute(pid, command)
+
+        assert pid |> CNode.stream(command) |> Enum.join() == output
+      end
+
+      test "splits search output on solutions", %{pid: pid} do
+        chunks =
+          pid
+          |> CNode.stream("search [3] in NAT : 0 =>* N:Nat .")
+          |> Enum.to_list()
+
+        assert Enum.any?(chunks, &(&1 =~ "Solution 1"))
+      end
+
+      test "worker stays usable after halting a stream early", %{pid: pid} do
+        pid |> CNode.stream("show module NAT .") |> Enum.take(1)
+
+        assert {:ok, result} = CNode.execute(pid, "reduce in NAT : 4 + 4 .")
+        assert result =~ "8"
+      end
+    end
+
     describe "load_file/2" do
       setup do
         {:ok, pid} = CNode.start_link([])
@@ -156,6 +328,54 @@ defmodule ExMaude.Backend.CNodeIntegrationTest do
         result = CNode.load_file(pid, "/nonexistent/file.maude")
         assert {:error, _} = result
       end
+
+      test "preloads modules into every instance" do
+        path = Path.join(System.tmp_dir!(), "test_cnode_pre_#{:rand.uniform(10000)}.maude")
+        File.write!(path, "fmod TEST-PRELOAD is sort Foo . op foo : -> Foo . endfm")
+        on_exit(fn -> File.rm(path) end)
+
+        {:ok, pid} = CNode.start_link(instances: 2, preload_modules: [path])
+
+        Enum.reduce_while(1..40, false, fn _i, _acc ->
+          if CNode.alive?(pid) do
+            {:halt, true}
+          else
+            Process.sleep(100)
+            {:cont, false}
+          end
+        end)
+
+        on_exit(fn -> catch_exit(CNode.stop(pid)) end)
+
+        commands = List.duplicate("reduce in TEST-PRELOAD : foo .", 4)
+        assert {:ok, results} = CNode.execute_batch(pid, commands)
+
+        for result <- results do
+          assert {:ok, output} = result
+          assert output =~ "foo"
+        end
+      end
+
+      test "keeps loaded modules after a command times out", %{pid: pid} do
+        path = Path.join(System.tmp_dir!(), "test_cnode_loop_#{:rand.uniform(10000)}.maude")
+
+        File.write!(path, """
+        mod TEST-LOOP is
+          sort S .
+          op a : -> S .
+          rl [spin] : a => a .
+        endm
+        """)
+
+        on_exit(fn -> File.rm(path) end)
+        assert :ok = CNode.load_file(pid, path)
+
+        assert {:error, %ExMaude.Error{type: :timeout}} =
+                 CNode.execute(pid, "rewrite in TEST-LOOP : a .", timeout: 500)
+
+        assert {:ok, result} = CNode.execute(pid, "reduce in TEST-LOOP : a .")
+        assert result =~ "a"
+      end
     end
 
     describe "alive?/1" do
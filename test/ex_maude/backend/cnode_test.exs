@@ -32,6 +32,10 @@ defmodule ExMaude.Backend.CNodeTest do
       assert function_exported?(CNode, :alive?, 1)
       assert function_exported?(CNode, :load_file, 2)
       assert function_exported?(CNode, :stop, 1)
+      assert function_exported?(CNode, :stream, 3)
+      assert function_exported?(CNode, :execute_batch, 3)
+      assert function_exported?(CNode, :execute_parsed, 3)
+      assert function_exported?(CNode, :stats, 1)
     end
 
     test "has correct struct fields" do
@@ -41,12 +45,40 @@ defmodule ExMaude.Backend.CNodeTest do
       assert Map.has_key?(state, :os_pid)
       assert Map.has_key?(state, :maude_path)
       assert Map.has_key?(state, :cookie)
+      assert Map.has_key?(state, :instances)
+      assert Map.has_key?(state, :queue)
+      assert Map.has_key?(state, :max_output)
+      assert Map.has_key?(state, :preload_modules)
+      assert Map.has_key?(state, :pending)
+      assert Map.has_key?(state, :health_ref)
+      assert Map.has_key?(state, :stats)
+      assert Map.has_key?(state, :transport)
+      assert Map.has_key?(state, :socket)
+      assert Map.has_key?(state, :streams)
+      assert Map.has_key?(state, :memory_limit)
+      assert Map.has_key?(state, :max_rss)
+      assert Map.has_key?(state, :cpu_affinity)
+      assert Map.has_key?(state, :modules)
       assert Map.has_key?(state, :connected)
     end
 
     test "struct has correct defaults" do
       state = %CNode{}
       assert state.cookie == ""
+      assert state.instances == 1
+      assert state.queue == 1024
+      assert state.max_output == 64 * 1024 * 1024
+      assert state.preload_modules == []
+      assert state.pending == %{}
+      assert state.health_ref == nil
+      assert state.stats == nil
+      assert state.transport == :distribution
+      assert state.socket == nil
+      assert state.streams == %{}
+      assert state.memory_limit == nil
+      assert state.max_rss == nil
+      assert state.cpu_affinity == nil
+      assert state.modules == %{}
       assert state.connected == false
     end
   end
@@ -61,6 +93,86 @@ defmodule ExMaude.Backend.CNodeTest do
       opts = [cookie: "secret_cookie"]
       assert Keyword.get(opts, :cookie) == "secret_cookie"
     end
+
+    test "accepts instances option" do
+      opts = [instances: 4]
+      assert Keyword.get(opts, :instances) == 4
+    end
+
+    test "accepts transport option" do
+      opts = [transport: :socket]
+      assert Keyword.get(opts, :transport) == :socket
+    end
+  end
+
+  describe "module loading" do
+    @source "fmod CACHED is sort S . endfm\n"
+
+    test "answers loads of unchanged sources without the bridge" do
+      state = %CNode{connected: true, modules: ExMaude.Backend.Modules.put(%{}, @source)}
+
+      assert {:reply, :ok, ^state} =
+               CNode.handle_call({:load_source, @source}, {self(), make_ref()}, state)
+    end
+
+    test "records a source once the bridge loaded it" do
+      ref = make_ref()
+      from = {self(), make_ref()}
+      timer = Process.send_after(self(), :unused, 60_000)
+      request = %{from: from, kind: :load_source, timer: timer, timeout: 1000, source: @source}
+      state = %CNode{connected: true, pending: %{ref => request}}
+
+      assert {:noreply, state} = CNode.handle_info({:ok, ref}, state)
+
+      {_pid, tag} = from
+      assert_received {^tag, :ok}
+      assert ExMaude.Backend.Modules.unchanged?(state.modules, @source)
+    end
+  end
+
+  describe "socket transport frames" do
+    setup do
+      socket = make_ref()
+      state = %CNode{transport: :socket, socket: socket, connected: true}
+      {:ok, socket: socket, state: state}
+    end
+
+    test "relays stream chunks to the consumer until the stream ends", context do
+      ref = make_ref()
+      state = %{context.state | streams: %{ref => {self(), Process.monitor(self())}}}
+
+      frame = :erlang.term_to_binary({:chunk, ref, "Solution 1\n"})
+      assert {:noreply, state} = CNode.handle_info({:tcp, context.socket, frame}, state)
+      assert_received {:chunk, ^ref, "Solution 1\n"}
+      assert Map.has_key?(state.streams, ref)
+
+      frame = :erlang.term_to_binary({:done, ref})
+      assert {:noreply, state} = CNode.handle_info({:tcp, context.socket, frame}, state)
+      assert_received {:done, ^ref}
+      assert state.streams == %{}
+    end
+
+    test "answers pending requests from decoded replies", context do
+      ref = make_ref()
+      from = {self(), make_ref()}
+      timer = Process.send_after(self(), :unused, 60_000)
+      request = %{from: from, kind: :execute, timer: timer, timeout: 1000}
+      state = %{context.state | pending: %{ref => request}}
+
+      frame = :erlang.term_to_binary({:ok, ref, "result Nat: 6"})
+      assert {:noreply, state} = CNode.handle_info({:tcp, context.socket, frame}, state)
+
+      {_pid, tag} = from
+      assert_received {^tag, {:ok, "result Nat: 6"}}
+      assert state.pending == %{}
+    end
+
+    test "stops the worker when the socket closes", context do
+      assert {:stop, :socket_closed, state} =
+               CNode.handle_info({:tcp_closed, context.socket}, context.state)
+
+      assert state.connected == false
+    end
   end
 
   describe "availability" do
@@ -111,6 +223,57 @@ defmodule ExMaude.Backend.CNodeTest do
     end
   end
 
+  describe "iodata commands" do
+    test "execute_batch/3 flattens each command" do
+      test_pid = self()
+
+      server =
+        spawn(fn ->
+          receive do
+            {:"$gen_call", from, request} ->
+              send(test_pid, {:request, request})
+              GenServer.reply(from, {:ok, []})
+          end
+        end)
+
+      assert {:ok, []} =
+               CNode.execute_batch(server, [["reduce in NAT : ", "1 ."], "reduce in NAT : 2 ."])
+
+      assert_received {:request,
+                       {:execute_batch, ["reduce in NAT : 1 .", "reduce in NAT : 2 ."], _timeout}}
+    end
+
+    test "stream/3 sends the command as one binary" do
+      {:ok, listen} = :gen_tcp.listen(0, [:binary, packet: 4, active: false])
+      {:ok, port} = :inet.port(listen)
+      {:ok, socket} = :gen_tcp.connect(~c"localhost", port, [:binary, packet: 4, active: false])
+      {:ok, bridge} = :gen_tcp.accept(listen)
+
+      server =
+        spawn(fn ->
+          receive do
+            {:"$gen_call", from, {:stream_target, _ref}} ->
+              GenServer.reply(from, {:ok, socket, 1_000})
+          end
+
+          Process.sleep(:infinity)
+        end)
+
+      consumer =
+        spawn(fn ->
+          server |> CNode.stream(["reduce in NAT : ", "1 ."], timeout: 5_000) |> Enum.take(1)
+        end)
+
+      assert {:ok, frame} = :gen_tcp.recv(bridge, 0, 1_000)
+
+      assert {:execute_stream, _ref, "reduce in NAT : 1 .", 5_000} =
+               :erlang.binary_to_term(frame)
+
+      Process.exit(consumer, :kill)
+      Process.exit(server, :kill)
+    end
+  end
+
   describe "load_file/2" do
     test "function exists with correct arity" do
       assert function_exported?(CNode, :load_file, 2)
@@ -0,0 +1,84 @@
+defmodule ExMaude.Backend.ModulesTest do
+  @moduledoc """
+  Tests for `ExMaude.Backend.Modules` - content-addressed module tables.
+  """
+
+  use ExUnit.Case, async: true
+
+  alias ExMaude.Backend.Modules
+
+  doctest ExMaude.Backend.Modules
+
+  @v1 """
+  fmod COUNTER is
+    protecting NAT .
+    op next : Nat -> Nat .
+    var N : Nat .
+    eq next(N) = N + 1 .
+  endfm
+  """
+
+  @v2 String.replace(@v1, "N + 1", "N + 2")
+
+  describe "names/1" do
+    test "finds every kind of declaration" do
+      source = """
+      fmod A is endfm
+        mod B{X :: TRIV} is endm
+      fth C is endfth
+      th D is endth
+      view E from TRIV to NAT is endv
+      """
+
+      assert Modules.names(source) == ["A", "B", "C", "D", "E"]
+    end
+
+    test "ignores keywords inside lines" do
+      assert Modules.names("red in NAT : 1 . --- see fmod FOO") == []
+    end
+  end
+
+  describe "unchanged?/2" do
+    test "is false for a new table" do
+      refute Modules.unchanged?(Modules.new(), @v1)
+    end
+
+    test "is true for the source loaded last" do
+      assert Modules.new() |> Modules.put(@v1) |> Modules.unchanged?(@v1)
+    end
+
+    test "reloads a rolled back version" do
+      table = Modules.new() |> Modules.put(@v1) |> Modules.put(@v2)
+
+      refute Modules.unchanged?(table, @v1)
+      assert Modules.unchanged?(table, @v2)
+    end
+
+    test "reloads when only some of the modules are current" do
+      table = Modules.put(Modules.new(), @v1)
+      refute Modules.unchanged?(table, @v1 <> "fmod OTHER is endfm\n")
+    end
+
+    test "always loads sources without declarations" do
+      source = "red in NAT : 1 + 1 ."
+      refute Modules.new() |> Modules.put(source) |> Modules.unchanged?(source)
+    end
+
+    test "always loads sources that load other files" do
+      source = "load base.maude\n" <> @v1
+      refute Modules.new() |> Modules.put(source) |> Modules.unchanged?(source)
+    end
+  end
+
+  describe "with_temp_file/2" do
+    test "passes a file with the source and removes it afterwards" do
+      path =
+        Modules.with_temp_file(@v1, fn path ->
+          assert File.read!(path) == @v1
+          path
+        end)
+
+      refute File.exists?(path)
+    end
+  end
+end
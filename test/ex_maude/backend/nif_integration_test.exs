@@ -39,6 +39,7 @@ defmodule ExMaude.Backend.NIFIntegrationTest do
         assert Map.has_key?(state, :maude_path)
         assert Map.has_key?(state, :initialized)
         assert state.initialized == false
+        assert state.pending == %{}
       end
     end
 
@@ -92,6 +93,20 @@ defmodule ExMaude.Backend.NIFIntegrationTest do
       test "handles timeout option", %{pid: pid} do
         assert {:ok, _} = NIF.execute(pid, "reduce in NAT : 1 + 1 .", timeout: 5000)
       end
+
+      test "keeps many commands in flight at once", %{pid: pid} do
+        results =
+          1..50
+          |> Task.async_stream(&NIF.execute(pid, "reduce in NAT : #{&1} + #{&1} ."),
+            max_concurrency: 50
+          )
+          |> Enum.map(fn {:ok, result} -> result end)
+
+        for {result, i} <- Enum.with_index(results, 1) do
+          assert {:ok, output} = result
+          assert output =~ "#{i * 2}"
+        end
+      end
     end
 
     describe "load_file/2" do
@@ -21,7 +21,7 @@ defmodule ExMaude.Backend.NIFTest do
   use ExUnit.Case, async: true
 
   alias ExMaude.Backend
-  alias ExMaude.Backend.NIF
+  alias ExMaude.Backend.{Modules, NIF}
 
   describe "module structure" do
     setup do
@@ -49,6 +49,12 @@ defmodule ExMaude.Backend.NIFTest do
       assert function_exported?(NIF, :load_file, 2)
       assert function_exported?(NIF, :stop, 1)
     end
+
+    test "native module queues commands asynchronously" do
+      Code.ensure_loaded!(NIF.Native)
+      assert function_exported?(NIF.Native, :execute_async, 3)
+      refute function_exported?(NIF.Native, :execute, 2)
+    end
   end
 
   describe "start_link/1" do
@@ -92,6 +98,71 @@ defmodule ExMaude.Backend.NIFTest do
     end
   end
 
+  describe "module loading" do
+    setup do
+      name = "ex_maude_nif_#{System.unique_integer([:positive])}.maude"
+      path = Path.join(System.tmp_dir!(), name)
+      File.write!(path, "fmod NIF-MOD is endfm")
+      on_exit(fn -> File.rm(path) end)
+      {:ok, path: path}
+    end
+
+    test "answers a load of unchanged modules without Maude", %{path: path} do
+      state = %NIF{initialized: true, modules: Modules.put(%{}, File.read!(path))}
+
+      assert {:reply, :ok, ^state} =
+               NIF.handle_call({:load_file, path}, {self(), make_ref()}, state)
+    end
+
+    test "records the modules of a completed load", %{path: path} do
+      ref = make_ref()
+      source = File.read!(path)
+      from = {self(), make_ref()}
+      state = %NIF{initialized: true, pending: %{ref => {{:load_file, source}, from, 30_000}}}
+
+      assert {:noreply, state} = NIF.handle_info({:maude_result, ref, {:ok, ""}}, state)
+      assert Modules.unchanged?(state.modules, source)
+    end
+
+    test "does not record a failed load", %{path: path} do
+      ref = make_ref()
+      source = File.read!(path)
+      pending = %{ref => {{:load_file, source}, {self(), ref}, 30_000}}
+      state = %NIF{initialized: true, pending: pending}
+
+      assert {:noreply, state} =
+               NIF.handle_info({:maude_result, ref, {:ok, "Error: no module"}}, state)
+
+      assert state.modules == %{}
+    end
+  end
+
+  describe "command timeouts" do
+    test "answers a timed-out command and stops once nothing is pending" do
+      [first, second] = [make_ref(), make_ref()]
+
+      state = %NIF{
+        initialized: true,
+        pending: %{
+          first => {:execute, {self(), first}, 100},
+          second => {:execute, {self(), second}, 100}
+        }
+      }
+
+      assert {:noreply, state} =
+               NIF.handle_info({:maude_result, first, {:error, "timeout"}}, state)
+
+      assert_received {^first, {:error, %ExMaude.Error{type: :timeout}}}
+      assert state.timed_out
+
+      assert {:stop, {:shutdown, :maude_timeout}, %{pending: pending}} =
+               NIF.handle_info({:maude_result, second, {:error, "maude exited"}}, state)
+
+      assert pending == %{}
+      assert_received {^second, {:error, %ExMaude.Error{type: :nif_error}}}
+    end
+  end
+
   describe "availability" do
     test "available? returns false (native not loaded)" do
       # Until the native Rustler module is implemented
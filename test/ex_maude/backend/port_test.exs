@@ -27,6 +27,69 @@ defmodule ExMaude.Backend.PortTest do
       assert Map.has_key?(state, :from)
       assert Map.has_key?(state, :timeout_ref)
       assert Map.has_key?(state, :maude_path)
+      assert Map.has_key?(state, :buffer_size)
+      assert Map.has_key?(state, :tail)
+      assert Map.has_key?(state, :parsed)
+      assert Map.has_key?(state, :modules)
+      assert Map.has_key?(state, :loading)
+    end
+  end
+
+  # Delivers output chunks the way the port would
+  defp feed(state, chunks) do
+    Enum.reduce(chunks, state, fn chunk, state ->
+      {:noreply, state} = Port.handle_info({state.port, {:data, chunk}}, state)
+      state
+    end)
+  end
+
+  describe "response assembly" do
+    setup do
+      tag = make_ref()
+      {:ok, state: %Port{port: make_ref(), from: {self(), tag}}, tag: tag}
+    end
+
+    test "completes at a prompt split across chunks", %{state: state, tag: tag} do
+      state = feed(state, ["result NzNat: 3\nMa", "ud", "e> "])
+
+      assert_received {^tag, {:ok, "3"}}
+      assert state.from == nil
+      assert state.buffer_size == 0
+    end
+
+    test "keeps only the prompt-sized tail while output grows", %{state: state, tag: tag} do
+      state = feed(state, List.duplicate("Solution 1 (state 0)\n", 1_000))
+
+      assert state.buffer_size == 21_000
+      assert byte_size(state.tail) == 5
+      refute_received {^tag, _}
+
+      feed(state, ["Maude> "])
+      assert_received {^tag, {:ok, output}}
+      assert byte_size(output) == 20_999
+    end
+
+    test "detects errors with the combined pattern", %{state: state, tag: tag} do
+      feed(state, ["Warning: <standard input>, line 1: no module FOO.\nMaude> "])
+      assert_received {^tag, {:error, _error}}
+    end
+
+    test "matches module errors case-insensitively", %{state: state, tag: tag} do
+      feed(state, ["Module FOO not found\nMaude> "])
+      assert_received {^tag, {:error, _error}}
+    end
+
+    test "keeps statistics on parsed results", %{state: state, tag: tag} do
+      state =
+        feed(%{state | parsed: true}, [
+          "rewrites: 1 in 2ms cpu (3ms real) (~ rewrites/second)\n",
+          "result NzNat: 3\nMaude> "
+        ])
+
+      assert_received {^tag, {:ok, %ExMaude.Result.Reduction{} = reduction}}
+      assert reduction.term.value == "3"
+      assert {reduction.rewrites, reduction.time_ms, reduction.real_ms} == {1, 2, 3}
+      refute state.parsed
     end
   end
 
@@ -76,10 +139,47 @@ defmodule ExMaude.Backend.PortTest do
     end
   end
 
+  describe "execute_parsed/3" do
+    test "function exists with correct arity" do
+      assert function_exported?(Port, :execute_parsed, 3)
+    end
+  end
+
   describe "load_file/2" do
     test "function exists with correct arity" do
       assert function_exported?(Port, :load_file, 2)
     end
+
+    @tag :tmp_dir
+    test "skips a file whose modules are loaded in this version", %{tmp_dir: tmp_dir} do
+      source = "fmod SKIPPED is sort S . endfm\n"
+      path = Path.join(tmp_dir, "skipped.maude")
+      File.write!(path, source)
+
+      state = %Port{port: make_ref(), modules: ExMaude.Backend.Modules.put(%{}, source)}
+
+      assert {:reply, {:ok, ""}, ^state} =
+               Port.handle_call({:load_file, path, 1_000}, {self(), make_ref()}, state)
+    end
+
+    test "records the source once the load succeeded" do
+      source = "fmod LOADED is sort S . endfm\n"
+      state = %Port{port: make_ref(), from: {self(), make_ref()}, loading: source}
+
+      state = feed(state, ["Maude> "])
+
+      assert state.loading == nil
+      assert ExMaude.Backend.Modules.unchanged?(state.modules, source)
+    end
+
+    test "does not record a load that failed" do
+      source = "fmod BROKEN is sort S endfm\n"
+      state = %Port{port: make_ref(), from: {self(), make_ref()}, loading: source}
+
+      state = feed(state, ["Warning: <standard input>, line 1: syntax error\nMaude> "])
+
+      assert state.modules == %{}
+    end
   end
 
   describe "stop/1" do
@@ -110,6 +210,33 @@ defmodule ExMaude.Backend.PortTest do
       Port.stop(pid)
     end
 
+    @tag :integration
+    @tag skip:
+           not File.regular?(Path.join(ExMaude.Binary.priv_dir(), "maude_pty")) &&
+             "priv/maude_pty not built"
+    test "executes through the PTY helper", %{maude_available: true} do
+      previous = Application.get_env(:ex_maude, :use_pty)
+      Application.put_env(:ex_maude, :use_pty, true)
+      on_exit(fn -> Application.put_env(:ex_maude, :use_pty, previous) end)
+
+      {:ok, pid} = Port.start_link([])
+
+      assert {:ok, "3"} = Port.execute(pid, "reduce in NAT : 1 + 2 .")
+      long_sum = Enum.map_join(1..2_000, " + ", &Integer.to_string/1)
+      assert {:ok, "2001000"} = Port.execute(pid, "reduce in NAT : #{long_sum} .")
+
+      Port.stop(pid)
+    end
+
+    @tag :integration
+    test "executes an iodata command", %{maude_available: true} do
+      {:ok, pid} = Port.start_link([])
+
+      assert {:ok, "6"} = Port.execute(pid, ["reduce in NAT : ", ["1 + 2", ?\s], "+ 3 ."])
+
+      Port.stop(pid)
+    end
+
     @tag :integration
     test "executes multiple commands sequentially", %{maude_available: true} do
       {:ok, pid} = Port.start_link([])
@@ -0,0 +1,118 @@
+defmodule ExMaude.CacheTest do
+  @moduledoc """
+  Tests for `ExMaude.Cache` - the opt-in result cache.
+  """
+
+  use ExUnit.Case, async: false
+
+  alias ExMaude.Cache
+
+  describe "without a running cache" do
+    test "enabled?/0 is false" do
+      refute Cache.enabled?()
+    end
+
+    test "fetch/2 always computes the result" do
+      assert {:ok, 1} = Cache.fetch({:reduce, "NAT", "0 + 1"}, fn -> {:ok, 1} end)
+      assert {:ok, 2} = Cache.fetch({:reduce, "NAT", "0 + 1"}, fn -> {:ok, 2} end)
+    end
+
+    test "invalidate/0, clear/0 and size/0 are no-ops" do
+      assert :ok = Cache.invalidate()
+      assert :ok = Cache.invalidate("fmod M is endfm")
+      assert :ok = Cache.clear()
+      assert Cache.size() == 0
+    end
+  end
+
+  describe "with a running cache" do
+    setup do
+      start_supervised!({Cache, max_entries: 3})
+      :ok
+    end
+
+    test "reuses successful results" do
+      key = {:reduce, "NAT", "1 + 2"}
+      assert {:ok, "3"} = Cache.fetch(key, fn -> {:ok, "3"} end)
+      assert {:ok, "3"} = Cache.fetch(key, fn -> flunk("computed twice") end)
+      assert Cache.size() == 1
+    end
+
+    test "does not store errors" do
+      key = {:parse, "NAT", "1 +"}
+      assert {:error, :bad} = Cache.fetch(key, fn -> {:error, :bad} end)
+      assert {:ok, "1"} = Cache.fetch(key, fn -> {:ok, "1"} end)
+    end
+
+    test "keys include operation and module" do
+      assert {:ok, :reduce} = Cache.fetch({:reduce, "NAT", "1"}, fn -> {:ok, :reduce} end)
+      assert {:ok, :parse} = Cache.fetch({:parse, "NAT", "1"}, fn -> {:ok, :parse} end)
+      assert {:ok, :int} = Cache.fetch({:reduce, "INT", "1"}, fn -> {:ok, :int} end)
+    end
+
+    test "invalidate/1 keeps results when the source is unchanged" do
+      key = {:reduce, "M", "t"}
+      source = "fmod M is endfm"
+
+      assert :ok = Cache.invalidate(source)
+      Cache.fetch(key, fn -> {:ok, :kept} end)
+
+      assert :ok = Cache.invalidate(source)
+      assert {:ok, :kept} = Cache.fetch(key, fn -> flunk("invalidated") end)
+
+      assert :ok = Cache.invalidate("fmod M is sort S . endfm")
+      assert Cache.size() == 0
+    end
+
+    test "invalidate/0 forgets the sources seen by invalidate/1" do
+      source = "fmod M is endfm"
+      Cache.invalidate(source)
+      Cache.invalidate()
+      Cache.fetch({:reduce, "M", "t"}, fn -> {:ok, :old} end)
+
+      assert :ok = Cache.invalidate(source)
+      assert Cache.size() == 0
+    end
+
+    test "invalidate/0 drops results of the old module set" do
+      key = {:reduce, "M", "t"}
+      Cache.fetch(key, fn -> {:ok, :old} end)
+
+      assert :ok = Cache.invalidate()
+      assert Cache.size() == 0
+      assert {:ok, :new} = Cache.fetch(key, fn -> {:ok, :new} end)
+    end
+
+    test "flushes once max_entries results are stored" do
+      for i <- 1..3, do: Cache.fetch({:reduce, "NAT", "#{i}"}, fn -> {:ok, i} end)
+      assert Cache.size() == 3
+
+      Cache.fetch({:reduce, "NAT", "4"}, fn -> {:ok, 4} end)
+      assert Cache.size() == 1
+    end
+
+    test "emits hit and miss telemetry" do
+      test_pid = self()
+      handler_id = "cache-test-#{inspect(make_ref())}"
+
+      :telemetry.attach_many(
+        handler_id,
+        [[:ex_maude, :cache, :hit], [:ex_maude, :cache, :miss]],
+        fn event, measurements, metadata, _ -> send(test_pid, {event, measurements, metadata}) end,
+        nil
+      )
+
+      on_exit(fn -> :telemetry.detach(handler_id) end)
+
+      key = {:reduce, "NAT", "5"}
+      Cache.fetch(key, fn -> {:ok, "5"} end)
+      Cache.fetch(key, fn -> {:ok, "5"} end)
+
+      assert_received {[:ex_maude, :cache, :miss], %{count: 1},
+                       %{operation: :reduce, module: "NAT"}}
+
+      assert_received {[:ex_maude, :cache, :hit], %{count: 1},
+                       %{operation: :reduce, module: "NAT"}}
+    end
+  end
+end
@@ -0,0 +1,205 @@
+defmodule ExMaude.ClusterTest do
+  @moduledoc """
+  Tests for `ExMaude.Cluster` - scheduling over the routers of all nodes.
+  """
+
+  use ExUnit.Case, async: false
+
+  import ExUnit.CaptureLog
+
+  alias ExMaude.{Cluster, Server}
+
+  defmodule FakeRouter do
+    @moduledoc false
+    # Answers like ExMaude.Router, and is its own worker
+    use GenServer
+
+    def start_link(opts), do: GenServer.start_link(__MODULE__, :ok, opts)
+
+    @impl GenServer
+    def init(:ok), do: {:ok, nil}
+
+    @impl GenServer
+    def handle_call({:route, _module, _timeout}, _from, state),
+      do: {:reply, {:ok, self()}, state}
+
+    def handle_call(:summary, _from, state),
+      do: {:reply, %{workers: 2, busy: 0, loaded: [], registered: ["LOCAL"]}, state}
+
+    def handle_call({:execute, command, _timeout}, _from, state),
+      do: {:reply, {:ok, "out:" <> command}, state}
+
+    @impl GenServer
+    def handle_cast({:release, _worker}, state), do: {:noreply, state}
+  end
+
+  defp peer(node, overrides) do
+    Map.merge(
+      %{
+        node: node,
+        router: {:router, node},
+        workers: 2,
+        busy: 0,
+        loaded: [],
+        registered: [],
+        seen: System.monotonic_time(:millisecond)
+      },
+      overrides
+    )
+  end
+
+  defp pick(peers, module) do
+    state = %Cluster{router: :router, peers: peers}
+    {:reply, pick, state} = Cluster.handle_call({:pick, module}, {self(), make_ref()}, state)
+    {pick, state}
+  end
+
+  describe "module functions" do
+    test "running?/1 is false without a member" do
+      refute Cluster.running?(:no_such_cluster)
+    end
+
+    test "pick/2 falls back to the local router without a member" do
+      assert %{node: node, router: ExMaude.Router} = Cluster.pick("NAT", :no_such_cluster)
+      assert node == node()
+    end
+  end
+
+  describe "pick" do
+    test "prefers a node with the module loaded over one with it registered" do
+      peers = %{
+        make_ref() => peer(:"a@host", %{registered: ["MOD"]}),
+        make_ref() => peer(:"b@host", %{loaded: ["MOD"], busy: 1})
+      }
+
+      assert {%{node: :"b@host", router: {:router, :"b@host"}}, _} = pick(peers, "MOD")
+    end
+
+    test "prefers a node with the module registered over any other" do
+      peers = %{
+        make_ref() => peer(:"a@host", %{}),
+        make_ref() => peer(:"b@host", %{registered: ["MOD"], busy: 3})
+      }
+
+      assert {%{node: :"b@host"}, _} = pick(peers, "MOD")
+    end
+
+    test "picks the fewest leases per worker within a tier" do
+      peers = %{
+        make_ref() => peer(:"a@host", %{workers: 2, busy: 2}),
+        make_ref() => peer(:"b@host", %{workers: 8, busy: 4})
+      }
+
+      assert {%{node: :"b@host"}, _} = pick(peers, "NAT")
+    end
+
+    test "prefers the local node on a tie" do
+      peers = %{
+        make_ref() => peer(:"a@host", %{}),
+        make_ref() => peer(node(), %{router: {:router, node()}})
+      }
+
+      assert {%{node: node, local: {:router, local}}, _} = pick(peers, "NAT")
+      assert node == node()
+      assert local == node()
+    end
+
+    test "counts its picks against the chosen node" do
+      peers = %{
+        make_ref() => peer(:"a@host", %{workers: 1}),
+        make_ref() => peer(:"b@host", %{workers: 1})
+      }
+
+      {%{node: first}, state} = pick(peers, "NAT")
+      {%{node: second}, _} = pick(state.peers, "NAT")
+      assert first != second
+    end
+
+    test "skips nodes without workers" do
+      peers = %{make_ref() => peer(:"a@host", %{workers: 0, loaded: ["MOD"]})}
+
+      assert {%{node: node, router: {:router, _}}, _} = pick(peers, "MOD")
+      assert node == node()
+    end
+  end
+
+  describe "scheduling" do
+    setup do
+      router = start_supervised!({FakeRouter, name: :cluster_test_router})
+
+      opts = [
+        name: :cluster_test,
+        router: :cluster_test_router,
+        scope: :cluster_test_scope,
+        interval: 60_000
+      ]
+
+      cluster = start_supervised!({Cluster, opts})
+
+      {:ok, router: router, cluster: cluster}
+    end
+
+    test "reports its own router", %{router: router} do
+      assert %{node: node, router: {:cluster_test_router, node}, local: local} =
+               Cluster.pick("LOCAL", :cluster_test)
+
+      assert local == {:cluster_test_router, node}
+      assert GenServer.whereis({:cluster_test_router, node}) == router
+    end
+
+    test "drops a report of a member that left the group" do
+      send(:cluster_test, {:report, spawn(fn -> :ok end), peer(:"gone@host", %{loaded: ["MOD"]})})
+      send(:cluster_test, :report)
+
+      assert %{node: node} = Cluster.pick("MOD", :cluster_test)
+      assert node == node()
+    end
+
+    test "runs a transaction on the local router" do
+      assert {:ok, "out:cmd"} =
+               Cluster.transaction("LOCAL", &Server.execute(&1, "cmd"), cluster: :cluster_test)
+    end
+
+    test "falls back to the local router when the picked node is unreachable", %{
+      cluster: cluster
+    } do
+      ghost = :"ghost@nowhere"
+
+      :sys.replace_state(cluster, fn state ->
+        %{state | peers: Map.put(state.peers, make_ref(), peer(ghost, %{loaded: ["MOD"]}))}
+      end)
+
+      log =
+        capture_log(fn ->
+          assert {:ok, "out:cmd"} =
+                   Cluster.transaction("MOD", &Server.execute(&1, "cmd"), cluster: :cluster_test)
+        end)
+
+      assert log =~ "ghost@nowhere unreachable"
+    end
+
+    test "returns an exit of a remote command without running it locally", %{
+      cluster: cluster
+    } do
+      remote = peer(:"other@host", %{router: {:cluster_test_router, node()}, loaded: ["MOD"]})
+      :sys.replace_state(cluster, &%{&1 | peers: Map.put(&1.peers, make_ref(), remote)})
+      test_pid = self()
+
+      run = fn _worker ->
+        send(test_pid, :ran)
+        exit({:nodedown, :"other@host"})
+      end
+
+      assert {:error, %ExMaude.Error{type: :pool_error}} =
+               Cluster.transaction("MOD", run, cluster: :cluster_test)
+
+      assert_received :ran
+      refute_received :ran
+    end
+
+    test "streams from the picked node" do
+      assert ["out:cmd"] =
+               "LOCAL" |> Cluster.stream("cmd", cluster: :cluster_test) |> Enum.to_list()
+    end
+  end
+end
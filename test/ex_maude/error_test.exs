@@ -97,6 +97,20 @@ defmodule ExMaude.ErrorTest do
     end
   end
 
+  describe "output_too_large/1" do
+    test "creates output limit error with byte count" do
+      error = Error.output_too_large(1024)
+
+      assert error.type == :output_too_large
+      assert String.contains?(error.message, "1024")
+      assert error.details == %{limit_bytes: 1024}
+    end
+
+    test "is not recoverable" do
+      refute Error.recoverable?(Error.output_too_large(1024))
+    end
+  end
+
   describe "crash/1" do
     test "creates crash error with exit code" do
       error = Error.crash(137)
@@ -43,6 +43,42 @@ defmodule ExMaude.IoT.EncoderTest do
     end
   end
 
+  describe "encode_rules_iodata/1" do
+    test "encodes empty list" do
+      assert {:ok, "empty"} = Encoder.encode_rules_iodata([])
+    end
+
+    test "matches encode_rules/1" do
+      rules = [
+        %{
+          id: "r1",
+          thing_id: "d1",
+          trigger: {:and, {:prop_gt, "temp", 80}, {:not, {:env_eq, "mode", :away}}},
+          actions: [{:set_prop, "d2", "state", "on"}, {:invoke, "d3", "beep"}],
+          priority: 2
+        },
+        %{id: "r2", thing_id: "d2", trigger: {:always}, actions: []}
+      ]
+
+      {:ok, iodata} = Encoder.encode_rules_iodata(rules)
+      assert {:ok, IO.iodata_to_binary(iodata)} == Encoder.encode_rules(rules)
+
+      assert IO.iodata_to_binary(iodata) ==
+               Enum.map_join(rules, ", ", &Encoder.encode_rule/1)
+    end
+
+    test "reuses the fragment of an unchanged rule" do
+      rule = %{id: "cached", thing_id: "d1", trigger: {:always}, actions: [], priority: 1}
+
+      {:ok, [first]} = Encoder.encode_rules_iodata([rule])
+      {:ok, [second]} = Encoder.encode_rules_iodata([rule])
+      assert first == second
+
+      {:ok, [changed]} = Encoder.encode_rules_iodata([%{rule | priority: 2}])
+      assert changed =~ ", 2)"
+    end
+  end
+
   describe "encode_rule/1" do
     test "encodes rule with all fields" do
       rule = %{
@@ -0,0 +1,55 @@
+defmodule ExMaude.IoT.FragmentsTest do
+  @moduledoc """
+  Tests for `ExMaude.IoT.Fragments` - the cache of encoded IoT rules.
+  """
+
+  use ExUnit.Case, async: false
+
+  alias ExMaude.IoT.Fragments
+
+  # The application starts the table; these tests run their own
+  setup do
+    _ = Supervisor.terminate_child(ExMaude.Supervisor, Fragments)
+    on_exit(fn -> Supervisor.restart_child(ExMaude.Supervisor, Fragments) end)
+    :ok
+  end
+
+  describe "without a running table" do
+    test "fetch/2 always encodes" do
+      refute Fragments.enabled?()
+      assert "a" = Fragments.fetch(:rule, fn -> "a" end)
+      assert "b" = Fragments.fetch(:rule, fn -> "b" end)
+    end
+
+    test "clear/0 and size/0 are no-ops" do
+      assert :ok = Fragments.clear()
+      assert Fragments.size() == 0
+    end
+  end
+
+  describe "with a running table" do
+    setup do
+      start_supervised!({Fragments, max_entries: 2})
+      :ok
+    end
+
+    test "reuses a stored fragment" do
+      assert "rule(1)" = Fragments.fetch({"r1", 1}, fn -> "rule(1)" end)
+      assert "rule(1)" = Fragments.fetch({"r1", 1}, fn -> flunk("encoded twice") end)
+      assert Fragments.size() == 1
+    end
+
+    test "flushes once max_entries fragments are stored" do
+      for n <- 1..3, do: Fragments.fetch(n, fn -> "rule(#{n})" end)
+
+      assert Fragments.size() == 1
+      assert "rule(3)" = Fragments.fetch(3, fn -> flunk("encoded twice") end)
+    end
+
+    test "clear/0 removes every fragment" do
+      Fragments.fetch(:r, fn -> "rule" end)
+      assert :ok = Fragments.clear()
+      assert Fragments.size() == 0
+    end
+  end
+end
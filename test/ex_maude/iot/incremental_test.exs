@@ -0,0 +1,138 @@
+defmodule ExMaude.IoT.IncrementalTest do
+  @moduledoc """
+  Tests for `ExMaude.IoT.Incremental` - incremental conflict detection.
+  """
+
+  use ExMaude.MaudeCase
+
+  alias ExMaude.IoT
+  alias ExMaude.IoT.Incremental
+
+  doctest ExMaude.IoT.Incremental
+
+  defp rule(id, thing_id, trigger, actions) do
+    %{id: id, thing_id: thing_id, trigger: trigger, actions: actions, priority: 1}
+  end
+
+  describe "keys/1" do
+    test "indexes env actions and env triggers" do
+      window = rule("r", "w", {:env_eq, "co2", "high"}, [{:set_env, "window", "open"}])
+
+      assert Incremental.keys(window) == [
+               {:env, "window"},
+               {:writes_env, "window"},
+               {:reads_env, "co2"}
+             ]
+    end
+
+    test "ignores invokes and compound triggers" do
+      trigger = {:and, {:prop_eq, "a", 1}, {:prop_eq, "b", 2}}
+      assert Incremental.keys(rule("r", "t", trigger, [{:invoke, "t", "beep"}])) == []
+    end
+  end
+
+  # Rules without neighbours are never sent to Maude
+  describe "without candidate rules" do
+    test "adds unrelated rules without checking them" do
+      rules = [
+        rule("a", "light-1", {:always}, [{:set_prop, "light-1", "state", "on"}]),
+        rule("b", "light-2", {:always}, [{:set_prop, "light-2", "state", "off"}]),
+        rule("c", "alarm", {:always}, [{:invoke, "alarm", "beep"}])
+      ]
+
+      assert {:ok, detector} = Incremental.put_rules(Incremental.new(), rules)
+
+      ids = detector |> Incremental.rules() |> Enum.map(& &1.id) |> Enum.sort()
+      assert ids == ["a", "b", "c"]
+      assert Incremental.conflicts(detector) == []
+    end
+
+    test "delete_rule/2 removes the rule from the index" do
+      {:ok, detector} =
+        Incremental.put_rule(
+          Incremental.new(),
+          rule("a", "light-1", {:always}, [{:set_prop, "light-1", "state", "on"}])
+        )
+
+      detector = Incremental.delete_rule(detector, "a")
+
+      assert detector.rules == %{}
+      assert detector.index == %{}
+      assert Incremental.delete_rule(detector, "missing") == detector
+    end
+  end
+
+  describe "with Maude" do
+    @describetag :integration
+
+    test "finds a state conflict with an existing rule", %{maude_available: true} do
+      {:ok, detector} =
+        Incremental.put_rule(
+          Incremental.new(),
+          rule("motion-light", "light-1", {:prop_eq, "motion", true}, [
+            {:set_prop, "light-1", "state", "on"}
+          ])
+        )
+
+      night =
+        rule("night-mode", "light-1", {:prop_gt, "time", 2300}, [
+          {:set_prop, "light-1", "state", "off"}
+        ])
+
+      {:ok, detector} = Incremental.put_rule(detector, night)
+
+      assert [%{type: :state_conflict}] = Incremental.conflicts_for(detector, "night-mode")
+      assert [%{type: :state_conflict}] = Incremental.conflicts_for(detector, "motion-light")
+    end
+
+    test "finds cascades in both directions", %{maude_available: true} do
+      door =
+        rule("door-light", "light-1", {:prop_eq, "door", "open"}, [
+          {:set_prop, "light-1", "state", "on"}
+        ])
+
+      sound =
+        rule("light-sound", "speaker", {:prop_eq, "state", "on"}, [{:invoke, "speaker", "play"}])
+
+      for rules <- [[door, sound], [sound, door]] do
+        {:ok, detector} = Incremental.put_rules(Incremental.new(), rules)
+
+        assert [%{type: :state_cascade, rule1: "door-light", rule2: "light-sound"}] =
+                 Incremental.conflicts(detector)
+      end
+    end
+
+    test "drops conflicts of a changed rule", %{maude_available: true} do
+      on = rule("on", "light-1", {:always}, [{:set_prop, "light-1", "state", "on"}])
+      off = rule("off", "light-1", {:always}, [{:set_prop, "light-1", "state", "off"}])
+
+      {:ok, detector} = Incremental.put_rules(Incremental.new(), [on, off])
+      assert [_conflict] = Incremental.conflicts(detector)
+
+      changed = %{off | actions: [{:set_prop, "light-1", "state", "on"}]}
+      {:ok, detector} = Incremental.put_rule(detector, changed)
+      assert Incremental.conflicts(detector) == []
+    end
+
+    test "agrees with detect_conflicts/2 on state and env conflicts", %{maude_available: true} do
+      rules =
+        for n <- 1..12 do
+          rule("r#{n}", "thing-#{rem(n, 3)}", {:always}, [
+            {:set_prop, "thing-#{rem(n, 3)}", "state", rem(n, 2)},
+            {:set_env, "mode-#{rem(n, 4)}", rem(n, 3)}
+          ])
+        end
+
+      {:ok, full} = IoT.detect_conflicts(rules)
+      {:ok, detector} = Incremental.put_rules(Incremental.new(), rules)
+
+      pairs = fn conflicts ->
+        conflicts
+        |> Enum.filter(&(&1.type in [:state_conflict, :env_conflict]))
+        |> MapSet.new(&{&1.type, Enum.sort([&1.rule1, &1.rule2])})
+      end
+
+      assert pairs.(Incremental.conflicts(detector)) == pairs.(full)
+    end
+  end
+end
@@ -0,0 +1,98 @@
+defmodule ExMaude.IoT.PartitionTest do
+  @moduledoc """
+  Tests for `ExMaude.IoT.Partition` - independent rule groups.
+  """
+
+  use ExUnit.Case, async: true
+
+  alias ExMaude.IoT.Partition
+
+  doctest ExMaude.IoT.Partition
+
+  defp rule(id, thing_id, trigger, actions) do
+    %{id: id, thing_id: thing_id, trigger: trigger, actions: actions, priority: 1}
+  end
+
+  defp ids(groups), do: Enum.map(groups, fn group -> Enum.map(group, & &1.id) end)
+
+  describe "groups/2 for :state" do
+    test "groups rules writing the same property of the same thing" do
+      rules = [
+        rule("a", "l1", {:always}, [{:set_prop, "l1", "state", "on"}]),
+        rule("b", "l2", {:always}, [{:set_prop, "l2", "state", "on"}]),
+        rule("c", "l1", {:always}, [{:set_prop, "l1", "state", "off"}]),
+        rule("d", "l2", {:always}, [{:set_prop, "l2", "state", "off"}])
+      ]
+
+      assert rules |> Partition.groups(:state) |> ids() == [["a", "c"], ["b", "d"]]
+    end
+
+    test "separates rules of different things writing the same target" do
+      rules = [
+        rule("a", "l1", {:always}, [{:set_prop, "lamp", "state", "on"}]),
+        rule("b", "l2", {:always}, [{:set_prop, "lamp", "state", "off"}])
+      ]
+
+      assert Partition.groups(rules, :state) == []
+    end
+
+    test "groups rules of one thing writing the same environment property" do
+      rules = [
+        rule("a", "t1", {:always}, [{:set_env, "temp", 20}]),
+        rule("b", "t2", {:always}, [{:set_env, "temp", 25}]),
+        rule("c", "t1", {:always}, [{:set_env, "temp", 30}])
+      ]
+
+      assert rules |> Partition.groups(:state) |> ids() == [["a", "c"]]
+    end
+
+    test "joins groups through a rule touching both" do
+      rules = [
+        rule("a", "t", {:always}, [{:set_prop, "t", "x", 1}]),
+        rule("b", "t", {:always}, [{:set_prop, "t", "y", 1}]),
+        rule("c", "t", {:always}, [{:set_prop, "t", "x", 2}, {:set_prop, "t", "y", 2}])
+      ]
+
+      assert rules |> Partition.groups(:state) |> ids() == [["a", "b", "c"]]
+    end
+  end
+
+  describe "groups/2 for :env" do
+    test "groups rules writing the same environment property" do
+      rules = [
+        rule("a", "w1", {:always}, [{:set_env, "window", "open"}]),
+        rule("b", "w2", {:always}, [{:set_env, "noise", "low"}]),
+        rule("c", "w3", {:always}, [{:set_env, "window", "closed"}])
+      ]
+
+      assert rules |> Partition.groups(:env) |> ids() == [["a", "c"]]
+    end
+  end
+
+  describe "groups/2 for :cascade" do
+    test "groups writers with rules triggered by the property" do
+      rules = [
+        rule("door", "l1", {:prop_eq, "door", "open"}, [{:set_prop, "l1", "state", "on"}]),
+        rule("other", "x", {:always}, [{:set_prop, "x", "level", 1}]),
+        rule("sound", "s1", {:prop_eq, "state", "on"}, [{:invoke, "s1", "play"}]),
+        rule("co2", "w1", {:env_eq, "window", "closed"}, []),
+        rule("ac", "a1", {:always}, [{:set_env, "window", "closed"}])
+      ]
+
+      assert rules |> Partition.groups(:cascade) |> ids() == [["door", "sound"], ["co2", "ac"]]
+    end
+
+    test "ignores compound triggers" do
+      rules = [
+        rule("a", "l1", {:always}, [{:set_prop, "l1", "state", "on"}]),
+        rule("b", "l2", {:and, {:prop_eq, "state", "on"}, {:always}}, [])
+      ]
+
+      assert Partition.groups(rules, :cascade) == []
+    end
+  end
+
+  test "returns no groups for an empty rule set" do
+    assert Partition.groups([], :state) == []
+  end
+end
@@ -278,6 +278,28 @@ defmodule ExMaude.IoTTest do
       {:ok, conflicts} = IoT.detect_conflicts([])
       assert conflicts == []
     end
+
+    test "finds the conflicts of every independent group", %{maude_available: true} do
+      rules =
+        for n <- 1..8, value <- ["on", "off"] do
+          %{
+            id: "light-#{n}-#{value}",
+            thing_id: "light-#{n}",
+            trigger: {:always},
+            actions: [{:set_prop, "light-#{n}", "state", value}],
+            priority: 1
+          }
+        end
+
+      {:ok, conflicts} = IoT.detect_conflicts(rules, max_concurrency: 4)
+
+      things =
+        conflicts
+        |> Enum.filter(&(&1.type == :state_conflict))
+        |> Enum.map(&(&1.rule1 |> String.split("-") |> Enum.take(2) |> Enum.join("-")))
+
+      assert Enum.sort(Enum.uniq(things)) == Enum.map(1..8, &"light-#{&1}")
+    end
   end
 
   describe "detect_state_conflicts/2 integration" do
@@ -50,6 +50,22 @@ defmodule ExMaude.MaudeTest do
     test "list_modules/1 is exported" do
       assert function_exported?(Maude, :list_modules, 1)
     end
+
+    test "stream/2 is exported" do
+      assert function_exported?(Maude, :stream, 2)
+    end
+
+    test "execute_batch/2 is exported" do
+      assert function_exported?(Maude, :execute_batch, 2)
+    end
+
+    test "execute_parsed/2 is exported" do
+      assert function_exported?(Maude, :execute_parsed, 2)
+    end
+
+    test "search_stream/4 is exported" do
+      assert function_exported?(Maude, :search_stream, 4)
+    end
   end
 
   describe "load_file/1 validation" do
@@ -240,6 +256,28 @@ defmodule ExMaude.MaudeTest do
     end
   end
 
+  describe "stream/2 integration" do
+    @tag :integration
+    test "streams raw command output", %{maude_available: true} do
+      output = "reduce in NAT : 3 + 3 ." |> Maude.stream() |> Enum.join()
+      assert output =~ "6"
+    end
+  end
+
+  describe "execute_batch/2 integration" do
+    @tag :integration
+    test "returns results in command order", %{maude_available: true} do
+      commands = for i <- 1..5, do: "reduce in NAT : #{i} * 10 ."
+      {:ok, results} = Maude.execute_batch(commands)
+
+      for {{:ok, output}, i} <- Enum.with_index(results, 1) do
+        assert output =~ "#{i * 10}"
+      end
+
+      assert length(results) == 5
+    end
+  end
+
   describe "version/0 integration" do
     @tag :integration
     test "returns version info", %{maude_available: true} do
@@ -0,0 +1,143 @@
+defmodule ExMaude.Parser.SearchStreamTest do
+  @moduledoc """
+  Tests for `ExMaude.Parser.SearchStream` - incremental search output parsing.
+  """
+
+  use ExUnit.Case, async: true
+
+  alias ExMaude.Parser
+  alias ExMaude.Parser.SearchStream
+  alias ExMaude.Result.Solution
+
+  doctest ExMaude.Parser.SearchStream
+
+  @output """
+  search [3, 100] in MY-MOD : init =>* S:State .
+
+  Solution 1 (state 5)
+  states: 6  rewrites: 10 in 2ms cpu (3ms real) (~ rewrites/second)
+  S:State --> active
+
+  Solution 2 (state 8)
+  states: 9  rewrites: 14 in 3ms cpu (4ms real) (~ rewrites/second)
+  S:State --> inactive
+  N:Nat --> 2
+
+  Solution 3 (state 11)
+  states: 12  rewrites: 20 in 4ms cpu (5ms real) (~ rewrites/second)
+  empty substitution
+
+  No more solutions.
+  states: 12  rewrites: 20 in 4ms cpu (5ms real) (~ rewrites/second)
+  """
+
+  defp chunks(output, size) do
+    for <<chunk::binary-size(size) <- output>>, do: chunk
+  end
+
+  defp feed_all(chunks, opts \\ []) do
+    {solutions, state} =
+      Enum.reduce(chunks, {[], SearchStream.new(opts)}, fn chunk, {acc, state} ->
+        {_, solutions, state} = SearchStream.feed(state, chunk)
+        {acc ++ solutions, state}
+      end)
+
+    {rest, state} = SearchStream.finish(state)
+    {solutions ++ rest, state}
+  end
+
+  describe "feed/2" do
+    test "matches parse_search_results/1 for any chunking" do
+      expected = Parser.parse_search_results(@output)
+
+      for size <- [1, 2, 7, 64, byte_size(@output)] do
+        padded = @output <> String.duplicate(" ", size - rem(byte_size(@output), size))
+        {solutions, _state} = padded |> chunks(size) |> feed_all()
+
+        assert Enum.map(solutions, &{&1.number, &1.state_num, &1.substitution}) ==
+                 Enum.map(expected, &{&1.solution, &1.state_num, &1.substitution})
+      end
+    end
+
+    test "emits a solution once its block ends" do
+      state = SearchStream.new()
+
+      {:cont, [], state} = SearchStream.feed(state, "Solution 1 (state 5)\nS:State --> active\n")
+      {:cont, [%Solution{number: 1}], _state} = SearchStream.feed(state, "\n")
+    end
+
+    test "keeps only the unfinished line between chunks" do
+      {:cont, [_ | _], state} = SearchStream.feed(SearchStream.new(), @output <> "Solution 4")
+
+      assert state.rest == "Solution 4"
+    end
+
+    test "accepts iodata" do
+      {:cont, [solution], _state} =
+        SearchStream.feed(SearchStream.new(), ["Solution 1\n", ["X:Nat --> 1\n", "\n"]])
+
+      assert solution.substitution == %{"X:Nat" => "1"}
+    end
+
+    test "records the latest statistics" do
+      {_solutions, state} = feed_all([@output])
+
+      assert SearchStream.stats(state) == %{states: 12, rewrites: 20, time_ms: 4, real_ms: 5}
+    end
+
+    test "returns no solutions for a failed search" do
+      assert {[], _state} = feed_all(["No solution.\nstates: 1  rewrites: 0\n"])
+    end
+  end
+
+  describe ":limit" do
+    test "halts once the limit is reached" do
+      assert {:halt, [first, second], state} =
+               SearchStream.feed(SearchStream.new(limit: 2), @output)
+
+      assert {first.number, second.number} == {1, 2}
+      assert {:halt, [], ^state} = SearchStream.feed(state, "Solution 9\n\n")
+      assert {[], ^state} = SearchStream.finish(state)
+    end
+
+    test "applies to finish/1" do
+      {solutions, _state} = feed_all(["Solution 1\nX:Nat --> 1\n\nSolution 2"], limit: 1)
+
+      assert [%Solution{number: 1}] = solutions
+    end
+  end
+
+  describe "stream/2" do
+    test "parses a stream of chunks lazily" do
+      assert @output |> chunks(1) |> SearchStream.stream() |> Enum.count() == 3
+    end
+
+    test "stops reading chunks after the limit" do
+      parent = self()
+
+      chunks =
+        @output
+        |> String.split("\n", trim: false)
+        |> Stream.map(&(&1 <> "\n"))
+        |> Stream.each(fn line -> send(parent, {:read, line}) end)
+
+      assert [%Solution{number: 1}] = chunks |> SearchStream.stream(limit: 1) |> Enum.to_list()
+
+      refute_received {:read, "Solution 2 (state 8)\n"}
+    end
+
+    test "runs the chunk stream's cleanup when halted early" do
+      parent = self()
+
+      chunks =
+        Stream.resource(
+          fn -> 1 end,
+          fn n -> {["Solution #{n}\nX:Nat --> #{n}\n\n"], n + 1} end,
+          fn _ -> send(parent, :closed) end
+        )
+
+      assert chunks |> SearchStream.stream(limit: 3) |> Enum.map(& &1.number) == [1, 2, 3]
+      assert_received :closed
+    end
+  end
+end
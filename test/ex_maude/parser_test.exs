@@ -657,4 +657,95 @@ fmod NAT"
       assert values == ["1", "2", "3"]
     end
   end
+
+  describe "tokenize/1" do
+    test "splits a reduction into sort, term and statistics" do
+      output = """
+      reduce in NAT : 1 + 2 .
+      rewrites: 1 in 0ms cpu (0ms real) (~ rewrites/second)
+      result NzNat: 3
+      """
+
+      assert Parser.tokenize(output) ==
+               {:result, "NzNat", "3", %{rewrites: 1, time_ms: 0, real_ms: 0}}
+    end
+
+    test "splits search output into solutions with the final statistics" do
+      output = """
+      Solution 1 (state 5)
+      states: 6  rewrites: 10 in 2ms cpu (3ms real)
+      S:State --> active
+
+      No more solutions.
+      states: 12  rewrites: 20 in 4ms cpu (5ms real)
+      """
+
+      assert {:search, [{1, 5, [{"S:State", "active"}]}], stats} = Parser.tokenize(output)
+      assert stats == %{states: 12, rewrites: 20, time_ms: 4, real_ms: 5}
+    end
+
+    test "treats a search without solutions as a search" do
+      assert {:search, [], %{states: 1}} = Parser.tokenize("No solution.\nstates: 1  rewrites: 0")
+    end
+
+    test "keeps errors and other output as text" do
+      output = "Warning: <standard input>, line 1: no parse for term.\nresult Nat: 1"
+      assert Parser.tokenize(output) == {:text, output}
+      assert Parser.tokenize("fmod NAT") == {:text, "fmod NAT"}
+    end
+  end
+
+  describe "parse_stats/1" do
+    test "reads rewrites, cpu and real time of a reduction" do
+      output = """
+      reduce in NAT : 1 + 2 .
+      rewrites: 1 in 3ms cpu (7ms real) (333 rewrites/second)
+      result NzNat: 3
+      """
+
+      assert Parser.parse_stats(output) == %{rewrites: 1, time_ms: 3, real_ms: 7}
+    end
+
+    test "uses the last statistics line of a search" do
+      output = """
+      Solution 1 (state 5)
+      states: 6  rewrites: 10 in 2ms cpu (3ms real)
+      S:State --> active
+
+      No more solutions.
+      states: 12  rewrites: 20 in 4ms cpu (5ms real)
+      """
+
+      assert Parser.parse_stats(output) == %{states: 12, rewrites: 20, time_ms: 4, real_ms: 5}
+    end
+
+    test "leaves out what Maude did not report" do
+      assert Parser.parse_stats("rewrites: 0 in 0ms cpu\nresult Nat: 0") ==
+               %{rewrites: 0, time_ms: 0}
+
+      assert Parser.parse_stats("fmod NAT") == %{}
+    end
+  end
+
+  describe "to_result/1" do
+    test "builds a reduction" do
+      result = Parser.to_result({:result, "NzNat", "3", %{rewrites: 1, time_ms: 0, real_ms: 2}})
+
+      assert %ExMaude.Result.Reduction{rewrites: 1, time_ms: 0, real_ms: 2} = result
+      assert result.term.value == "3"
+      assert result.term.sort == "NzNat"
+    end
+
+    test "builds a search" do
+      result = Parser.to_result({:search, [{1, :undefined, [{"X:Nat", "1"}]}], %{states: 4}})
+
+      assert %ExMaude.Result.Search{states_explored: 4, time_ms: nil} = result
+      assert [%ExMaude.Result.Solution{number: 1, state_num: nil} = solution] = result.solutions
+      assert solution.substitution == %{"X:Nat" => "1"}
+    end
+
+    test "returns text unchanged" do
+      assert Parser.to_result({:text, "fmod NAT"}) == "fmod NAT"
+    end
+  end
 end
@@ -0,0 +1,113 @@
+defmodule ExMaude.Pool.AutoscalerTest do
+  @moduledoc """
+  Tests for `ExMaude.Pool.Autoscaler` - load-driven pool shards.
+  """
+
+  use ExUnit.Case, async: false
+
+  alias ExMaude.Pool.Autoscaler
+
+  doctest ExMaude.Pool.Autoscaler
+
+  @config [max_workers: 8, step: 2, slow_ratio: 0.1]
+
+  defp sample(overrides) do
+    Map.merge(%{checkouts: 100, slow: 0, in_use: 4, size: 4, base_size: 4}, Map.new(overrides))
+  end
+
+  describe "decide/2" do
+    test "grows when too many checkouts waited" do
+      assert Autoscaler.decide(sample(slow: 11), @config) == :up
+    end
+
+    test "holds when few checkouts waited" do
+      assert Autoscaler.decide(sample(slow: 10), @config) == :hold
+    end
+
+    test "holds without checkouts" do
+      assert Autoscaler.decide(sample(checkouts: 0, slow: 0, in_use: 4), @config) == :hold
+    end
+
+    test "does not grow past max_workers" do
+      assert Autoscaler.decide(sample(slow: 50, size: 8), @config) == :hold
+      assert Autoscaler.decide(sample(slow: 50, size: 7), @config) == :hold
+      assert Autoscaler.decide(sample(slow: 50, size: 6), @config) == :up
+    end
+
+    test "shrinks when a shard's worth of workers is unused" do
+      assert Autoscaler.decide(sample(size: 6, in_use: 4), @config) == :down
+      assert Autoscaler.decide(sample(size: 6, in_use: 5), @config) == :hold
+    end
+
+    test "never shrinks below the base pool" do
+      assert Autoscaler.decide(sample(size: 4, in_use: 0), @config) == :hold
+    end
+
+    test "does not shrink while checkouts are slow" do
+      assert Autoscaler.decide(sample(size: 6, in_use: 0, slow: 1), @config) == :hold
+    end
+
+    test "uses defaults for missing settings" do
+      assert Autoscaler.decide(sample(slow: 50), []) == :up
+    end
+  end
+
+  describe "without a running autoscaler" do
+    test "shards/0 is empty" do
+      assert Autoscaler.shards() == []
+    end
+
+    test "untrack/2 falls back to the default" do
+      assert Autoscaler.untrack(self(), :base) == :base
+    end
+
+    test "track/2 is a no-op" do
+      assert :ok = Autoscaler.track(self(), :shard)
+    end
+  end
+
+  describe "with a running autoscaler" do
+    setup do
+      start_supervised!({Autoscaler, interval: 60_000})
+      :ok
+    end
+
+    test "starts without shards" do
+      assert Autoscaler.shards() == []
+    end
+
+    test "routes tracked workers to their shard" do
+      worker = spawn(fn -> Process.sleep(:infinity) end)
+
+      assert :ok = Autoscaler.track(worker, :ex_maude_pool_shard_1)
+      assert Autoscaler.untrack(worker, :base) == :ex_maude_pool_shard_1
+      assert Autoscaler.untrack(self(), :base) == :base
+    end
+
+    test "forgets a worker's shard once it is checked in" do
+      worker = spawn(fn -> Process.sleep(:infinity) end)
+      :ok = Autoscaler.track(worker, :ex_maude_pool_shard_1)
+
+      assert Autoscaler.untrack(worker, :base) == :ex_maude_pool_shard_1
+      assert Autoscaler.untrack(worker, :base) == :base
+    end
+
+    test "receives pool checkout events" do
+      :telemetry.execute(
+        [:ex_maude, :pool, :checkout, :stop],
+        %{duration: 0, wait: 0},
+        %{result: :ok, backend: :port}
+      )
+
+      assert Process.alive?(Process.whereis(Autoscaler))
+    end
+
+    test "counts a checkout as slow by its wait, not the transaction" do
+      event = [:ex_maude, :pool, :checkout, :stop]
+      Autoscaler.handle_checkout(event, %{duration: 1_000, wait: 5}, %{}, 10)
+      Autoscaler.handle_checkout(event, %{duration: 1_000, wait: 50}, %{}, 10)
+
+      assert [{:stats, 2, 1}] = :ets.lookup(:ex_maude_pool_shards, :stats)
+    end
+  end
+end
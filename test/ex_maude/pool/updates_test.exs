@@ -0,0 +1,139 @@
+defmodule ExMaude.Pool.UpdatesTest do
+  @moduledoc """
+  Tests for `ExMaude.Pool.Updates` - the versioned update log of the pool.
+  """
+
+  use ExUnit.Case, async: false
+
+  alias ExMaude.Pool.Updates
+
+  setup do
+    # The application starts the log; use a fresh one for every test
+    _ = Supervisor.terminate_child(ExMaude.Supervisor, Updates)
+    start_supervised!(Updates)
+
+    on_exit(fn -> Supervisor.restart_child(ExMaude.Supervisor, Updates) end)
+
+    worker = spawn(fn -> Process.sleep(:infinity) end)
+    {:ok, worker: worker}
+  end
+
+  defp flush_loads do
+    receive do
+      {:load, _, _} = load -> [load | flush_loads()]
+      {:load, _} = load -> [load | flush_loads()]
+    after
+      0 -> []
+    end
+  end
+
+  test "starts at version 0", %{worker: worker} do
+    assert Updates.version() == 0
+    refute Updates.stale?(worker)
+  end
+
+  test "catch_up/1 applies missed updates in order", %{worker: worker} do
+    test_pid = self()
+    {:ok, 1} = Updates.publish(fn w -> send(test_pid, {:update, 1, w}) end)
+    {:ok, 2} = Updates.publish(fn w -> send(test_pid, {:update, 2, w}) end)
+
+    assert Updates.stale?(worker)
+    assert :ok = Updates.catch_up(worker)
+
+    assert_received {:update, 1, ^worker}
+    assert_received {:update, 2, ^worker}
+
+    assert :ok = Updates.await(2, 1, 1_000)
+    refute Updates.stale?(worker)
+  end
+
+  test "catch_up/1 records the version before returning", %{worker: worker} do
+    {:ok, version} = Updates.publish(fn _ -> :ok end)
+
+    Updates.catch_up(worker)
+    assert Updates.worker_version(worker) == version
+    refute Updates.stale?(worker)
+  end
+
+  test "catch_up/1 invalidates cached results", %{worker: worker} do
+    start_supervised!(ExMaude.Cache)
+    ExMaude.Cache.fetch({:reduce, "M", "t"}, fn -> {:ok, :old} end)
+    {:ok, _} = Updates.publish(fn _ -> :ok end)
+
+    Updates.catch_up(worker)
+    assert ExMaude.Cache.size() == 0
+  end
+
+  test "a keyed update replaces the earlier one", %{worker: worker} do
+    test_pid = self()
+    {:ok, 1} = Updates.publish(fn _ -> send(test_pid, {:spec, 1}) end, :spec)
+    {:ok, 2} = Updates.publish(fn _ -> send(test_pid, :other) end)
+    {:ok, 3} = Updates.publish(fn _ -> send(test_pid, {:spec, 3}) end, :spec)
+
+    Updates.catch_up(worker)
+    refute_received {:spec, 1}
+    assert_received :other
+    assert_received {:spec, 3}
+    assert Updates.worker_version(worker) == 3
+  end
+
+  test "replay/1 runs recorded broadcasts in the order first recorded", %{worker: worker} do
+    test_pid = self()
+    :ok = Updates.record(:base, fn _ -> send(test_pid, {:load, :base, 1}) end)
+    :ok = Updates.record(:spec, fn _ -> send(test_pid, {:load, :spec}) end)
+    :ok = Updates.record(:base, fn _ -> send(test_pid, {:load, :base, 2}) end)
+
+    assert :ok = Updates.replay(worker)
+    assert [{:load, :base, 2}, {:load, :spec}] = flush_loads()
+  end
+
+  test "a failing update does not block later ones", %{worker: worker} do
+    test_pid = self()
+    {:ok, _} = Updates.publish(fn _ -> raise "boom" end)
+    {:ok, _} = Updates.publish(fn _ -> send(test_pid, :second) end)
+
+    Updates.catch_up(worker)
+    assert_received :second
+  end
+
+  test "await/3 waits for enough workers", %{worker: worker} do
+    {:ok, version} = Updates.publish(fn _ -> :ok end)
+    other = spawn(fn -> Process.sleep(:infinity) end)
+
+    Updates.catch_up(worker)
+    assert {:error, :timeout} = Updates.await(version, 2, 100)
+
+    Updates.catch_up(other)
+    assert :ok = Updates.await(version, 2, 1_000)
+  end
+
+  test "dead workers stop counting", %{worker: worker} do
+    {:ok, version} = Updates.publish(fn _ -> :ok end)
+    Updates.catch_up(worker)
+    assert :ok = Updates.await(version, 1, 1_000)
+
+    Process.exit(worker, :kill)
+    Process.sleep(50)
+    assert {:error, :timeout} = Updates.await(version, 1, 100)
+  end
+
+  test "forgets waiters whose call timed out" do
+    {:ok, version} = Updates.publish(fn _ -> :ok end)
+    assert {:error, :timeout} = Updates.await(version, 1, 50)
+
+    Process.sleep(20)
+    assert %{waiters: []} = :sys.get_state(Updates)
+  end
+
+  test "rechecks waiters when a worker goes down", %{worker: worker} do
+    {:ok, version} = Updates.publish(fn _ -> :ok end)
+    Updates.catch_up(worker)
+    tag = make_ref()
+    waiter = {version, 1, {self(), tag}, make_ref()}
+    :sys.replace_state(Updates, &%{&1 | waiters: [waiter]})
+
+    send(Updates, {:DOWN, make_ref(), :process, spawn(fn -> :ok end), :normal})
+    assert_receive {^tag, :ok}
+    assert %{waiters: []} = :sys.get_state(Updates)
+  end
+end
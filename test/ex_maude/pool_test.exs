@@ -6,6 +6,7 @@ defmodule ExMaude.PoolTest do
   use ExMaude.MaudeCase
 
   alias ExMaude.Pool
+  alias ExMaude.Pool.Updates
   alias ExMaude.Error
 
   doctest ExMaude.Pool
@@ -465,6 +466,7 @@ defmodule ExMaude.PoolTest do
       # Should receive telemetry event with ok result
       assert_receive {:telemetry, measurements, metadata}, 1000
       assert Map.has_key?(measurements, :duration)
+      assert measurements.wait <= measurements.duration
       assert metadata.result == :ok
 
       :telemetry.detach(handler_id)
@@ -491,6 +493,55 @@ defmodule ExMaude.PoolTest do
     end
   end
 
+  describe "publish/1 with running pool" do
+    @tag :integration
+    test "every worker applies the update once", %{maude_available: true} do
+      test_pid = self()
+      {:ok, version} = Pool.publish(fn worker -> send(test_pid, {:updated, worker}) end)
+
+      assert version == Pool.version()
+
+      # Busy workers take the update at checkin
+      for _ <- 1..4, do: Pool.transaction(fn _worker -> :ok end)
+
+      assert :ok = Pool.await_version(version, timeout: 5_000)
+      assert_receive {:updated, _worker}, 1_000
+    end
+
+    @tag :integration
+    test "a checked-out worker is updated before checkin returns", %{maude_available: true} do
+      test_pid = self()
+      worker = Pool.checkout(timeout: 5_000)
+      {:ok, _version} = Pool.publish(fn worker -> send(test_pid, {:updated, worker}) end)
+
+      Pool.checkin(worker)
+      assert_received {:updated, ^worker}
+    end
+
+    @tag :integration
+    test "a stale worker is updated before checkout returns", %{maude_available: true} do
+      test_pid = self()
+      {:ok, _version} = Updates.publish(fn worker -> send(test_pid, {:updated, worker}) end)
+
+      worker = Pool.checkout(timeout: 5_000)
+      assert_received {:updated, ^worker}
+      Pool.checkin(worker)
+    end
+
+    @tag :integration
+    test "an idle pool reaches the version without traffic", %{maude_available: true} do
+      {:ok, version} = Pool.publish(fn _worker -> :ok end)
+      assert :ok = Pool.await_version(version, timeout: 5_000)
+    end
+
+    @tag :integration
+    test "await_version/2 times out for unreachable counts", %{maude_available: true} do
+      {:ok, version} = Pool.publish(fn _worker -> :ok end)
+      assert {:error, %Error{type: :timeout}} =
+               Pool.await_version(version, workers: 100, timeout: 100)
+    end
+  end
+
   describe "config helpers" do
     test "uses config values for pool size" do
       original = Application.get_env(:ex_maude, :pool_size)
@@ -74,6 +74,7 @@ defmodule ExMaude.Result.ReductionTest do
       {:ok, result} = Reduction.parse(output)
 
       assert result.time_ms == 5
+      assert result.real_ms == 5
     end
 
     test "parses reduction with module" do
@@ -0,0 +1,178 @@
+defmodule ExMaude.RouterTest do
+  @moduledoc """
+  Tests for `ExMaude.Router` - the module-affinity worker pool.
+  """
+
+  use ExMaude.MaudeCase
+
+  alias ExMaude.{Router, Server}
+
+  describe "module functions" do
+    test "running?/1 is false without a router" do
+      refute Router.running?(:no_such_router)
+    end
+
+    test "transaction/3 is exported" do
+      assert function_exported?(Router, :transaction, 3)
+    end
+
+    test "register/3 is exported" do
+      assert function_exported?(Router, :register, 3)
+    end
+
+    test "transaction/3 returns a pool error without a router" do
+      assert {:error, %ExMaude.Error{type: :pool_error}} =
+               Router.transaction("NAT", fn _ -> :unreachable end, router: :no_such_router)
+    end
+
+    test "transaction/3 returns a pool error when the worker exits" do
+      worker = spawn(fn -> :ok end)
+
+      router =
+        spawn(fn ->
+          receive do
+            {:"$gen_call", from, {:route, "NAT", _timeout}} -> GenServer.reply(from, {:ok, worker})
+          end
+        end)
+
+      assert {:error, %ExMaude.Error{type: :pool_error}} =
+               Router.transaction("NAT", &GenServer.call(&1, :execute), router: router)
+    end
+  end
+
+  describe "broadcast loads" do
+    setup do
+      [a, b] = for _ <- 1..2, do: spawn(fn -> Process.sleep(:infinity) end)
+
+      state = %Router{
+        workers: %{
+          a => %{modules: MapSet.new(["OLD"]), busy: 0},
+          b => %{modules: MapSet.new(["BCAST"]), busy: 0}
+        }
+      }
+
+      {:ok, a: a, b: b, state: state}
+    end
+
+    test "records modules where the load succeeded", %{a: a, b: b, state: state} do
+      loaded = {:loaded, [{a, true}, {b, false}], ["BCAST"]}
+      {:reply, :ok, state} = Router.handle_call(loaded, {self(), make_ref()}, state)
+
+      assert state.workers[a].modules == MapSet.new(["OLD", "BCAST"])
+      assert state.workers[b].modules == MapSet.new()
+    end
+
+    test "routes broadcast modules to the workers that have them", %{a: a, b: b, state: state} do
+      loaded = {:loaded, [{a, true}, {b, false}], ["BCAST"]}
+      {:reply, :ok, state} = Router.handle_call(loaded, {self(), make_ref()}, state)
+
+      assert {:reply, {:ok, worker}, _state} =
+               Router.handle_call({:route, "BCAST", 1_000}, {self(), make_ref()}, state)
+
+      assert worker == a
+    end
+  end
+
+  describe "lazy load waiters" do
+    test "only callers still waiting get a lease" do
+      worker = spawn(fn -> Process.sleep(:infinity) end)
+      ref = make_ref()
+      [gave_up, waiting, gone] = [make_ref(), make_ref(), make_ref()]
+      now = System.monotonic_time(:millisecond)
+      dead = spawn(fn -> :ok end)
+      Process.sleep(10)
+
+      waiters = [
+        {{self(), gave_up}, now - 1},
+        {{self(), waiting}, now + 60_000},
+        {{dead, gone}, now + 60_000}
+      ]
+
+      state = %Router{
+        workers: %{worker => %{modules: MapSet.new(), busy: 0}},
+        loading: %{ref => {"LAZY", worker, waiters}}
+      }
+
+      {:noreply, state} = Router.handle_info({ref, :ok}, state)
+
+      assert state.workers[worker] == %{modules: MapSet.new(["LAZY"]), busy: 1}
+      assert_received {^waiting, {:ok, ^worker}}
+      refute_received {^gave_up, _}
+    end
+  end
+
+  describe "routing integration" do
+    setup do
+      paths =
+        for name <- ["ROUTE-A", "ROUTE-B"], into: %{} do
+          {name, create_temp_module("fmod #{name} is sort S . op c : -> S . endfm")}
+        end
+
+      router = start_supervised!({Router, name: :router_test, size: 2, modules: paths})
+      {:ok, router: router}
+    end
+
+    @tag :integration
+    test "loads a module lazily and keeps routing to that worker" do
+      run = fn worker -> {worker, Server.execute(worker, "reduce in ROUTE-A : c .")} end
+
+      {first, {:ok, output}} = Router.transaction("ROUTE-A", run, router: :router_test)
+      assert output =~ "c"
+
+      {second, {:ok, _}} = Router.transaction("ROUTE-A", run, router: :router_test)
+      assert first == second
+    end
+
+    @tag :integration
+    test "spreads modules over workers" do
+      for module <- ["ROUTE-A", "ROUTE-B"] do
+        {:ok, _} =
+          Router.transaction(module, &Server.execute(&1, "reduce in #{module} : c ."),
+            router: :router_test
+          )
+      end
+
+      loaded = :router_test |> Router.status() |> Map.values() |> Enum.map(& &1.modules)
+      assert Enum.sort(loaded) == [["ROUTE-A"], ["ROUTE-B"]]
+    end
+
+    @tag :integration
+    test "summarizes workers, leases and modules" do
+      {:ok, _} =
+        Router.transaction("ROUTE-A", &Server.execute(&1, "reduce in ROUTE-A : c ."),
+          router: :router_test
+        )
+
+      assert %{workers: 2, busy: 0, loaded: ["ROUTE-A"], registered: registered} =
+               Router.summary(:router_test)
+
+      assert Enum.sort(registered) == ["ROUTE-A", "ROUTE-B"]
+    end
+
+    @tag :integration
+    test "routes unregistered modules to any worker" do
+      assert {:ok, output} =
+               Router.transaction("NAT", &Server.execute(&1, "reduce in NAT : 1 + 1 ."),
+                 router: :router_test
+               )
+
+      assert output =~ "2"
+    end
+
+    @tag :integration
+    test "concurrent first uses share one load" do
+      results =
+        1..8
+        |> Task.async_stream(fn _ ->
+          Router.transaction("ROUTE-B", &Server.execute(&1, "reduce in ROUTE-B : c ."),
+            router: :router_test
+          )
+        end)
+        |> Enum.map(fn {:ok, result} -> result end)
+
+      assert Enum.all?(results, &match?({:ok, _}, &1))
+      loaded = :router_test |> Router.status() |> Map.values() |> Enum.map(& &1.modules)
+      assert Enum.count(loaded, &("ROUTE-B" in &1)) == 1
+    end
+  end
+end
@@ -25,6 +25,18 @@ defmodule ExMaude.ServerTest do
     test "alive?/1 is exported" do
       assert function_exported?(Server, :alive?, 1)
     end
+
+    test "stream/3 is exported" do
+      assert function_exported?(Server, :stream, 3)
+    end
+
+    test "execute_batch/3 is exported" do
+      assert function_exported?(Server, :execute_batch, 3)
+    end
+
+    test "execute_parsed/3 is exported" do
+      assert function_exported?(Server, :execute_parsed, 3)
+    end
   end
 
   describe "configuration" do
@@ -48,6 +48,16 @@ defmodule ExMaude.TelemetryIntegrationTest do
       assert duration > 0
     end
 
+    @tag :integration
+    test "reduce reports Maude statistics as measurements", %{ref: ref} do
+      {:ok, "6"} = ExMaude.Maude.reduce("NAT", "1 + 2 + 3", cache: false)
+
+      assert_receive {^ref, [:ex_maude, :command, :stop], measurements, %{operation: :reduce}}
+      assert measurements.rewrites > 0
+      assert is_integer(measurements.cpu_ms)
+      assert is_integer(measurements.real_ms)
+    end
+
     @tag :integration
     test "rewrite emits command telemetry", %{ref: ref} do
       {:ok, _} = ExMaude.Maude.rewrite("NAT", "0", max_rewrites: 10)
@@ -38,6 +38,20 @@ defmodule ExMaude.TelemetryTest do
       assert [:ex_maude, :pool, :checkout, :stop] in events
     end
 
+    test "includes cache events" do
+      events = Telemetry.events()
+
+      assert [:ex_maude, :cache, :hit] in events
+      assert [:ex_maude, :cache, :miss] in events
+    end
+
+    test "includes bridge events" do
+      events = Telemetry.events()
+
+      assert [:ex_maude, :bridge, :stats] in events
+      assert [:ex_maude, :bridge, :phase] in events
+    end
+
     test "includes iot events" do
       events = Telemetry.events()
 
@@ -194,6 +208,43 @@ defmodule ExMaude.TelemetryTest do
       # Non-tuple results should use :ok as the result atom
       assert stop_meta.result == :ok
     end
+
+    test "adds recorded measurements to the stop event", %{ref: ref} do
+      Telemetry.span([:ex_maude, :command], %{operation: :reduce}, fn ->
+        Telemetry.put_measurements(%{rewrites: 3, cpu_ms: 1})
+        Telemetry.put_measurements(%{real_ms: 2, states: nil})
+        {:ok, "6"}
+      end)
+
+      assert_receive {^ref, [:ex_maude, :command, :stop], measurements, _}
+      assert %{rewrites: 3, cpu_ms: 1, real_ms: 2, duration: _} = measurements
+      refute Map.has_key?(measurements, :states)
+    end
+
+    test "keeps measurements of nested spans apart", %{ref: ref} do
+      Telemetry.span([:ex_maude, :command], %{operation: :outer}, fn ->
+        Telemetry.put_measurements(%{rewrites: 1})
+
+        Telemetry.span([:ex_maude, :command], %{operation: :inner}, fn ->
+          Telemetry.put_measurements(%{rewrites: 5})
+          {:ok, :inner}
+        end)
+
+        {:ok, :outer}
+      end)
+
+      assert_receive {^ref, [:ex_maude, :command, :stop], %{rewrites: 5}, %{operation: :inner}}
+      assert_receive {^ref, [:ex_maude, :command, :stop], %{rewrites: 1}, %{operation: :outer}}
+    end
+
+    test "ignores measurements outside of a span", %{ref: ref} do
+      assert :ok = Telemetry.put_measurements(%{rewrites: 7})
+
+      Telemetry.span([:ex_maude, :command], %{operation: :test}, fn -> {:ok, nil} end)
+
+      assert_receive {^ref, [:ex_maude, :command, :stop], measurements, _}
+      refute Map.has_key?(measurements, :rewrites)
+    end
   end
 
   describe "Prometheus/OpenTelemetry compatibility" do
@@ -305,9 +356,9 @@ defmodule ExMaude.TelemetryTest do
   end
 
   describe "events/0 additional tests" do
-    test "returns exactly 7 events" do
+    test "returns exactly 11 events" do
       events = Telemetry.events()
-      assert length(events) == 7
+      assert length(events) == 11
     end
 
     test "all events are unique" do